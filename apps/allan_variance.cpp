@@ -0,0 +1,62 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+
+#include "imu_tk/base.h"
+
+using namespace std;
+using namespace imu_tk;
+
+/* Usage: allan_variance <static samples .mat file> [scale factor] [n_threads]
+ *
+ * The whitespace separated samples (timestamp, x, y, z), multiplied by the scale factor 
+ * (e.g., to convert raw readings in physical units), are read from a long static capture.
+ * The Allan deviations are printed for each cluster time (one line per cluster time:
+ * tau, x, y, z), followed by the estimated noise parameters */
+int main(int argc, char** argv)
+{
+  if( argc < 2 )
+    return -1;
+
+  double scale = ( argc > 2 )?atof( argv[2] ):1.0;
+  int n_threads = ( argc > 3 )?atoi( argv[3] ):0;
+
+  TriadBuffer samples;
+  {
+    ifstream infile( argv[1] );
+    string line;
+    double ts, d[3];
+    while( getline( infile, line ) )
+    {
+      istringstream iss( line );
+      if( iss >> ts >> d[0] >> d[1] >> d[2] )
+        samples.push_back( ts, scale*d[0], scale*d[1], scale*d[2] );
+    }
+  }
+  if( samples.size() < 3 )
+  {
+    cout<<"No samples imported from "<<argv[1]<<endl;
+    return -1;
+  }
+
+  AllanVariance avar;
+  allanVariance( samples, avar, -1.0, DataInterval(), n_threads );
+
+  cout<<"# "<<samples.size()<<" samples, period "<<avar.data_dt<<" s"<<endl
+      <<"# tau adev_x adev_y adev_z"<<endl;
+  for( int i = 0; i < avar.size(); i++ )
+  {
+    Eigen::Vector3d adev = avar.deviation(i);
+    cout<<avar.taus[i]<<" "<<adev(0)<<" "<<adev(1)<<" "<<adev(2)<<endl;
+  }
+
+  NoiseParameters params = noiseParameters( avar );
+  cout<<"# random walk : "<<params.random_walk.transpose()<<endl
+      <<"# bias instability : "<<params.bias_instability.transpose()
+      <<" (tau "<<params.bias_instability_tau.transpose()<<")"<<endl
+      <<"# rate random walk : "<<params.rate_random_walk.transpose()<<endl;
+
+  return 0;
+}
@@ -0,0 +1,55 @@
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+
+#include "imu_tk/batch_calibration.h"
+
+using namespace std;
+using namespace imu_tk;
+using namespace Eigen;
+
+/* Usage: batch_calib <data directory> [output directory] [n_threads]
+ *
+ * Calibrate all the units with the data files <unit>_acc.* and <unit>_gyro.* 
+ * stored in the data directory, saving the <unit>.yaml calibration files and 
+ * the batch_report.json report in the output directory */
+int main(int argc, char** argv)
+{
+  if( argc < 2 )
+    return -1;
+  
+  string output_dir = ( argc > 2 )?argv[2]:argv[1];
+  
+  CalibratedTriad init_acc_calib, init_gyro_calib;
+  init_acc_calib.setBias( Vector3d(32768, 32768, 32768) );
+  init_acc_calib.setScale( Vector3d(0.00249, 0.00249, 0.00249) );
+  init_gyro_calib.setScale( Vector3d(1.0/6258.0, 1.0/6258.0, 1.0/6258.0) );
+  
+  MultiPosCalibration mp_calib;
+  mp_calib.setInitAccCalibration( init_acc_calib );
+  mp_calib.setInitGyroCalibration( init_gyro_calib );  
+  mp_calib.setGravityMagnitude(9.81744);
+  
+  BatchCalibrator batch_calib;
+  batch_calib.setCalibration( mp_calib );
+  batch_calib.setOutputDirectory( output_dir );
+  if( argc > 3 )
+    batch_calib.setNumThreads( atoi( argv[3] ) );
+  
+  int n_units = batch_calib.addDirectory( argv[1] );
+  cout<<"Calibrating "<<n_units<<" units"<<endl;
+  
+  BatchCalibrationReport report = batch_calib.calibrate();
+  for( int i = 0; i < int(report.units.size()); i++ )
+  {
+    const BatchCalibrationResult &unit = report.units[i];
+    cout<<unit.name<<" : "<<( unit.success?( "saved " + unit.calib_filename ):unit.error )<<endl;
+  }
+  cout<<report.num_succeeded<<" units calibrated, "<<report.num_failed<<" failed, in "
+      <<report.total.wall_time<<" s (CPU time "<<report.total.cpu_time<<" s)"<<endl;
+  
+  ofstream report_file( ( output_dir + "/batch_report.json" ).c_str() );
+  report_file<<report.toJson();
+  
+  return ( report.num_failed == 0 )?0:1;
+}
@@ -0,0 +1,111 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+
+#include "imu_tk/io_utils.h"
+
+using namespace std;
+using namespace imu_tk;
+
+/* Reference importer, line by line with getline() and sscanf() */
+static void legacyImportAsciiData( const char *filename, vector< TriadData > &samples,
+                                   TimestampUnit unit )
+{
+  samples.clear();
+  string line;
+  ifstream infile( filename );
+  double ts, d[3];
+  int interval_id;
+  while ( getline ( infile,line ) )
+  {
+    if( sscanf ( line.data(), "%lf,%lf,%lf,%lf,%d", &ts, &d[0], &d[1], &d[2], &interval_id ) == 5 )
+    {
+      ts /= unit;
+      samples.push_back ( TriadData ( ts, d[0], d[1], d[2], interval_id ) );
+    }
+  }
+}
+
+static bool sameSamples( const vector< TriadData > &s0, const vector< TriadData > &s1 )
+{
+  if( s0.size() != s1.size() )
+    return false;
+  for( int i = 0; i < int(s0.size()); i++ )
+    if( s0[i].timestamp() != s1[i].timestamp() || s0[i].data() != s1[i].data() ||
+        s0[i].interval_id() != s1[i].interval_id() )
+      return false;
+  return true;
+}
+
+template < typename _F > static double elapsedSeconds( _F f )
+{
+  chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+  f();
+  return chrono::duration<double>( chrono::steady_clock::now() - t0 ).count();
+}
+
+/* Usage: bench_import <xsens .mat file> [n_replicas] [n_threads]
+ *
+ * The whitespace separated xsens samples (timestamp, x, y, z) are converted in the
+ * comma separated format read by importAsciiData(), replicated n_replicas times */
+int main(int argc, char** argv)
+{
+  if( argc < 2 )
+    return -1;
+
+  int n_replicas = ( argc > 2 )?atoi( argv[2] ):10;
+  int n_threads = ( argc > 3 )?atoi( argv[3] ):int(thread::hardware_concurrency());
+  if( n_threads < 1 ) n_threads = 1;
+
+  const char *csv_filename = "bench_import.csv";
+  {
+    ifstream infile( argv[1] );
+    ofstream outfile( csv_filename );
+    string line, csv_data;
+    double ts, d[3];
+    while( getline( infile, line ) )
+    {
+      istringstream iss( line );
+      if( iss >> ts >> d[0] >> d[1] >> d[2] )
+      {
+        ostringstream oss;
+        oss.precision(8);
+        oss<<scientific<<ts<<","<<d[0]<<","<<d[1]<<","<<d[2]<<",-1\n";
+        csv_data += oss.str();
+      }
+    }
+    for( int r = 0; r < n_replicas; r++ )
+      outfile<<csv_data;
+
+    if( csv_data.empty() )
+    {
+      cout<<"No samples imported from "<<argv[1]<<endl;
+      return -1;
+    }
+  }
+
+  ifstream csv_file( csv_filename, ios::binary | ios::ate );
+  double size_mb = double( csv_file.tellg() )/( 1 << 20 );
+  csv_file.close();
+  cout<<"Input file: "<<size_mb<<" MB"<<endl;
+
+  vector< TriadData > ref_samples, samples;
+  double t = elapsedSeconds( [&](){ legacyImportAsciiData( csv_filename, ref_samples, TIMESTAMP_UNIT_SEC ); } );
+  cout<<"getline + sscanf : "<<ref_samples.size()<<" samples, "<<t<<" s, "<<size_mb/t<<" MB/s"<<endl;
+
+  for( int n = 1; n <= n_threads; n *= 2 )
+  {
+    t = elapsedSeconds( [&](){ importAsciiData( csv_filename, samples, TIMESTAMP_UNIT_SEC,
+                                                DATASET_COMMA_SEPARATED, n ); } );
+    cout<<"importAsciiData ("<<n<<" threads) : "<<samples.size()<<" samples, "
+        <<t<<" s, "<<size_mb/t<<" MB/s"<<( sameSamples( ref_samples, samples )?"":" MISMATCH" )<<endl;
+  }
+
+  remove( csv_filename );
+  return 0;
+}
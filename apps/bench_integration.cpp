@@ -0,0 +1,190 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+
+#include "imu_tk/calibration.h"
+#include "imu_tk/integration.h"
+
+using namespace std;
+using namespace imu_tk;
+
+/* Nominal scale factor of the raw xsens gyroscopes, used if no calibration is provided */
+static const double NOMINAL_GYRO_SCALE = 2.1e-4;
+
+/* Reference integration: RK4 steps in double precision, with each sample period
+ * split into n_sub_steps steps (linearly interpolated rotational velocities) */
+static void referenceIntegration( const TriadBuffer &gyro_samples, vector< double > &quats,
+                                  int n_sub_steps = 16 )
+{
+  int n_samps = gyro_samples.size();
+  quats.resize( 4*n_samps );
+  double quat[4] = { 1.0, 0, 0, 0 };
+  copy( quat, quat + 4, quats.begin() );
+  for( int i = 0; i < n_samps - 1; i++ )
+  {
+    double dt = ( gyro_samples.timestamp(i+1) - gyro_samples.timestamp(i) )/n_sub_steps;
+    for( int s = 0; s < n_sub_steps; s++ )
+    {
+      double omega0[3], omega1[3], a0 = double(s)/n_sub_steps, a1 = double(s + 1)/n_sub_steps;
+      for( int j = 0; j < 3; j++ )
+      {
+        omega0[j] = ( 1.0 - a0 )*gyro_samples( i, j ) + a0*gyro_samples( i + 1, j );
+        omega1[j] = ( 1.0 - a1 )*gyro_samples( i, j ) + a1*gyro_samples( i + 1, j );
+      }
+      quatIntegrationStepRK4InPlace( quat, omega0, omega1, dt );
+    }
+    copy( quat, quat + 4, quats.begin() + 4*( i + 1 ) );
+  }
+}
+
+/* Angle (in degrees) of the rotation between two unit quaternions */
+template < typename _T > static double rotationAngle( const _T *quat0, const double *quat1 )
+{
+  const double q0[4] = { double(quat0[0]), double(quat0[1]), double(quat0[2]), double(quat0[3]) };
+  double rel_quat[4];
+  relativeQuaternion( q0, quat1, rel_quat );
+  double sin_half = sqrt( rel_quat[1]*rel_quat[1] + rel_quat[2]*rel_quat[2] + rel_quat[3]*rel_quat[3] );
+  return 2.0*atan2( sin_half, fabs( rel_quat[0] ) )*180.0/M_PI;
+}
+
+enum StepFunction
+{
+  STEP_RK4_SCALAR,
+  STEP_RK4_SIMD,
+  STEP_FIRST_ORDER,
+  STEP_ZERO_ORDER_HOLD
+};
+
+static const char *stepFunctionName( StepFunction step )
+{
+  switch( step )
+  {
+    case STEP_RK4_SCALAR : return "RK4 (scalar)      ";
+    case STEP_RK4_SIMD : return "RK4 (SIMD)        ";
+    case STEP_FIRST_ORDER : return "first order       ";
+    default : return "zero-order hold   ";
+  }
+}
+
+template < typename _T > static void integrate( const TriadBuffer_<_T> &gyro_samples, StepFunction step,
+                                                _T *quats )
+{
+  _T quat[4] = { _T(1.0), _T(0), _T(0), _T(0) };
+  copy( quat, quat + 4, quats );
+  const _T *x = gyro_samples.x(), *y = gyro_samples.y(), *z = gyro_samples.z(),
+           *ts = gyro_samples.timestamps();
+  for( int i = 0; i < gyro_samples.size() - 1; i++ )
+  {
+    const _T omega0[3] = { x[i], y[i], z[i] }, omega1[3] = { x[i + 1], y[i + 1], z[i + 1] };
+    const _T dt = ts[i + 1] - ts[i];
+    switch( step )
+    {
+      case STEP_RK4_SCALAR :
+        quatIntegrationStepRK4InPlace( quat, omega0, omega1, dt );
+        break;
+      case STEP_RK4_SIMD :
+        quatIntegrationStepRK4Simd( quat, omega0, omega1, dt );
+        break;
+      case STEP_FIRST_ORDER :
+        quatIntegrationStepFirstOrder( quat, omega0, omega1, dt );
+        break;
+      default :
+        quatIntegrationStepZeroOrderHold( quat, omega0, omega1, dt );
+        break;
+    }
+    copy( quat, quat + 4, quats + 4*( i + 1 ) );
+  }
+}
+
+template < typename _T > static void benchmark( const TriadBuffer &gyro_samples,
+                                                const vector< double > &ref_quats, int n_repeats )
+{
+  int n_samps = gyro_samples.size();
+  TriadBuffer_<_T> samples;
+  samples.reserve( n_samps );
+  for( int i = 0; i < n_samps; i++ )
+    samples.push_back( _T(gyro_samples.timestamp(i)), _T(gyro_samples.x(i)),
+                       _T(gyro_samples.y(i)), _T(gyro_samples.z(i)) );
+
+  vector< _T > quats( 4*n_samps );
+  for( int s = STEP_RK4_SCALAR; s <= STEP_ZERO_ORDER_HOLD; s++ )
+  {
+    StepFunction step = StepFunction(s);
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    for( int r = 0; r < n_repeats; r++ )
+      integrate( samples, step, quats.data() );
+    double t = chrono::duration<double>( chrono::steady_clock::now() - t0 ).count();
+
+    double max_drift = 0;
+    for( int i = 0; i < n_samps; i++ )
+      max_drift = max( max_drift, rotationAngle( &quats[4*i], &ref_quats[4*i] ) );
+    double final_drift = rotationAngle( &quats[4*( n_samps - 1 )], &ref_quats[4*( n_samps - 1 )] );
+
+    cout<<( sizeof(_T) == sizeof(double) ? "double " : "float  " )<<stepFunctionName( step )
+        <<double( n_repeats )*( n_samps - 1 )/t*1e-6<<" Msteps/s, drift: final "
+        <<final_drift<<" deg, max "<<max_drift<<" deg"<<endl;
+  }
+}
+
+/* Usage: bench_integration <xsens gyroscopes .mat file> [gyroscopes calibration file] [n_repeats]
+ *
+ * The whitespace separated xsens samples (timestamp, x, y, z) are calibrated with the provided
+ * calibration (see CalibratedTriad_::save()), or unbiased with the mean of the initial static
+ * interval and scaled by a nominal scale factor. The drift of each integration method is
+ * the angle between its orientations and the ones of a reference integration with 16 RK4
+ * steps per sample period. */
+int main(int argc, char** argv)
+{
+  if( argc < 2 )
+    return -1;
+
+  int n_repeats = ( argc > 3 )?atoi( argv[3] ):20;
+  if( n_repeats < 1 ) n_repeats = 1;
+
+  TriadBuffer gyro_samples;
+  {
+    ifstream infile( argv[1] );
+    string line;
+    double ts, d[3];
+    while( getline( infile, line ) )
+    {
+      istringstream iss( line );
+      if( iss >> ts >> d[0] >> d[1] >> d[2] )
+        gyro_samples.push_back( ts, d[0], d[1], d[2] );
+    }
+  }
+  if( gyro_samples.size() < 2 )
+  {
+    cout<<"No samples imported from "<<argv[1]<<endl;
+    return -1;
+  }
+
+  CalibratedTriad gyro_calib;
+  if( argc > 2 && gyro_calib.load( argv[2] ) )
+    cout<<"Using the gyroscopes calibration "<<argv[2]<<endl;
+  else
+  {
+    gyro_calib.setScale( Eigen::Vector3d( NOMINAL_GYRO_SCALE, NOMINAL_GYRO_SCALE, NOMINAL_GYRO_SCALE ) );
+    gyro_calib.setBias( dataMean( gyro_samples, DataInterval( 100, 3000 ) ) );
+  }
+  TriadBuffer calib_gyro_samples;
+  calib_gyro_samples.reserve( gyro_samples.size() );
+  for( int i = 0; i < gyro_samples.size(); i++ )
+  {
+    Eigen::Vector3d omega = gyro_calib.unbiasNormalize( gyro_samples.data(i) );
+    calib_gyro_samples.push_back( gyro_samples.timestamp(i), omega(0), omega(1), omega(2) );
+  }
+
+  vector< double > ref_quats;
+  referenceIntegration( calib_gyro_samples, ref_quats );
+
+  cout<<calib_gyro_samples.size()<<" samples, "<<n_repeats<<" repetitions"<<endl;
+  benchmark<double>( calib_gyro_samples, ref_quats, n_repeats );
+  benchmark<float>( calib_gyro_samples, ref_quats, n_repeats );
+
+  return 0;
+}
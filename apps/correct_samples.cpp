@@ -0,0 +1,70 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+#include "imu_tk/runtime_calibration.h"
+
+using namespace std;
+using namespace imu_tk;
+
+static const int BLOCK_SIZE = 256;
+
+static void writeBlock( const double *ts, const double *x, const double *y, const double *z, int n )
+{
+  for( int i = 0; i < n; i++ )
+    cout<<ts[i]<<" "<<x[i]<<" "<<y[i]<<" "<<z[i]<<"\n";
+}
+
+/* Usage: correct_samples <calibration file> [raw counts scale] < raw samples > corrected samples
+ *
+ * Each input line contains a timestamp followed by the x, y, z raw counts (whitespace or
+ * comma separated, further values are ignored). The samples are corrected in blocks with
+ * the calibration loaded from file (see CalibratedTriad_::load()): this example uses 
+ * only the header-only imu_tk_runtime target. */
+int main(int argc, char** argv)
+{
+  if( argc < 2 )
+    return -1;
+
+  CalibratedTriad calib;
+  if( !calib.load( argv[1] ) )
+  {
+    cerr<<"Can't load the calibration "<<argv[1]<<endl;
+    return -1;
+  }
+  double raw_scale = ( argc > 2 )?atof( argv[2] ):1.0;
+  TriadCorrection correction( calib, raw_scale );
+
+  cout.precision( 10 );
+  double ts[BLOCK_SIZE], x[BLOCK_SIZE], y[BLOCK_SIZE], z[BLOCK_SIZE];
+  int n = 0;
+  string line;
+  while( getline( cin, line ) )
+  {
+    for( int i = 0; i < int(line.size()); i++ )
+      if( line[i] == ',' ) line[i] = ' ';
+    char *p = &line[0], *end;
+    double v[4];
+    int j = 0;
+    for( ; j < 4; j++, p = end )
+    {
+      v[j] = strtod( p, &end );
+      if( end == p ) break;
+    }
+    if( j < 4 )
+      continue;
+    
+    ts[n] = v[0]; x[n] = v[1]; y[n] = v[2]; z[n] = v[3];
+    if( ++n == BLOCK_SIZE )
+    {
+      correction.apply( x, y, z, n );
+      writeBlock( ts, x, y, z, n );
+      n = 0;
+    }
+  }
+  correction.apply( x, y, z, n );
+  writeBlock( ts, x, y, z, n );
+  cout.flush();
+
+  return 0;
+}
@@ -0,0 +1,450 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdio>
+#include <map>
+#include <random>
+
+#include <benchmark/benchmark.h>
+#include <Eigen/Geometry>
+
+#include "imu_tk/io_utils.h"
+#include "imu_tk/calibration.h"
+#include "imu_tk/filters.h"
+#include "imu_tk/integration.h"
+#include "imu_tk/runtime_calibration.h"
+#include "imu_tk/time_alignment.h"
+#include "imu_tk/hash.h"
+
+using namespace std;
+using namespace imu_tk;
+
+#ifndef IMU_TK_BENCH_DATA_DIR
+#define IMU_TK_BENCH_DATA_DIR "bin/test_data"
+#endif
+
+/* Directory of the recorded xsens dataset (xsens_acc.mat, xsens_gyro.mat) */
+static string data_dir = IMU_TK_BENCH_DATA_DIR;
+
+/* Dataset size used to select the recorded xsens dataset in place of a synthetic one */
+static const int XSENS_DATASET = 0;
+
+/* Synthetic datasets: an initial static interval followed by a sequence of rotations
+ * and static intervals, sampled by a xsens-like IMU */
+static const double SYNTH_RATE = 100.0;
+static const int SYNTH_INIT_SAMPLES = 3100, SYNTH_MOTION_SAMPLES = 100, SYNTH_STATIC_SAMPLES = 300;
+static const double SYNTH_G_MAG = 9.81, SYNTH_RAW_BIAS = 32768.0, SYNTH_NOISE = 2.0;
+static const double SYNTH_ACC_SCALE = 2.4e-3, SYNTH_GYRO_SCALE = 2.1e-4;
+
+static void syntheticDataset( int n_samps, vector< TriadData > &acc_samples,
+                              vector< TriadData > &gyro_samples )
+{
+  mt19937 gen(1);
+  normal_distribution< double > noise( 0, SYNTH_NOISE );
+  uniform_real_distribution< double > unif( -1.0, 1.0 );
+  Eigen::Matrix3d acc_mis;
+  acc_mis << 1.0, -0.004, 0.003,
+             0.002, 1.0, -0.005,
+             -0.003, 0.001, 1.0;
+
+  acc_samples.clear();
+  gyro_samples.clear();
+  acc_samples.reserve( n_samps );
+  gyro_samples.reserve( n_samps );
+
+  const double dt = 1.0/SYNTH_RATE;
+  Eigen::Matrix3d rot = Eigen::Matrix3d::Identity();
+  Eigen::Vector3d omega( 0, 0, 0 );
+  for( int i = 0; i < n_samps; i++ )
+  {
+    int pos_i = i - SYNTH_INIT_SAMPLES;
+    if( pos_i >= 0 )
+    {
+      int phase_i = pos_i % ( SYNTH_MOTION_SAMPLES + SYNTH_STATIC_SAMPLES );
+      if( !phase_i )
+      {
+        /* New rotation, between 60 and 120 degrees around a random axis */
+        Eigen::Vector3d axis( unif( gen ), unif( gen ), unif( gen ) );
+        double angle = ( 90.0 + 30.0*unif( gen ) )*M_PI/180.0;
+        omega = axis.normalized()*angle*SYNTH_RATE/SYNTH_MOTION_SAMPLES;
+      }
+      else if( phase_i == SYNTH_MOTION_SAMPLES )
+        omega.setZero();
+
+      if( !omega.isZero() )
+        rot = rot*Eigen::AngleAxisd( omega.norm()*dt, omega.normalized() );
+    }
+
+    Eigen::Vector3d g_body = rot.transpose()*Eigen::Vector3d( 0, 0, SYNTH_G_MAG );
+    Eigen::Vector3d acc = acc_mis*g_body/SYNTH_ACC_SCALE, gyro = omega/SYNTH_GYRO_SCALE;
+    for( int j = 0; j < 3; j++ )
+    {
+      acc(j) += SYNTH_RAW_BIAS + noise( gen );
+      gyro(j) += SYNTH_RAW_BIAS + noise( gen );
+    }
+    acc_samples.push_back( TriadData( i*dt, acc ) );
+    gyro_samples.push_back( TriadData( i*dt, gyro ) );
+  }
+}
+
+/* Whitespace separated xsens samples (timestamp, x, y, z) */
+static void importMatFile( const char *filename, vector< TriadData > &samples )
+{
+  ifstream infile( filename );
+  string line;
+  double ts, d[3];
+  while( getline( infile, line ) )
+  {
+    istringstream iss( line );
+    if( iss >> ts >> d[0] >> d[1] >> d[2] )
+      samples.push_back( TriadData( ts, d[0], d[1], d[2] ) );
+  }
+}
+
+template < typename _T > struct Dataset
+{
+  bool valid;
+  vector< TriadData_<_T> > acc, gyro;
+  TriadBuffer_<_T> acc_buf, gyro_buf;
+  /* Static intervals detected in the accelerometers signal */
+  vector< DataInterval > static_intervals;
+  _T static_threshold, g_mag;
+  CalibratedTriad_<_T> init_acc_calib, init_gyro_calib;
+  /* Comma separated version of the accelerometers samples, read by importAsciiData() */
+  string csv_filename;
+};
+
+static vector< string > tmp_files;
+
+template < typename _T > static vector< TriadData_<_T> > convertSamples( const vector< TriadData > &samples )
+{
+  vector< TriadData_<_T> > res;
+  res.reserve( samples.size() );
+  for( int i = 0; i < int(samples.size()); i++ )
+    res.push_back( TriadData_<_T>( _T(samples[i].timestamp()), _T(samples[i].x()),
+                                   _T(samples[i].y()), _T(samples[i].z()) ) );
+  return res;
+}
+
+/* Load the recorded dataset (n_samps = XSENS_DATASET) or generate a synthetic dataset of
+ * n_samps samples, once for each size */
+template < typename _T > static const Dataset<_T> &dataset( int n_samps )
+{
+  static map< int, Dataset<_T> > datasets;
+  typename map< int, Dataset<_T> >::iterator it = datasets.find( n_samps );
+  if( it != datasets.end() )
+    return it->second;
+
+  Dataset<_T> &ds = datasets[n_samps];
+  vector< TriadData > acc_samples, gyro_samples;
+  if( n_samps == XSENS_DATASET )
+  {
+    importMatFile( ( data_dir + "/xsens_acc.mat" ).c_str(), acc_samples );
+    importMatFile( ( data_dir + "/xsens_gyro.mat" ).c_str(), gyro_samples );
+    ds.g_mag = _T(9.8);
+    ds.init_acc_calib.setBias( Eigen::Matrix< _T, 3, 1 >( 0, 0, 0 ) );
+    ds.init_gyro_calib.setScale( Eigen::Matrix< _T, 3, 1 >( 1, 1, 1 ) );
+  }
+  else
+  {
+    syntheticDataset( n_samps, acc_samples, gyro_samples );
+    ds.g_mag = _T(SYNTH_G_MAG);
+    ds.init_acc_calib.setScale( Eigen::Matrix< _T, 3, 1 >::Constant( _T(SYNTH_ACC_SCALE) ) );
+    ds.init_acc_calib.setBias( Eigen::Matrix< _T, 3, 1 >::Constant( _T(SYNTH_RAW_BIAS) ) );
+    ds.init_gyro_calib.setScale( Eigen::Matrix< _T, 3, 1 >::Constant( _T(SYNTH_GYRO_SCALE) ) );
+  }
+
+  ds.valid = !acc_samples.empty() && acc_samples.size() == gyro_samples.size();
+  if( !ds.valid )
+    return ds;
+
+  ds.acc = convertSamples<_T>( acc_samples );
+  ds.gyro = convertSamples<_T>( gyro_samples );
+  ds.acc_buf = TriadBuffer_<_T>( ds.acc );
+  ds.gyro_buf = TriadBuffer_<_T>( ds.gyro );
+
+  /* Same threshold used by MultiPosCalibration_, from the variance of the
+   * initial static interval */
+  int init_end_idx = 0;
+  while( init_end_idx < ds.acc_buf.size() - 1 && ds.acc_buf.timestamp( init_end_idx ) -
+         ds.acc_buf.timestamp(0) < _T(30.0) )
+    init_end_idx++;
+  ds.static_threshold = _T(2)*dataVariance( ds.acc_buf, DataInterval( 0, init_end_idx ) ).norm();
+  staticIntervalsDetector( ds.acc_buf, ds.static_threshold, ds.static_intervals );
+
+  ostringstream oss;
+  oss<<"imu_tk_bench_"<<n_samps<<"_"<<sizeof(_T)<<".csv";
+  ds.csv_filename = oss.str();
+  ofstream outfile( ds.csv_filename.c_str() );
+  outfile.precision(8);
+  outfile<<scientific;
+  for( int i = 0; i < int(acc_samples.size()); i++ )
+    outfile<<acc_samples[i].timestamp()<<","<<acc_samples[i].x()<<","
+           <<acc_samples[i].y()<<","<<acc_samples[i].z()<<",-1\n";
+  tmp_files.push_back( ds.csv_filename );
+
+  return ds;
+}
+
+#define IMU_TK_BENCH_DATASET( state, ds )                                   \
+  const Dataset<_T> &ds = dataset<_T>( int( state.range(0) ) );              \
+  if( !ds.valid )                                                           \
+  {                                                                         \
+    state.SkipWithError( "Dataset not available" );                         \
+    return;                                                                 \
+  }
+
+static void setCounters( benchmark::State &state, int n_samps )
+{
+  state.SetItemsProcessed( int64_t( state.iterations() )*n_samps );
+  state.counters["samples"] = n_samps;
+}
+
+/* Arguments: dataset size, number of threads */
+template < typename _T > static void BM_ImportAsciiData( benchmark::State &state )
+{
+  IMU_TK_BENCH_DATASET( state, ds );
+  int n_threads = int( state.range(1) );
+  vector< TriadData_<_T> > samples;
+  for( auto _ : state )
+  {
+    importAsciiData( ds.csv_filename.c_str(), samples, TIMESTAMP_UNIT_SEC,
+                     DATASET_COMMA_SEPARATED, n_threads );
+    benchmark::DoNotOptimize( samples.data() );
+  }
+  ifstream csv_file( ds.csv_filename.c_str(), ios::binary | ios::ate );
+  state.SetBytesProcessed( int64_t( state.iterations() )*int64_t( csv_file.tellg() ) );
+  setCounters( state, int(samples.size()) );
+}
+
+template < typename _T > static void BM_StaticIntervalsDetector( benchmark::State &state )
+{
+  IMU_TK_BENCH_DATASET( state, ds );
+  vector< DataInterval > intervals;
+  for( auto _ : state )
+  {
+    staticIntervalsDetector( ds.acc_buf, ds.static_threshold, intervals );
+    benchmark::DoNotOptimize( intervals.data() );
+  }
+  setCounters( state, ds.acc_buf.size() );
+  state.counters["intervals"] = intervals.size();
+}
+
+/* Arguments: dataset size, only_means */
+template < typename _T > static void BM_ExtractIntervalsSamples( benchmark::State &state )
+{
+  IMU_TK_BENCH_DATASET( state, ds );
+  bool only_means = state.range(1) != 0;
+  TriadBuffer_<_T> extracted_samples;
+  vector< DataInterval > extracted_intervals;
+  for( auto _ : state )
+  {
+    extractIntervalsSamples( ds.acc_buf, ds.static_intervals, extracted_samples,
+                             extracted_intervals, 100, only_means );
+    benchmark::DoNotOptimize( extracted_samples.x() );
+  }
+  setCounters( state, ds.acc_buf.size() );
+}
+
+template < typename _T > static void BM_DataMean( benchmark::State &state )
+{
+  IMU_TK_BENCH_DATASET( state, ds );
+  for( auto _ : state )
+  {
+    Eigen::Matrix< _T, 3, 1> mean = dataMean( ds.acc_buf );
+    benchmark::DoNotOptimize( mean );
+  }
+  setCounters( state, ds.acc_buf.size() );
+}
+
+template < typename _T > static void BM_DataVariance( benchmark::State &state )
+{
+  IMU_TK_BENCH_DATASET( state, ds );
+  for( auto _ : state )
+  {
+    Eigen::Matrix< _T, 3, 1> variance = dataVariance( ds.acc_buf );
+    benchmark::DoNotOptimize( variance );
+  }
+  setCounters( state, ds.acc_buf.size() );
+}
+
+template < typename _T > static void BM_AllanVariance( benchmark::State &state )
+{
+  IMU_TK_BENCH_DATASET( state, ds );
+  AllanVariance_<_T> avar;
+  for( auto _ : state )
+  {
+    allanVariance( ds.gyro_buf, avar );
+    benchmark::DoNotOptimize( avar.variances.data() );
+  }
+  setCounters( state, ds.gyro_buf.size() );
+}
+
+/* Hash of the accelerometers samples (e.g., the results cache key) */
+template < typename _T > static void BM_SamplesHash( benchmark::State &state )
+{
+  IMU_TK_BENCH_DATASET( state, ds );
+  for( auto _ : state )
+    benchmark::DoNotOptimize( samplesHash( ds.acc_buf ) );
+  setCounters( state, ds.acc_buf.size() );
+}
+
+/* Acc/gyro time offset estimation, with the gyroscopes timestamps shifted by 0.1 s */
+template < typename _T > static void BM_EstimateTimeOffset( benchmark::State &state )
+{
+  IMU_TK_BENCH_DATASET( state, ds );
+  TriadBuffer_<_T> gyro_buf = ds.gyro_buf;
+  _T *ts = gyro_buf.timestamps();
+  for( int i = 0; i < gyro_buf.size(); i++ )
+    ts[i] -= _T(0.1);
+  for( auto _ : state )
+    benchmark::DoNotOptimize( estimateTimeOffset( ds.acc_buf, gyro_buf ) );
+  setCounters( state, ds.acc_buf.size() + gyro_buf.size() );
+}
+
+/* Single quatIntegrationStepRK4() calls over the (unbiased and scaled) gyroscopes samples */
+template < typename _T > static void BM_QuatIntegrationStepRK4( benchmark::State &state )
+{
+  IMU_TK_BENCH_DATASET( state, ds );
+  TriadBuffer_<_T> gyro_buf = ds.gyro_buf;
+  CalibratedTriad_<_T> gyro_calib = ds.init_gyro_calib;
+  gyro_calib.setBias( dataMean( gyro_buf, DataInterval( 0, 100 ) ) );
+  TriadCorrection_<_T>( gyro_calib ).apply( gyro_buf );
+  const _T *x = gyro_buf.x(), *y = gyro_buf.y(), *z = gyro_buf.z(), *ts = gyro_buf.timestamps();
+  for( auto _ : state )
+  {
+    _T quat[4] = { _T(1.0), _T(0), _T(0), _T(0) };
+    for( int i = 0; i < gyro_buf.size() - 1; i++ )
+    {
+      const _T omega0[3] = { x[i], y[i], z[i] }, omega1[3] = { x[i + 1], y[i + 1], z[i + 1] };
+      quatIntegrationStepRK4( quat, omega0, omega1, ts[i + 1] - ts[i], quat );
+    }
+    benchmark::DoNotOptimize( quat );
+  }
+  setCounters( state, gyro_buf.size() - 1 );
+}
+
+template < typename _T > static void BM_IntegrateGyroInterval( benchmark::State &state )
+{
+  IMU_TK_BENCH_DATASET( state, ds );
+  for( auto _ : state )
+  {
+    Eigen::Matrix< _T, 3, 3> rot;
+    integrateGyroInterval( ds.gyro_buf, rot, _T(1.0/SYNTH_RATE) );
+    benchmark::DoNotOptimize( rot );
+  }
+  setCounters( state, ds.gyro_buf.size() - 1 );
+}
+
+/* Accelerometers residuals of the multi-position calibration, g^2 - |T*K*(X - B)|^2,
+ * evaluated for all the samples of the static intervals (the Ceres cost functions are
+ * internal to the calibration, see BM_CalibrateAccGyro for the full solver cost) */
+template < typename _T > static void BM_AccResidual( benchmark::State &state )
+{
+  IMU_TK_BENCH_DATASET( state, ds );
+  TriadBuffer_<_T> static_samples;
+  vector< DataInterval > extracted_intervals;
+  extractIntervalsSamples( ds.acc_buf, ds.static_intervals, static_samples, extracted_intervals );
+  const _T g_mag2 = ds.g_mag*ds.g_mag;
+  for( auto _ : state )
+  {
+    _T cost = 0;
+    for( int i = 0; i < static_samples.size(); i++ )
+    {
+      _T res = g_mag2 - ds.init_acc_calib.unbiasNormalize( static_samples.data(i) ).squaredNorm();
+      cost += res*res;
+    }
+    benchmark::DoNotOptimize( cost );
+  }
+  setCounters( state, static_samples.size() );
+}
+
+/* Arguments: dataset size, JacobianMode */
+template < typename _T > static void BM_CalibrateAccGyro( benchmark::State &state )
+{
+  IMU_TK_BENCH_DATASET( state, ds );
+  bool success = true;
+  for( auto _ : state )
+  {
+    MultiPosCalibration_<_T> mp_calib;
+    mp_calib.setInitAccCalibration( const_cast< CalibratedTriad_<_T> & >( ds.init_acc_calib ) );
+    mp_calib.setInitGyroCalibration( const_cast< CalibratedTriad_<_T> & >( ds.init_gyro_calib ) );
+    mp_calib.setGravityMagnitude( ds.g_mag );
+    mp_calib.setJacobianMode( JacobianMode( state.range(1) ) );
+    mp_calib.enableVarianceIntervalsDetection( true );
+    success = mp_calib.calibrateAccGyro( ds.acc_buf, ds.gyro_buf ) && success;
+  }
+  if( !success )
+    state.SkipWithError( "Calibration failed" );
+  setCounters( state, ds.acc_buf.size() );
+}
+
+static void datasetSizes( benchmark::internal::Benchmark *b )
+{
+  b->Arg( XSENS_DATASET )->Arg( 1 << 14 )->Arg( 1 << 16 )->Arg( 1 << 18 );
+}
+
+static void importArgs( benchmark::internal::Benchmark *b )
+{
+  b->ArgNames( { "samples", "threads" } );
+  for( int n : { XSENS_DATASET, 1 << 14, 1 << 16, 1 << 18 } )
+    for( int n_threads : { 1, 4 } )
+      b->Args( { n, n_threads } );
+}
+
+static void extractArgs( benchmark::internal::Benchmark *b )
+{
+  b->ArgNames( { "samples", "only_means" } );
+  for( int n : { XSENS_DATASET, 1 << 14, 1 << 16, 1 << 18 } )
+    for( int only_means : { 0, 1 } )
+      b->Args( { n, only_means } );
+}
+
+static void calibrationArgs( benchmark::internal::Benchmark *b )
+{
+  b->ArgNames( { "samples", "analytic" } )->Unit( benchmark::kMillisecond );
+  for( int n : { XSENS_DATASET, 1 << 14, 1 << 16 } )
+    for( int mode : { JACOBIAN_AUTODIFF, JACOBIAN_ANALYTIC } )
+      b->Args( { n, mode } );
+}
+
+/* Wall clock times, some benchmarks use multiple threads */
+#define IMU_TK_BENCHMARK( func, args )                                      \
+  BENCHMARK_TEMPLATE( func, double )->Apply( args )->UseRealTime();         \
+  BENCHMARK_TEMPLATE( func, float )->Apply( args )->UseRealTime()
+
+IMU_TK_BENCHMARK( BM_ImportAsciiData, importArgs );
+IMU_TK_BENCHMARK( BM_StaticIntervalsDetector, datasetSizes );
+IMU_TK_BENCHMARK( BM_ExtractIntervalsSamples, extractArgs );
+IMU_TK_BENCHMARK( BM_DataMean, datasetSizes );
+IMU_TK_BENCHMARK( BM_DataVariance, datasetSizes );
+IMU_TK_BENCHMARK( BM_AllanVariance, datasetSizes );
+IMU_TK_BENCHMARK( BM_EstimateTimeOffset, datasetSizes );
+IMU_TK_BENCHMARK( BM_SamplesHash, datasetSizes );
+IMU_TK_BENCHMARK( BM_QuatIntegrationStepRK4, datasetSizes );
+IMU_TK_BENCHMARK( BM_IntegrateGyroInterval, datasetSizes );
+IMU_TK_BENCHMARK( BM_AccResidual, datasetSizes );
+IMU_TK_BENCHMARK( BM_CalibrateAccGyro, calibrationArgs );
+
+/* Usage: imu_tk_bench [benchmark options] [test data directory]
+ *
+ * Dataset size 0 is the recorded xsens dataset (xsens_acc.mat and xsens_gyro.mat in the
+ * test data directory, by default bin/test_data), the others are synthetic datasets.
+ * Use e.g. --benchmark_format=json or --benchmark_out=<file> --benchmark_out_format=csv
+ * for machine-readable results, and --benchmark_filter=<regex> to run a subset */
+int main(int argc, char** argv)
+{
+  benchmark::Initialize( &argc, argv );
+  if( argc > 1 )
+    data_dir = argv[1];
+
+  /* Only errors, the calibrations are repeated many times */
+  setLogLevel( LOG_LEVEL_ERROR );
+
+  benchmark::RunSpecifiedBenchmarks();
+
+  for( int i = 0; i < int(tmp_files.size()); i++ )
+    remove( tmp_files[i].c_str() );
+  return 0;
+}
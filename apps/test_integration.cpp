@@ -1,7 +1,5 @@
 #include <iostream>
 
-#include <QApplication>
-
 #include "imu_tk/io_utils.h"
 #include "imu_tk/calibration.h"
 #include "imu_tk/filters.h"
@@ -17,8 +15,6 @@ int main(int argc, char** argv)
   if( argc < 2 )
     return -1;
 
-  QApplication app(argc, argv);
-  
   vector< TriadData > acc_data, gyro_data, mag_data;
   
   cout<<"Importing IMU data from file : "<< argv[1]<<endl;  
@@ -34,7 +30,8 @@ int main(int argc, char** argv)
 
   Vector3d mag_mean = dataMean( mag_data, DataInterval(100, 3000));
   
-  Vis3D vis;
+  /* The scene is refreshed by its own render thread, so the integration runs at full speed */
+  Vis3D vis( "imu_tk", true );
   
   Eigen::Vector4d quat(1.0, 0, 0, 0); // Identity quaternion
   double t[3] = {0, 0, 0};
@@ -0,0 +1,165 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <sstream>
+#include <limits>
+
+#include "imu_tk/calibration_residuals.h"
+
+using namespace std;
+using namespace imu_tk;
+using namespace Eigen;
+
+/* Maximum relative error allowed between the analytic and the autodiff Jacobians */
+static const double JACOBIAN_TOLERANCE = 1e-9;
+
+/* Evaluate the analytic and the autodiff cost functions with the same parameters, and
+ * check that residuals and Jacobians agree. The two cost functions are deleted */
+static bool checkJacobian( const string &name, ceres::CostFunction *analytic,
+                           ceres::CostFunction *autodiff, const double *params )
+{
+  const int n_res = autodiff->num_residuals(),
+            n_params = autodiff->parameter_block_sizes()[0];
+  vector< double > res_an( n_res ), res_ad( n_res ), res_nj( n_res ),
+                   jac_an( n_res*n_params ), jac_ad( n_res*n_params );
+  const double *parameters[1] = { params };
+  double *jacobians_an[1] = { jac_an.data() }, *jacobians_ad[1] = { jac_ad.data() };
+
+  bool ok = analytic->num_residuals() == n_res &&
+            analytic->Evaluate( parameters, res_an.data(), jacobians_an ) &&
+            analytic->Evaluate( parameters, res_nj.data(), NULL ) &&
+            autodiff->Evaluate( parameters, res_ad.data(), jacobians_ad );
+
+  double res_err = 0, res_max = 0, jac_err = 0, jac_max = 0;
+  for( int i = 0; ok && i < n_res; i++ )
+  {
+    res_err = max( res_err, max( abs( res_an[i] - res_ad[i] ), abs( res_nj[i] - res_ad[i] ) ) );
+    res_max = max( res_max, abs( res_ad[i] ) );
+  }
+  for( int i = 0; ok && i < n_res*n_params; i++ )
+  {
+    jac_err = max( jac_err, abs( jac_an[i] - jac_ad[i] ) );
+    jac_max = max( jac_max, abs( jac_ad[i] ) );
+  }
+
+  res_err /= max( res_max, numeric_limits<double>::min() );
+  jac_err /= max( jac_max, numeric_limits<double>::min() );
+  ok = ok && res_err <= JACOBIAN_TOLERANCE && jac_err <= JACOBIAN_TOLERANCE;
+
+  cout<<( ok?"[ OK ] ":"[FAIL] " )<<name<<" : residuals rel. error "<<res_err
+      <<", Jacobian rel. error "<<jac_err<<endl;
+
+  delete analytic;
+  delete autodiff;
+  return ok;
+}
+
+/* Deterministic pseudo-random values in [-1, 1] */
+static double randomValue()
+{
+  static unsigned int state = 12345;
+  state = state*1103515245u + 12345u;
+  return double( ( state >> 8 ) & 0xFFFF )/32767.5 - 1.0;
+}
+
+template <typename _T> static bool testAccJacobians( const string &type_name )
+{
+  bool ok = true;
+  double params[9] = { 0.01*randomValue(), 0.01*randomValue(), 0.01*randomValue(),
+                       0.00240, 0.00242, 0.00241, 33000, 33200, 32400 };
+  TriadBuffer_<_T> samples;
+  for( int i = 0; i < 16; i++ )
+    samples.push_back( TriadData_<_T>( _T(0.01*i), _T(33000 + 4000*randomValue()),
+                                       _T(33200 + 4000*randomValue()),
+                                       _T(32400 + 4000*randomValue()) ) );
+
+  for( int i = 0; i < 4; i++ )
+  {
+    const Eigen::Matrix< _T, 3, 1> sample( samples.x(i), samples.y(i), samples.z(i) );
+    ok = checkJacobian( "MultiPosAccAnalyticResidual<" + type_name + ">",
+                        MultiPosAccAnalyticResidual<_T>::Create( _T(9.81), sample ),
+                        MultiPosAccResidual<_T>::Create( _T(9.81), sample ), params ) && ok;
+  }
+
+  // The batched residual is compared sample by sample with the autodiff residual
+  const int start_idx = 3, n_samps = samples.size() - start_idx;
+  ceres::CostFunction *batch = MultiPosAccBatchResidual<_T>::Create( _T(9.81), samples,
+                                                                      start_idx, n_samps );
+  vector< double > res( n_samps ), jac( n_samps*9 );
+  const double *parameters[1] = { params };
+  double *jacobians[1] = { jac.data() };
+  bool batch_ok = batch->Evaluate( parameters, res.data(), jacobians );
+  double jac_err = 0, jac_max = 0;
+  for( int i = 0; batch_ok && i < n_samps; i++ )
+  {
+    const Eigen::Matrix< _T, 3, 1> sample( samples.x(start_idx + i), samples.y(start_idx + i),
+                                           samples.z(start_idx + i) );
+    ceres::CostFunction *autodiff = MultiPosAccResidual<_T>::Create( _T(9.81), sample );
+    double res_ad, jac_ad[9], *jacobians_ad[1] = { jac_ad };
+    batch_ok = autodiff->Evaluate( parameters, &res_ad, jacobians_ad ) &&
+               abs( res_ad - res[i] ) <= JACOBIAN_TOLERANCE*max( 1.0, abs( res_ad ) );
+    for( int j = 0; j < 9; j++ )
+    {
+      jac_err = max( jac_err, abs( jac_ad[j] - jac[9*i + j] ) );
+      jac_max = max( jac_max, abs( jac_ad[j] ) );
+    }
+    delete autodiff;
+  }
+  delete batch;
+  jac_err /= max( jac_max, numeric_limits<double>::min() );
+  batch_ok = batch_ok && jac_err <= JACOBIAN_TOLERANCE;
+  cout<<( batch_ok?"[ OK ] ":"[FAIL] " )<<"MultiPosAccBatchResidual<"<<type_name
+      <<"> : Jacobian rel. error "<<jac_err<<endl;
+
+  return ok && batch_ok;
+}
+
+template <int _N_PARAMS> static bool testGyroJacobians( double dt )
+{
+  TriadBuffer samples;
+  double t = 0;
+  for( int i = 0; i < 300; i++ )
+  {
+    samples.push_back( TriadData( t, 3000*sin( 0.03*i ), 2000*cos( 0.05*i ), 1500*sin( 0.02*i + 1 ) ) );
+    // Irregular timestamps, used if dt <= 0
+    t += 0.01 + 1e-3*randomValue();
+  }
+
+  double params[12];
+  for( int i = 0; i < 6; i++ )
+    params[i] = 0.01*randomValue();
+  params[6] = 2.10e-4; params[7] = 2.05e-4; params[8] = 2.08e-4;
+  params[9] = 50; params[10] = -30; params[11] = 10;
+
+  Eigen::Vector3d g_versor_pos0( 0.1, 0.2, 0.97 ), g_versor_pos1( 0.5, -0.3, 0.8 );
+  g_versor_pos0.normalize();
+  g_versor_pos1.normalize();
+  const DataInterval interval( 10, 280 );
+
+  stringstream name;
+  name<<"MultiPosGyroAnalyticResidual<double, "<<_N_PARAMS<<">, "
+      <<( dt > 0?"fixed dt":"timestamps dt" );
+  return checkJacobian( name.str(),
+                        MultiPosGyroAnalyticResidual<double, _N_PARAMS>::Create( g_versor_pos0, g_versor_pos1,
+                                                                                  samples, interval, dt ),
+                        MultiPosGyroResidual<double, _N_PARAMS>::Create( g_versor_pos0, g_versor_pos1,
+                                                                         samples, interval, dt ),
+                        params );
+}
+
+int main()
+{
+  bool ok = testAccJacobians<double>( "double" );
+  ok = testAccJacobians<float>( "float" ) && ok;
+
+  const double dts[2] = { 0.01, -1.0 };
+  for( int i = 0; i < 2; i++ )
+  {
+    ok = testGyroJacobians<9>( dts[i] ) && ok;
+    ok = testGyroJacobians<12>( dts[i] ) && ok;
+  }
+
+  cout<<( ok?"All the Jacobians tests passed":"Some Jacobians tests failed" )<<endl;
+  return ok?0:1;
+}
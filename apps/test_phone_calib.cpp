@@ -25,6 +25,7 @@ int main(int argc, char** argv)
   MultiPosCalibration mp_calib;
     
   mp_calib.setInitStaticIntervalDuration(50.0);
+  mp_calib.enableVarianceIntervalsDetection(true);
   mp_calib.setGravityMagnitude(9.803);
   mp_calib.enableVerboseOutput(false);
   mp_calib.enableAccUseMeans(false);
@@ -78,15 +79,25 @@ int main(int argc, char** argv)
     return -1;
   }
 //   
+  // Integrate both the test sequences only once: the rotation in each test interval 
+  // is obtained from the cumulative rotations at the interval boundaries
+  vector<double> test_quats( 4*gyro_data_test.size() ), test_quats_calib( 4*gyro_data_test_calib.size() );
+  integrateGyroStream( gyro_data_test, test_quats.data() );
+  integrateGyroStream( gyro_data_test_calib, test_quats_calib.data() );
+  
   int uncalib_score = 0, calib_score = 0;
   cout<<"n_intervals :"<<n_intervals<<endl;
   for(int i = n_intervals; i < static_intervals.size(); i++)
   {
     Vector3d res, res_calib;
     Matrix3d test_rot_res, test_rot_res_calib;
+    Vector4d test_quat, test_quat_calib;
+    int idx0 = static_intervals[i-n_intervals].end_idx, idx1 = static_intervals[i].start_idx;
     
-    integrateGyroInterval( gyro_data_test, test_rot_res, double(-1), DataInterval(static_intervals[i-n_intervals].end_idx, static_intervals[i].start_idx) );
-    integrateGyroInterval( gyro_data_test_calib, test_rot_res_calib, double(-1), DataInterval(static_intervals[i-n_intervals].end_idx, static_intervals[i].start_idx) );
+    relativeQuaternion( &test_quats[4*idx0], &test_quats[4*idx1], test_quat.data() );
+    relativeQuaternion( &test_quats_calib[4*idx0], &test_quats_calib[4*idx1], test_quat_calib.data() );
+    quaternionToRotation( test_quat.data(), test_rot_res );
+    quaternionToRotation( test_quat_calib.data(), test_rot_res_calib );
     
     decomposeRotation(test_rot_res, res);
     decomposeRotation(test_rot_res_calib, res_calib);
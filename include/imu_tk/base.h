@@ -28,11 +28,15 @@
 
 #pragma once
 
+#include <algorithm>
 #include <Eigen/Core>
+#include <boost/shared_ptr.hpp>
 #include <iostream>
 #include <stdexcept>
 #include <vector>
 
+#include "imu_tk/log.h"
+
 namespace imu_tk
 {
 /** @brief Simple container for a data item (e.g., timestamp + x, y, z accelerometers or
@@ -133,6 +137,337 @@ private:
 
 typedef TriadData_<double> TriadData;
 
+/** @brief Structure of arrays container for a sequence of data items: timestamps, x, y, z 
+ *         values and interval ids are stored in separate, contiguous arrays, so loops over
+ *         a single field can be vectorized.
+ * 
+ * The storage is reference counted: copies of a TriadBuffer_ object share the same data, 
+ * that is duplicated only when one of the copies is modified (copy-on-write). 
+ * As for boost::shared_ptr, different copies can be safely read from different threads. 
+ * A TriadBuffer_ object can also refer to external arrays (e.g., a memory mapped file, 
+ * see importBinaryData()), that are copied only when the buffer is modified. 
+ * Note that the non-const accessors (e.g., x() or timestamps() ) of a non-const object 
+ * count as a modification: if the data is shared, they first duplicate the whole buffer. 
+ * To only read the data of a shared buffer, use a const reference. */
+template <typename _T > class TriadBuffer_
+{
+public:
+  /** @brief Construct an empty TriadBuffer_ object */
+  TriadBuffer_() : size_(0) { sync(); }
+
+  /** @brief Construct a TriadBuffer_ object with n_samples uninitialized samples
+   *         (interval ids are set to -1) */
+  explicit TriadBuffer_( int n_samples ) : size_(0) 
+  { 
+    resize( n_samples ); 
+  }
+
+  /** @brief Construct a TriadBuffer_ object from a sequence of TriadData_ objects */
+  explicit TriadBuffer_( const std::vector< TriadData_<_T> > &samples ) : size_(0)
+  {
+    reserve( samples.size() );
+    for( int i = 0; i < int(samples.size()); i++ )
+      push_back( samples[i] );
+  }
+  
+  /** @brief Construct a TriadBuffer_ object that refers to n_samples samples stored 
+   *         in external arrays, without copying them 
+   * 
+   * @param n_samples Number of samples
+   * @param timestamps Timestamps array
+   * @param x, y, z Values arrays
+   * @param interval_ids Interval ids array
+   * @param owner Object that keeps the arrays valid (e.g., a memory mapped file): 
+   *              it is released when all the copies of the buffer have been 
+   *              destroyed or modified
+   */
+  TriadBuffer_( int n_samples, const _T *timestamps, const _T *x, const _T *y, const _T *z, 
+                const int *interval_ids, const boost::shared_ptr< const void > &owner ) : 
+    storage_( new Storage() ),
+    size_( n_samples )
+  {
+    storage_->owner = owner;
+    storage_->ext_timestamps = timestamps;
+    storage_->ext_data[0] = x;
+    storage_->ext_data[1] = y;
+    storage_->ext_data[2] = z;
+    storage_->ext_interval_ids = interval_ids;
+    sync();
+  }
+  
+  ~TriadBuffer_() {};
+  
+  inline int size() const { return size_; };
+  inline bool empty() const { return size_ == 0; };
+  
+  /** @brief Reserve the storage for at least n_samples samples */
+  void reserve( int n_samples )
+  {
+    detach();
+    storage_->timestamps.reserve( n_samples );
+    for( int j = 0; j < 3; j++ )
+      storage_->data[j].reserve( n_samples );
+    storage_->interval_ids.reserve( n_samples );
+    sync();
+  }
+  
+  /** @brief Resize the container to n_samples samples (new interval ids are set to -1) */
+  void resize( int n_samples )
+  {
+    detach();
+    storage_->timestamps.resize( n_samples );
+    for( int j = 0; j < 3; j++ )
+      storage_->data[j].resize( n_samples );
+    storage_->interval_ids.resize( n_samples, -1 );
+    size_ = n_samples;
+    sync();
+  }
+  
+  /** @brief Remove all the samples */
+  void clear() { resize(0); };
+
+  /** @brief Append a sample at the end of the container */
+  inline void push_back( const TriadData_<_T> &sample )
+  {
+    push_back( sample.timestamp(), sample.x(), sample.y(), sample.z(), sample.interval_id() );
+  };
+  
+  /** @brief Append a sample at the end of the container, given a timestamp and three values */
+  inline void push_back( _T timestamp, _T x, _T y, _T z, int interval_id = -1 )
+  {
+    // Fast path: the storage is not shared and the (non empty) arrays are not reallocated, 
+    // so the pointers are still valid
+    if( size_ && size_ < capacity_ && storage_.use_count() == 1 )
+    {
+      storage_->timestamps.push_back( timestamp );
+      storage_->data[0].push_back( x );
+      storage_->data[1].push_back( y );
+      storage_->data[2].push_back( z );
+      storage_->interval_ids.push_back( interval_id );
+      size_++;
+      return;
+    }
+    
+    detach();
+    storage_->timestamps.push_back( timestamp );
+    storage_->data[0].push_back( x );
+    storage_->data[1].push_back( y );
+    storage_->data[2].push_back( z );
+    storage_->interval_ids.push_back( interval_id );
+    size_++;
+    sync();
+  };
+  
+  /** @brief Set the i-th sample */
+  inline void set( int i, const TriadData_<_T> &sample )
+  {
+    timestamps()[i] = sample.timestamp();
+    x()[i] = sample.x();
+    y()[i] = sample.y();
+    z()[i] = sample.z();
+    intervalIds()[i] = sample.interval_id();
+  };
+
+  inline const _T& timestamp( int i ) const { return timestamps_[i]; };
+  inline const _T& x( int i ) const { return data_[0][i]; };
+  inline const _T& y( int i ) const { return data_[1][i]; };
+  inline const _T& z( int i ) const { return data_[2][i]; };
+  inline const _T& operator() ( int i, int index ) const { return data_[index][i]; };
+  inline const int& interval_id( int i ) const { return interval_ids_[i]; };
+  inline Eigen::Matrix< _T, 3, 1> data( int i ) const
+  { 
+    return Eigen::Matrix< _T, 3, 1>( data_[0][i], data_[1][i], data_[2][i] ); 
+  };
+
+  /** @brief Provide the i-th sample as a TriadData_ object */
+  inline TriadData_<_T> operator[] ( int i ) const
+  {
+    return TriadData_<_T>( timestamps_[i], data_[0][i], data_[1][i], data_[2][i], interval_ids_[i] );
+  };
+  
+  /** @brief Contiguous array of timestamps */
+  inline const _T* timestamps() const { return timestamps_; };
+  /** @brief Contiguous array of values along the index-th axis (0 : x, 1 : y, 2 : z) */
+  inline const _T* axis( int index ) const { return data_[index]; };
+  inline const _T* x() const { return data_[0]; };
+  inline const _T* y() const { return data_[1]; };
+  inline const _T* z() const { return data_[2]; };
+  /** @brief Contiguous array of interval ids */
+  inline const int* intervalIds() const { return interval_ids_; };
+
+  /* Non-const accessors: if the data is shared with other copies (or refers to external 
+   * arrays), the whole buffer is first duplicated */
+  inline _T* timestamps() { detach(); return timestamps_; };
+  inline _T* axis( int index ) { detach(); return data_[index]; };
+  inline _T* x() { detach(); return data_[0]; };
+  inline _T* y() { detach(); return data_[1]; };
+  inline _T* z() { detach(); return data_[2]; };
+  inline int* intervalIds() { detach(); return interval_ids_; };
+  
+  /** @brief Copy the samples into a sequence of TriadData_ objects */
+  void toTriadData( std::vector< TriadData_<_T> > &samples ) const
+  {
+    samples.clear();
+    samples.reserve( size_ );
+    for( int i = 0; i < size_; i++ )
+      samples.push_back( (*this)[i] );
+  }
+
+private:
+  
+  struct Storage
+  {
+    Storage() : ext_timestamps(NULL), ext_interval_ids(NULL) 
+    { 
+      ext_data[0] = ext_data[1] = ext_data[2] = NULL; 
+    };
+    
+    std::vector<_T> timestamps, data[3];
+    std::vector<int> interval_ids;
+    
+    /* External (read only) arrays, used if owner is set */
+    boost::shared_ptr< const void > owner;
+    const _T *ext_timestamps, *ext_data[3];
+    const int *ext_interval_ids;
+  };
+  
+  /* Make sure the storage is owned and not shared with other copies before modifying it */
+  void detach()
+  {
+    if( !storage_ )
+      storage_ = boost::shared_ptr< Storage >( new Storage() );
+    else if( storage_->owner )
+    {
+      boost::shared_ptr< Storage > storage( new Storage() );
+      storage->timestamps.assign( timestamps_, timestamps_ + size_ );
+      for( int j = 0; j < 3; j++ )
+        storage->data[j].assign( data_[j], data_[j] + size_ );
+      storage->interval_ids.assign( interval_ids_, interval_ids_ + size_ );
+      storage_ = storage;
+      sync();
+    }
+    else if( storage_.use_count() > 1 )
+    {
+      storage_ = boost::shared_ptr< Storage >( new Storage( *storage_ ) );
+      sync();
+    }
+  }
+  
+  /* Update the pointers to the (contiguous) arrays, and the number of samples that 
+   * can be appended without reallocating them (0 for external arrays) */
+  void sync()
+  {
+    capacity_ = 0;
+    if( storage_ && !storage_->owner )
+    {
+      capacity_ = int( storage_->timestamps.capacity() );
+      for( int j = 0; j < 3; j++ )
+        capacity_ = std::min( capacity_, int( storage_->data[j].capacity() ) );
+      capacity_ = std::min( capacity_, int( storage_->interval_ids.capacity() ) );
+    }
+    
+    if( storage_ && storage_->owner && size_ )
+    {
+      // Written only after a detach()
+      timestamps_ = const_cast< _T * >( storage_->ext_timestamps );
+      for( int j = 0; j < 3; j++ )
+        data_[j] = const_cast< _T * >( storage_->ext_data[j] );
+      interval_ids_ = const_cast< int * >( storage_->ext_interval_ids );
+    }
+    else if( storage_ && size_ )
+    {
+      timestamps_ = &storage_->timestamps[0];
+      for( int j = 0; j < 3; j++ )
+        data_[j] = &storage_->data[j][0];
+      interval_ids_ = &storage_->interval_ids[0];
+    }
+    else
+    {
+      timestamps_ = data_[0] = data_[1] = data_[2] = NULL;
+      interval_ids_ = NULL;
+    }
+  }
+  
+  boost::shared_ptr< Storage > storage_;
+  _T *timestamps_, *data_[3];
+  int *interval_ids_;
+  int size_, capacity_;
+};
+
+typedef TriadBuffer_<double> TriadBuffer;
+
+/** @brief Timestamps index of a data samples buffer, that maps timestamps to sample indices 
+ *         in logarithmic time.
+ * 
+ * The searches start from an interpolated guess of the index (exact for uniformly sampled 
+ * signals), refined by an exponential search followed by a binary search, so that they 
+ * require O(log(d)) comparisons, where d is the distance of the result from the guess. 
+ * The timestamps should be non-decreasing, see monotone(): otherwise the 
+ * results of the searches are undefined. The index shares the timestamps with the
+ * buffer, without copying them (see TriadBuffer_).
+ */
+template <typename _T> class TimeIndex_
+{
+public:
+  /** @brief Construct the index of the timestamps of a data samples buffer, checking
+   *         their monotonicity */
+  explicit TimeIndex_( const TriadBuffer_<_T> &samples );
+  
+  /** @brief Number of indexed samples */
+  inline int size() const { return samples_.size(); };
+  
+  /** @brief True if the timestamps are non-decreasing */
+  inline bool monotone() const { return monotone_; };
+  
+  /** @brief Index of the first sample not before start_idx with timestamp greater than 
+   *         or equal to ts, or size() if there is no such sample */
+  int lowerBound( _T ts, int start_idx = 0 ) const;
+  
+  /** @brief Index of the first sample not before start_idx with timestamp greater 
+   *         than ts, or size() if there is no such sample */
+  int upperBound( _T ts, int start_idx = 0 ) const;
+  
+  /** @brief Index of the sample with the timestamp nearest to ts */
+  int nearest( _T ts ) const;
+  
+  /** @brief Compute lowerBound() for each input timestamp. If the input timestamps are 
+   *         non-decreasing, all the indices are found in a single, merge-style pass, 
+   *         each search starting from the previous result.
+   * 
+   * @param timestamps Input timestamps
+   * @param[out] indices Output indices, one for each input timestamp
+   */
+  void lowerBounds( const std::vector< _T > &timestamps, std::vector< int > &indices ) const;
+  
+private:
+  int search( _T ts, int start_idx, int guess_idx, bool upper ) const;
+  int guessIndex( _T ts, int start_idx ) const;
+  
+  TriadBuffer_<_T> samples_;
+  const _T *timestamps_;
+  bool monotone_;
+};
+
+typedef TimeIndex_<double> TimeIndex;
+
+/** @brief Interface for a source of data items (e.g., a data file) that provides 
+ *         the samples sequentially, in chunks, so that the whole sequence does not 
+ *         need to be stored in memory */
+template <typename _T > class TriadDataSource_
+{
+public:
+  virtual ~TriadDataSource_() {};
+  
+  /** @brief Read the next chunk of samples
+   * 
+   * @param[out] chunk Output samples, its previous content is replaced
+   * @param max_samples Maximum number of samples to read
+   * 
+   * @return The number of samples read, 0 at the end of the sequence
+   */
+  virtual int read( TriadBuffer_<_T> &chunk, int max_samples ) = 0;
+};
+
 /** @brief Generates a sequence of characters with a properly formatted 
  *         representation of a TriadData_  instance (triad_data), 
  *         and inserts them into the output stream os. */
@@ -157,7 +492,6 @@ struct DataInterval
    * @param end_ts Final timestamp
    */
 
-  /*
   template <typename _T> 
     static DataInterval fromTimestamps( const std::vector< TriadData_<_T> > &samples, 
                                         _T start_ts, _T end_ts )
@@ -180,7 +514,20 @@ struct DataInterval
     
     return DataInterval( start_idx, end_idx );
   };
-  */
+
+  /** @brief Same as fromTimestamps(), with the indices extracted from a timestamps index 
+   *         (see TimeIndex_) */
+  template <typename _T> 
+    static DataInterval fromTimestamps( const TimeIndex_<_T> &time_index, 
+                                        _T start_ts, _T end_ts )
+  {
+    if( start_ts < 0 || end_ts <= start_ts )
+      throw std::invalid_argument("Invalid timestamps");
+    if( time_index.size() < 3 )
+      throw std::invalid_argument("Invalid data samples buffer");
+    
+    return DataInterval( time_index.nearest( start_ts ), time_index.nearest( end_ts ) );
+  };
 
   /** @brief Extracts from the data samples vector a DataInterval object that represents 
    *         the initial interval with a given duration.
@@ -215,6 +562,61 @@ struct DataInterval
     return DataInterval( initial_idx, end_idx );
   };
 
+  /** @brief Extracts from the data samples buffer a DataInterval object that represents 
+   *         the initial interval, see initialInterval()
+   *     
+   * @param samples Input signal (data samples buffer)
+   */
+  template <typename _T> 
+    static DataInterval initialInterval( const TriadBuffer_<_T> &samples )
+  {
+    const int *interval_ids = samples.intervalIds();
+    int initial_idx = -1;
+    int end_idx     = -1;
+
+    int i = 0;
+    while ( (initial_idx == -1 || end_idx == -1) && i < samples.size())
+    {
+       if ( initial_idx == -1 && interval_ids[i] == 0)
+       {
+         initial_idx = i;
+       }
+
+       if ( initial_idx != -1 && interval_ids[i] != 0 )
+       {
+         end_idx = i-1;
+       }
+       i++;
+    }
+    
+    assert ( initial_idx != -1 && end_idx != -1 && "Error in base.h initialInterval algorithm!");
+    
+    return DataInterval( initial_idx, end_idx );
+  };
+
+  /** @brief Extracts from the data samples buffer a DataInterval object that represents 
+   *         the initial interval with a given duration, i.e. the samples with timestamps 
+   *         not greater than the first timestamp plus duration (the interval ids are 
+   *         not used).
+   *     
+   * @param samples Input signal (data samples buffer), ordered by increasing timestamps
+   * @param duration Interval duration
+   */
+  template <typename _T> 
+    static DataInterval initialInterval( const TriadBuffer_<_T> &samples, _T duration )
+  {
+    if( duration <= 0)
+      throw std::invalid_argument("Invalid interval duration");
+    if( samples.size() < 3 )
+      throw std::invalid_argument("Invalid data samples buffer");
+    
+    const _T *timestamps = samples.timestamps();
+    int end_idx = std::upper_bound( timestamps, timestamps + samples.size(), 
+                                    timestamps[0] + duration ) - timestamps - 1;
+    
+    return DataInterval( 0, end_idx );
+  };
+
   /** @brief Extracts from the data samples vector a DataInterval object that represents 
    *         the final interval with a given duration.
    *     
@@ -222,7 +624,6 @@ struct DataInterval
    * @param duration Interval duration
    */
 
-  /*
   template <typename _T> 
     static DataInterval finalInterval( const std::vector< TriadData_<_T> > &samples, 
                                        _T duration )
@@ -241,12 +642,10 @@ struct DataInterval
     
     return DataInterval( start_idx, samples.size() - 1 );
   };
-  */
 
   int start_idx, end_idx;
   
 private:
-  /*
   template <typename _T> static int timeToIndex( const std::vector< TriadData_<_T> > &samples, 
                                                  _T ts )
   {
@@ -264,8 +663,7 @@ private:
       return idx0;
     else
       return idx1;
-  }
-  */;
+  };
 };
 
 /** @brief Perform a simple consistency check on a target input interval, 
@@ -283,6 +681,12 @@ template <typename _T>
   DataInterval checkInterval( const std::vector< TriadData_<_T> > &samples, 
                               const DataInterval &interval );
 
+/** @brief Perform a simple consistency check on a target input interval, 
+ *         given an input data samples buffer, see checkInterval() */
+template <typename _T> 
+  DataInterval checkInterval( const TriadBuffer_<_T> &samples, 
+                              const DataInterval &interval );
+
 
 /** @brief Compute the arithmetic mean of a sequence of TriadData_ objects. If a valid data 
  *         interval is provided, the mean is computed only inside this interval
@@ -300,6 +704,11 @@ template <typename _T>
   Eigen::Matrix< _T, 3, 1> dataMean ( const std::vector< TriadData_<_T> > &samples, 
                                       const DataInterval &interval = DataInterval() );
 
+/** @brief Compute the arithmetic mean of a data samples buffer, see dataMean() */
+template <typename _T> 
+  Eigen::Matrix< _T, 3, 1> dataMean ( const TriadBuffer_<_T> &samples, 
+                                      const DataInterval &interval = DataInterval() );
+
 
 /** @brief Compute the variance of a sequence of TriadData_ objects. If a valid data 
  *         interval is provided, the variance is computed only inside this interval
@@ -317,6 +726,169 @@ template <typename _T>
   Eigen::Matrix< _T, 3, 1> dataVariance ( const std::vector< TriadData_<_T> > &samples, 
                                           const DataInterval &interval = DataInterval() );
 
+/** @brief Compute the variance of a data samples buffer, see dataVariance() */
+template <typename _T>
+  Eigen::Matrix< _T, 3, 1> dataVariance ( const TriadBuffer_<_T> &samples, 
+                                          const DataInterval &interval = DataInterval() );
+
+/** @brief Overlapping Allan variances of a data triad (see allanVariance()), 
+ *         for a sequence of octave-spaced cluster times */
+template <typename _T> struct AllanVariance_
+{
+  AllanVariance_() : data_dt(0) {};
+  
+  /** @brief Provides the number of cluster times */
+  int size() const { return int(taus.size()); };
+  
+  /** @brief Provides the Allan deviations (square roots of the variances) of the i-th cluster time */
+  Eigen::Matrix< _T, 3, 1> deviation( int i ) const { return variances[i].cwiseSqrt(); };
+  
+  /** @brief Sample period used to compute the cluster times */
+  _T data_dt;
+  /** @brief Cluster sizes, in samples */
+  std::vector< int > cluster_sizes;
+  /** @brief Cluster times (cluster sizes multiplied by data_dt) */
+  std::vector< _T > taus;
+  /** @brief Allan variances of the x, y and z axes for each cluster time */
+  std::vector< Eigen::Matrix< _T, 3, 1> > variances;
+};
+
+typedef AllanVariance_<double> AllanVariance;
+
+/** @brief Noise parameters of a data triad, estimated from its Allan deviation 
+ *         (see noiseParameters()). For a gyroscopes triad with samples in rad/s, the white 
+ *         noise is the angle random walk (rad/sqrt(s)), for an accelerometers triad 
+ *         with samples in m/s^2 it is the velocity random walk (m/s/sqrt(s)) */
+template <typename _T> struct NoiseParameters_
+{
+  /** @brief White noise (random walk) coefficients N, with sigma(tau) = N/sqrt(tau) */
+  Eigen::Matrix< _T, 3, 1> random_walk;
+  /** @brief Bias instability coefficients B, with min sigma(tau) = 0.664*B */
+  Eigen::Matrix< _T, 3, 1> bias_instability;
+  /** @brief Cluster times of the bias instability (minima of the Allan deviations) */
+  Eigen::Matrix< _T, 3, 1> bias_instability_tau;
+  /** @brief Rate random walk coefficients K, with sigma(tau) = K*sqrt(tau/3) */
+  Eigen::Matrix< _T, 3, 1> rate_random_walk;
+};
+
+typedef NoiseParameters_<double> NoiseParameters;
+
+/** @brief Compute the overlapping Allan variances of a data samples buffer, usually collected 
+ *         in a long static capture, for octave-spaced cluster sizes m = 1, 2, 4, ... 
+ *         up to half of the samples
+ * 
+ * @param samples Input signal (data samples buffer)
+ * @param[out] avar Resulting Allan variances
+ * @param data_dt Fixed sample period. If less than 0, the mean period of the sample 
+ *                timestamps is used
+ * @param interval Data interval where to compute the variances. If this interval is not valid,
+ *                 i.e., one of the two indices is -1, the variances are computed for the whole data
+ *                 sequence.
+ * @param n_threads Number of threads (if less than 1, the number of hardware threads), 
+ *                  each cluster size of each axis is computed by a different task
+ * 
+ * For each axis, the variances are computed from the cumulative sums \f$\theta_k\f$ 
+ * of the (mean removed) samples, accumulated in double precision: 
+ * \f[ \sigma^2(\tau) = \frac{1}{2\tau^2(N - 2m + 1)}
+ *     \sum_{k=0}^{N-2m} ( \theta_{k+2m} - 2\theta_{k+m} + \theta_k )^2 \f]
+ * with \f$\tau = m \cdot dt\f$, i.e. in O(N) for each cluster size.
+ */
+template <typename _T>
+  void allanVariance( const TriadBuffer_<_T> &samples, AllanVariance_<_T> &avar, 
+                      _T data_dt = _T(-1), const DataInterval &interval = DataInterval(), 
+                      int n_threads = 0 );
+
+/** @brief Same as allanVariance(), with a sequence of TriadData_ objects as input signal */
+template <typename _T>
+  void allanVariance( const std::vector< TriadData_<_T> > &samples, AllanVariance_<_T> &avar, 
+                      _T data_dt = _T(-1), const DataInterval &interval = DataInterval(), 
+                      int n_threads = 0 );
+
+/** @brief Estimate the noise parameters of a data triad from its Allan variances 
+ *         (IEEE Std 952 slope method): the random walk and the rate random walk are 
+ *         taken where the slope of the log-log Allan deviation is closest to -1/2 and +1/2 
+ *         respectively, the bias instability at the minimum of the deviation */
+template <typename _T>
+  NoiseParameters_<_T> noiseParameters( const AllanVariance_<_T> &avar );
+
+
+/** @brief Precomputed statistics of a data samples buffer (or vector), that provides 
+ *         the mean and the variance of the samples in any interval in constant time.
+ * 
+ * The index stores the prefix sums of the samples and of their squares, accumulated in 
+ * double precision (also for float samples) with a compensated (Kahan) summation and
+ * shifted by the first sample to limit the cancellation errors in the variance. 
+ * It requires 6 doubles for each sample, and it is useful when the statistics 
+ * of many (possibly overlapping) intervals are queried, e.g. in the thresholds sweeps.
+ * The index does not refer to the samples after its construction.
+ */
+template <typename _T> class TriadStatsIndex_
+{
+public:
+  /** @brief Construct an empty index */
+  TriadStatsIndex_() : size_(0) {};
+  
+  /** @brief Construct the index of the samples of a data samples buffer */
+  explicit TriadStatsIndex_( const TriadBuffer_<_T> &samples ) { build( samples ); };
+  
+  /** @brief Construct the index of a sequence of TriadData_ objects */
+  explicit TriadStatsIndex_( const std::vector< TriadData_<_T> > &samples ) { build( samples ); };
+  
+  /** @brief Build the index of the samples of a data samples buffer, 
+   *         replacing the previous content */
+  void build( const TriadBuffer_<_T> &samples );
+  
+  /** @brief Build the index of a sequence of TriadData_ objects, 
+   *         replacing the previous content */
+  void build( const std::vector< TriadData_<_T> > &samples );
+  
+  /** @brief Number of indexed samples */
+  inline int size() const { return size_; };
+  inline bool empty() const { return size_ == 0; };
+  
+  /** @brief Compute the arithmetic mean of the samples inside an interval (see dataMean()): 
+   *         if the interval is not valid, the mean is computed for the whole sequence */
+  Eigen::Matrix< _T, 3, 1> mean( const DataInterval &interval = DataInterval() ) const;
+  
+  /** @brief Compute the variance of the samples inside an interval (see dataVariance()): 
+   *         if the interval is not valid, the variance is computed for the whole sequence */
+  Eigen::Matrix< _T, 3, 1> variance( const DataInterval &interval = DataInterval() ) const;
+  
+  /** @brief Compute both the mean and the variance of the samples inside an interval */
+  void meanVariance( const DataInterval &interval, Eigen::Matrix< _T, 3, 1> &mean, 
+                     Eigen::Matrix< _T, 3, 1> &variance ) const;
+  
+private:
+  void init( int n_samples );
+  void add( int i, const Eigen::Matrix< double, 3, 1> &sample );
+  DataInterval checkInterval( const DataInterval &interval ) const;
+  void intervalSums( const DataInterval &interval, Eigen::Matrix< double, 3, 1> &sum, 
+                     Eigen::Matrix< double, 3, 1> &sum_sq ) const;
+  
+  int size_;
+  Eigen::Matrix< double, 3, 1> offset_, comp_, comp_sq_;
+  /* Prefix sums (size_ + 1 elements) of the shifted samples and of their squares */
+  std::vector< double > sum_[3], sum_sq_[3];
+};
+
+typedef TriadStatsIndex_<double> TriadStatsIndex;
+
+/** @brief Compute the arithmetic mean inside an interval from a statistics index, see dataMean() */
+template <typename _T> 
+  Eigen::Matrix< _T, 3, 1> dataMean ( const TriadStatsIndex_<_T> &stats_index, 
+                                      const DataInterval &interval = DataInterval() )
+{
+  return stats_index.mean( interval );
+}
+
+/** @brief Compute the variance inside an interval from a statistics index, see dataVariance() */
+template <typename _T> 
+  Eigen::Matrix< _T, 3, 1> dataVariance ( const TriadStatsIndex_<_T> &stats_index, 
+                                          const DataInterval &interval = DataInterval() )
+{
+  return stats_index.variance( interval );
+}
+
 
 /** @brief If the flag only_means is set to false, for each interval 
   *        (input vector intervals) extract from the input signal 
@@ -337,6 +909,8 @@ template <typename _T>
   * @param only_means If true, extract for each interval only the local mean, computed 
   *                   in intervals with size at least interval_n_samps samples. The timestamp is
   *                   the one of the center of the interval.
+  * @param stats_index If not NULL and only_means is true, the local means are computed 
+  *                    in constant time from this statistics index, built over samples
   * 
   */
 
@@ -346,7 +920,18 @@ template <typename _T>
                                  const std::vector< DataInterval > &intervals,
                                  std::vector< TriadData_<_T> > &extracted_samples,
                                  std::vector< DataInterval > &extracted_intervals,
-                                 int interval_n_samps = 100, bool only_means = false );
+                                 int interval_n_samps = 100, bool only_means = false,
+                                 const TriadStatsIndex_<_T> *stats_index = NULL );
+
+/** @brief Same as extractIntervalsSamples(), with input and output data 
+  *        samples buffers in place of TriadData_ vectors */
+template <typename _T> 
+  void extractIntervalsSamples ( const TriadBuffer_<_T> &samples,
+                                 const std::vector< DataInterval > &intervals,
+                                 TriadBuffer_<_T> &extracted_samples,
+                                 std::vector< DataInterval > &extracted_intervals,
+                                 int interval_n_samps = 100, bool only_means = false,
+                                 const TriadStatsIndex_<_T> *stats_index = NULL );
 
 
 /** @brief Decompose a rotation matrix into the roll, pitch, and yaw angular components
@@ -373,6 +958,129 @@ template <typename _T>
 }
 
 
+template <typename _T>
+  TimeIndex_<_T>::TimeIndex_( const TriadBuffer_<_T> &samples ) :
+  samples_( samples ),
+  timestamps_( samples_.timestamps() ),
+  monotone_( true )
+{
+  for( int i = 1; i < samples_.size() && monotone_; i++ )
+    monotone_ = !( timestamps_[i] < timestamps_[i - 1] );
+}
+
+template <typename _T>
+  int TimeIndex_<_T>::lowerBound( _T ts, int start_idx ) const
+{
+  if( start_idx < 0 ) start_idx = 0;
+  return search( ts, start_idx, guessIndex( ts, start_idx ), false );
+}
+
+template <typename _T>
+  int TimeIndex_<_T>::upperBound( _T ts, int start_idx ) const
+{
+  if( start_idx < 0 ) start_idx = 0;
+  return search( ts, start_idx, guessIndex( ts, start_idx ), true );
+}
+
+template <typename _T>
+  int TimeIndex_<_T>::nearest( _T ts ) const
+{
+  int idx1 = lowerBound( ts );
+  if( idx1 <= 0 )
+    return 0;
+  if( idx1 >= size() )
+    return size() - 1;
+  
+  int idx0 = idx1 - 1;
+  if( ts - timestamps_[idx0] < timestamps_[idx1] - ts )
+    return idx0;
+  else
+    return idx1;
+}
+
+template <typename _T>
+  void TimeIndex_<_T>::lowerBounds( const std::vector< _T > &timestamps, 
+                                    std::vector< int > &indices ) const
+{
+  indices.resize( timestamps.size() );
+  int idx = 0;
+  for( int i = 0; i < int(timestamps.size()); i++ )
+  {
+    if( i > 0 && timestamps[i] < timestamps[i - 1] )
+      idx = lowerBound( timestamps[i] );
+    else
+      // Exponential search forward from the previous result
+      idx = search( timestamps[i], idx, idx, false );
+    indices[i] = idx;
+  }
+}
+
+template <typename _T>
+  int TimeIndex_<_T>::guessIndex( _T ts, int start_idx ) const
+{
+  int last_idx = size() - 1;
+  if( start_idx >= last_idx || !( timestamps_[last_idx] > timestamps_[start_idx] ) )
+    return start_idx;
+  
+  double guess = double( ts - timestamps_[start_idx] )/double( timestamps_[last_idx] - timestamps_[start_idx] );
+  if( !( guess > 0 ) )
+    return start_idx;
+  if( guess >= 1 )
+    return last_idx;
+  return start_idx + int( guess*( last_idx - start_idx ) );
+}
+
+template <typename _T>
+  int TimeIndex_<_T>::search( _T ts, int start_idx, int guess_idx, bool upper ) const
+{
+  // Find the first index in [lo, hi) that satisfies the predicate 
+  // timestamp > ts (upper) or timestamp >= ts (!upper)
+  int lo = start_idx, hi = size();
+  if( lo >= hi )
+    return hi;
+  
+  if( guess_idx < lo ) guess_idx = lo;
+  if( guess_idx >= hi ) guess_idx = hi - 1;
+  
+  if( upper ? ( timestamps_[guess_idx] > ts ) : !( timestamps_[guess_idx] < ts ) )
+  {
+    // Exponential search backward
+    hi = guess_idx;
+    for( int step = 1; hi - step >= lo; step *= 2 )
+    {
+      int probe = hi - step;
+      if( upper ? ( timestamps_[probe] > ts ) : !( timestamps_[probe] < ts ) )
+        hi = probe;
+      else
+      {
+        lo = probe + 1;
+        break;
+      }
+    }
+  }
+  else
+  {
+    // Exponential search forward
+    lo = guess_idx + 1;
+    for( int step = 1; lo + step - 1 < hi; step *= 2 )
+    {
+      int probe = lo + step - 1;
+      if( upper ? ( timestamps_[probe] > ts ) : !( timestamps_[probe] < ts ) )
+      {
+        hi = probe;
+        break;
+      }
+      else
+        lo = probe + 1;
+    }
+  }
+  
+  if( upper )
+    return std::upper_bound( timestamps_ + lo, timestamps_ + hi, ts ) - timestamps_;
+  else
+    return std::lower_bound( timestamps_ + lo, timestamps_ + hi, ts ) - timestamps_;
+}
+
 template <typename _T>
   DataInterval checkInterval( const std::vector< TriadData_<_T> > &samples, 
                               const DataInterval &interval )
@@ -386,6 +1094,18 @@ template <typename _T>
 }
 
 
+template <typename _T>
+  DataInterval checkInterval( const TriadBuffer_<_T> &samples, 
+                              const DataInterval &interval )
+{
+  int start_idx = interval.start_idx, end_idx = interval.end_idx;
+  if( start_idx < 0) start_idx = 0;
+  if( end_idx < start_idx || end_idx > samples.size() - 1 ) 
+    end_idx = samples.size() - 1;
+  
+  return DataInterval( start_idx, end_idx );
+}
+
 template <typename _T>
   Eigen::Matrix< _T, 3, 1> dataMean( const std::vector< TriadData_<_T> >& samples, 
                                      const DataInterval& interval )
@@ -421,30 +1141,177 @@ template <typename _T>
   return variance;
 }
 
+template <typename _T>
+  Eigen::Matrix< _T, 3, 1> dataMean( const TriadBuffer_<_T>& samples, 
+                                     const DataInterval& interval )
+{
+  typedef Eigen::Map< const Eigen::Matrix< _T, Eigen::Dynamic, 1 > > ConstMapType;
+  
+  DataInterval rev_interval =  checkInterval( samples, interval );
+  int n_samp = rev_interval.end_idx - rev_interval.start_idx + 1;
+  Eigen::Matrix< _T, 3, 1> mean;
+  
+  for( int j = 0; j < 3; j++ )
+    mean(j) = ConstMapType( samples.axis(j) + rev_interval.start_idx, n_samp ).sum();
+  
+  mean /= _T(n_samp);
+  
+  return mean;
+}
+
+template <typename _T>
+  Eigen::Matrix< _T, 3, 1> dataVariance( const TriadBuffer_<_T>& samples, 
+                                         const DataInterval& interval )
+{
+  typedef Eigen::Map< const Eigen::Matrix< _T, Eigen::Dynamic, 1 > > ConstMapType;
+  
+  DataInterval rev_interval =  checkInterval( samples, interval );
+  int n_samp = rev_interval.end_idx - rev_interval.start_idx + 1;
+  Eigen::Matrix< _T, 3, 1> mean = dataMean( samples, rev_interval );
+  
+  Eigen::Matrix< _T, 3, 1> variance;
+  for( int j = 0; j < 3; j++ )
+    variance(j) = ( ConstMapType( samples.axis(j) + rev_interval.start_idx, n_samp ).array() - 
+                    mean(j) ).square().sum();
+  variance /= _T(n_samp - 1);
+  
+  return variance;
+}
+
+template <typename _T>
+  void TriadStatsIndex_<_T>::build( const TriadBuffer_<_T> &samples )
+{
+  init( samples.size() );
+  const _T *x = samples.x(), *y = samples.y(), *z = samples.z();
+  for( int i = 0; i < size_; i++ )
+    add( i, Eigen::Matrix< double, 3, 1>( x[i], y[i], z[i] ) );
+}
+
+template <typename _T>
+  void TriadStatsIndex_<_T>::build( const std::vector< TriadData_<_T> > &samples )
+{
+  init( samples.size() );
+  for( int i = 0; i < size_; i++ )
+    add( i, samples[i].data().template cast<double>() );
+}
+
+template <typename _T>
+  Eigen::Matrix< _T, 3, 1> TriadStatsIndex_<_T>::mean( const DataInterval &interval ) const
+{
+  Eigen::Matrix< _T, 3, 1> mean_val, variance_val;
+  meanVariance( interval, mean_val, variance_val );
+  return mean_val;
+}
+
+template <typename _T>
+  Eigen::Matrix< _T, 3, 1> TriadStatsIndex_<_T>::variance( const DataInterval &interval ) const
+{
+  Eigen::Matrix< _T, 3, 1> mean_val, variance_val;
+  meanVariance( interval, mean_val, variance_val );
+  return variance_val;
+}
+
+template <typename _T>
+  void TriadStatsIndex_<_T>::meanVariance( const DataInterval &interval, 
+                                           Eigen::Matrix< _T, 3, 1> &mean, 
+                                           Eigen::Matrix< _T, 3, 1> &variance ) const
+{
+  if( empty() )
+    throw std::invalid_argument("Empty statistics index");
+  
+  DataInterval rev_interval = checkInterval( interval );
+  double n_samp = rev_interval.end_idx - rev_interval.start_idx + 1;
+  Eigen::Matrix< double, 3, 1> sum, sum_sq;
+  intervalSums( rev_interval, sum, sum_sq );
+  
+  mean = ( sum/n_samp + offset_ ).template cast<_T>();
+  // Rounding errors could provide small negative values for constant signals
+  variance = ( ( sum_sq - sum.cwiseProduct( sum )/n_samp )/( n_samp - 1 ) ).cwiseMax( 0.0 ).template cast<_T>();
+}
+
+template <typename _T>
+  void TriadStatsIndex_<_T>::init( int n_samples )
+{
+  size_ = n_samples;
+  offset_.setZero();
+  comp_.setZero();
+  comp_sq_.setZero();
+  for( int j = 0; j < 3; j++ )
+  {
+    sum_[j].assign( size_ + 1, 0.0 );
+    sum_sq_[j].assign( size_ + 1, 0.0 );
+  }
+}
+
+template <typename _T>
+  void TriadStatsIndex_<_T>::add( int i, const Eigen::Matrix< double, 3, 1> &sample )
+{
+  if( !i )
+    offset_ = sample;
+  
+  Eigen::Matrix< double, 3, 1> val = sample - offset_;
+  for( int j = 0; j < 3; j++ )
+  {
+    // Kahan summation: comp_ and comp_sq_ keep the lost low-order parts
+    double y = val(j) - comp_(j), t = sum_[j][i] + y;
+    comp_(j) = ( t - sum_[j][i] ) - y;
+    sum_[j][i + 1] = t;
+    
+    y = val(j)*val(j) - comp_sq_(j);
+    t = sum_sq_[j][i] + y;
+    comp_sq_(j) = ( t - sum_sq_[j][i] ) - y;
+    sum_sq_[j][i + 1] = t;
+  }
+}
+
+template <typename _T>
+  DataInterval TriadStatsIndex_<_T>::checkInterval( const DataInterval &interval ) const
+{
+  int start_idx = interval.start_idx, end_idx = interval.end_idx;
+  if( start_idx < 0) start_idx = 0;
+  if( end_idx < start_idx || end_idx > size_ - 1 ) 
+    end_idx = size_ - 1;
+  
+  return DataInterval( start_idx, end_idx );
+}
+
+template <typename _T>
+  void TriadStatsIndex_<_T>::intervalSums( const DataInterval &interval, 
+                                           Eigen::Matrix< double, 3, 1> &sum, 
+                                           Eigen::Matrix< double, 3, 1> &sum_sq ) const
+{
+  for( int j = 0; j < 3; j++ )
+  {
+    sum(j) = sum_[j][interval.end_idx + 1] - sum_[j][interval.start_idx];
+    sum_sq(j) = sum_sq_[j][interval.end_idx + 1] - sum_sq_[j][interval.start_idx];
+  }
+}
+
 template <typename _T>
   void extractIntervalsSamples ( const std::vector< TriadData_<_T> >& samples, 
                                  const std::vector< DataInterval >& intervals, 
                                  std::vector< TriadData_<_T> >& extracted_samples, 
                                  std::vector< DataInterval > &extracted_intervals,
-                                 int min_interval_n_samps, bool only_means )
+                                 int min_interval_n_samps, bool only_means,
+                                 const TriadStatsIndex_<_T> *stats_index )
 {
   // Check for valid intervals  (i.e., intervals with at least interval_n_samps samples)
-  std::cout << std::endl << std::endl << std::endl << std::endl << "Starting extractIntervalSamples!" << std::endl;
-  std::cout << "min number of sample to declare valid interval = " << min_interval_n_samps << std::endl;
+  IMU_TK_LOG_DEBUG( "Starting extractIntervalSamples!" );
+  IMU_TK_LOG_DEBUG( "min number of sample to declare valid interval = " << min_interval_n_samps );
 
-  std::cout << "number of intervals received = " << intervals.size() << std::endl;
+  IMU_TK_LOG_DEBUG( "number of intervals received = " << intervals.size() );
   int n_valid_intervals = 0, n_static_samples = 0;
   for( int i = 0; i < intervals.size(); i++)
   {
     int interval_size = intervals[i].end_idx - intervals[i].start_idx + 1;
-    std::cout << "size of interval num " << i << " = " << interval_size << std::endl;
+    IMU_TK_LOG_DEBUG( "size of interval num " << i << " = " << interval_size );
     if( interval_size >= min_interval_n_samps )
     {
       n_valid_intervals++;
       n_static_samples += interval_size;
     }
-    std::cout << "num of valid intervals = " << n_valid_intervals << std::endl;
-    std::cout << "num of valid static samples = " << n_static_samples << std::endl;
+    IMU_TK_LOG_TRACE( "num of valid intervals = " << n_valid_intervals );
+    IMU_TK_LOG_TRACE( "num of valid static samples = " << n_static_samples );
   }
   
   if( only_means )
@@ -455,8 +1322,8 @@ template <typename _T>
   extracted_samples.reserve(n_static_samples);
   extracted_intervals.reserve(n_valid_intervals);
   
-  std::cout << "Final num of valid intervals = " << n_valid_intervals << std::endl;
-  std::cout << "Final num of valid static samples = " << n_static_samples << std::endl;
+  IMU_TK_LOG_DEBUG( "Final num of valid intervals = " << n_valid_intervals );
+  IMU_TK_LOG_DEBUG( "Final num of valid static samples = " << n_static_samples );
 
   // For each valid interval, extract the samples
   for( int i = 0; i < intervals.size(); i++)
@@ -470,7 +1337,8 @@ template <typename _T>
         DataInterval mean_interval( intervals[i].start_idx, intervals[i].end_idx );
         // Take the timestamp centered in the interval where the mean is computed
         _T timestamp = samples[ intervals[i].start_idx + interval_size/2 ].timestamp();
-        Eigen::Matrix< _T, 3, 1> mean_val = dataMean ( samples, mean_interval );
+        Eigen::Matrix< _T, 3, 1> mean_val = stats_index ? stats_index->mean( mean_interval ) :
+                                                          dataMean ( samples, mean_interval );
         extracted_samples.push_back( TriadData_<_T>(timestamp, mean_val, i) );
       }
       else
@@ -482,6 +1350,60 @@ template <typename _T>
   }
 }
 
+template <typename _T>
+  void extractIntervalsSamples ( const TriadBuffer_<_T>& samples, 
+                                 const std::vector< DataInterval >& intervals, 
+                                 TriadBuffer_<_T>& extracted_samples, 
+                                 std::vector< DataInterval > &extracted_intervals,
+                                 int min_interval_n_samps, bool only_means,
+                                 const TriadStatsIndex_<_T> *stats_index )
+{
+  // Check for valid intervals  (i.e., intervals with at least interval_n_samps samples)
+  int n_valid_intervals = 0, n_static_samples = 0;
+  for( int i = 0; i < int(intervals.size()); i++)
+  {
+    int interval_size = intervals[i].end_idx - intervals[i].start_idx + 1;
+    if( interval_size >= min_interval_n_samps )
+    {
+      n_valid_intervals++;
+      n_static_samples += interval_size;
+    }
+  }
+  
+  if( only_means )
+    n_static_samples = n_valid_intervals;
+  
+  extracted_samples.clear();
+  extracted_intervals.clear();
+  extracted_samples.reserve(n_static_samples);
+  extracted_intervals.reserve(n_valid_intervals);
+
+  // For each valid interval, extract the samples
+  for( int i = 0; i < int(intervals.size()); i++)
+  {
+    int interval_size = intervals[i].end_idx - intervals[i].start_idx + 1;
+    if( interval_size >= min_interval_n_samps )
+    {
+      extracted_intervals.push_back( intervals[i] );
+      if( only_means )
+      {
+        DataInterval mean_interval( intervals[i].start_idx, intervals[i].end_idx );
+        // Take the timestamp centered in the interval where the mean is computed
+        _T timestamp = samples.timestamp( intervals[i].start_idx + interval_size/2 );
+        Eigen::Matrix< _T, 3, 1> mean_val = stats_index ? stats_index->mean( mean_interval ) :
+                                                          dataMean ( samples, mean_interval );
+        extracted_samples.push_back( timestamp, mean_val(0), mean_val(1), mean_val(2), i );
+      }
+      else
+      {
+        for(int j = intervals[i].start_idx; j <= intervals[i].end_idx; j++)
+          extracted_samples.push_back( samples.timestamp(j), samples.x(j), samples.y(j), 
+                                       samples.z(j), samples.interval_id(j) );
+      }
+    }
+  }
+}
+
 template <typename _T> void decomposeRotation( const Eigen::Matrix< _T, 3, 3> &rot_mat,
                                                Eigen::Matrix< _T, 3, 1> &rpy_rot_vec )
 {
@@ -0,0 +1,197 @@
+/* 
+ * imu_tk - Inertial Measurement Unit Toolkit
+ * 
+ *  Copyright (c) 2014, Alberto Pretto <pretto@diag.uniroma1.it>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ * 
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ * 
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <boost/shared_ptr.hpp>
+
+#include "imu_tk/base.h"
+#include "imu_tk/io_utils.h"
+#include "imu_tk/calibration.h"
+#include "imu_tk/calibration_report.h"
+
+namespace imu_tk
+{
+/** @brief Input data of a unit (i.e., an accelerometers and gyroscopes pair) to be
+ *         calibrated by a BatchCalibrator_: either the names of the data files or 
+ *         the data samples buffers */
+template <typename _T> struct BatchCalibrationUnit_
+{
+  /** @brief Name of the unit, used to name the calibration file */
+  std::string name;
+  /** @brief Accelerometers and gyroscopes data files, ASCII files (see importAsciiData() )
+   *         or binary files (see importBinaryData() ). If empty, the samples buffers are used */
+  std::string acc_filename, gyro_filename;
+  /** @brief Accelerometers and gyroscopes data samples, used if no file is provided */
+  TriadBuffer_<_T> acc_samples, gyro_samples;
+};
+
+/** @brief Result of the calibration of a single unit */
+template <typename _T> struct BatchCalibrationResult_
+{
+  BatchCalibrationResult_() : success(false){};
+  
+  std::string name;
+  /** @brief True if the unit has been successfully calibrated */
+  bool success;
+  /** @brief Error description, if the calibration failed */
+  std::string error;
+  /** @brief Name of the saved calibration file (see MultiPosCalibration_::save() ), 
+   *         empty if not saved */
+  std::string calib_filename;
+  CalibratedTriad_<_T> acc_calib, gyro_calib;
+  CalibrationReport report;
+};
+
+/** @brief Aggregate report of a batch calibration */
+template <typename _T> struct BatchCalibrationReport_
+{
+  BatchCalibrationReport_() : num_succeeded(0), num_failed(0){};
+  
+  /** @brief Results of the units, in the same order of BatchCalibrator_::units() */
+  std::vector< BatchCalibrationResult_<_T> > units;
+  int num_succeeded, num_failed;
+  /** @brief Overall time spent in the batch calibration (the CPU time includes 
+   *         the time of all the worker threads) */
+  StageTiming total;
+  
+  /** @brief Provides the report (including the CalibrationReport of each unit) 
+   *         as a JSON object */
+  std::string toJson() const;
+};
+
+/** @brief Calibrate the accelerometers and gyroscopes (see 
+ *         MultiPosCalibration_::calibrateAccGyro() ) of many units in parallel, 
+ *         using a pool of worker threads (see ThreadPool).
+ * 
+ * Each unit is calibrated by its own copy of a prototype MultiPosCalibration_ object 
+ * that holds the calibration settings, so nothing is shared between the 
+ * calibrations (the verbose output is disabled, and the log messages with a level 
+ * below LOG_LEVEL_WARNING are suppressed). The failure of a unit (e.g., a missing or 
+ * corrupted data file, an exception) is reported in its result and does not affect 
+ * the other units.
+ * 
+ * Unless explicitly set in the prototype, the parameters sweep and the uncertainty estimation
+ * of each unit (see SweepOptions::num_threads and UncertaintyOptions::num_threads) use a single 
+ * thread. The CPU times in the report of each unit are the ones of the worker thread 
+ * that calibrated the unit (see CPU_TIME_THREAD).
+ */
+template <typename _T> class BatchCalibrator_
+{
+public:
+  /** @brief Default constructor: default calibration settings, 
+   *         as many worker threads as the hardware threads */
+  BatchCalibrator_();
+  ~BatchCalibrator_(){};
+  
+  /** @brief Provides the prototype calibration object */
+  const MultiPosCalibration_<_T> &calibration() const { return *calibration_; };
+  
+  /** @brief Provides the number of worker threads (if less than 1, 
+   *         the number of hardware threads is used) */
+  int numThreads() const { return n_threads_; };
+  
+  /** @brief Provides the directory where the calibration files are saved */
+  const std::string &outputDirectory() const { return output_dir_; };
+  
+  /** @brief Provides the units to be calibrated */
+  const std::vector< BatchCalibrationUnit_<_T> > &units() const { return units_; };
+  
+  /** @brief Set the prototype calibration object, copied for each unit: the calibration
+   *         settings (initial guesses, gravity magnitude, solver options, ...) are 
+   *         taken from this object. It is recommended to use a single solver thread
+   *         for each unit (the default, see MultiPosCalibration_::setNumThreads() ), 
+   *         since the units are already calibrated in parallel */
+  void setCalibration( const MultiPosCalibration_<_T> &calibration )
+  { 
+    calibration_ = boost::shared_ptr< const MultiPosCalibration_<_T> >( 
+                     new MultiPosCalibration_<_T>( calibration ) ); 
+  };
+  
+  /** @brief Set the number of worker threads (if less than 1, the number of hardware 
+   *         threads is used). Default is 0. */
+  void setNumThreads( int n_threads ){ n_threads_ = n_threads; };
+  
+  /** @brief Set the timestamps unit and the format of the ASCII data files 
+   *         (see importAsciiData() ). Default is TIMESTAMP_UNIT_SEC, DATASET_COMMA_SEPARATED */
+  void setAsciiDataFormat( TimestampUnit unit, DatasetType type ){ unit_ = unit; type_ = type; };
+  
+  /** @brief Set the directory where the calibration file of each unit is saved, 
+   *         as "<unit name>.yaml". If empty (the default), the calibration file is saved
+   *         in the directory of the accelerometers data file (or not saved at all, 
+   *         if the unit data are provided as samples buffers) */
+  void setOutputDirectory( const std::string &dir ){ output_dir_ = dir; };
+  
+  /** @brief Add a unit to be calibrated, given the accelerometers and gyroscopes data files */
+  void addUnit( const std::string &name, const std::string &acc_filename, 
+                const std::string &gyro_filename );
+
+  /** @brief Add a unit to be calibrated, given the accelerometers and gyroscopes data samples 
+   *         (the buffers are shared, not copied, see TriadBuffer_) */
+  void addUnit( const std::string &name, const TriadBuffer_<_T> &acc_samples, 
+                const TriadBuffer_<_T> &gyro_samples );
+  
+  /** @brief Add all the units with the data files stored in a directory.
+   *         The accelerometers data files are the files with a name that contains 
+   *         acc_tag, the related gyroscopes data file has the same name with gyro_tag in 
+   *         place of acc_tag. The unit name is the file name without acc_tag and 
+   *         the extension (e.g., unit01_acc.txt and unit01_gyro.txt -> unit01 ). 
+   * 
+   * @return The number of units added, sorted by name
+   */
+  int addDirectory( const std::string &dir, const std::string &acc_tag = "_acc", 
+                    const std::string &gyro_tag = "_gyro" );
+  
+  /** @brief Remove all the units */
+  void clearUnits(){ units_.clear(); };
+  
+  /** @brief Calibrate all the units, and provide the aggregate report */
+  BatchCalibrationReport_<_T> calibrate() const;
+  
+private:
+  
+  void calibrateUnit( const BatchCalibrationUnit_<_T> &unit, 
+                      BatchCalibrationResult_<_T> &result ) const;
+  bool loadData( const std::string &filename, TriadBuffer_<_T> &samples ) const;
+  
+  boost::shared_ptr< const MultiPosCalibration_<_T> > calibration_;
+  int n_threads_;
+  TimestampUnit unit_;
+  DatasetType type_;
+  std::string output_dir_;
+  std::vector< BatchCalibrationUnit_<_T> > units_;
+};
+
+typedef BatchCalibrationUnit_<double> BatchCalibrationUnit;
+typedef BatchCalibrationResult_<double> BatchCalibrationResult;
+typedef BatchCalibrationReport_<double> BatchCalibrationReport;
+typedef BatchCalibrator_<double> BatchCalibrator;
+
+}
@@ -0,0 +1,400 @@
+/* 
+ * imu_tk - Inertial Measurement Unit Toolkit
+ * 
+ *  Copyright (c) 2014, Alberto Pretto <pretto@diag.uniroma1.it>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ * 
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ * 
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <map>
+#include <string>
+#include <limits>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <locale>
+#include <Eigen/Core>
+
+#include "imu_tk/base.h"
+
+namespace imu_tk
+{
+/** @brief Plain storage of the calibration parameters of a sensor triad (see CalibratedTriad_ 
+ *         for their meaning), that can be initialized at compile time, e.g. to embed 
+ *         the calibration of a specific device in a firmware:
+ * 
+ * constexpr TriadCalibrationParams_<float> acc_params( mis_yz, mis_zy, ..., b_z );
+ */
+template < typename _T > struct TriadCalibrationParams_
+{
+  constexpr TriadCalibrationParams_( _T mis_yz = _T(0), _T mis_zy = _T(0), _T mis_zx = _T(0), 
+                                     _T mis_xz = _T(0), _T mis_xy = _T(0), _T mis_yx = _T(0), 
+                                     _T s_x = _T(1),    _T s_y = _T(1),    _T s_z = _T(1), 
+                                     _T b_x = _T(0),    _T b_y = _T(0),    _T b_z = _T(0) ) :
+    mis_yz(mis_yz), mis_zy(mis_zy), mis_zx(mis_zx), mis_xz(mis_xz), mis_xy(mis_xy), mis_yx(mis_yx),
+    s_x(s_x), s_y(s_y), s_z(s_z), b_x(b_x), b_y(b_y), b_z(b_z) {};
+  
+  _T mis_yz, mis_zy, mis_zx, mis_xz, mis_xy, mis_yx;
+  _T s_x, s_y, s_z;
+  _T b_x, b_y, b_z;
+};
+
+typedef TriadCalibrationParams_<double> TriadCalibrationParams;
+
+/** @brief This object contains the calibration parameters (misalignment, scale factors, ...)
+ *         of a generic orthogonal sensor triad (accelerometers, gyroscopes, etc.)
+ * 
+ * Triad model:
+ *         
+ * -Misalignment matrix:
+ * 
+ * general case:
+ * 
+ *     [    1     -mis_yz   mis_zy  ]
+ * T = [  mis_xz     1     -mis_zx  ]
+ *     [ -mis_xy   mis_yx     1     ]
+ * 
+ * "body" frame spacial case:
+ * 
+ *     [  1     -mis_yz   mis_zy  ]
+ * T = [  0        1     -mis_zx  ]
+ *     [  0        0        1     ]
+ * 
+ * Scale matrix:
+ * 
+ *     [  s_x      0        0  ]
+ * K = [   0      s_y       0  ]
+ *     [   0       0       s_z ]
+ * 
+ * Bias vector:
+ * 
+ *     [ b_x ]
+ * B = [ b_y ]
+ *     [ b_z ]
+ * 
+ * Given a raw sensor reading X (e.g., the acceleration ), the calibrated "unbiased" reading X' is obtained
+ * 
+ * X' = T*K*(X - B)
+ * 
+ * with B the bias (variable) + offset (constant, possibbly 0), or, equivalently:
+ * 
+ * X' = T*K*X - B'
+ * 
+ * with B' = T*K*B
+ * 
+ * Without knowing the value of the bias (and with offset == 0), the calibrated reading X'' is simply:
+ * 
+ * X'' = T*K*X
+*/
+template < typename _T > class CalibratedTriad_
+{
+public:
+  /** @brief Basic "default" constructor: without any parameter, it initilizes the calibration parameter with 
+   *         default values (zero scaling factors and biases, identity misalignment matrix)
+   */
+  CalibratedTriad_( const _T &mis_yz = _T(0), const _T &mis_zy = _T(0), const _T &mis_zx = _T(0), 
+                    const _T &mis_xz = _T(0), const _T &mis_xy = _T(0), const _T &mis_yx = _T(0), 
+                    const _T &s_x = _T(1),    const _T &s_y = _T(1),    const _T &s_z = _T(1), 
+                    const _T &b_x = _T(0),    const _T &b_y = _T(0),    const _T &b_z  = _T(0) );
+ 
+  /** @brief Build the calibration from the plain parameters storage */
+  explicit CalibratedTriad_( const TriadCalibrationParams_<_T> &params ) :
+    CalibratedTriad_( params.mis_yz, params.mis_zy, params.mis_zx, params.mis_xz, 
+                      params.mis_xy, params.mis_yx, params.s_x, params.s_y, params.s_z, 
+                      params.b_x, params.b_y, params.b_z ) {};
+ 
+  ~CalibratedTriad_(){};
+               
+  inline _T misYZ() const { return -mis_mat_(0,1); };
+  inline _T misZY() const { return mis_mat_(0,2); };
+  inline _T misZX() const { return -mis_mat_(1,2); };
+  inline _T misXZ() const { return mis_mat_(1,0); };
+  inline _T misXY() const { return -mis_mat_(2,0); };
+  inline _T misYX() const { return mis_mat_(2,1); };
+
+  inline _T scaleX() const { return scale_mat_(0,0); };
+  inline _T scaleY() const { return scale_mat_(1,1); };
+  inline _T scaleZ() const { return scale_mat_(2,2); };
+      
+  inline _T biasX() const { return bias_vec_(0); };
+  inline _T biasY() const { return bias_vec_(1); };
+  inline _T biasZ() const { return bias_vec_(2); };
+  
+  /** @brief Provide the calibration parameters in the plain parameters storage */
+  inline TriadCalibrationParams_<_T> params() const
+  {
+    return TriadCalibrationParams_<_T>( misYZ(), misZY(), misZX(), misXZ(), misXY(), misYX(),
+                                        scaleX(), scaleY(), scaleZ(), biasX(), biasY(), biasZ() );
+  };
+  
+  inline const Eigen::Matrix< _T, 3 , 3>& getMisalignmentMatrix() const { return mis_mat_; };
+  inline const Eigen::Matrix< _T, 3 , 3>& getScaleMatrix() const { return scale_mat_; };
+  inline const Eigen::Matrix< _T, 3 , 1>& getBiasVector() const { return bias_vec_; };
+  /** @brief Provide the (precomputed) misalignment * scale matrix T*K */
+  inline const Eigen::Matrix< _T, 3 , 3>& getMisalignmentScaleMatrix() const { return ms_mat_; };
+
+  inline void setScale( const Eigen::Matrix< _T, 3 , 1> &s_vec ) 
+  { 
+    scale_mat_(0,0) = s_vec(0); scale_mat_(1,1) = s_vec(1);  scale_mat_(2,2) = s_vec(2); 
+    update();
+  };
+  
+  inline void setBias( const Eigen::Matrix< _T, 3 , 1> &b_vec ) 
+  { 
+    bias_vec_ = b_vec;
+    update();
+  };
+  
+  /** @brief Load the calibration parameters from a simple text file.
+   * 
+   * The file should containts a sequence of two, space separated 3X3 matrixes 
+   * (the misalignment and the scale matrix) followed by a 3x1 biases vector, or 
+   * the same parameters in the format written by save().
+   */
+  bool load( std::string filename );
+  
+  /** @brief Save the calibration parameters in a simple text file.
+   * 
+   * The file will containts a sequence of two, space separated 3X3 matrixes 
+   * (the misalignment and the scale matrix) followed by a 3x1 biases vector 
+   */
+  bool save( std::string filename ) const;
+
+  /** @brief Normalize a raw data X by correcting the misalignment and the scale,
+   *         i.e., by applying the equation  X'' = T*K*X
+   */
+  inline Eigen::Matrix< _T, 3 , 1> normalize( const Eigen::Matrix< _T, 3 , 1> &raw_data ) const
+  {
+    return ms_mat_*raw_data;
+  };
+  
+  /** @brief Normalize a raw data X by correcting the misalignment and the scale,
+   *         i.e., by applying the equation  X'' = T*K*X
+   */
+  inline TriadData_<_T> normalize( const TriadData_<_T> &raw_data ) const
+  {
+    return TriadData_<_T>( raw_data.timestamp(), normalize( raw_data.data()) );
+  };
+  
+  /** @brief Normalize a raw data X by removing the biases and 
+   *         correcting the misalignment and the scale, 
+   *         i.e., by applying the equation  X' = T*K*(X - B)
+   */
+  inline Eigen::Matrix< _T, 3 , 1> unbiasNormalize( const Eigen::Matrix< _T, 3 , 1> &raw_data ) const
+  {
+    return ms_mat_*(raw_data - bias_vec_); 
+  };
+  
+  /** @brief Normalize a raw data X by removing the biases and 
+   *         correcting the misalignment and the scale, 
+   *         i.e., by applying the equation  X' = T*K*(X - B)
+   */
+  inline TriadData_<_T> unbiasNormalize( const TriadData_<_T> &raw_data ) const
+  {
+    return TriadData_<_T>( raw_data.timestamp(), unbiasNormalize( raw_data.data()) );
+  };
+  
+  /** @brief Remove the biases from a raw data */
+  inline Eigen::Matrix< _T, 3 , 1> unbias( const Eigen::Matrix< _T, 3 , 1> &raw_data ) const
+  {
+    return raw_data - bias_vec_; 
+  };
+  
+  /** @brief Remove the biases from a raw data */
+  inline TriadData_<_T> unbias( const TriadData_<_T> &raw_data ) const
+  {
+    return TriadData_<_T>( raw_data.timestamp(), unbias( raw_data.data()) );
+  };
+  
+  //TODO: Make getters and turn these into private variables
+  /** @brief Misalignment matrix */
+  Eigen::Matrix< _T, 3 , 3> mis_mat_;
+  /** @brief Scale matrix */
+  Eigen::Matrix< _T, 3 , 3> scale_mat_;
+  /** @brief Bias vector */
+  Eigen::Matrix< _T, 3 , 1> bias_vec_;
+
+private:
+
+  /** @brief Update internal data (e.g., compute Misalignment * scale matrix) 
+   *         after a parameter is changed */
+  void update();
+  
+  /** @brief Misalignment * scale matrix */
+  Eigen::Matrix< _T, 3 , 3> ms_mat_;
+};
+
+typedef CalibratedTriad_<double> CalibratedTriad;
+
+/** @brief Generates a sequence of characters with a properly formatted 
+ *         representation of a CalibratedTriad_  instance (calib_triad), 
+ *         and inserts them into the output stream os. */
+template <typename _T> std::ostream& operator<<(std::ostream& os, 
+                                                const imu_tk::CalibratedTriad_<_T>& calib_triad);
+
+/** @brief Read the values stored in a calibration file as a sequence of "key: [ v0, v1, ... ]"
+ *         entries (see CalibratedTriad_::save() and MultiPosCalibration_::save() ).
+ *         The values not preceded by any key (e.g., a simple text file with 
+ *         space separated values) are stored with an empty key.
+ * 
+ * @return False if the file can't be opened
+ */
+inline bool readCalibrationValues( const std::string &filename, 
+                                   std::map< std::string, std::vector< double > > &values );
+
+}
+
+/* Implementations */
+
+inline bool imu_tk::readCalibrationValues( const std::string &filename, 
+                                           std::map< std::string, std::vector< double > > &values )
+{
+  values.clear();
+  std::ifstream file( filename.c_str() );
+  if( !file.is_open() )
+    return false;
+  
+  std::string token, key;
+  while( file >> token )
+  {
+    // Split the token in keys (ending with ':') and values, separated by brakets and commas
+    for( int i = 0; i < int(token.size()); i++ )
+      if( token[i] == '[' || token[i] == ']' || token[i] == ',' )
+        token[i] = ' ';
+    
+    std::istringstream token_stream( token );
+    std::string item;
+    while( token_stream >> item )
+    {
+      if( item[item.size() - 1] == ':' )
+      {
+        key = item.substr( 0, item.size() - 1 );
+        values[key];
+        continue;
+      }
+      std::istringstream value_stream( item );
+      value_stream.imbue( std::locale::classic() );
+      double value;
+      if( value_stream >> value && value_stream.eof() )
+        values[key].push_back( value );
+    }
+  }
+  return true;
+}
+
+template <typename _T> 
+  imu_tk::CalibratedTriad_<_T>::CalibratedTriad_( const _T &mis_yz, const _T &mis_zy, const _T &mis_zx, 
+                                                const _T &mis_xz, const _T &mis_xy, const _T &mis_yx, 
+                                                const _T &s_x, const _T &s_y, const _T &s_z, 
+                                                const _T &b_x, const _T &b_y, const _T &b_z )
+{
+  mis_mat_ <<  _T(1)   , -mis_yz  ,  mis_zy  ,
+                mis_xz ,  _T(1)   , -mis_zx  ,  
+               -mis_xy ,  mis_yx  ,  _T(1)   ;
+              
+  scale_mat_ <<   s_x  ,   _T(0)  ,  _T(0) ,
+                 _T(0) ,    s_y   ,  _T(0) ,  
+                 _T(0) ,   _T(0)  ,   s_z  ;
+                    
+  bias_vec_ <<  b_x , b_y , b_z ; 
+  
+  update();
+}
+
+template <typename _T> 
+  bool imu_tk::CalibratedTriad_<_T>::load( std::string filename )
+{
+  std::map< std::string, std::vector< double > > values;
+  if( !readCalibrationValues( filename, values ) )
+    return false;
+  
+  std::vector< double > mat;
+  if( values["misalign_matrix"].size() == 9 && values["escale_matrix"].size() == 9 &&
+      values["bias_vector"].size() == 3 )
+  {
+    // Format written by save()
+    mat = values["misalign_matrix"];
+    mat.insert( mat.end(), values["escale_matrix"].begin(), values["escale_matrix"].end() );
+    mat.insert( mat.end(), values["bias_vector"].begin(), values["bias_vector"].end() );
+  }
+  else
+    mat = values[""];
+  
+  if( mat.size() < 21 )
+    return false;
+  
+  mis_mat_ = Eigen::Map< const Eigen::Matrix< double, 3, 3, Eigen::RowMajor> >( &mat[0] ).template cast<_T>();
+  scale_mat_ = Eigen::Map< const Eigen::Matrix< double, 3, 3, Eigen::RowMajor> >( &mat[9] ).template cast<_T>();
+  bias_vec_ = Eigen::Map< const Eigen::Matrix< double, 3, 1> >( &mat[18] ).template cast<_T>();
+  
+  update();
+  
+  return true;
+}
+
+template <typename _T> 
+  bool imu_tk::CalibratedTriad_<_T>::save( std::string filename ) const
+{
+  std::ofstream file( filename.data() );
+  if (file.is_open())
+  {
+    // Enough digits to load back the same parameters
+    file.precision( std::numeric_limits<_T>::max_digits10 );
+    file<<"misalign_matrix: ["
+        << mis_mat_(0,0) << ", " << mis_mat_(0,1) << ", " << mis_mat_(0,2) << ", " << std::endl << "                      "
+        << mis_mat_(1,0) << ", " << mis_mat_(1,1) << ", " << mis_mat_(1,2) << ", " << std::endl << "                      "
+        << mis_mat_(2,0) << ", " << mis_mat_(2,1) << ", " << mis_mat_(2,2) << "]"
+        << std::endl     << std::endl
+        <<"escale_matrix: ["
+        << scale_mat_(0,0) << ", " << scale_mat_(0,1) << ", " << scale_mat_(0,2) << ", " << std::endl << "                    "
+        << scale_mat_(1,0) << ", " << scale_mat_(1,1) << ", " << scale_mat_(1,2) << ", " << std::endl << "                    "
+        << scale_mat_(2,0) << ", " << scale_mat_(2,1) << ", " << scale_mat_(2,2) << "]"
+        << std::endl     << std::endl
+        <<"bias_vector: ["
+        << bias_vec_(0) << ", " << bias_vec_(1) << ", " << bias_vec_(2) << "]"
+        <<std::endl<<std::endl;
+    
+    return true;
+  }
+  return false;  
+}
+
+template <typename _T> void imu_tk::CalibratedTriad_<_T>::update()
+{
+  ms_mat_ = mis_mat_*scale_mat_;
+}
+
+template <typename _T> std::ostream& imu_tk::operator<<(std::ostream& os, 
+                                                        const imu_tk::CalibratedTriad_<_T>& calib_triad)
+{
+  os<<"Misalignment Matrix"<<std::endl;
+  os<<calib_triad.getMisalignmentMatrix()<<std::endl;
+  os<<"Scale Matrix"<<std::endl;
+  os<<calib_triad.getScaleMatrix()<<std::endl;
+  os<<"Bias Vector"<<std::endl;
+  os<<calib_triad.getBiasVector()<<std::endl;
+  return os;
+}
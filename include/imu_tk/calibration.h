@@ -29,188 +29,149 @@
 #pragma once
 
 #include <vector>
+#include <map>
+#include <string>
+#include <limits>
 #include <iostream>
 #include <fstream>
 
 #include "imu_tk/base.h"
+#include "imu_tk/calibrated_triad.h"
+#include "imu_tk/filters.h"
+#include "imu_tk/calibration_report.h"
+#include "imu_tk/runtime_calibration.h"
+#include "imu_tk/hash.h"
+
+#include "ceres/types.h"
 
 namespace imu_tk
 {
-/** @brief This object contains the calibration parameters (misalignment, scale factors, ...)
- *         of a generic orthogonal sensor triad (accelerometers, gyroscopes, etc.)
- * 
- * Triad model:
- *         
- * -Misalignment matrix:
- * 
- * general case:
- * 
- *     [    1     -mis_yz   mis_zy  ]
- * T = [  mis_xz     1     -mis_zx  ]
- *     [ -mis_xy   mis_yx     1     ]
- * 
- * "body" frame spacial case:
- * 
- *     [  1     -mis_yz   mis_zy  ]
- * T = [  0        1     -mis_zx  ]
- *     [  0        0        1     ]
- * 
- * Scale matrix:
- * 
- *     [  s_x      0        0  ]
- * K = [   0      s_y       0  ]
- *     [   0       0       s_z ]
- * 
- * Bias vector:
- * 
- *     [ b_x ]
- * B = [ b_y ]
- *     [ b_z ]
- * 
- * Given a raw sensor reading X (e.g., the acceleration ), the calibrated "unbiased" reading X' is obtained
- * 
- * X' = T*K*(X - B)
- * 
- * with B the bias (variable) + offset (constant, possibbly 0), or, equivalently:
- * 
- * X' = T*K*X - B'
- * 
- * with B' = T*K*B
- * 
- * Without knowing the value of the bias (and with offset == 0), the calibrated reading X'' is simply:
- * 
- * X'' = T*K*X
-*/
-template < typename _T > class CalibratedTriad_
+/** @brief Method used to compute the Jacobians of the calibration cost functions */
+enum JacobianMode
 {
-public:
-  /** @brief Basic "default" constructor: without any parameter, it initilizes the calibration parameter with 
-   *         default values (zero scaling factors and biases, identity misalignment matrix)
-   */
-  CalibratedTriad_( const _T &mis_yz = _T(0), const _T &mis_zy = _T(0), const _T &mis_zx = _T(0), 
-                    const _T &mis_xz = _T(0), const _T &mis_xy = _T(0), const _T &mis_yx = _T(0), 
-                    const _T &s_x = _T(1),    const _T &s_y = _T(1),    const _T &s_z = _T(1), 
-                    const _T &b_x = _T(0),    const _T &b_y = _T(0),    const _T &b_z  = _T(0) );
- 
-  ~CalibratedTriad_(){};
-               
-  inline _T misYZ() const { return -mis_mat_(0,1); };
-  inline _T misZY() const { return mis_mat_(0,2); };
-  inline _T misZX() const { return -mis_mat_(1,2); };
-  inline _T misXZ() const { return mis_mat_(1,0); };
-  inline _T misXY() const { return -mis_mat_(2,0); };
-  inline _T misYX() const { return mis_mat_(2,1); };
-
-  inline _T scaleX() const { return scale_mat_(0,0); };
-  inline _T scaleY() const { return scale_mat_(1,1); };
-  inline _T scaleZ() const { return scale_mat_(2,2); };
-      
-  inline _T biasX() const { return bias_vec_(0); };
-  inline _T biasY() const { return bias_vec_(1); };
-  inline _T biasZ() const { return bias_vec_(2); };
-  
-  inline const Eigen::Matrix< _T, 3 , 3>& getMisalignmentMatrix() const { return mis_mat_; };
-  inline const Eigen::Matrix< _T, 3 , 3>& getScaleMatrix() const { return scale_mat_; };
-  inline const Eigen::Matrix< _T, 3 , 1>& getBiasVector() const { return bias_vec_; };
-    
-  inline void setScale( const Eigen::Matrix< _T, 3 , 1> &s_vec ) 
-  { 
-    scale_mat_(0,0) = s_vec(0); scale_mat_(1,1) = s_vec(1);  scale_mat_(2,2) = s_vec(2); 
-    update();
-  };
-  
-  inline void setBias( const Eigen::Matrix< _T, 3 , 1> &b_vec ) 
-  { 
-    bias_vec_ = b_vec;
-    update();
-  };
-  
-  /** @brief Load the calibration parameters from a simple text file.
-   * 
-   * The file should containts a sequence of two, space separated 3X3 matrixes 
-   * (the misalignment and the scale matrix) followed by a 3x1 biases vector (see the load()
-   * function)
-   */
-  bool load( std::string filename );
-  
-  /** @brief Save the calibration parameters in a simple text file.
-   * 
-   * The file will containts a sequence of two, space separated 3X3 matrixes 
-   * (the misalignment and the scale matrix) followed by a 3x1 biases vector 
-   */
-  bool save( std::string filename ) const;
+  /** Automatic differentiation (ceres::AutoDiffCostFunction) */
+  JACOBIAN_AUTODIFF,
+  /** Hand-derived, closed-form Jacobians */
+  JACOBIAN_ANALYTIC
+};
 
-  /** @brief Normalize a raw data X by correcting the misalignment and the scale,
-   *         i.e., by applying the equation  X'' = T*K*X
-   */
-  inline Eigen::Matrix< _T, 3 , 1> normalize( const Eigen::Matrix< _T, 3 , 1> &raw_data ) const
-  {
-    return ms_mat_*raw_data;
-  };
-  
-  /** @brief Normalize a raw data X by correcting the misalignment and the scale,
-   *         i.e., by applying the equation  X'' = T*K*X
-   */
-  inline TriadData_<_T> normalize( const TriadData_<_T> &raw_data ) const
-  {
-    return TriadData_<_T>( raw_data.timestamp(), normalize( raw_data.data()) );
-  };
-  
-  /** @brief Normalize a raw data X by removing the biases and 
-   *         correcting the misalignment and the scale, 
-   *         i.e., by applying the equation  X' = T*K*(X - B)
-   */
-  inline Eigen::Matrix< _T, 3 , 1> unbiasNormalize( const Eigen::Matrix< _T, 3 , 1> &raw_data ) const
-  {
-    return ms_mat_*(raw_data - bias_vec_); 
-  };
-  
-  /** @brief Normalize a raw data X by removing the biases and 
-   *         correcting the misalignment and the scale, 
-   *         i.e., by applying the equation  X' = T*K*(X - B)
-   */
-  inline TriadData_<_T> unbiasNormalize( const TriadData_<_T> &raw_data ) const
-  {
-    return TriadData_<_T>( raw_data.timestamp(), unbiasNormalize( raw_data.data()) );
-  };
-  
-  /** @brief Remove the biases from a raw data */
-  inline Eigen::Matrix< _T, 3 , 1> unbias( const Eigen::Matrix< _T, 3 , 1> &raw_data ) const
-  {
-    return raw_data - bias_vec_; 
-  };
-  
-  /** @brief Remove the biases from a raw data */
-  inline TriadData_<_T> unbias( const TriadData_<_T> &raw_data ) const
-  {
-    return TriadData_<_T>( raw_data.timestamp(), unbias( raw_data.data()) );
-  };
-  
-  //TODO: Make getters and turn these into private variables
-  /** @brief Misalignment matrix */
-  Eigen::Matrix< _T, 3 , 3> mis_mat_;
-  /** @brief Scale matrix */
-  Eigen::Matrix< _T, 3 , 3> scale_mat_;
-  /** @brief Bias vector */
-  Eigen::Matrix< _T, 3 , 1> bias_vec_;
+/** @brief Options of the non-linear least squares solver (see ceres::Solver::Options) used 
+ *         in the accelerometers and gyroscopes calibrations. The defaults are the Ceres ones,
+ *         except for the linear solver (DENSE_QR) */
+struct SolverOptions
+{
+  SolverOptions() :
+    num_threads(1),
+    linear_solver_type(ceres::DENSE_QR),
+    trust_region_strategy_type(ceres::LEVENBERG_MARQUARDT),
+    max_num_iterations(50),
+    function_tolerance(1e-6),
+    gradient_tolerance(1e-10),
+    parameter_tolerance(1e-8){};
+  
+  /** Number of threads used to evaluate the residuals and the Jacobians. If less than 1, 
+   *  the number of hardware threads is used */
+  int num_threads;
+  ceres::LinearSolverType linear_solver_type;
+  ceres::TrustRegionStrategyType trust_region_strategy_type;
+  int max_num_iterations;
+  double function_tolerance;
+  double gradient_tolerance;
+  double parameter_tolerance;
+};
 
-private:
+/** @brief Settings of the accelerometers calibration parameters sweep (see 
+ *         MultiPosCalibration_::enableParameterSweep() ). The empty grids use the 
+ *         current setting of the calibration object */
+struct SweepOptions
+{
+  SweepOptions() :
+    num_random_settings(0),
+    num_init_guesses(1),
+    init_perturbation(0.05),
+    seed(0),
+    num_threads(0){};
+  
+  /** Minimum number of samples of the static intervals (see 
+   *  MultiPosCalibration_::setMinIntervalNumSamples() ) */
+  std::vector< int > min_interval_n_samples;
+  /** Accelerometers calibration modes: with the means of the static intervals or 
+   *  with all their samples (see MultiPosCalibration_::enableAccUseMeans() ) */
+  std::vector< bool > acc_use_means;
+  /** Multipliers of the variance magnitude of the initial static interval, used as 
+   *  thresholds with the variance-based static intervals detection. If empty, 
+   *  the multipliers from 2 to 10 are used */
+  std::vector< double > threshold_multipliers;
+  /** If greater than 0, only num_random_settings settings (randomly drawn from the grid) 
+   *  are tried, otherwise all the settings of the grid */
+  int num_random_settings;
+  /** Number of initial guesses tried for each setting: the first one is the accelerometers
+   *  initial guess calibration, the others are random perturbations of it */
+  int num_init_guesses;
+  /** Maximum relative perturbation of the scale factors of the initial guesses. The biases are 
+   *  perturbed up to init_perturbation times the gravity magnitude, the misalignments up to 
+   *  init_perturbation radians */
+  double init_perturbation;
+  /** Seed of the random settings and initial guesses */
+  unsigned int seed;
+  /** Number of threads used to run the settings and the initial guesses concurrently. If less
+   *  than 1, the number of hardware threads is used */
+  int num_threads;
+};
 
-  /** @brief Update internal data (e.g., compute Misalignment * scale matrix) 
-   *         after a parameter is changed */
-  void update();
-  
-  /** @brief Misalignment * scale matrix */
-  Eigen::Matrix< _T, 3 , 3> ms_mat_;
+/** @brief Resampling method of the static intervals used to estimate the uncertainty of the
+ *         calibration parameters (see UncertaintyOptions) */
+enum ResamplingMethod
+{
+  /** Bootstrap: each replica uses as many static intervals as the calibration, 
+   *  drawn with replacement */
+  RESAMPLING_BOOTSTRAP,
+  /** Jackknife: each replica leaves out one static interval */
+  RESAMPLING_JACKKNIFE
 };
 
-typedef CalibratedTriad_<double> CalibratedTriad;
+/** @brief Settings of the uncertainty estimation of the calibration parameters (see 
+ *         MultiPosCalibration_::enableUncertaintyEstimation() ) */
+struct UncertaintyOptions
+{
+  UncertaintyOptions() :
+    method(RESAMPLING_BOOTSTRAP),
+    num_replicas(100),
+    seed(0),
+    num_threads(0){};
+  
+  ResamplingMethod method;
+  /** Number of bootstrap replicas (the jackknife uses one replica for each static interval) */
+  int num_replicas;
+  /** Seed of the bootstrap resampling */
+  unsigned int seed;
+  /** Number of threads used to solve the replicas concurrently. If less than 1, 
+   *  the number of hardware threads is used */
+  int num_threads;
+};
 
-/** @brief Generates a sequence of characters with a properly formatted 
- *         representation of a CalibratedTriad_  instance (calib_triad), 
- *         and inserts them into the output stream os. */
-template <typename _T> std::ostream& operator<<(std::ostream& os, 
-                                                const imu_tk::CalibratedTriad_<_T>& calib_triad);
+/** @brief Standard deviations of the calibration parameters of a sensor triad 
+ *         (see CalibratedTriad_), estimated by resampling the static intervals */
+template <typename _T> struct TriadUncertainty_
+{
+  TriadUncertainty_() :
+    num_replicas(0),
+    mis_mat_std( Eigen::Matrix< _T, 3, 3>::Zero() ),
+    scale_std( Eigen::Matrix< _T, 3, 1>::Zero() ),
+    bias_std( Eigen::Matrix< _T, 3, 1>::Zero() ){};
+  
+  /** @brief True if the uncertainty has been estimated */
+  bool valid() const { return num_replicas > 0; };
+  
+  /** Number of replicas used in the estimation */
+  int num_replicas;
+  /** Standard deviations of the misalignment matrix entries */
+  Eigen::Matrix< _T, 3, 3> mis_mat_std;
+  /** Standard deviations of the scale factors */
+  Eigen::Matrix< _T, 3, 1> scale_std;
+  /** Standard deviations of the biases */
+  Eigen::Matrix< _T, 3, 1> bias_std;
+};
 
 /** @brief This object enables to calibrate an accelerometers triad and eventually
  *         a related gyroscopes triad (i.e., to estimate theirs misalignment matrix, 
@@ -238,11 +199,19 @@ public:
 
 
   /** @brief Provides the duration in seconds of the initial static interval */
-  //_T initStaticIntervalDuration() const { return init_interval_duration_; };
+  _T initStaticIntervalDuration() const { return init_interval_duration_; };
   
   /** @brief Provides the number of data samples to be extracted from each detected static intervals */
   //int intarvalsNumSamples() const { return interval_n_samples_; };
   
+  /** @brief Provides the minimum number of samples of the static intervals used 
+   *         in the calibration */
+  int minIntervalNumSamples() const { return min_interval_n_samples_; };
+  
+  /** @brief Provides the minimum number of static intervals required by the 
+   *         accelerometers calibration */
+  int minNumIntervals() const { return min_num_intervals_; };
+  
   /** @brief Provides the accelerometers initial guess calibration parameters */
   const CalibratedTriad_<_T>& initAccCalibration(){ return init_acc_calib_; };
   
@@ -253,6 +222,14 @@ public:
    *         accelerations of each static interval instead of all samples */
   bool accUseMeans() const { return acc_use_means_; };
   
+  /** @brief True if the residuals of all the accelerometers static samples are 
+   *         evaluated by a single, batched cost function */
+  bool accBatchedResidual() const { return acc_batched_residual_; };
+  
+  /** @brief True if the static intervals are automatically detected from the local 
+   *         variance of the accelerometers signal, instead of using the interval ids */
+  bool varianceIntervalsDetection() const { return variance_intervals_detection_; };
+  
   /** @brief Provides the (fixed) data period used in the gyroscopes integration. 
    *         If this period is less than 0, the gyroscopes timestamps are used
    *         in place of this period. */  
@@ -263,6 +240,46 @@ public:
    *         period) are assumed known. */ 
   bool optimizeGyroBias() const { return optimize_gyro_bias_; };
   
+  /** @brief True if the gyroscopes samples are aligned in time to the accelerometers samples 
+   *         before the gyroscopes calibration (see enableTimeAlignment() ) */
+  bool timeAlignment() const { return time_alignment_; };
+  
+  /** @brief Provides the maximum absolute time offset between the gyroscopes 
+   *         and the accelerometers timestamps, used in the time alignment */
+  _T maxTimeOffset() const { return max_time_offset_; };
+  
+  /** @brief Provides the time offset added to the gyroscopes timestamps by the last 
+   *         time alignment, 0 if the time alignment is not enabled */
+  _T timeOffset() const { return time_offset_; };
+  
+  /** @brief True if the accelerometers calibration is obtained by a parameters sweep 
+   *         (see enableParameterSweep() ) */
+  bool parameterSweep() const { return parameter_sweep_; };
+  
+  /** @brief Provides the settings of the parameters sweep */
+  const SweepOptions &sweepOptions() const { return sweep_options_; };
+  
+  /** @brief True if the uncertainty of the calibration parameters is estimated 
+   *         (see enableUncertaintyEstimation() ) */
+  bool uncertaintyEstimation() const { return uncertainty_estimation_; };
+  
+  /** @brief Provides the settings of the uncertainty estimation */
+  const UncertaintyOptions &uncertaintyOptions() const { return uncertainty_options_; };
+  
+  /** @brief Provides the directory of the results cache (see setResultCacheDir() ), 
+   *         empty if the cache is not used */
+  const std::string &resultCacheDir() const { return result_cache_dir_; };
+  
+  /** @brief True if the results of the last calibration have been loaded from the results 
+   *         cache (see setResultCacheDir() ) */
+  bool resultFromCache() const { return result_from_cache_; };
+  
+  /** @brief Provides the method used to compute the Jacobians of the cost functions */
+  JacobianMode jacobianMode() const { return jacobian_mode_; };
+  
+  /** @brief Provides the options of the non-linear least squares solver */
+  const SolverOptions &solverOptions() const { return solver_options_; };
+  
   /** @brief True if the verbose output is enabled */ 
   bool verboseOutput() const { return verbose_output_; };
   
@@ -275,13 +292,23 @@ public:
    */
   void setGravityMagnitude( _T g ){ g_mag_ = g; };
   
-  /** @brief Set the duration in seconds of the initial static interval. Default 30 seconds. */
-  //_T setInitStaticIntervalDuration( _T duration ) { init_interval_duration_ = duration; };
+  /** @brief Set the duration in seconds of the initial static interval, used with the 
+   *         variance-based static intervals detection (see enableVarianceIntervalsDetection()). 
+   *         Default 30 seconds. */
+  void setInitStaticIntervalDuration( _T duration ) { init_interval_duration_ = duration; };
   
   /** @brief Set the number of data samples to be extracted from each detected static intervals.
    *         Default is 100.  */
   //int setIntarvalsNumSamples( int num ) { interval_n_samples_ = num; };
   
+  /** @brief Set the minimum number of samples of the static intervals used in the 
+   *         calibration: shorter intervals are discarded. Default is 100. */
+  void setMinIntervalNumSamples( int num ){ min_interval_n_samples_ = num; };
+  
+  /** @brief Set the minimum number of static intervals required by the accelerometers 
+   *         calibration: with less intervals, the calibration fails. Default is 12. */
+  void setMinNumIntervals( int num ){ min_num_intervals_ = num; };
+  
   /** @brief Set the accelerometers initial guess calibration parameters */  
   void setInitAccCalibration( CalibratedTriad_<_T> &init_calib ){ init_acc_calib_ = init_calib; };
   
@@ -294,6 +321,26 @@ public:
    */
   void enableAccUseMeans ( bool enabled ){ acc_use_means_ = enabled; };
   
+  /** @brief If the parameter enabled is true, the residuals of all the accelerometers
+   *         static samples are evaluated by a single cost function, in a vectorized way and 
+   *         with closed-form Jacobians (i.e., the Jacobian mode is not considered), in place
+   *         of one residual block for each sample. Recommended for large datasets.
+   *         Default is false.
+   */
+  void enableAccBatchedResidual ( bool enabled ){ acc_batched_residual_ = enabled; };
+  
+  /** @brief If the parameter enabled is true, the static intervals are automatically 
+   *         detected by the variance-based staticIntervalsDetector(), instead of using the 
+   *         interval ids of the accelerometers samples. The threshold is a multiple (from 2 to 10) 
+   *         of the variance magnitude in the initial static interval (i.e., the first 
+   *         initStaticIntervalDuration() seconds): the calibration is performed for each 
+   *         multiple, keeping the one with the minimum residual. The initial static interval 
+   *         is also used to compute the gyroscopes biases. It is not used by the calibrations from
+   *         a TriadDataSource_ and by the incremental calibrations, which always use the interval ids.
+   *         Default is false.
+   */
+  void enableVarianceIntervalsDetection ( bool enabled ){ variance_intervals_detection_ = enabled; };
+  
   /** @brief Set the (fixed) data period used in the gyroscopes integration. 
    *         If this period is less than 0, the gyroscopes timestamps are used
    *         in place of this period. Default is -1.
@@ -305,7 +352,95 @@ public:
    *         (computed in the initial static period) are assumed known. */ 
   bool enableGyroBiasOptimization( bool enabled  ) { optimize_gyro_bias_ = enabled; };
   
-  /** @brief If the parameter enabled is true, verbose output is activeted  */   
+  /** @brief If the parameter enabled is true, calibrateAccGyro() estimates the time offset 
+   *         between the gyroscopes and the accelerometers timestamps and resamples the 
+   *         gyroscopes onto the accelerometers timestamps (see alignGyroToAcc() ), for sensors
+   *         that timestamp the two triads independently (e.g., with different rates, offsets 
+   *         or jitter). The calibrated gyroscopes samples (see getCalibGyroSamples() ) are then 
+   *         the resampled ones. Not used by the calibrations from a TriadDataSource_.
+   *         Default is false.
+   */
+  void enableTimeAlignment( bool enabled ){ time_alignment_ = enabled; };
+  
+  /** @brief Set the maximum absolute time offset (in seconds) between the gyroscopes 
+   *         and the accelerometers timestamps, used in the time alignment. Default is 1 */
+  void setMaxTimeOffset( _T max_offset ){ max_time_offset_ = max_offset; };
+  
+  /** @brief If the parameter enabled is true, calibrateAcc() and calibrateAccGyro() run the
+   *         accelerometers calibration for each setting of a grid (the minimum number of samples 
+   *         of the static intervals, the use of the means and, with the variance-based 
+   *         detection, the threshold multiplier, see SweepOptions) and for several initial 
+   *         guesses, concurrently on a thread pool, keeping the solution with the minimum cost.
+   * 
+   * The input data and the intervals statistics are shared by all the runs, the static 
+   * intervals are detected once for each threshold, and the samples are extracted once for 
+   * each setting. Since the settings change the number of residuals, the cost used to compare
+   * the solutions is the mean squared residual of the calibrated means of the static intervals. 
+   * Each problem is solved with a single solver thread, and the stage timings of the report are 
+   * the wall times of the (parallel) detection, extraction and solve phases. Not used by 
+   * the calibrations from a TriadDataSource_ and by the incremental calibrations.
+   * Default is false.
+   */
+  void enableParameterSweep( bool enabled ){ parameter_sweep_ = enabled; };
+  
+  /** @brief Set the settings of the parameters sweep (see SweepOptions) */
+  void setSweepOptions( const SweepOptions &options ){ sweep_options_ = options; };
+  
+  /** @brief If the parameter enabled is true, calibrateAcc() and calibrateAccGyro() also estimate 
+   *         the standard deviations of the calibration parameters (see getAccUncertainty() and 
+   *         getGyroUncertainty() ), by resampling the static intervals (see UncertaintyOptions).
+   * 
+   * For each replica, the accelerometers calibration is solved again with the resampled static 
+   * intervals, using their means or all their samples as the calibration does (see 
+   * enableAccUseMeans() ), and the gyroscopes calibration with the motion intervals that 
+   * follow them (using the gravity versors given by the replica accelerometers calibration). 
+   * The replicas start from the estimated parameters, share the input samples and the 
+   * unbiased gyroscopes samples, and are solved concurrently on a thread pool. Without the 
+   * means, each replica solves a problem as large as the calibration one. 
+   * Not used by the calibrations from a TriadDataSource_ and by the incremental calibrations.
+   * Default is false.
+   */
+  void enableUncertaintyEstimation( bool enabled ){ uncertainty_estimation_ = enabled; };
+  
+  /** @brief Set the settings of the uncertainty estimation (see UncertaintyOptions) */
+  void setUncertaintyOptions( const UncertaintyOptions &options ){ uncertainty_options_ = options; };
+  
+  /** @brief Set the directory of an on-disk results cache used by calibrateAccGyro(), or an empty 
+   *         string to disable the cache. Default is empty.
+   * 
+   * The results (the accelerometers and gyroscopes calibrations, the static intervals and 
+   * their statistics, the time offset and the uncertainties) are stored in a file named after a hash of 
+   * the input samples and of all the calibration settings (see resultCacheFile() ). If the file 
+   * already exists, the calibration loads the results and skips the intervals detection and 
+   * the optimizations; the report then only provides the number of samples and the total time.
+   * The directory must exist. Not used by the calibrations from a TriadDataSource_ and by the 
+   * incremental calibrations.
+   */
+  void setResultCacheDir( const std::string &dir ){ result_cache_dir_ = dir; };
+  
+  /** @brief Provides the results cache file of a calibrateAccGyro() call with the current settings
+   *         (see setResultCacheDir() ), given the hashes of the acceleremoters and gyroscopes samples 
+   *         (see samplesHash(), or the hashes computed by importAsciiData() ) */
+  std::string resultCacheFile( uint64_t acc_samples_hash, uint64_t gyro_samples_hash ) const;
+  
+  /** @brief Set the method used to compute the Jacobians of the cost functions: 
+   *         automatic differentiation (JACOBIAN_AUTODIFF) or closed-form, 
+   *         hand-derived Jacobians (JACOBIAN_ANALYTIC). Default is JACOBIAN_AUTODIFF.
+   */
+  void setJacobianMode( JacobianMode mode ){ jacobian_mode_ = mode; };
+  
+  /** @brief Set the options of the non-linear least squares solver (see SolverOptions) */
+  void setSolverOptions( const SolverOptions &options ){ solver_options_ = options; };
+  
+  /** @brief Set the number of threads used by the solver to evaluate the residuals 
+   *         (if less than 1, the number of hardware threads is used). Default is 1. 
+   *         With the batched accelerometers residual (see enableAccBatchedResidual()), 
+   *         the static samples are split into num_threads residual blocks. */
+  void setNumThreads( int num_threads ){ solver_options_.num_threads = num_threads; };
+  
+  /** @brief If the parameter enabled is true, verbose output is activeted 
+   *         (i.e., during the calibration also the LOG_LEVEL_DEBUG messages are logged, 
+   *         see imu_tk/log.h) */   
   void enableVerboseOutput( bool enabled ){ verbose_output_ = enabled; };
   
   /** @brief Estimate the calibration parameters for the acceleremoters triad 
@@ -329,6 +464,48 @@ public:
   bool calibrateAccGyro( const std::vector< TriadData_<_T> > &acc_samples, 
                          const std::vector< TriadData_<_T> > &gyro_samples );
 
+  /** @brief Same as calibrateAcc(), with the acceleremoters data stored in a 
+   *         data samples buffer (see TriadBuffer_) 
+   */
+  bool calibrateAcc( const TriadBuffer_<_T> &acc_samples );
+  
+  /** @brief Same as calibrateAccGyro(), with the acceleremoters and gyroscopes data 
+   *         stored in data samples buffers (see TriadBuffer_) 
+   */
+  bool calibrateAccGyro( const TriadBuffer_<_T> &acc_samples, 
+                         const TriadBuffer_<_T> &gyro_samples );
+  
+  /** @brief Same as calibrateAccGyro( const TriadBuffer_<_T> &, const TriadBuffer_<_T> & ), 
+   *         with the hashes of the acceleremoters and gyroscopes samples already computed 
+   *         (e.g., by importAsciiData() ), used to find the results cache file 
+   *         (see setResultCacheDir() ) without hashing the samples again
+   */
+  bool calibrateAccGyro( const TriadBuffer_<_T> &acc_samples, 
+                         const TriadBuffer_<_T> &gyro_samples,
+                         uint64_t acc_samples_hash, uint64_t gyro_samples_hash );
+  
+  /** @brief Same as calibrateAcc(), reading the acceleremoters data sequentially from
+   *         a data source (e.g., an AsciiDataReader_), in chunks of chunk_size samples
+   * 
+   * The static intervals are detected while reading the data, and only their statistics
+   * (and their samples, if the means are not used, see enableAccUseMeans()) are stored.
+   * The calibrated data vector is not computed, i.e. getCalibAccSamples() provides
+   * an empty vector.
+   */
+  bool calibrateAcc( TriadDataSource_<_T> &acc_source, int chunk_size = 65536 );
+  
+  /** @brief Same as calibrateAccGyro(), reading the acceleremoters and gyroscopes data 
+   *         sequentially from two data sources, in chunks of chunk_size samples
+   * 
+   * As for calibrateAcc( TriadDataSource_<_T> &, int ), only the statistics of the 
+   * static intervals are stored, along with the gyroscopes samples
+   * between each pair of consecutive static intervals. The calibrated data vectors are
+   * not computed.
+   */
+  bool calibrateAccGyro( TriadDataSource_<_T> &acc_source, 
+                         TriadDataSource_<_T> &gyro_source,
+                         int chunk_size = 65536 );
+
   /** @brief Provide the calibration parameters for the acceleremoters triad (it should be called after
    *         calibrateAcc() or calibrateAccGyro() ) */
   const CalibratedTriad_<_T>& getAccCalib() const  { return acc_calib_; };
@@ -336,29 +513,178 @@ public:
    *         calibrateAccGyro() ). */
   const CalibratedTriad_<_T>& getGyroCalib() const  { return gyro_calib_; };
   
+  /** @brief Provide the standard deviations of the accelerometers calibration parameters 
+   *         (see enableUncertaintyEstimation() ). They are not valid if the uncertainty 
+   *         has not been estimated in the last calibration */
+  const TriadUncertainty_<_T>& getAccUncertainty() const  { return acc_uncertainty_; };
+  /** @brief Provide the standard deviations of the gyroscopes calibration parameters, 
+   *         as for getAccUncertainty() */
+  const TriadUncertainty_<_T>& getGyroUncertainty() const  { return gyro_uncertainty_; };
+  
+  /** @brief Provide a view of the calibrated acceleremoters data (it should be called after
+   *         calibrateAcc() or calibrateAccGyro() ): the samples are calibrated on access */
+  const CalibratedSamplesView_<_T>& getCalibAccSamplesView() const { return calib_acc_view_; };
+
+  /** @brief Provide a view of the calibrated gyroscopes data (it should be called after
+   *         calibrateAccGyro() ): the samples are calibrated on access */
+  const CalibratedSamplesView_<_T>& getCalibGyroSamplesView() const { return calib_gyro_view_; };
+  
   /** @brief Provide the calibrated acceleremoters data vector (it should be called after
-   *         calibrateAcc() or calibrateAccGyro() ) */
-  const std::vector< TriadData_<_T> >& getCalibAccSamples() const { return calib_acc_samples_; };
+   *         calibrateAcc() or calibrateAccGyro() ). 
+   * 
+   * The vector is computed from getCalibAccSamplesView() on the first call after 
+   * each calibration, and then kept up to the next calibration: it should not be called 
+   * concurrently from different threads. */
+  const std::vector< TriadData_<_T> >& getCalibAccSamples() const 
+  { 
+    return materializedSamples( calib_acc_view_, calib_acc_samples_ ); 
+  };
 
   /** @brief Provide the calibrated gyroscopes data vector (it should be called after
-   *         calibrateAccGyro() ) */
-  const std::vector< TriadData_<_T> >& getCalibGyroSamples() const { return calib_gyro_samples_; };
+   *         calibrateAccGyro() ), computed as for getCalibAccSamples() */
+  const std::vector< TriadData_<_T> >& getCalibGyroSamples() const 
+  { 
+    return materializedSamples( calib_gyro_view_, calib_gyro_samples_ ); 
+  };
+  
+  /** @brief Provide the timings and the counters of the last calibration (it should be called 
+   *         after calibrateAcc() or calibrateAccGyro() ), see CalibrationReport */
+  const CalibrationReport& getReport() const { return report_; };
 
-  /** @brief Save the calibration gyros and accelerometers parameters in a yaml file to be loaded from ros */
+  /** @brief Save the calibration gyros and accelerometers parameters in a yaml file to be loaded from ros.
+   *         If estimated, the standard deviations of the parameters are saved too, in the 
+   *         entries with the "_std" suffix (e.g., acc_bias_vector_std) */
   bool save( std::string filename ) const;
+  
+  /** @brief Load the calibration gyros and accelerometers parameters from a file written 
+   *         by save(). The loaded parameters are used as the initial guesses of the 
+   *         next calibrations (warm start, see setInitAccCalibration() and 
+   *         setInitGyroCalibration() ), and as the current calibration parameters.
+   * 
+   * @return False if the file can't be opened or it does not contain all the parameters
+   */
+  bool load( std::string filename );
+  
+  /** @brief Provides the maximum number of static intervals stored in the accelerometers 
+   *         intervals cache (see accIntervalsCache() ). If less than 1, all the intervals 
+   *         are stored. */
+  int maxCachedIntervals() const { return max_cached_intervals_; };
+  
+  /** @brief Set the maximum number of static intervals stored in the accelerometers 
+   *         intervals cache: when new intervals are added, the oldest ones are removed.
+   *         If less than 1, all the intervals are stored. Default is 0. */
+  void setMaxCachedIntervals( int num ){ max_cached_intervals_ = num; };
+  
+  /** @brief Provides the statistics (e.g., the means) of the static intervals used in the 
+   *         last accelerometers calibration. The cache is filled by calibrateAcc() and
+   *         calibrateAccGyro(), and extended by calibrateAccIncremental() */
+  const std::vector< IntervalStatistics_<_T> > &accIntervalsCache() const { return acc_intervals_cache_; };
+  
+  /** @brief Remove all the intervals from the accelerometers intervals cache */
+  void clearAccIntervalsCache(){ acc_intervals_cache_.clear(); };
+  
+  /** @brief Save the accelerometers intervals cache in a file */
+  bool saveAccIntervalsCache( std::string filename ) const;
+  
+  /** @brief Load the accelerometers intervals cache from a file written by 
+   *         saveAccIntervalsCache(), replacing the current content of the cache */
+  bool loadAccIntervalsCache( std::string filename );
+  
+  /** @brief Incrementally update the calibration parameters for the acceleremoters triad, 
+   *         given new acceleremoters data.
+   * 
+   * Only the new data is processed: the static intervals detected in acc_samples are added
+   * to the accelerometers intervals cache (see accIntervalsCache() ), and the calibration 
+   * is estimated using the means of all the cached intervals (as with enableAccUseMeans() ), 
+   * starting from the current calibration parameters (i.e., the last estimated ones or 
+   * the ones loaded with load() ), if any, or from the initial guess otherwise. 
+   * The intervals already in the cache (i.e., with the same timestamps, number of samples
+   * and mean, e.g. if the same data are provided again) are not added twice.
+   * The calibrated data vector is not computed.
+   * 
+   * @param acc_samples New acceleremoters data, ordered by increasing timestamps,
+   *                    collected at the sensor data rate. 
+   */
+  bool calibrateAccIncremental( const TriadBuffer_<_T> &acc_samples );
+  
+  /** @brief Same as calibrateAccIncremental(), reading the new acceleremoters data 
+   *         sequentially from a data source, in chunks of chunk_size samples */
+  bool calibrateAccIncremental( TriadDataSource_<_T> &acc_source, int chunk_size = 65536 );
 
 private:
   
+  bool calibrateAccSweep( const TriadBuffer_<_T> &acc_samples );
+  bool loadCachedResult( const std::string &filename, const TriadBuffer_<_T> &acc_samples,
+                         const TriadBuffer_<_T> &gyro_samples );
+  bool saveCachedResult( const std::string &filename ) const;
+  void writeAccIntervals( std::ostream &os ) const;
+  void setCalibAccSamples( const TriadBuffer_<_T> &acc_samples );
+  void intervalsStatistics( const TriadBuffer_<_T> &acc_samples, 
+                            const std::vector< DataInterval > &extracted_intervals,
+                            const TriadStatsIndex_<_T> &stats_index,
+                            std::vector< IntervalStatistics_<_T> > &intervals ) const;
+  bool calibrateAccStream( TriadDataSource_<_T> &acc_source, int chunk_size,
+                           std::vector< IntervalStatistics_<_T> > &valid_intervals );
+  bool calibrateGyro( const TriadBuffer_<_T> &acc_samples, const TriadBuffer_<_T> &gyro_samples );
+  bool updateAccCalibration( const std::vector< IntervalStatistics_<_T> > &new_intervals );
+  void estimateAccUncertainty( const TriadBuffer_<_T> &acc_samples, 
+                               const std::vector< IntervalStatistics_<_T> > &intervals,
+                               bool use_means );
+  void estimateGyroUncertainty( const TriadBuffer_<_T> &static_acc_means,
+                                const TriadBuffer_<_T> &unbiased_gyro_samples,
+                                const std::vector< DataInterval > &gyro_intervals,
+                                const Eigen::Matrix< _T, 3, 1> &gyro_bias );
+  int cacheAccIntervals( const std::vector< IntervalStatistics_<_T> > &intervals );
+  bool solveAccCalibration( const TriadBuffer_<_T> &static_samples, int n_static_intervals,
+                            const CalibratedTriad_<_T> &init_calib );
+  bool solveGyroCalibration( const std::vector< Eigen::Matrix< _T, 3, 1> > &g_versors,
+                             const TriadBuffer_<_T> &unbiased_gyro_samples,
+                             const std::vector< DataInterval > &gyro_intervals,
+                             const Eigen::Matrix< _T, 3, 1> &gyro_bias );
+  void clearCalibSamples();
+  static const std::vector< TriadData_<_T> >& 
+    materializedSamples( const CalibratedSamplesView_<_T> &view, std::vector< TriadData_<_T> > &samples )
+  {
+    if( int(samples.size()) != view.size() )
+      view.materialize( samples );
+    return samples;
+  };
+  
   _T g_mag_;
-  const int min_num_intervals_;
+  int min_num_intervals_;
+  _T init_interval_duration_;
   int min_interval_n_samples_;
   bool acc_use_means_;
+  bool acc_batched_residual_;
+  bool variance_intervals_detection_;
   _T gyro_dt_;
   bool optimize_gyro_bias_;
+  bool time_alignment_;
+  _T max_time_offset_, time_offset_;
+  bool parameter_sweep_;
+  SweepOptions sweep_options_;
   std::vector< DataInterval > min_cost_static_intervals_;
+  int min_cost_interval_n_samples_;
+  bool uncertainty_estimation_;
+  UncertaintyOptions uncertainty_options_;
+  /* Static intervals and motion intervals (i.e., pairs of consecutive static intervals) 
+   * of each replica, with the replicas accelerometers calibrations */
+  std::vector< std::vector< int > > replica_intervals_, replica_pairs_;
+  std::vector< CalibratedTriad_<_T> > acc_replicas_;
+  TriadUncertainty_<_T> acc_uncertainty_, gyro_uncertainty_;
+  std::string result_cache_dir_;
+  bool result_from_cache_;
   CalibratedTriad_<_T> init_acc_calib_, init_gyro_calib_;
   CalibratedTriad_<_T> acc_calib_, gyro_calib_;
-  std::vector< TriadData_<_T> > calib_acc_samples_, calib_gyro_samples_;
+  std::vector< IntervalStatistics_<_T> > acc_intervals_cache_;
+  int max_cached_intervals_;
+  bool has_acc_calib_;
+  CalibratedSamplesView_<_T> calib_acc_view_, calib_gyro_view_;
+  /* Calibrated samples computed on demand, see getCalibAccSamples() */
+  mutable std::vector< TriadData_<_T> > calib_acc_samples_, calib_gyro_samples_;
+  JacobianMode jacobian_mode_;
+  SolverOptions solver_options_;
+  CalibrationReport report_;
   
   bool verbose_output_;
 };
@@ -369,103 +695,14 @@ typedef MultiPosCalibration_<double> MultiPosCalibration;
 
 /* Implementations */
 
-template <typename _T> 
-  imu_tk::CalibratedTriad_<_T>::CalibratedTriad_( const _T &mis_yz, const _T &mis_zy, const _T &mis_zx, 
-                                                const _T &mis_xz, const _T &mis_xy, const _T &mis_yx, 
-                                                const _T &s_x, const _T &s_y, const _T &s_z, 
-                                                const _T &b_x, const _T &b_y, const _T &b_z )
-{
-  mis_mat_ <<  _T(1)   , -mis_yz  ,  mis_zy  ,
-                mis_xz ,  _T(1)   , -mis_zx  ,  
-               -mis_xy ,  mis_yx  ,  _T(1)   ;
-              
-  scale_mat_ <<   s_x  ,   _T(0)  ,  _T(0) ,
-                 _T(0) ,    s_y   ,  _T(0) ,  
-                 _T(0) ,   _T(0)  ,   s_z  ;
-                    
-  bias_vec_ <<  b_x , b_y , b_z ; 
-  
-  update();
-}
-
-template <typename _T> 
-  bool imu_tk::CalibratedTriad_<_T>::load( std::string filename )
-{
-  std::ifstream file( filename.data() );
-  if (file.is_open())
-  {
-    _T mat[9] = {0};
-    
-    for( int i=0; i<9; i++)
-      file >> mat[i];
-
-    mis_mat_ = Eigen::Map< const Eigen::Matrix< _T, 3, 3, Eigen::RowMajor> >(mat);
-      
-    for( int i=0; i<9; i++)
-      file >> mat[i];
-    
-    scale_mat_ = Eigen::Map< const Eigen::Matrix< _T, 3, 3, Eigen::RowMajor> >(mat);
-        
-    for( int i=0; i<3; i++)
-      file >> mat[i];
-    
-    bias_vec_ = Eigen::Map< const Eigen::Matrix< _T, 3, 1> >(mat);    
-    
-    update();
-    
-    return true;
-  }
-  return false;  
-}
-
-template <typename _T> 
-  bool imu_tk::CalibratedTriad_<_T>::save( std::string filename ) const
-{
-  std::ofstream file( filename.data() );
-  if (file.is_open())
-  {
-    file<<"misalign_matrix: ["
-        << mis_mat_(0,0) << ", " << mis_mat_(0,1) << ", " << mis_mat_(0,2) << ", " << std::endl << "                      "
-        << mis_mat_(1,0) << ", " << mis_mat_(1,1) << ", " << mis_mat_(1,2) << ", " << std::endl << "                      "
-        << mis_mat_(2,0) << ", " << mis_mat_(2,1) << ", " << mis_mat_(2,2) << "]"
-        << std::endl     << std::endl
-        <<"escale_matrix: ["
-        << scale_mat_(0,0) << ", " << scale_mat_(0,1) << ", " << scale_mat_(0,2) << ", " << std::endl << "                    "
-        << scale_mat_(1,0) << ", " << scale_mat_(1,1) << ", " << scale_mat_(1,2) << ", " << std::endl << "                    "
-        << scale_mat_(2,0) << ", " << scale_mat_(2,1) << ", " << scale_mat_(2,2) << "]"
-        << std::endl     << std::endl
-        <<"bias_vector: ["
-        << bias_vec_(0,0) << ", " << bias_vec_(0,1) << ", " << bias_vec_(0,2) << "]"
-        <<std::endl<<std::endl;
-    
-    return true;
-  }
-  return false;  
-}
-
-template <typename _T> void imu_tk::CalibratedTriad_<_T>::update()
-{
-  ms_mat_ = mis_mat_*scale_mat_;
-}
-
-template <typename _T> std::ostream& imu_tk::operator<<(std::ostream& os, 
-                                                        const imu_tk::CalibratedTriad_<_T>& calib_triad)
-{
-  os<<"Misalignment Matrix"<<std::endl;
-  os<<calib_triad.getMisalignmentMatrix()<<std::endl;
-  os<<"Scale Matrix"<<std::endl;
-  os<<calib_triad.getScaleMatrix()<<std::endl;
-  os<<"Bias Vector"<<std::endl;
-  os<<calib_triad.getBiasVector()<<std::endl;
-  return os;
-}
-
 template <typename _T>
   bool imu_tk::MultiPosCalibration_<_T>::save( std::string filename ) const
 {
   std::ofstream file( filename.data() );
   if (file.is_open())
   {
+    // Enough digits to load back the same parameters (see load() )
+    file.precision( std::numeric_limits<_T>::max_digits10 );
     imu_tk::CalibratedTriad_<_T> acc_calib  = this->getAccCalib();
     imu_tk::CalibratedTriad_<_T> gyro_calib = this->getGyroCalib();
 
@@ -495,6 +732,30 @@ template <typename _T>
         <<"gyro_bias_vector: ["
         << gyro_calib.bias_vec_(0) << ", " << gyro_calib.bias_vec_(1) << ", " << gyro_calib.bias_vec_(2) << "]"
         <<std::endl<<std::endl;
+    
+    const char *prefixes[2] = { "acc_", "gyro_" };
+    const imu_tk::TriadUncertainty_<_T> *uncertainty[2] = { &acc_uncertainty_, &gyro_uncertainty_ };
+    for( int i = 0; i < 2; i++ )
+    {
+      if( !uncertainty[i]->valid() )
+        continue;
+      const Eigen::Matrix< _T, 3, 3> &mis_std = uncertainty[i]->mis_mat_std;
+      const Eigen::Matrix< _T, 3, 1> &scale_std = uncertainty[i]->scale_std, 
+                                     &bias_std = uncertainty[i]->bias_std;
+      file<<prefixes[i]<<"misalign_matrix_std: ["
+          << mis_std(0,0) << ", " << mis_std(0,1) << ", " << mis_std(0,2) << ", "
+          << mis_std(1,0) << ", " << mis_std(1,1) << ", " << mis_std(1,2) << ", "
+          << mis_std(2,0) << ", " << mis_std(2,1) << ", " << mis_std(2,2) << "]"
+          << std::endl << std::endl
+          <<prefixes[i]<<"scale_factors_std: ["
+          << scale_std(0) << ", " << scale_std(1) << ", " << scale_std(2) << "]"
+          << std::endl << std::endl
+          <<prefixes[i]<<"bias_vector_std: ["
+          << bias_std(0) << ", " << bias_std(1) << ", " << bias_std(2) << "]"
+          << std::endl << std::endl
+          <<prefixes[i]<<"uncertainty_replicas: "<<uncertainty[i]->num_replicas
+          << std::endl << std::endl;
+    }
 
     return true;
   }
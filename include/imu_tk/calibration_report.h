@@ -0,0 +1,203 @@
+/* 
+ * imu_tk - Inertial Measurement Unit Toolkit
+ * 
+ *  Copyright (c) 2014, Alberto Pretto <pretto@diag.uniroma1.it>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ * 
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ * 
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <string>
+#include <chrono>
+
+namespace imu_tk
+{
+/** @brief The stages of a triad calibration, see CalibrationReport */
+enum CalibrationStage
+{
+  /** Static intervals detection (for the gyroscopes, detection of the initial 
+   *  static interval and biases estimation) */
+  STAGE_INTERVALS_DETECTION = 0,
+  /** Extraction of the samples used in the calibration */
+  STAGE_SAMPLES_EXTRACTION,
+  /** Construction of the non-linear least squares problem */
+  STAGE_PROBLEM_CONSTRUCTION,
+  /** Problem optimization (i.e., ceres::Solve()) */
+  STAGE_SOLVE,
+  /** Calibration of the input samples with the estimated parameters */
+  STAGE_SAMPLES_CALIBRATION,
+  
+  NUM_CALIBRATION_STAGES
+};
+
+/** @brief Provides the name of a calibration stage (e.g., "solve") */
+const char *calibrationStageName( CalibrationStage stage );
+
+/** @brief Wall time and CPU time (see CpuTimeClock) in seconds spent in a calibration stage */
+struct StageTiming
+{
+  StageTiming() : wall_time(0), cpu_time(0){};
+  
+  double wall_time;
+  double cpu_time;
+};
+
+/** @brief Statistics of an optimization problem and of its solution (see ceres::Solver::Summary) */
+struct SolverReport
+{
+  SolverReport() : 
+    num_residual_blocks(0), num_residuals(0), 
+    num_successful_steps(0), num_unsuccessful_steps(0),
+    num_residual_evaluations(-1), num_jacobian_evaluations(-1), 
+    initial_cost(0), final_cost(0), converged(false){};
+  
+  int num_residual_blocks;
+  int num_residuals;
+  int num_successful_steps;
+  int num_unsuccessful_steps;
+  /** Number of residuals and Jacobians evaluations, -1 if not provided by the solver */
+  int num_residual_evaluations;
+  int num_jacobian_evaluations;
+  double initial_cost;
+  double final_cost;
+  bool converged;
+};
+
+/** @brief Timings and counters of the calibration of a sensor triad */
+struct TriadCalibrationReport
+{
+  TriadCalibrationReport() : 
+    calibrated(false), num_samples(0), num_static_intervals(0), num_used_samples(0){};
+  
+  /** True if the calibration has been performed */
+  bool calibrated;
+  /** Number of input samples processed */
+  int num_samples;
+  /** Number of static intervals used in the calibration */
+  int num_static_intervals;
+  /** Number of samples used in the optimization problem (for the accelerometers, the static
+   *  samples or the static intervals means, for the gyroscopes the integrated samples) */
+  int num_used_samples;
+  StageTiming stages[NUM_CALIBRATION_STAGES];
+  SolverReport solver;
+};
+
+/** @brief Structured report filled by the calibration (see 
+ *         MultiPosCalibration_::getReport() ), with the time spent in each 
+ *         stage of the accelerometers and gyroscopes calibrations */
+struct CalibrationReport
+{
+  TriadCalibrationReport acc, gyro;
+  /** Overall time spent in the calibration */
+  StageTiming total;
+  
+  /** @brief Reset the report */
+  void clear() { *this = CalibrationReport(); };
+  
+  /** @brief Provides the report as a JSON object (the non-finite values are written as null) */
+  std::string toJson() const;
+  
+  /** @brief Save the report as a JSON object in a file */
+  bool saveJson( const std::string &filename ) const;
+};
+
+/** @brief Clocks used to measure the CPU time */
+enum CpuTimeClock
+{
+  /** CPU time of the whole process, i.e. of all its threads */
+  CPU_TIME_PROCESS = 0,
+  /** CPU time of the calling thread only */
+  CPU_TIME_THREAD
+};
+
+/** @brief Provides the current CPU time in seconds, measured with the given clock. Where 
+ *         clock_gettime() is not available, the process CPU time given by std::clock() is used 
+ *         for both the clocks */
+double cpuTime( CpuTimeClock clock );
+
+/** @brief Provides the clock used by the StageTimer objects created in the calling thread, 
+ *         i.e. the clock set by the innermost ScopedCpuTimeClock object, if any, 
+ *         or CPU_TIME_PROCESS otherwise */
+CpuTimeClock cpuTimeClock();
+
+/** @brief Set the CPU clock of the StageTimer objects created in the calling thread for  
+ *         the lifetime of the object, restoring the previous one on destruction (e.g., 
+ *         BatchCalibrator_ uses CPU_TIME_THREAD, since the units are calibrated concurrently) */
+class ScopedCpuTimeClock
+{
+public:
+  explicit ScopedCpuTimeClock( CpuTimeClock clock );
+  ~ScopedCpuTimeClock();
+  
+private:
+  ScopedCpuTimeClock( const ScopedCpuTimeClock & );
+  ScopedCpuTimeClock &operator=( const ScopedCpuTimeClock & );
+  
+  CpuTimeClock prev_clock_;
+};
+
+/** @brief Measure the wall and CPU time (see cpuTimeClock() ) elapsed between its construction 
+ *         and its destruction (or the call to stop() ), adding it to a StageTiming 
+ *         object or, if accumulate is false, replacing its content */
+class StageTimer
+{
+public:
+  explicit StageTimer( StageTiming &timing, bool accumulate = true ) :
+    timing_(timing), accumulate_(accumulate), running_(true), cpu_clock_(cpuTimeClock()),
+    wall_start_(std::chrono::steady_clock::now()), cpu_start_(cpuTime( cpu_clock_ )){};
+  ~StageTimer(){ stop(); };
+  
+  /** @brief Stop measuring the time (only the first call has effect) */
+  void stop()
+  {
+    if( !running_ )
+      return;
+    running_ = false;
+    double wall_time = std::chrono::duration<double>( std::chrono::steady_clock::now() - 
+                                                      wall_start_ ).count(),
+           cpu_time = cpuTime( cpu_clock_ ) - cpu_start_;
+    if( accumulate_ )
+    {
+      timing_.wall_time += wall_time;
+      timing_.cpu_time += cpu_time;
+    }
+    else
+    {
+      timing_.wall_time = wall_time;
+      timing_.cpu_time = cpu_time;
+    }
+  };
+  
+private:
+  StageTimer( const StageTimer & );
+  StageTimer &operator=( const StageTimer & );
+  
+  StageTiming &timing_;
+  bool accumulate_, running_;
+  CpuTimeClock cpu_clock_;
+  std::chrono::steady_clock::time_point wall_start_;
+  double cpu_start_;
+};
+
+}
@@ -0,0 +1,528 @@
+/* 
+ * imu_tk - Inertial Measurement Unit Toolkit
+ * 
+ *  Copyright (c) 2014, Alberto Pretto <pretto@diag.uniroma1.it>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ * 
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ * 
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <Eigen/Core>
+
+#include "imu_tk/base.h"
+#include "imu_tk/calibrated_triad.h"
+#include "imu_tk/integration.h"
+
+#include "ceres/ceres.h"
+#include "ceres/rotation.h"
+
+/* Cost functions of the multi-position calibration problems (see MultiPosCalibration_), 
+ * in both the automatic differentiation and the closed-form Jacobian versions. 
+ * This header is used by the calibration and by its tests, it is not included by imu_tk.h */
+
+namespace imu_tk
+{
+
+template <typename _T1> struct MultiPosAccResidual
+{
+  MultiPosAccResidual( const _T1 &g_mag, const Eigen::Matrix< _T1, 3 , 1> &sample ) :
+  g_mag_(g_mag),
+  sample_(sample){}
+  
+  template <typename _T2>
+    bool operator() ( const _T2* const params, _T2* residuals ) const
+  {
+    Eigen::Matrix< _T2, 3 , 1> raw_samp( _T2(sample_(0)), _T2(sample_(1)), _T2(sample_(2)) );
+    /* Assume body frame same as accelerometer frame, 
+     * so bottom left params in the misalignment matris are set to zero */
+    CalibratedTriad_<_T2> calib_triad( params[0], params[1], params[2], 
+                                     _T2(0), _T2(0), _T2(0),
+                                     params[3], params[4], params[5], 
+                                     params[6], params[7], params[8] );
+    
+    Eigen::Matrix< _T2, 3 , 1> calib_samp = calib_triad.unbiasNormalize( raw_samp );
+    residuals[0] = _T2 ( g_mag_ ) - calib_samp.norm();
+    return true;
+  }
+  
+  static ceres::CostFunction* Create ( const _T1 &g_mag, const Eigen::Matrix< _T1, 3 , 1> &sample )
+  {
+    return ( new ceres::AutoDiffCostFunction< MultiPosAccResidual, 1, 9 > (
+               new MultiPosAccResidual<_T1>( g_mag, sample ) ) );
+  }
+  
+  const _T1 g_mag_;
+  const Eigen::Matrix< _T1, 3 , 1> sample_;
+};
+
+/* Same model of MultiPosAccResidual, with closed-form Jacobian: given v = X - B and 
+ * c = T*K*v, the residual is r = g_mag - ||c|| and dr/dp = -(c/||c||)^T * dc/dp */
+template <typename _T1> class MultiPosAccAnalyticResidual : public ceres::SizedCostFunction< 1, 9 >
+{
+public:
+  MultiPosAccAnalyticResidual( const _T1 &g_mag, const Eigen::Matrix< _T1, 3 , 1> &sample ) :
+  g_mag_(g_mag),
+  sample_(sample.template cast<double>()){}
+  
+  virtual bool Evaluate( double const* const* parameters, double* residuals, 
+                         double** jacobians ) const
+  {
+    const double *params = parameters[0];
+    CalibratedTriad_<double> calib_triad( params[0], params[1], params[2], 
+                                          0, 0, 0,
+                                          params[3], params[4], params[5], 
+                                          params[6], params[7], params[8] );
+    
+    const Eigen::Vector3d v = calib_triad.unbias( sample_ ), 
+                          c = calib_triad.normalize( v );
+    const double c_norm = c.norm();
+    residuals[0] = double( g_mag_ ) - c_norm;
+    
+    if( jacobians != NULL && jacobians[0] != NULL )
+    {
+      const Eigen::Matrix3d &mis_mat = calib_triad.getMisalignmentMatrix();
+      const Eigen::Vector3d dr_dc = -c/c_norm;
+      const double s_y = params[4], s_z = params[5];
+
+      // Misalignments
+      jacobians[0][0] = -dr_dc(0)*s_y*v(1);
+      jacobians[0][1] =  dr_dc(0)*s_z*v(2);
+      jacobians[0][2] = -dr_dc(1)*s_z*v(2);
+      // Scale factors
+      for( int j = 0; j < 3; j++ )
+        jacobians[0][3 + j] = dr_dc.dot( mis_mat.col(j) )*v(j);
+      // Biases
+      const Eigen::Matrix3d ms_mat = mis_mat*calib_triad.getScaleMatrix();
+      for( int j = 0; j < 3; j++ )
+        jacobians[0][6 + j] = -dr_dc.dot( ms_mat.col(j) );
+    }
+    return true;
+  }
+  
+  static ceres::CostFunction* Create ( const _T1 &g_mag, const Eigen::Matrix< _T1, 3 , 1> &sample )
+  {
+    return new MultiPosAccAnalyticResidual<_T1>( g_mag, sample );
+  }
+  
+private:
+  const _T1 g_mag_;
+  const Eigen::Vector3d sample_;
+};
+
+/* Batched version of MultiPosAccAnalyticResidual: a single cost function that evaluates
+ * the residuals of n_samps static samples starting from start_idx, stored in a structure 
+ * of arrays buffer (i.e., an N x 3 column major matrix, one contiguous column for each axis).
+ * The evaluation does not allocate memory: residuals and Jacobian are written directly 
+ * into the solver buffers.
+ * The static samples can be split in several blocks, evaluated in parallel by the solver */
+template <typename _T1> class MultiPosAccBatchResidual : public ceres::CostFunction
+{
+public:
+  MultiPosAccBatchResidual( const _T1 &g_mag, const TriadBuffer_<_T1> &samples, 
+                            int start_idx, int n_samps ) :
+  g_mag_(g_mag),
+  samples_( n_samps, 3 )
+  {
+    for( int j = 0; j < 3; j++ )
+      samples_.col(j) = Eigen::Map< const Eigen::Matrix< _T1, Eigen::Dynamic, 1 > >
+                          ( samples.axis(j) + start_idx, n_samps ).template cast<double>();
+    
+    set_num_residuals( samples_.rows() );
+    mutable_parameter_block_sizes()->push_back(9);
+  }
+  
+  virtual bool Evaluate( double const* const* parameters, double* residuals, 
+                         double** jacobians ) const
+  {
+    const double *params = parameters[0];
+    CalibratedTriad_<double> calib_triad( params[0], params[1], params[2], 
+                                          0, 0, 0,
+                                          params[3], params[4], params[5], 
+                                          params[6], params[7], params[8] );
+    
+    const Eigen::Matrix3d &mis_mat = calib_triad.getMisalignmentMatrix();
+    const Eigen::Matrix3d ms_mat = mis_mat*calib_triad.getScaleMatrix();
+    const Eigen::Vector3d &bias_vec = calib_triad.getBiasVector();
+    const double s_y = params[4], s_z = params[5];
+    const int n_samps = samples_.rows();
+    const bool compute_jacobian = ( jacobians != NULL && jacobians[0] != NULL );
+    
+    // For each sample, v = X - B, c = T*K*v and dr/dc = -c/||c|| are fixed size vectors
+    Eigen::Map< Eigen::VectorXd > res( residuals, n_samps );
+    for( int i = 0; i < n_samps; i++ )
+    {
+      const Eigen::Vector3d v = samples_.row(i).transpose() - bias_vec, 
+                            c = ms_mat*v;
+      const double c_norm = c.norm();
+      res(i) = double( g_mag_ ) - c_norm;
+      
+      if( compute_jacobian )
+      {
+        const Eigen::Vector3d dr_dc = -c/c_norm;
+        Eigen::Map< Eigen::Matrix< double, 1, 9 > > jac( jacobians[0] + 9*i );
+        // Misalignments
+        jac(0) = -s_y*dr_dc(0)*v(1);
+        jac(1) =  s_z*dr_dc(0)*v(2);
+        jac(2) = -s_z*dr_dc(1)*v(2);
+        // Scale factors and biases
+        for( int j = 0; j < 3; j++ )
+        {
+          jac(3 + j) = dr_dc.dot( mis_mat.col(j) )*v(j);
+          jac(6 + j) = -dr_dc.dot( ms_mat.col(j) );
+        }
+      }
+    }
+    return true;
+  }
+  
+  static ceres::CostFunction* Create ( const _T1 &g_mag, const TriadBuffer_<_T1> &samples,
+                                       int start_idx, int n_samps )
+  {
+    return new MultiPosAccBatchResidual<_T1>( g_mag, samples, start_idx, n_samps );
+  }
+  
+private:
+  typedef Eigen::Matrix< double, Eigen::Dynamic, 3 > SamplesMatrix;
+  
+  const _T1 g_mag_;
+  SamplesMatrix samples_;
+};
+
+/* The number of parameters _N_PARAMS is 12 if the gyroscopes biases are optimized, 9 otherwise. 
+ * As for all the residuals, the evaluation does not modify the object (the samples buffer
+ * is only read), so several residuals can be evaluated concurrently by the solver */
+template <typename _T1, int _N_PARAMS> struct MultiPosGyroResidual
+{
+  enum { OPTIMIZE_BIAS = ( _N_PARAMS == 12 ) };
+  
+  MultiPosGyroResidual( const Eigen::Matrix< _T1, 3 , 1> &g_versor_pos0, 
+                        const Eigen::Matrix< _T1, 3 , 1> &g_versor_pos1,
+                        const TriadBuffer_<_T1> &gyro_samples, 
+                        const DataInterval &gyro_interval_pos01, 
+                        _T1 dt ) :
+
+  g_versor_pos0_(g_versor_pos0), 
+  g_versor_pos1_(g_versor_pos1),
+  gyro_samples_(gyro_samples),
+  interval_pos01_(gyro_interval_pos01),
+  dt_(dt){}
+  
+  template <typename _T2>
+    bool operator() ( const _T2* const params, _T2* residuals ) const
+  {
+    CalibratedTriad_<_T2> calib_triad( params[0], params[1], params[2], 
+                                      params[3], params[4], params[5], 
+                                      params[6], params[7], params[8],
+                                      OPTIMIZE_BIAS?params[9]:_T2(0), 
+                                      OPTIMIZE_BIAS?params[10]:_T2(0), 
+                                      OPTIMIZE_BIAS?params[11]:_T2(0) );
+    
+    const Eigen::Matrix< _T2, 3 , 3> ms_mat = calib_triad.getMisalignmentMatrix()*
+                                              calib_triad.getScaleMatrix();
+    const Eigen::Matrix< _T2, 3 , 1> &bias_vec = calib_triad.getBiasVector();
+    const TriadBuffer_<_T1> &gyro_samples = gyro_samples_;
+    
+    // Calibrate the samples and integrate them in a single pass
+    _T2 quat[4] = { _T2(1.0), _T2(0), _T2(0), _T2(0) }; // Identity quaternion
+    _T2 omega0[3], omega1[3];
+    
+    normalizeSample( ms_mat, bias_vec, gyro_samples, interval_pos01_.start_idx, omega0 );
+    for( int i = interval_pos01_.start_idx; i < interval_pos01_.end_idx; i++ )
+    {
+      normalizeSample( ms_mat, bias_vec, gyro_samples, i + 1, omega1 );
+      const double dt = ( dt_ > _T1(0) )?double(dt_):
+                        double(gyro_samples.timestamp(i + 1)) - double(gyro_samples.timestamp(i));
+      quatIntegrationStepRK4InPlace( quat, omega0, omega1, dt );
+      
+      omega0[0] = omega1[0]; omega0[1] = omega1[1]; omega0[2] = omega1[2];
+    }
+    
+    Eigen::Matrix< _T2, 3 , 3> rot_mat;
+    ceres::MatrixAdapter<_T2, 1, 3> rot_mat_adapter = ceres::ColumnMajorAdapter3x3(rot_mat.data());
+    ceres::QuaternionToRotation( quat, rot_mat_adapter );
+    
+    Eigen::Matrix< _T2, 3 , 1> diff = rot_mat.transpose()*g_versor_pos0_.template cast<_T2>() -
+                                      g_versor_pos1_.template cast<_T2>();
+    
+    residuals[0] = diff(0);
+    residuals[1] = diff(1);
+    residuals[2] = diff(2);
+    
+    return true;
+  }
+  
+  /* Apply omega = T*K*(X - B) to the i-th raw (unbiased) sample X. If the biases are not optimized, 
+   * X is not promoted to a _T2 and the products are computed between _T2 and scalars */
+  template <typename _T2>
+    inline void normalizeSample( const Eigen::Matrix< _T2, 3 , 3> &ms_mat, 
+                                 const Eigen::Matrix< _T2, 3 , 1> &bias_vec,
+                                 const TriadBuffer_<_T1> &samples, int i, _T2 omega[3] ) const
+  {
+    if( OPTIMIZE_BIAS )
+    {
+      const _T2 x = _T2(double(samples.x(i))) - bias_vec(0), 
+                y = _T2(double(samples.y(i))) - bias_vec(1), 
+                z = _T2(double(samples.z(i))) - bias_vec(2);
+      for( int r = 0; r < 3; r++ )
+        omega[r] = ms_mat(r,0)*x + ms_mat(r,1)*y + ms_mat(r,2)*z;
+    }
+    else
+    {
+      const double x = double(samples.x(i)), y = double(samples.y(i)), z = double(samples.z(i));
+      for( int r = 0; r < 3; r++ )
+        omega[r] = ms_mat(r,0)*x + ms_mat(r,1)*y + ms_mat(r,2)*z;
+    }
+  }
+  
+  static ceres::CostFunction* Create ( const Eigen::Matrix< _T1, 3 , 1> &g_versor_pos0, 
+                                       const Eigen::Matrix< _T1, 3 , 1> &g_versor_pos1,
+                                       const TriadBuffer_<_T1> &gyro_samples, 
+                                       const DataInterval &gyro_interval_pos01, 
+                                       _T1 dt )
+  {
+    return ( new ceres::AutoDiffCostFunction< MultiPosGyroResidual, 3, _N_PARAMS > (
+              new MultiPosGyroResidual( g_versor_pos0, g_versor_pos1, gyro_samples, 
+                                        gyro_interval_pos01, dt ) ) );
+  }
+  
+  const Eigen::Matrix< _T1, 3 , 1> g_versor_pos0_, g_versor_pos1_;
+  /* The (bias-removed) gyroscopes samples buffer is shared among all the residuals, 
+   * each residual only refers to its own interval */
+  const TriadBuffer_<_T1> gyro_samples_;
+  const DataInterval interval_pos01_;
+  const _T1 dt_;
+};
+
+/* Same model of MultiPosGyroResidual, with closed-form Jacobian. 
+ * The parameters derivatives of the quaternion are propagated along with the RK4 
+ * integration: since omega_skew(omega)*q is bilinear in omega and q, for each RK4
+ * coefficient k = omega_skew(omega)*q it is dk/dp = Q(q)*domega/dp + omega_skew(omega)*dq/dp,
+ * with Q(q)*omega = omega_skew(omega)*q */
+template <typename _T1, int _N_PARAMS> 
+  class MultiPosGyroAnalyticResidual : public ceres::SizedCostFunction< 3, _N_PARAMS >
+{
+public:
+  typedef Eigen::Matrix< double, 3, _N_PARAMS > OmegaJacobian;
+  typedef Eigen::Matrix< double, 4, _N_PARAMS > QuatJacobian;
+  
+  enum { OPTIMIZE_BIAS = ( _N_PARAMS == 12 ) };
+  
+  MultiPosGyroAnalyticResidual( const Eigen::Matrix< _T1, 3 , 1> &g_versor_pos0, 
+                                const Eigen::Matrix< _T1, 3 , 1> &g_versor_pos1,
+                                const TriadBuffer_<_T1> &gyro_samples, 
+                                const DataInterval &gyro_interval_pos01, 
+                                _T1 dt ) :
+  g_versor_pos0_(g_versor_pos0.template cast<double>()), 
+  g_versor_pos1_(g_versor_pos1.template cast<double>()),
+  gyro_samples_(gyro_samples),
+  interval_pos01_(gyro_interval_pos01),
+  dt_(dt){}
+  
+  virtual bool Evaluate( double const* const* parameters, double* residuals, 
+                         double** jacobians ) const
+  {
+    const double *params = parameters[0];
+    const bool compute_jacobian = ( jacobians != NULL && jacobians[0] != NULL );
+    CalibratedTriad_<double> calib_triad( params[0], params[1], params[2], 
+                                          params[3], params[4], params[5], 
+                                          params[6], params[7], params[8],
+                                          OPTIMIZE_BIAS?params[9]:0, 
+                                          OPTIMIZE_BIAS?params[10]:0, 
+                                          OPTIMIZE_BIAS?params[11]:0 );
+    const TriadBuffer_<_T1> &gyro_samples = gyro_samples_;
+    
+    Eigen::Vector4d quat( 1.0, 0, 0, 0 ); // Identity quaternion
+    QuatJacobian d_quat = QuatJacobian::Zero();
+    Eigen::Vector3d omega0, omega1;
+    OmegaJacobian d_omega0, d_omega1;
+    
+    normalizeSample( calib_triad, params, gyro_samples, interval_pos01_.start_idx, 
+                     omega0, compute_jacobian?&d_omega0:NULL );
+    for( int i = interval_pos01_.start_idx; i < interval_pos01_.end_idx; i++ )
+    {
+      normalizeSample( calib_triad, params, gyro_samples, i + 1, 
+                       omega1, compute_jacobian?&d_omega1:NULL );
+      const double dt = ( dt_ > _T1(0) )?double(dt_):
+                        double(gyro_samples.timestamp(i + 1)) - double(gyro_samples.timestamp(i));
+      if( compute_jacobian )
+        integrationStep( quat, d_quat, omega0, d_omega0, omega1, d_omega1, dt );
+      else
+        quatIntegrationStepRK4InPlace( quat.data(), omega0.data(), omega1.data(), dt );
+      
+      omega0 = omega1;
+      if( compute_jacobian )
+        d_omega0 = d_omega1;
+    }
+    
+    Eigen::Matrix3d rot_mat;
+    ceres::MatrixAdapter<double, 1, 3> rot_mat_adapter = ceres::ColumnMajorAdapter3x3(rot_mat.data());
+    ceres::QuaternionToRotation( quat.data(), rot_mat_adapter );
+    
+    Eigen::Map< Eigen::Vector3d > diff( residuals );
+    diff = rot_mat.transpose()*g_versor_pos0_ - g_versor_pos1_;
+    
+    if( compute_jacobian )
+    {
+      // Derivatives of rot_mat^T*g_versor_pos0 w.r.t. the (unit) quaternion (a, b, c, d)
+      const double a = quat(0), b = quat(1), c = quat(2), d = quat(3);
+      Eigen::Matrix< double, 3, 4 > d_diff_d_quat;
+      Eigen::Matrix3d d_rot_t;
+      d_rot_t <<  a,  d, -c,
+                 -d,  a,  b,
+                  c, -b,  a;
+      d_diff_d_quat.col(0) = 2.0*d_rot_t*g_versor_pos0_;
+      d_rot_t <<  b,  c,  d,
+                  c, -b,  a,
+                  d, -a, -b;
+      d_diff_d_quat.col(1) = 2.0*d_rot_t*g_versor_pos0_;
+      d_rot_t << -c,  b, -a,
+                  b,  c,  d,
+                  a,  d, -c;
+      d_diff_d_quat.col(2) = 2.0*d_rot_t*g_versor_pos0_;
+      d_rot_t << -d,  a,  b,
+                 -a, -d,  c,
+                  b,  c,  d;
+      d_diff_d_quat.col(3) = 2.0*d_rot_t*g_versor_pos0_;
+      
+      Eigen::Map< Eigen::Matrix< double, 3, _N_PARAMS, Eigen::RowMajor > > jacobian( jacobians[0] );
+      jacobian = d_diff_d_quat*d_quat;
+    }
+    
+    return true;
+  }
+  
+  static ceres::CostFunction* Create ( const Eigen::Matrix< _T1, 3 , 1> &g_versor_pos0, 
+                                       const Eigen::Matrix< _T1, 3 , 1> &g_versor_pos1,
+                                       const TriadBuffer_<_T1> &gyro_samples, 
+                                       const DataInterval &gyro_interval_pos01, 
+                                       _T1 dt )
+  {
+    return new MultiPosGyroAnalyticResidual( g_versor_pos0, g_versor_pos1, gyro_samples, 
+                                             gyro_interval_pos01, dt );
+  }
+  
+private:
+  
+  /* Apply omega = T*K*(X - B) to the i-th raw (unbiased) sample X, and eventually 
+   * compute domega/dp */
+  inline void normalizeSample( const CalibratedTriad_<double> &calib_triad, const double *params,
+                               const TriadBuffer_<_T1> &samples, int i, Eigen::Vector3d &omega, 
+                               OmegaJacobian *d_omega ) const
+  {
+    const Eigen::Vector3d v = calib_triad.unbias( Eigen::Vector3d( samples.x(i), samples.y(i), 
+                                                                   samples.z(i) ) );
+    omega = calib_triad.normalize( v );
+    
+    if( d_omega != NULL )
+    {
+      const Eigen::Matrix3d &mis_mat = calib_triad.getMisalignmentMatrix();
+      const double s_x = params[6], s_y = params[7], s_z = params[8];
+      OmegaJacobian &jac = *d_omega;
+      jac.template leftCols<6>().setZero();
+      // Misalignments
+      jac(0,0) = -s_y*v(1);
+      jac(0,1) =  s_z*v(2);
+      jac(1,2) = -s_z*v(2);
+      jac(1,3) =  s_x*v(0);
+      jac(2,4) = -s_x*v(0);
+      jac(2,5) =  s_y*v(1);
+      // Scale factors
+      for( int j = 0; j < 3; j++ )
+        jac.col(6 + j) = mis_mat.col(j)*v(j);
+      // Biases
+      if( OPTIMIZE_BIAS )
+      {
+        const Eigen::Matrix3d ms_mat = mis_mat*calib_triad.getScaleMatrix();
+        jac.template rightCols<_N_PARAMS - 9>() = -ms_mat.leftCols(_N_PARAMS - 9);
+      }
+    }
+  }
+  
+  /* Q(q) such that Q(q)*omega = omega_skew(omega)*q */
+  static inline void quatSkew( const Eigen::Vector4d &q, Eigen::Matrix< double, 4, 3 > &skew )
+  {
+    skew << -q(1), -q(2), -q(3),
+             q(0), -q(3),  q(2),
+             q(3),  q(0), -q(1),
+            -q(2),  q(1),  q(0);
+  }
+  
+  /* Same RK4 step of quatIntegrationStepRK4InPlace(), along with the propagation of the 
+   * quaternion derivatives */
+  static inline void integrationStep( Eigen::Vector4d &quat, QuatJacobian &d_quat,
+                                      const Eigen::Vector3d &omega0, const OmegaJacobian &d_omega0,
+                                      const Eigen::Vector3d &omega1, const OmegaJacobian &d_omega1,
+                                      double dt )
+  {
+    const Eigen::Vector3d omega01 = 0.5*( omega0 + omega1 );
+    const OmegaJacobian d_omega01 = 0.5*( d_omega0 + d_omega1 );
+    const double half_step = 0.25*dt, full_step = 0.5*dt, final_step = dt/12.0;
+    Eigen::Matrix4d omega_skew0, omega_skew01, omega_skew1;
+    Eigen::Matrix< double, 4, 3 > q_skew;
+    
+    computeOmegaSkew( omega0, omega_skew0 );
+    computeOmegaSkew( omega01, omega_skew01 );
+    computeOmegaSkew( omega1, omega_skew1 );
+    
+    // First Runge-Kutta coefficient
+    quatSkew( quat, q_skew );
+    const Eigen::Vector4d k1 = omega_skew0*quat;
+    const QuatJacobian d_k1 = q_skew*d_omega0 + omega_skew0*d_quat;
+    // Second Runge-Kutta coefficient
+    Eigen::Vector4d tmp_q = quat + half_step*k1;
+    QuatJacobian d_tmp_q = d_quat + half_step*d_k1;
+    quatSkew( tmp_q, q_skew );
+    const Eigen::Vector4d k2 = omega_skew01*tmp_q;
+    const QuatJacobian d_k2 = q_skew*d_omega01 + omega_skew01*d_tmp_q;
+    // Third Runge-Kutta coefficient (same omega as second coeff.)
+    tmp_q = quat + half_step*k2;
+    d_tmp_q = d_quat + half_step*d_k2;
+    quatSkew( tmp_q, q_skew );
+    const Eigen::Vector4d k3 = omega_skew01*tmp_q;
+    const QuatJacobian d_k3 = q_skew*d_omega01 + omega_skew01*d_tmp_q;
+    // Forth Runge-Kutta coefficient
+    tmp_q = quat + full_step*k3;
+    d_tmp_q = d_quat + full_step*d_k3;
+    quatSkew( tmp_q, q_skew );
+    const Eigen::Vector4d k4 = omega_skew1*tmp_q;
+    const QuatJacobian d_k4 = q_skew*d_omega1 + omega_skew1*d_tmp_q;
+    
+    quat += final_step*( k1 + 2.0*( k2 + k3 ) + k4 );
+    d_quat += final_step*( d_k1 + 2.0*( d_k2 + d_k3 ) + d_k4 );
+    
+    // Normalization: d(q/||q||) = (I - q_n*q_n^T)*dq/||q||
+    const double quat_norm = quat.norm();
+    quat /= quat_norm;
+    d_quat = ( d_quat - quat*( quat.transpose()*d_quat ) )/quat_norm;
+  }
+  
+  const Eigen::Vector3d g_versor_pos0_, g_versor_pos1_;
+  /* The (bias-removed) gyroscopes samples buffer is shared among all the residuals, 
+   * each residual only refers to its own interval */
+  const TriadBuffer_<_T1> gyro_samples_;
+  const DataInterval interval_pos01_;
+  const _T1 dt_;
+};
+
+}
@@ -34,10 +34,29 @@
 namespace imu_tk
 {
 
+/**
+  * @brief Extract the static intervals labeled in the input signal, i.e. the sequences 
+  *        of samples with the same interval id (samples with interval id -1 are motion 
+  *        samples). 
+  * 
+  * @param samples Input 3D signal (e.g, the acceleremeter readings)
+  * @param[out] intervals  Ouput static intervals
+  */
+template <typename _T> 
+  void staticIntervalsDetector ( const std::vector< TriadData_<_T> > &samples,
+                                 std::vector< DataInterval > &intervals);
+
+/**
+  * @brief Same as staticIntervalsDetector(), with a data samples buffer as input signal
+  */
+template <typename _T> 
+  void staticIntervalsDetector ( const TriadBuffer_<_T> &samples,
+                                 std::vector< DataInterval > &intervals);
+
 /**
   * @brief Classify between static and motion intervals checking if for each sample 
   *        of the input signal \f$s\f$ (samples) the local variance magnitude 
-  *        is lower or greater then a threshold.
+  *        is lower or greater then a threshold (the interval ids are not used).
   * 
   * @param samples Input 3D signal (e.g, the acceleremeter readings)
   * @param threshold Threshold used in the classification
@@ -54,9 +73,156 @@ namespace imu_tk
   * 
   * Where \f$var_{w_s}(s^t)\f$ is an operator that compute the variance of
   * a general 1D signal in a interval of length \f$w_s\f$ samples
-  * centered in \f$t\f$.
+  * centered in \f$t\f$. The variances are updated in constant time for each sample
+  * (see StaticIntervalsVarianceDetector_).
   */
 template <typename _T> 
-  void staticIntervalsDetector ( const std::vector< TriadData_<_T> > &samples,
-                                 std::vector< DataInterval > &intervals);
+  void staticIntervalsDetector ( const std::vector< TriadData_<_T> > &samples, _T threshold,
+                                 std::vector< DataInterval > &intervals, int win_size = 101 );
+
+/**
+  * @brief Same as staticIntervalsDetector( const std::vector< TriadData_<_T> > &, _T, 
+  *        std::vector< DataInterval > &, int ), with a data samples buffer as input signal
+  */
+template <typename _T> 
+  void staticIntervalsDetector ( const TriadBuffer_<_T> &samples, _T threshold,
+                                 std::vector< DataInterval > &intervals, int win_size = 101 );
+
+/**
+  * @brief Label the static intervals in a data samples buffer: the interval id of the samples 
+  *        of the i-th interval is set to i, the interval id of all the other samples to -1 
+  *        (e.g., to use the intervals detected by staticIntervalsDetector() in place of 
+  *        manually labeled intervals)
+  */
+template <typename _T> 
+  void labelStaticIntervals ( TriadBuffer_<_T> &samples, 
+                              const std::vector< DataInterval > &intervals );
+
+/** @brief Summary of a static interval, computed by a StaticIntervalsStreamDetector_ */
+template <typename _T> struct IntervalStatistics_
+{
+  /** @brief Indices of the first and last samples of the interval in the whole sequence */
+  DataInterval interval;
+  /** @brief Id of the interval */
+  int interval_id;
+  /** @brief Timestamps of the first and last samples of the interval */
+  _T start_timestamp, end_timestamp;
+  /** @brief Arithmetic mean and variance of the samples (see dataMean() and dataVariance()) */
+  Eigen::Matrix< _T, 3, 1> mean, variance;
+  
+  int numSamples() const { return interval.end_idx - interval.start_idx + 1; };
+};
+
+/**
+  * @brief Incremental version of staticIntervalsDetector(): the samples are provided 
+  *        in consecutive chunks (e.g., read from a TriadDataSource_), and for 
+  *        each detected static interval only its statistics are stored, and 
+  *        optionally its samples (only for the intervals with a minimum number of samples). 
+  * 
+  * The detected intervals are the same of staticIntervalsDetector(). The statistics and 
+  * the stored samples refer only to the samples labeled with the interval id, 
+  * i.e. motion samples (with interval id -1) inside an interval, if any, are ignored.
+  */
+template <typename _T> class StaticIntervalsStreamDetector_
+{
+public:
+  /** @brief Constructor
+   * 
+   * @param min_interval_n_samples If store_samples is true, the samples are stored
+   *                               only for the intervals with at least min_interval_n_samples 
+   *                               samples
+   * @param store_samples If true, the samples of the static intervals are stored
+   */
+  StaticIntervalsStreamDetector_( int min_interval_n_samples = 0, bool store_samples = false );
+  
+  /** @brief Remove all the detected intervals and samples */
+  void reset();
+  
+  /** @brief Process the next chunk of samples */
+  void process( const TriadBuffer_<_T> &chunk );
+  
+  /** @brief Complete the current static interval, if any: it should be called after
+   *         the last chunk of samples */
+  void finish();
+  
+  /** @brief Number of samples processed so far */
+  int numSamples() const { return n_samples_; };
+  
+  /** @brief Statistics of the detected static intervals */
+  const std::vector< IntervalStatistics_<_T> > &intervals() const { return intervals_; };
+  
+  /** @brief Stored samples (see StaticIntervalsStreamDetector_()), in the same order 
+   *         of intervals() */
+  const TriadBuffer_<_T> &samples() const { return samples_; };
+  
+private:
+  void closeInterval();
+  
+  int min_interval_n_samples_;
+  bool store_samples_;
+  int n_samples_;
+  std::vector< IntervalStatistics_<_T> > intervals_;
+  TriadBuffer_<_T> samples_;
+  
+  /* Current interval */
+  IntervalStatistics_<_T> cur_interval_;
+  bool in_interval_;
+  Eigen::Matrix< double, 3, 1> cur_welford_mean_, cur_welford_m2_;
+  int cur_n_samples_, cur_samples_start_;
+};
+
+/**
+  * @brief Streaming version of the variance-based staticIntervalsDetector(): the
+  *        samples are provided in consecutive chunks, in a single pass.
+  * 
+  * The sums and the sums of squares of the samples in the sliding window are updated 
+  * in constant time for each sample (adding the new sample and removing the oldest one,
+  * with the values shifted by the first sample to limit the cancellation errors), 
+  * and periodically recomputed from the window to avoid the accumulation of rounding 
+  * errors. The sums are computed in double precision also for float samples.
+  */
+template <typename _T> class StaticIntervalsVarianceDetector_
+{
+public:
+  /** @brief Constructor
+   * 
+   * @param threshold Threshold on the variance magnitude used in the classification
+   * @param win_size Size of the sliding window (at least 11, odd, otherwise it is 
+   *                 increased accordingly)
+   */
+  StaticIntervalsVarianceDetector_( _T threshold, int win_size = 101 );
+  
+  /** @brief Remove all the detected intervals */
+  void reset();
+  
+  /** @brief Process the next chunk of samples */
+  void process( const TriadBuffer_<_T> &chunk );
+  
+  /** @brief Complete the current static interval, if any: it should be called after
+   *         the last chunk of samples */
+  void finish();
+  
+  /** @brief Number of samples processed so far */
+  int numSamples() const { return n_samples_; };
+  
+  /** @brief Size of the sliding window actually used */
+  int windowSize() const { return win_size_; };
+  
+  /** @brief Detected static intervals (i.e., indices of the first and last samples 
+   *         of the intervals in the whole sequence) */
+  const std::vector< DataInterval > &intervals() const { return intervals_; };
+  
+private:
+  void recomputeSums();
+  
+  _T threshold_;
+  int win_size_;
+  int n_samples_, n_updates_;
+  /* Circular buffer with the (shifted) samples of the window */
+  std::vector< Eigen::Matrix< double, 3, 1> > window_;
+  Eigen::Matrix< double, 3, 1> offset_, sum_, sum_sq_;
+  bool in_interval_;
+  DataInterval cur_interval_;
+  std::vector< DataInterval > intervals_;
+};
 }
@@ -0,0 +1,87 @@
+/* 
+ * imu_tk - Inertial Measurement Unit Toolkit
+ * 
+ *  Copyright (c) 2014, Alberto Pretto <pretto@diag.uniroma1.it>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ * 
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ * 
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+#include "imu_tk/base.h"
+
+namespace imu_tk
+{
+/** @brief Streaming 64 bit hash of a sequence of bytes, with the XXH64 algorithm 
+ *         (i.e., the digest of the concatenation of the updates is the XXH64 hash 
+ *         of the concatenated data). Not a cryptographic hash */
+class Hash64
+{
+public:
+  /** @brief Start a new hash with the given seed */
+  explicit Hash64( uint64_t seed = 0 ) { reset( seed ); };
+  
+  /** @brief Restart the hash with the given seed, discarding the data added so far */
+  void reset( uint64_t seed = 0 );
+  
+  /** @brief Add size bytes of data to the hash */
+  void update( const void *data, size_t size );
+  
+  /** @brief Add the bytes of a value (e.g., a number) to the hash */
+  template < typename _V > void updateValue( const _V &value ) { update( &value, sizeof(_V) ); };
+  
+  /** @brief Provides the hash of the data added so far (the hash can be further updated) */
+  uint64_t digest() const;
+  
+private:
+  uint64_t acc_[4];
+  unsigned char pending_[32];
+  size_t n_pending_;
+  uint64_t total_size_;
+  uint64_t seed_;
+};
+
+/** @brief Add a sequence of data samples to a hash. Each sample adds its timestamp, its
+ *         x, y and z values (with the _T representation) and its interval id (as a 32 bit 
+ *         integer), so the same samples stored in a TriadData_ vector or in a TriadBuffer_ 
+ *         give the same hash */
+template <typename _T> void hashSamples( Hash64 &hash, const TriadBuffer_<_T> &samples );
+
+/** @brief Same as hashSamples(), with the samples stored in a TriadData_ vector */
+template <typename _T> void hashSamples( Hash64 &hash, const std::vector< TriadData_<_T> > &samples );
+
+/** @brief Same as hashSamples(), with n_samples samples stored in a TriadData_ array (e.g., 
+ *         to hash a vector while it is being filled) */
+template <typename _T> void hashSamples( Hash64 &hash, const TriadData_<_T> *samples, int n_samples );
+
+/** @brief Provides the hash (with seed 0) of a sequence of data samples (see hashSamples() ) */
+template <typename _T> uint64_t samplesHash( const TriadBuffer_<_T> &samples );
+
+/** @brief Same as samplesHash(), with the samples stored in a TriadData_ vector */
+template <typename _T> uint64_t samplesHash( const std::vector< TriadData_<_T> > &samples );
+
+}
@@ -29,7 +29,14 @@
 #pragma once
 
 #include "imu_tk/base.h"
+#include "imu_tk/batch_calibration.h"
+#include "imu_tk/calibrated_triad.h"
 #include "imu_tk/calibration.h"
+#include "imu_tk/calibration_report.h"
 #include "imu_tk/io_utils.h"
+#include "imu_tk/log.h"
+#include "imu_tk/runtime_calibration.h"
+#include "imu_tk/thread_pool.h"
+#include "imu_tk/time_alignment.h"
 #include "imu_tk/integration.h"
 #include "imu_tk/visualization.h"
@@ -29,11 +29,20 @@
 #pragma once
 
 #include <Eigen/Core>
-#include <ceres/rotation.h>
 
 #include "imu_tk/base.h"
 
+#include <algorithm>
 #include <iostream>
+#include <cmath>
+#include <stdexcept>
+#include <limits>
+
+#if defined(__SSE2__) || defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
 
 namespace imu_tk
 {
@@ -49,6 +58,25 @@ template <typename _T> inline void normalizeQuaternion( Eigen::Matrix< _T, 4, 1>
  */
 template <typename _T> inline void normalizeQuaternion( _T quat[4] );
 
+/** @brief Compute the product of two quaternions (Hamilton convention, 
+ *         as ceres::QuaternionProduct())
+ * 
+ * @param quat0 The 4D array representing the first quaternion
+ * @param quat1 The 4D array representing the second quaternion
+ * @param[out] quat_res Resulting quaternion quat0*quat1, it should not alias the inputs
+ */
+template <typename _T> inline void quaternionProduct( const _T quat0[4], const _T quat1[4], 
+                                                      _T quat_res[4] );
+
+/** @brief Convert a (possibly not normalized) quaternion into the corresponding
+ *         rotation matrix (as ceres::QuaternionToRotation())
+ * 
+ * @param quat The 4D array representing the quaternion
+ * @param[out] rot_mat Resulting rotation matrix
+ */
+template <typename _T> inline void quaternionToRotation( const _T quat[4], 
+                                                         Eigen::Matrix< _T, 3, 3> &rot_mat );
+
 /** @brief Perform a RK4 Runge-Kutta integration step
  * 
  * @param quat The input Eigen 4D vector representing the initial rotation
@@ -75,6 +103,94 @@ template <typename _T> inline void quatIntegrationStepRK4( const _T quat[4],
                                                            const _T omega1[3], 
                                                            const _T &dt, _T quat_res[4] );
 
+/** @brief Perform in place a RK4 Runge-Kutta integration step, working directly on 
+ *         the quaternion components, i.e. without building the omega skew matrices and
+ *         without any dynamic allocation
+ * 
+ * The time step may have a different (scalar) type than the quaternion, e.g. a plain double
+ * time step can be used to integrate ceres::Jet quaternions
+ * 
+ * @param[in,out] quat The 4D array representing the rotation to be updated
+ * @param omega0 Initial rotational velocity at time t0
+ * @param omega1 Final rotational velocity at time t1
+ * @param dt Time step (t1 - t0).
+ */
+template <typename _T, typename _TDt> inline void quatIntegrationStepRK4InPlace( _T quat[4], 
+                                                                               const _T omega0[3], 
+                                                                               const _T omega1[3], 
+                                                                               const _TDt &dt );
+
+/** @brief Perform in place a RK4 Runge-Kutta integration step (see quatIntegrationStepRK4InPlace()),
+ *         processing the four quaternion components in parallel with SIMD instructions: 
+ *         SSE2 or AVX for double and float quaternions on x86 processors, NEON for 
+ *         float quaternions on ARM processors. For the other types, or if the instruction 
+ *         sets are not enabled at compile time, it is the same as quatIntegrationStepRK4InPlace().
+ * 
+ * @param[in,out] quat The 4D array representing the rotation to be updated
+ * @param omega0 Initial rotational velocity at time t0
+ * @param omega1 Final rotational velocity at time t1
+ * @param dt Time step (t1 - t0).
+ */
+template <typename _T> inline void quatIntegrationStepRK4Simd( _T quat[4], const _T omega0[3], 
+                                                               const _T omega1[3], const _T &dt );
+
+#if defined(__SSE2__) || defined(__AVX__)
+inline void quatIntegrationStepRK4Simd( double quat[4], const double omega0[3], 
+                                        const double omega1[3], const double &dt );
+inline void quatIntegrationStepRK4Simd( float quat[4], const float omega0[3], 
+                                        const float omega1[3], const float &dt );
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+inline void quatIntegrationStepRK4Simd( float quat[4], const float omega0[3], 
+                                        const float omega1[3], const float &dt );
+#endif
+
+/** @brief Perform in place a first order integration step, i.e. the first order expansion 
+ *         of the exponential map of the mean rotational velocity in the time step, followed
+ *         by a normalization. Cheaper but less accurate than the RK4 Runge-Kutta step.
+ * 
+ * @param[in,out] quat The 4D array representing the rotation to be updated
+ * @param omega0 Initial rotational velocity at time t0
+ * @param omega1 Final rotational velocity at time t1
+ * @param dt Time step (t1 - t0).
+ */
+template <typename _T> inline void quatIntegrationStepFirstOrder( _T quat[4], const _T omega0[3], 
+                                                                  const _T omega1[3], const _T &dt );
+
+/** @brief Perform in place a closed-form integration step, assuming the rotational velocity 
+ *         constant in the time step (zero-order hold) and equal to the mean of omega0 and 
+ *         omega1: the rotation is updated with the exact exponential map of this velocity.
+ * 
+ * @param[in,out] quat The 4D array representing the rotation to be updated
+ * @param omega0 Initial rotational velocity at time t0
+ * @param omega1 Final rotational velocity at time t1
+ * @param dt Time step (t1 - t0).
+ */
+template <typename _T> inline void quatIntegrationStepZeroOrderHold( _T quat[4], const _T omega0[3], 
+                                                                     const _T omega1[3], const _T &dt );
+
+/** @brief Methods used to integrate the rotational velocities, see quatIntegrationStep() */
+enum QuatIntegrationMethod
+{
+  /** RK4 Runge-Kutta method (see quatIntegrationStepRK4Simd()) */
+  QUAT_INTEGRATION_RK4,
+  /** First order expansion of the exponential map (see quatIntegrationStepFirstOrder()) */
+  QUAT_INTEGRATION_FIRST_ORDER,
+  /** Closed-form zero-order hold (see quatIntegrationStepZeroOrderHold()) */
+  QUAT_INTEGRATION_ZERO_ORDER_HOLD
+};
+
+/** @brief Perform in place an integration step with the selected integration method
+ * 
+ * @param[in,out] quat The 4D array representing the rotation to be updated
+ * @param omega0 Initial rotational velocity at time t0
+ * @param omega1 Final rotational velocity at time t1
+ * @param dt Time step (t1 - t0).
+ * @param method Integration method
+ */
+template <typename _T> inline void quatIntegrationStep( _T quat[4], const _T omega0[3], 
+                                                        const _T omega1[3], const _T &dt,
+                                                        QuatIntegrationMethod method = QUAT_INTEGRATION_RK4 );
+
 /** @brief Integrate a sequence of rotational velocities using the RK4 
  *         Runge-Kutta discrete integration method. The initial rotation is assumed to be the
  *         identity quaternion.
@@ -85,10 +201,12 @@ template <typename _T> inline void quatIntegrationStepRK4( const _T quat[4],
  * @param interval Data interval where to compute the integration. If this interval is not valid,
  *                 i.e., one of the two indices is -1, the integration is computed for the whole data
  *                 sequence.
+ * @param method Integration method, see QuatIntegrationMethod. Default is QUAT_INTEGRATION_RK4
  */
 template <typename _T> void integrateGyroInterval( const std::vector< TriadData_<_T> > &gyro_samples, 
                                                    Eigen::Matrix< _T, 4, 1> &quat_res, _T data_dt = _T(-1),
-                                                   const DataInterval &interval = DataInterval() );
+                                                   const DataInterval &interval = DataInterval(),
+                                                   QuatIntegrationMethod method = QUAT_INTEGRATION_RK4 );
 
 /** @brief Integrate a sequence of rotational velocities using the RK4 
  *         Runge-Kutta discrete integration method. The initial rotation is assumed to be the
@@ -100,10 +218,91 @@ template <typename _T> void integrateGyroInterval( const std::vector< TriadData_
  * @param interval Data interval where to compute the integration. If this interval is not valid,
  *                 i.e., one of the two indices is -1, the integration is computed for the whole data
  *                 sequence.
+ * @param method Integration method, see QuatIntegrationMethod. Default is QUAT_INTEGRATION_RK4
  */
 template <typename _T> void integrateGyroInterval( const std::vector< TriadData_<_T> > &gyro_samples, 
                                                    Eigen::Matrix< _T, 3, 3> &rot_res, _T data_dt = _T(-1),
-                                                   const DataInterval &interval = DataInterval() );
+                                                   const DataInterval &interval = DataInterval(),
+                                                   QuatIntegrationMethod method = QUAT_INTEGRATION_RK4 );
+
+/** @brief Integrate a sequence of rotational velocities stored in a data samples buffer, 
+ *         see integrateGyroInterval() */
+template <typename _T> void integrateGyroInterval( const TriadBuffer_<_T> &gyro_samples, 
+                                                   Eigen::Matrix< _T, 4, 1> &quat_res, _T data_dt = _T(-1),
+                                                   const DataInterval &interval = DataInterval(),
+                                                   QuatIntegrationMethod method = QUAT_INTEGRATION_RK4 );
+
+/** @brief Integrate a sequence of rotational velocities stored in a data samples buffer, 
+ *         see integrateGyroInterval() */
+template <typename _T> void integrateGyroInterval( const TriadBuffer_<_T> &gyro_samples, 
+                                                   Eigen::Matrix< _T, 3, 3> &rot_res, _T data_dt = _T(-1),
+                                                   const DataInterval &interval = DataInterval(),
+                                                   QuatIntegrationMethod method = QUAT_INTEGRATION_RK4 );
+
+/** @brief Integrate once a whole sequence of rotational velocities using the RK4 
+ *         Runge-Kutta discrete integration method, providing the cumulative rotation at 
+ *         each sample. The rotation at the first sample of the interval is the identity 
+ *         quaternion.
+ * 
+ * The rotation between the samples i and j of the interval (i.e., the result of 
+ * integrateGyroInterval() in the interval [i, j]) is then given by 
+ * \f$q_i^{-1} q_j\f$, see relativeQuaternion(), without integrating again the samples. 
+ * 
+ * @param gyro_samples Input gyroscope signal (data samples buffer)
+ * @param[out] quats Preallocated output array for the resulting rotation quaternions 
+ *                   (4 values for each sample of the interval, i.e. 
+ *                   4*(interval.end_idx - interval.start_idx + 1) values): the quaternion 
+ *                   of the k-th sample of the interval is stored starting from quats[4*k]
+ * @param dt Fixed time step (t1 - t0) between samples. If is -1, the sample timestamps are used instead.
+ * @param interval Data interval where to compute the integration. If this interval is not valid,
+ *                 i.e., one of the two indices is -1, the integration is computed for the whole data
+ *                 sequence.
+ * @param method Integration method, see QuatIntegrationMethod. Default is QUAT_INTEGRATION_RK4
+ */
+template <typename _T> void integrateGyroStream( const TriadBuffer_<_T> &gyro_samples, _T *quats, 
+                                                 _T data_dt = _T(-1),
+                                                 const DataInterval &interval = DataInterval(),
+                                                 QuatIntegrationMethod method = QUAT_INTEGRATION_RK4 );
+
+/** @brief Same as integrateGyroStream(), with the rotational velocities stored in 
+ *         a data samples vector */
+template <typename _T> void integrateGyroStream( const std::vector< TriadData_<_T> > &gyro_samples, 
+                                                 _T *quats, _T data_dt = _T(-1),
+                                                 const DataInterval &interval = DataInterval(),
+                                                 QuatIntegrationMethod method = QUAT_INTEGRATION_RK4 );
+
+/** @brief Integrate once a whole sequence of rotational velocities (see integrateGyroStream()), 
+ *         providing the cumulative rotations only at the requested samples (checkpoints). 
+ *         The rotation at the first sample of the sequence is the identity quaternion.
+ * 
+ * @param gyro_samples Input gyroscope signal (data samples buffer)
+ * @param checkpoints Indices of the requested samples, in non-decreasing order
+ * @param[out] quats Preallocated output array for the resulting rotation quaternions 
+ *                   (4*checkpoints.size() values)
+ * @param dt Fixed time step (t1 - t0) between samples. If is -1, the sample timestamps are used instead.
+ * @param method Integration method, see QuatIntegrationMethod. Default is QUAT_INTEGRATION_RK4
+ */
+template <typename _T> void integrateGyroCheckpoints( const TriadBuffer_<_T> &gyro_samples, 
+                                                      const std::vector< int > &checkpoints,
+                                                      _T *quats, _T data_dt = _T(-1),
+                                                      QuatIntegrationMethod method = QUAT_INTEGRATION_RK4 );
+
+/** @brief Same as integrateGyroCheckpoints(), with the rotational velocities stored in 
+ *         a data samples vector */
+template <typename _T> void integrateGyroCheckpoints( const std::vector< TriadData_<_T> > &gyro_samples, 
+                                                      const std::vector< int > &checkpoints,
+                                                      _T *quats, _T data_dt = _T(-1),
+                                                      QuatIntegrationMethod method = QUAT_INTEGRATION_RK4 );
+
+/** @brief Compute the rotation between two cumulative rotations (e.g., provided by 
+ *         integrateGyroStream()), i.e. the quaternion \f$q_0^{-1} q_1\f$
+ * 
+ * @param quat0 The 4D array representing the (unit) initial rotation
+ * @param quat1 The 4D array representing the (unit) final rotation
+ * @param[out] quat_res Resulting relative rotation
+ */
+template <typename _T> inline void relativeQuaternion( const _T quat0[4], const _T quat1[4], 
+                                                       _T quat_res[4] );
 
 }
 
@@ -121,6 +320,34 @@ template <typename _T> inline void imu_tk::normalizeQuaternion ( _T quat[4] )
   imu_tk::normalizeQuaternion ( tmp_q );
 }
 
+template <typename _T> inline void imu_tk::quaternionProduct( const _T quat0[4], const _T quat1[4], 
+                                                              _T quat_res[4] )
+{
+  quat_res[0] = quat0[0]*quat1[0] - quat0[1]*quat1[1] - quat0[2]*quat1[2] - quat0[3]*quat1[3];
+  quat_res[1] = quat0[0]*quat1[1] + quat0[1]*quat1[0] + quat0[2]*quat1[3] - quat0[3]*quat1[2];
+  quat_res[2] = quat0[0]*quat1[2] - quat0[1]*quat1[3] + quat0[2]*quat1[0] + quat0[3]*quat1[1];
+  quat_res[3] = quat0[0]*quat1[3] + quat0[1]*quat1[2] - quat0[2]*quat1[1] + quat0[3]*quat1[0];
+}
+
+template <typename _T> inline void imu_tk::quaternionToRotation( const _T quat[4], 
+                                                                 Eigen::Matrix< _T, 3, 3> &rot_mat )
+{
+  const _T a = quat[0], b = quat[1], c = quat[2], d = quat[3];
+  const _T aa = a*a, ab = a*b, ac = a*c, ad = a*d, bb = b*b, bc = b*c, 
+           bd = b*d, cc = c*c, cd = c*d, dd = d*d;
+  const _T inv_norm = _T(1.0)/( aa + bb + cc + dd );
+  
+  rot_mat(0,0) = ( aa + bb - cc - dd )*inv_norm;
+  rot_mat(0,1) = _T(2.0)*( bc - ad )*inv_norm;
+  rot_mat(0,2) = _T(2.0)*( ac + bd )*inv_norm;
+  rot_mat(1,0) = _T(2.0)*( ad + bc )*inv_norm;
+  rot_mat(1,1) = ( aa - bb + cc - dd )*inv_norm;
+  rot_mat(1,2) = _T(2.0)*( cd - ab )*inv_norm;
+  rot_mat(2,0) = _T(2.0)*( bd - ac )*inv_norm;
+  rot_mat(2,1) = _T(2.0)*( ab + cd )*inv_norm;
+  rot_mat(2,2) = ( aa - bb - cc + dd )*inv_norm;
+}
+
 template <typename _T> 
   static inline void computeOmegaSkew( const Eigen::Matrix< _T, 3, 1> &omega, 
                                        Eigen::Matrix< _T, 4, 4> &skew )
@@ -137,27 +364,386 @@ template <typename _T>
                                               const Eigen::Matrix< _T, 3, 1> &omega1, 
                                               const _T &dt, Eigen::Matrix< _T, 4, 1> &quat_res )
 {
-  Eigen::Matrix< _T, 3, 1> omega01 = _T(0.5)*( omega0 + omega1 );
-  Eigen::Matrix< _T, 4, 1> k1, k2, k3, k4, tmp_q;
-  Eigen::Matrix< _T, 4, 4> omega_skew;
+  // quat and quat_res may be the same object
+  Eigen::Matrix< _T, 4, 1> tmp_q = quat;
+  quatIntegrationStepRK4Simd( tmp_q.data(), omega0.data(), omega1.data(), dt );
+  quat_res = tmp_q;
+}
+
+/* Compute the product between the omega skew matrix (see computeOmegaSkew()) 
+ * and a quaternion, without building the matrix */
+template <typename _T> 
+  static inline void quatOmegaProduct( const _T omega[3], const _T quat[4], _T res[4] )
+{
+  res[0] = -omega[0]*quat[1] - omega[1]*quat[2] - omega[2]*quat[3];
+  res[1] =  omega[0]*quat[0] + omega[2]*quat[2] - omega[1]*quat[3];
+  res[2] =  omega[1]*quat[0] - omega[2]*quat[1] + omega[0]*quat[3];
+  res[3] =  omega[2]*quat[0] + omega[1]*quat[1] - omega[0]*quat[2];
+}
+
+template <typename _T, typename _TDt> 
+  inline void imu_tk::quatIntegrationStepRK4InPlace( _T quat[4], const _T omega0[3], 
+                                                     const _T omega1[3], const _TDt &dt )
+{
+  using std::sqrt;
+  
+  const _TDt half(0.5);
+  const _T omega01[3] = { half*( omega0[0] + omega1[0] ),
+                          half*( omega0[1] + omega1[1] ),
+                          half*( omega0[2] + omega1[2] ) };
+  // The 1/2 factor of the quaternion derivative is folded into the step sizes
+  const _TDt half_step = _TDt(0.25)*dt, full_step = _TDt(0.5)*dt, 
+             final_step = dt/_TDt(12.0);
+  _T k1[4], k2[4], k3[4], k4[4], tmp_q[4];
   
   // First Runge-Kutta coefficient
-  computeOmegaSkew( omega0, omega_skew );
-  k1 = _T(0.5)*omega_skew*quat;
+  quatOmegaProduct( omega0, quat, k1 );
   // Second Runge-Kutta coefficient
-  tmp_q = quat + _T(0.5)*dt*k1;
-  computeOmegaSkew( omega01, omega_skew );
-  k2 = _T(0.5)*omega_skew*tmp_q;
-  // Third Runge-Kutta coefficient (same omega skew as second coeff.)
-  tmp_q = quat + _T(0.5)*dt*k2;
-  k3 = _T(0.5)*omega_skew*tmp_q;
+  for( int j = 0; j < 4; j++ )
+    tmp_q[j] = quat[j] + half_step*k1[j];
+  quatOmegaProduct( omega01, tmp_q, k2 );
+  // Third Runge-Kutta coefficient (same omega as second coeff.)
+  for( int j = 0; j < 4; j++ )
+    tmp_q[j] = quat[j] + half_step*k2[j];
+  quatOmegaProduct( omega01, tmp_q, k3 );
   // Forth Runge-Kutta coefficient
-  tmp_q = quat + dt*k3;
-  computeOmegaSkew( omega1, omega_skew );
-  k4 = _T(0.5)*omega_skew*tmp_q;
-  _T mult1 = _T(1.0)/_T(6.0), mult2 = _T(1.0)/_T(3.0);
-  quat_res = quat + dt*(mult1*k1 + mult2*k2 + mult2*k3 + mult1*k4);
-  normalizeQuaternion(quat_res);
+  for( int j = 0; j < 4; j++ )
+    tmp_q[j] = quat[j] + full_step*k3[j];
+  quatOmegaProduct( omega1, tmp_q, k4 );
+  
+  for( int j = 0; j < 4; j++ )
+    quat[j] += final_step*( k1[j] + _TDt(2.0)*( k2[j] + k3[j] ) + k4[j] );
+  
+  const _T inv_norm = _T(1.0)/sqrt( quat[0]*quat[0] + quat[1]*quat[1] + 
+                                    quat[2]*quat[2] + quat[3]*quat[3] );
+  for( int j = 0; j < 4; j++ )
+    quat[j] *= inv_norm;
+}
+
+template <typename _T> 
+  inline void imu_tk::quatIntegrationStepRK4Simd( _T quat[4], const _T omega0[3], 
+                                                  const _T omega1[3], const _T &dt )
+{
+  quatIntegrationStepRK4InPlace( quat, omega0, omega1, dt );
+}
+
+#if defined(__AVX__)
+
+/* Product between the omega skew matrix and a quaternion (see quatOmegaProduct()): 
+ * the signs of the omega skew matrix are folded in the (per-column) omega vectors */
+static inline __m256d quatOmegaProductSimd( const __m256d &quat, const __m256d omega[3] )
+{
+  const __m256d quat_1032 = _mm256_permute_pd( quat, 0x5 ), 
+                quat_2301 = _mm256_permute2f128_pd( quat, quat, 0x1 ),
+                quat_3210 = _mm256_permute_pd( quat_2301, 0x5 );
+  return _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd( quat_1032, omega[0] ), 
+                                       _mm256_mul_pd( quat_2301, omega[1] ) ),
+                        _mm256_mul_pd( quat_3210, omega[2] ) );
+}
+
+static inline void quatOmegaColumnsSimd( const double omega[3], __m256d omega_cols[3] )
+{
+  omega_cols[0] = _mm256_set_pd( -omega[0], omega[0], omega[0], -omega[0] );
+  omega_cols[1] = _mm256_set_pd( omega[1], omega[1], -omega[1], -omega[1] );
+  omega_cols[2] = _mm256_set_pd( omega[2], -omega[2], omega[2], -omega[2] );
+}
+
+inline void imu_tk::quatIntegrationStepRK4Simd( double quat[4], const double omega0[3], 
+                                                const double omega1[3], const double &dt )
+{
+  const double omega01[3] = { 0.5*( omega0[0] + omega1[0] ),
+                              0.5*( omega0[1] + omega1[1] ),
+                              0.5*( omega0[2] + omega1[2] ) };
+  __m256d omega0_cols[3], omega01_cols[3], omega1_cols[3];
+  quatOmegaColumnsSimd( omega0, omega0_cols );
+  quatOmegaColumnsSimd( omega01, omega01_cols );
+  quatOmegaColumnsSimd( omega1, omega1_cols );
+  
+  // The 1/2 factor of the quaternion derivative is folded into the step sizes
+  const __m256d half_step = _mm256_set1_pd( 0.25*dt ), full_step = _mm256_set1_pd( 0.5*dt ), 
+                final_step = _mm256_set1_pd( dt/12.0 ), two = _mm256_set1_pd( 2.0 );
+  
+  const __m256d q = _mm256_loadu_pd( quat );
+  const __m256d k1 = quatOmegaProductSimd( q, omega0_cols );
+  const __m256d k2 = quatOmegaProductSimd( _mm256_add_pd( q, _mm256_mul_pd( half_step, k1 ) ), omega01_cols );
+  const __m256d k3 = quatOmegaProductSimd( _mm256_add_pd( q, _mm256_mul_pd( half_step, k2 ) ), omega01_cols );
+  const __m256d k4 = quatOmegaProductSimd( _mm256_add_pd( q, _mm256_mul_pd( full_step, k3 ) ), omega1_cols );
+  
+  const __m256d k = _mm256_add_pd( _mm256_add_pd( k1, k4 ), 
+                                   _mm256_mul_pd( two, _mm256_add_pd( k2, k3 ) ) );
+  const __m256d res = _mm256_add_pd( q, _mm256_mul_pd( final_step, k ) );
+  
+  // Squared norm, broadcast to all the elements
+  __m256d sq_norm = _mm256_mul_pd( res, res );
+  sq_norm = _mm256_add_pd( sq_norm, _mm256_permute_pd( sq_norm, 0x5 ) );
+  sq_norm = _mm256_add_pd( sq_norm, _mm256_permute2f128_pd( sq_norm, sq_norm, 0x1 ) );
+  const __m256d inv_norm = _mm256_div_pd( _mm256_set1_pd( 1.0 ), _mm256_sqrt_pd( sq_norm ) );
+  
+  _mm256_storeu_pd( quat, _mm256_mul_pd( res, inv_norm ) );
+}
+
+#elif defined(__SSE2__)
+
+/* Double quaternions stored in two SSE2 registers: (w, x) and (y, z) */
+struct QuatSimd
+{
+  __m128d lo, hi;
+};
+
+static inline __m128d swapSimd( const __m128d &v ) { return _mm_shuffle_pd( v, v, 0x1 ); }
+
+/* Product between the omega skew matrix and a quaternion (see quatOmegaProduct()): 
+ * the signs of the omega skew matrix are folded in the (per-column) omega vectors */
+static inline QuatSimd quatOmegaProductSimd( const QuatSimd &quat, const QuatSimd omega[3] )
+{
+  const __m128d lo_10 = swapSimd( quat.lo ), hi_32 = swapSimd( quat.hi );
+  QuatSimd res;
+  res.lo = _mm_add_pd( _mm_add_pd( _mm_mul_pd( lo_10, omega[0].lo ), _mm_mul_pd( quat.hi, omega[1].lo ) ),
+                       _mm_mul_pd( hi_32, omega[2].lo ) );
+  res.hi = _mm_add_pd( _mm_add_pd( _mm_mul_pd( hi_32, omega[0].hi ), _mm_mul_pd( quat.lo, omega[1].hi ) ),
+                       _mm_mul_pd( lo_10, omega[2].hi ) );
+  return res;
+}
+
+static inline void quatOmegaColumnsSimd( const double omega[3], QuatSimd omega_cols[3] )
+{
+  omega_cols[0].lo = _mm_set_pd( omega[0], -omega[0] );
+  omega_cols[0].hi = _mm_set_pd( -omega[0], omega[0] );
+  omega_cols[1].lo = _mm_set1_pd( -omega[1] );
+  omega_cols[1].hi = _mm_set1_pd( omega[1] );
+  omega_cols[2].lo = _mm_set_pd( omega[2], -omega[2] );
+  omega_cols[2].hi = _mm_set_pd( omega[2], -omega[2] );
+}
+
+static inline QuatSimd quatAddScaledSimd( const QuatSimd &q, const __m128d &scale, const QuatSimd &k )
+{
+  QuatSimd res;
+  res.lo = _mm_add_pd( q.lo, _mm_mul_pd( scale, k.lo ) );
+  res.hi = _mm_add_pd( q.hi, _mm_mul_pd( scale, k.hi ) );
+  return res;
+}
+
+inline void imu_tk::quatIntegrationStepRK4Simd( double quat[4], const double omega0[3], 
+                                                const double omega1[3], const double &dt )
+{
+  const double omega01[3] = { 0.5*( omega0[0] + omega1[0] ),
+                              0.5*( omega0[1] + omega1[1] ),
+                              0.5*( omega0[2] + omega1[2] ) };
+  QuatSimd omega0_cols[3], omega01_cols[3], omega1_cols[3];
+  quatOmegaColumnsSimd( omega0, omega0_cols );
+  quatOmegaColumnsSimd( omega01, omega01_cols );
+  quatOmegaColumnsSimd( omega1, omega1_cols );
+  
+  // The 1/2 factor of the quaternion derivative is folded into the step sizes
+  const __m128d half_step = _mm_set1_pd( 0.25*dt ), full_step = _mm_set1_pd( 0.5*dt ), 
+                final_step = _mm_set1_pd( dt/12.0 ), two = _mm_set1_pd( 2.0 );
+  
+  QuatSimd q;
+  q.lo = _mm_loadu_pd( quat );
+  q.hi = _mm_loadu_pd( quat + 2 );
+  const QuatSimd k1 = quatOmegaProductSimd( q, omega0_cols );
+  const QuatSimd k2 = quatOmegaProductSimd( quatAddScaledSimd( q, half_step, k1 ), omega01_cols );
+  const QuatSimd k3 = quatOmegaProductSimd( quatAddScaledSimd( q, half_step, k2 ), omega01_cols );
+  const QuatSimd k4 = quatOmegaProductSimd( quatAddScaledSimd( q, full_step, k3 ), omega1_cols );
+  
+  QuatSimd k;
+  k.lo = _mm_add_pd( _mm_add_pd( k1.lo, k4.lo ), _mm_mul_pd( two, _mm_add_pd( k2.lo, k3.lo ) ) );
+  k.hi = _mm_add_pd( _mm_add_pd( k1.hi, k4.hi ), _mm_mul_pd( two, _mm_add_pd( k2.hi, k3.hi ) ) );
+  const QuatSimd res = quatAddScaledSimd( q, final_step, k );
+  
+  // Squared norm, broadcast to both the elements
+  __m128d sq_norm = _mm_add_pd( _mm_mul_pd( res.lo, res.lo ), _mm_mul_pd( res.hi, res.hi ) );
+  sq_norm = _mm_add_pd( sq_norm, swapSimd( sq_norm ) );
+  const __m128d inv_norm = _mm_div_pd( _mm_set1_pd( 1.0 ), _mm_sqrt_pd( sq_norm ) );
+  
+  _mm_storeu_pd( quat, _mm_mul_pd( res.lo, inv_norm ) );
+  _mm_storeu_pd( quat + 2, _mm_mul_pd( res.hi, inv_norm ) );
+}
+
+#endif
+
+#if defined(__SSE2__) || defined(__AVX__)
+
+static inline __m128 quatOmegaProductSimd( const __m128 &quat, const __m128 omega[3] )
+{
+  return _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_shuffle_ps( quat, quat, _MM_SHUFFLE( 2, 3, 0, 1 ) ), omega[0] ),
+                                 _mm_mul_ps( _mm_shuffle_ps( quat, quat, _MM_SHUFFLE( 1, 0, 3, 2 ) ), omega[1] ) ),
+                     _mm_mul_ps( _mm_shuffle_ps( quat, quat, _MM_SHUFFLE( 0, 1, 2, 3 ) ), omega[2] ) );
+}
+
+static inline void quatOmegaColumnsSimd( const float omega[3], __m128 omega_cols[3] )
+{
+  omega_cols[0] = _mm_set_ps( -omega[0], omega[0], omega[0], -omega[0] );
+  omega_cols[1] = _mm_set_ps( omega[1], omega[1], -omega[1], -omega[1] );
+  omega_cols[2] = _mm_set_ps( omega[2], -omega[2], omega[2], -omega[2] );
+}
+
+inline void imu_tk::quatIntegrationStepRK4Simd( float quat[4], const float omega0[3], 
+                                                const float omega1[3], const float &dt )
+{
+  const float omega01[3] = { 0.5f*( omega0[0] + omega1[0] ),
+                             0.5f*( omega0[1] + omega1[1] ),
+                             0.5f*( omega0[2] + omega1[2] ) };
+  __m128 omega0_cols[3], omega01_cols[3], omega1_cols[3];
+  quatOmegaColumnsSimd( omega0, omega0_cols );
+  quatOmegaColumnsSimd( omega01, omega01_cols );
+  quatOmegaColumnsSimd( omega1, omega1_cols );
+  
+  // The 1/2 factor of the quaternion derivative is folded into the step sizes
+  const __m128 half_step = _mm_set1_ps( 0.25f*dt ), full_step = _mm_set1_ps( 0.5f*dt ), 
+               final_step = _mm_set1_ps( dt/12.0f ), two = _mm_set1_ps( 2.0f );
+  
+  const __m128 q = _mm_loadu_ps( quat );
+  const __m128 k1 = quatOmegaProductSimd( q, omega0_cols );
+  const __m128 k2 = quatOmegaProductSimd( _mm_add_ps( q, _mm_mul_ps( half_step, k1 ) ), omega01_cols );
+  const __m128 k3 = quatOmegaProductSimd( _mm_add_ps( q, _mm_mul_ps( half_step, k2 ) ), omega01_cols );
+  const __m128 k4 = quatOmegaProductSimd( _mm_add_ps( q, _mm_mul_ps( full_step, k3 ) ), omega1_cols );
+  
+  const __m128 k = _mm_add_ps( _mm_add_ps( k1, k4 ), _mm_mul_ps( two, _mm_add_ps( k2, k3 ) ) );
+  const __m128 res = _mm_add_ps( q, _mm_mul_ps( final_step, k ) );
+  
+  // Squared norm, broadcast to all the elements
+  __m128 sq_norm = _mm_mul_ps( res, res );
+  sq_norm = _mm_add_ps( sq_norm, _mm_shuffle_ps( sq_norm, sq_norm, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+  sq_norm = _mm_add_ps( sq_norm, _mm_shuffle_ps( sq_norm, sq_norm, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+  const __m128 inv_norm = _mm_div_ps( _mm_set1_ps( 1.0f ), _mm_sqrt_ps( sq_norm ) );
+  
+  _mm_storeu_ps( quat, _mm_mul_ps( res, inv_norm ) );
+}
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+static inline float32x4_t quatOmegaProductSimd( const float32x4_t &quat, const float32x4_t omega[3] )
+{
+  const float32x4_t quat_2301 = vextq_f32( quat, quat, 2 );
+  float32x4_t res = vmulq_f32( vrev64q_f32( quat ), omega[0] );
+  res = vmlaq_f32( res, quat_2301, omega[1] );
+  return vmlaq_f32( res, vrev64q_f32( quat_2301 ), omega[2] );
+}
+
+static inline void quatOmegaColumnsSimd( const float omega[3], float32x4_t omega_cols[3] )
+{
+  const float cols[12] = { -omega[0], omega[0], omega[0], -omega[0],
+                           -omega[1], -omega[1], omega[1], omega[1],
+                           -omega[2], omega[2], -omega[2], omega[2] };
+  for( int j = 0; j < 3; j++ )
+    omega_cols[j] = vld1q_f32( cols + 4*j );
+}
+
+inline void imu_tk::quatIntegrationStepRK4Simd( float quat[4], const float omega0[3], 
+                                                const float omega1[3], const float &dt )
+{
+  const float omega01[3] = { 0.5f*( omega0[0] + omega1[0] ),
+                             0.5f*( omega0[1] + omega1[1] ),
+                             0.5f*( omega0[2] + omega1[2] ) };
+  float32x4_t omega0_cols[3], omega01_cols[3], omega1_cols[3];
+  quatOmegaColumnsSimd( omega0, omega0_cols );
+  quatOmegaColumnsSimd( omega01, omega01_cols );
+  quatOmegaColumnsSimd( omega1, omega1_cols );
+  
+  // The 1/2 factor of the quaternion derivative is folded into the step sizes
+  const float half_step = 0.25f*dt, full_step = 0.5f*dt, final_step = dt/12.0f;
+  
+  const float32x4_t q = vld1q_f32( quat );
+  const float32x4_t k1 = quatOmegaProductSimd( q, omega0_cols );
+  const float32x4_t k2 = quatOmegaProductSimd( vmlaq_n_f32( q, k1, half_step ), omega01_cols );
+  const float32x4_t k3 = quatOmegaProductSimd( vmlaq_n_f32( q, k2, half_step ), omega01_cols );
+  const float32x4_t k4 = quatOmegaProductSimd( vmlaq_n_f32( q, k3, full_step ), omega1_cols );
+  
+  const float32x4_t k = vmlaq_n_f32( vaddq_f32( k1, k4 ), vaddq_f32( k2, k3 ), 2.0f );
+  const float32x4_t res = vmlaq_n_f32( q, k, final_step );
+  
+  const float32x4_t sq = vmulq_f32( res, res );
+#if defined(__aarch64__)
+  const float sq_norm = vaddvq_f32( sq );
+#else
+  float32x2_t sum = vadd_f32( vget_low_f32( sq ), vget_high_f32( sq ) );
+  sum = vpadd_f32( sum, sum );
+  const float sq_norm = vget_lane_f32( sum, 0 );
+#endif
+  
+  vst1q_f32( quat, vmulq_n_f32( res, 1.0f/std::sqrt( sq_norm ) ) );
+}
+
+#endif
+
+template <typename _T> 
+  inline void imu_tk::quatIntegrationStepFirstOrder( _T quat[4], const _T omega0[3], 
+                                                     const _T omega1[3], const _T &dt )
+{
+  using std::sqrt;
+  
+  const _T omega01[3] = { _T(0.5)*( omega0[0] + omega1[0] ),
+                          _T(0.5)*( omega0[1] + omega1[1] ),
+                          _T(0.5)*( omega0[2] + omega1[2] ) };
+  _T k[4];
+  quatOmegaProduct( omega01, quat, k );
+  
+  const _T half_dt = _T(0.5)*dt;
+  for( int j = 0; j < 4; j++ )
+    quat[j] += half_dt*k[j];
+  
+  const _T inv_norm = _T(1.0)/sqrt( quat[0]*quat[0] + quat[1]*quat[1] + 
+                                    quat[2]*quat[2] + quat[3]*quat[3] );
+  for( int j = 0; j < 4; j++ )
+    quat[j] *= inv_norm;
+}
+
+template <typename _T> 
+  inline void imu_tk::quatIntegrationStepZeroOrderHold( _T quat[4], const _T omega0[3], 
+                                                        const _T omega1[3], const _T &dt )
+{
+  using std::sqrt;
+  using std::sin;
+  using std::cos;
+  
+  const _T omega01[3] = { _T(0.5)*( omega0[0] + omega1[0] ),
+                          _T(0.5)*( omega0[1] + omega1[1] ),
+                          _T(0.5)*( omega0[2] + omega1[2] ) };
+  const _T omega_norm = sqrt( omega01[0]*omega01[0] + omega01[1]*omega01[1] + omega01[2]*omega01[2] );
+  const _T half_angle = _T(0.5)*dt*omega_norm;
+  
+  // Rotation increment exp( dt*omega/2 ), with the Taylor expansion for small angles 
+  _T cos_half, sin_half_omega;
+  if( half_angle*half_angle < std::numeric_limits<_T>::epsilon() )
+  {
+    cos_half = _T(1.0) - _T(0.5)*half_angle*half_angle;
+    sin_half_omega = _T(0.5)*dt*( _T(1.0) - half_angle*half_angle/_T(6.0) );
+  }
+  else
+  {
+    cos_half = cos( half_angle );
+    sin_half_omega = sin( half_angle )/omega_norm;
+  }
+  
+  const _T delta_quat[4] = { cos_half, sin_half_omega*omega01[0], 
+                             sin_half_omega*omega01[1], sin_half_omega*omega01[2] };
+  const _T prev_quat[4] = { quat[0], quat[1], quat[2], quat[3] };
+  quaternionProduct( prev_quat, delta_quat, quat );
+  
+  const _T inv_norm = _T(1.0)/sqrt( quat[0]*quat[0] + quat[1]*quat[1] + 
+                                    quat[2]*quat[2] + quat[3]*quat[3] );
+  for( int j = 0; j < 4; j++ )
+    quat[j] *= inv_norm;
+}
+
+template <typename _T> 
+  inline void imu_tk::quatIntegrationStep( _T quat[4], const _T omega0[3], const _T omega1[3], 
+                                           const _T &dt, QuatIntegrationMethod method )
+{
+  switch( method )
+  {
+    case QUAT_INTEGRATION_FIRST_ORDER:
+      quatIntegrationStepFirstOrder( quat, omega0, omega1, dt );
+      break;
+    case QUAT_INTEGRATION_ZERO_ORDER_HOLD:
+      quatIntegrationStepZeroOrderHold( quat, omega0, omega1, dt );
+      break;
+    case QUAT_INTEGRATION_RK4:
+    default:
+      quatIntegrationStepRK4Simd( quat, omega0, omega1, dt );
+      break;
+  }
 }
 
 template <typename _T> 
@@ -179,7 +765,8 @@ template <typename _T>
 
 template <typename _T> void imu_tk::integrateGyroInterval( const std::vector< TriadData_<_T> > &gyro_samples, 
                                                            Eigen::Matrix< _T, 4, 1> &quat_res,
-                                                           _T data_dt, const DataInterval &interval )
+                                                           _T data_dt, const DataInterval &interval,
+                                                           QuatIntegrationMethod method )
 {
   DataInterval rev_interval =  checkInterval( gyro_samples, interval );
 
@@ -189,20 +776,131 @@ template <typename _T> void imu_tk::integrateGyroInterval( const std::vector< Tr
   {
     _T dt = ( data_dt > _T(0))?data_dt:gyro_samples[i+1].timestamp() - gyro_samples[i].timestamp();
     
-    quatIntegrationStepRK4( quat_res,
-                            gyro_samples[i].data(), 
-                            gyro_samples[i + 1].data(), 
-                            dt,
-                            quat_res );
+    quatIntegrationStep( quat_res.data(),
+                         gyro_samples[i].data().data(), 
+                         gyro_samples[i + 1].data().data(), 
+                         dt, method );
   }
 }
 
 template <typename _T> void imu_tk::integrateGyroInterval( const std::vector< TriadData_<_T> >& gyro_samples, 
                                                            Eigen::Matrix< _T, 3 , 3  >& rot_res, 
-                                                           _T data_dt, const DataInterval& interval )
+                                                           _T data_dt, const DataInterval& interval,
+                                                           QuatIntegrationMethod method )
+{
+  Eigen::Matrix< _T, 4, 1> quat_res;
+  integrateGyroInterval( gyro_samples, quat_res, data_dt, interval, method );
+  quaternionToRotation( quat_res.data(), rot_res );
+}
+
+template <typename _T> void imu_tk::integrateGyroInterval( const TriadBuffer_<_T> &gyro_samples, 
+                                                           Eigen::Matrix< _T, 4, 1> &quat_res,
+                                                           _T data_dt, const DataInterval &interval,
+                                                           QuatIntegrationMethod method )
+{
+  DataInterval rev_interval =  checkInterval( gyro_samples, interval );
+
+  quat_res = Eigen::Matrix< _T, 4, 1>(_T(1.0), _T(0), _T(0), _T(0)); // Identity quaternion
+  
+  _T omega0[3], omega1[3];
+  for( int j = 0; j < 3; j++ )
+    omega1[j] = gyro_samples( rev_interval.start_idx, j );
+  
+  for( int i = rev_interval.start_idx; i < rev_interval.end_idx; i++)
+  {
+    _T dt = ( data_dt > _T(0))?data_dt:gyro_samples.timestamp(i+1) - gyro_samples.timestamp(i);
+    
+    for( int j = 0; j < 3; j++ )
+    {
+      omega0[j] = omega1[j];
+      omega1[j] = gyro_samples( i + 1, j );
+    }
+    quatIntegrationStep( quat_res.data(), omega0, omega1, dt, method );
+  }
+}
+
+template <typename _T> void imu_tk::integrateGyroInterval( const TriadBuffer_<_T>& gyro_samples, 
+                                                           Eigen::Matrix< _T, 3 , 3  >& rot_res, 
+                                                           _T data_dt, const DataInterval& interval,
+                                                           QuatIntegrationMethod method )
 {
   Eigen::Matrix< _T, 4, 1> quat_res;
-  integrateGyroInterval( gyro_samples, quat_res, data_dt, interval );
-  ceres::MatrixAdapter<_T, 1, 3> rot_mat = ceres::ColumnMajorAdapter3x3(rot_res.data());
-  ceres::QuaternionToRotation( quat_res.data(), rot_mat );
-}
\ No newline at end of file
+  integrateGyroInterval( gyro_samples, quat_res, data_dt, interval, method );
+  quaternionToRotation( quat_res.data(), rot_res );
+}
+
+template <typename _T> void imu_tk::integrateGyroStream( const TriadBuffer_<_T> &gyro_samples, _T *quats, 
+                                                         _T data_dt, const DataInterval &interval,
+                                                         QuatIntegrationMethod method )
+{
+  DataInterval rev_interval =  checkInterval( gyro_samples, interval );
+  
+  // Identity quaternion
+  _T quat[4] = { _T(1.0), _T(0), _T(0), _T(0) };
+  std::copy( quat, quat + 4, quats );
+  
+  _T omega0[3], omega1[3];
+  for( int j = 0; j < 3; j++ )
+    omega1[j] = gyro_samples( rev_interval.start_idx, j );
+  
+  for( int i = rev_interval.start_idx; i < rev_interval.end_idx; i++)
+  {
+    _T dt = ( data_dt > _T(0))?data_dt:gyro_samples.timestamp(i+1) - gyro_samples.timestamp(i);
+    
+    for( int j = 0; j < 3; j++ )
+    {
+      omega0[j] = omega1[j];
+      omega1[j] = gyro_samples( i + 1, j );
+    }
+    quatIntegrationStep( quat, omega0, omega1, dt, method );
+    quats += 4;
+    std::copy( quat, quat + 4, quats );
+  }
+}
+
+template <typename _T> void imu_tk::integrateGyroStream( const std::vector< TriadData_<_T> > &gyro_samples, 
+                                                         _T *quats, _T data_dt, const DataInterval &interval,
+                                                         QuatIntegrationMethod method )
+{
+  integrateGyroStream( TriadBuffer_<_T>( gyro_samples ), quats, data_dt, interval, method );
+}
+
+template <typename _T> void imu_tk::integrateGyroCheckpoints( const TriadBuffer_<_T> &gyro_samples, 
+                                                              const std::vector< int > &checkpoints,
+                                                              _T *quats, _T data_dt,
+                                                              QuatIntegrationMethod method )
+{
+  // Identity quaternion
+  _T quat[4] = { _T(1.0), _T(0), _T(0), _T(0) };
+  int i = 0;
+  for( int k = 0; k < int(checkpoints.size()); k++ )
+  {
+    if( checkpoints[k] < i || checkpoints[k] >= gyro_samples.size() )
+      throw std::invalid_argument("Invalid checkpoints");
+    
+    for( ; i < checkpoints[k]; i++ )
+    {
+      _T dt = ( data_dt > _T(0))?data_dt:gyro_samples.timestamp(i+1) - gyro_samples.timestamp(i);
+      const _T omega0[3] = { gyro_samples( i, 0 ), gyro_samples( i, 1 ), gyro_samples( i, 2 ) },
+               omega1[3] = { gyro_samples( i + 1, 0 ), gyro_samples( i + 1, 1 ), gyro_samples( i + 1, 2 ) };
+      quatIntegrationStep( quat, omega0, omega1, dt, method );
+    }
+    std::copy( quat, quat + 4, quats + 4*k );
+  }
+}
+
+template <typename _T> void imu_tk::integrateGyroCheckpoints( const std::vector< TriadData_<_T> > &gyro_samples, 
+                                                              const std::vector< int > &checkpoints,
+                                                              _T *quats, _T data_dt,
+                                                              QuatIntegrationMethod method )
+{
+  integrateGyroCheckpoints( TriadBuffer_<_T>( gyro_samples ), checkpoints, quats, data_dt, method );
+}
+
+template <typename _T> inline void imu_tk::relativeQuaternion( const _T quat0[4], const _T quat1[4], 
+                                                               _T quat_res[4] )
+{
+  // The inverse of a unit quaternion is its conjugate
+  const _T inv_quat0[4] = { quat0[0], -quat0[1], -quat0[2], -quat0[3] };
+  quaternionProduct( inv_quat0, quat1, quat_res );
+}
@@ -29,8 +29,10 @@
 #pragma once
 
 #include <vector>
+#include <cstdio>
 
 #include "imu_tk/base.h"
+#include "imu_tk/hash.h"
 
 namespace imu_tk
 {
@@ -47,23 +49,209 @@ enum DatasetType
   DATASET_COMMA_SEPARATED
 };
 
+/** @brief Physical quantity measured by a data triad, stored in the binary data files */
+enum TriadType
+{
+  TRIAD_UNKNOWN = 0,
+  TRIAD_ACC     = 1, 
+  TRIAD_GYRO    = 2,
+  TRIAD_MAG     = 3
+};
+
+/** @brief Description of the content of a binary data file (see exportBinaryData()) */
+struct BinaryDataInfo
+{
+  BinaryDataInfo() : version(0), n_samples(0), sample_rate(0), double_precision(true) {};
+  
+  /** @brief File format version */
+  int version;
+  /** @brief Number of samples of each triad */
+  int n_samples;
+  /** @brief Nominal sample rate in Hz, 0 if unknown */
+  double sample_rate;
+  /** @brief True if the values are stored as doubles, false if stored as floats */
+  bool double_precision;
+  /** @brief Type of each triad */
+  std::vector< TriadType > triad_types;
+  /** @brief For each triad, true if the interval ids are stored */
+  std::vector< bool > has_interval_ids;
+};
+
+/** @brief Import a sequence of data triads from an ASCII file, one sample per line, 
+ *         in the format "timestamp, x, y, z, interval_id"
+ * 
+ * @param filename Input file name
+ * @param[out] samples Imported samples
+ * @param unit Unit of the timestamps in the file, the imported timestamps are in seconds
+ * @param type Dataset format
+ * @param n_threads If greater than 1, the file is split in n_threads chunks of lines 
+ *                  parsed in parallel
+ * @param[out] samples_hash If not NULL, the hash of the imported samples (the same provided
+ *                          by samplesHash() ), computed while the samples are imported
+ * 
+ * The numbers are parsed independently of the current locale (the "nan" and "inf" 
+ * values are accepted, as by strtod()). Invalid lines are reported and skipped.
+ */
 template <typename _T> 
   void importAsciiData( const char *filename,
                         std::vector< TriadData_<_T> > &samples, 
                         TimestampUnit unit = TIMESTAMP_UNIT_USEC,
-                        DatasetType type = DATASET_COMMA_SEPARATED );
+                        DatasetType type = DATASET_COMMA_SEPARATED,
+                        int n_threads = 1, uint64_t *samples_hash = NULL );
 
+/** @brief Import two sequences of data triads sharing the same timestamps 
+ *         (e.g., accelerometers and gyroscopes) from an ASCII file, in the format 
+ *         "timestamp, x0, y0, z0, x1, y1, z1", see importAsciiData() */
 template <typename _T>
   void importAsciiData( const char *filename,
                         std::vector< TriadData_<_T> > &samples0,
                         std::vector< TriadData_<_T> > &samples1,
                         TimestampUnit unit = TIMESTAMP_UNIT_USEC,
-                        DatasetType type = DATASET_COMMA_SEPARATED );
+                        DatasetType type = DATASET_COMMA_SEPARATED,
+                        int n_threads = 1 );
+
+/** @brief Import three sequences of data triads sharing the same timestamps 
+ *         from an ASCII file, in the format 
+ *         "timestamp, x0, y0, z0, x1, y1, z1, x2, y2, z2", see importAsciiData() */
 template <typename _T>
   void importAsciiData( const char *filename,
                         std::vector< TriadData_<_T> > &samples0,
                         std::vector< TriadData_<_T> > &samples1,
                         std::vector< TriadData_<_T> > &samples2,
                         TimestampUnit unit = TIMESTAMP_UNIT_USEC,
-                        DatasetType type = DATASET_COMMA_SEPARATED );
+                        DatasetType type = DATASET_COMMA_SEPARATED,
+                        int n_threads = 1 );
+
+/** @brief Sequential reader of the ASCII files read by importAsciiData(): the samples 
+ *         are parsed and provided in chunks, while the file is being read, so 
+ *         the whole file content does not need to be stored in memory 
+ *         (see TriadDataSource_) */
+template <typename _T> class AsciiDataReader_ : public TriadDataSource_<_T>
+{
+public:
+  AsciiDataReader_();
+  ~AsciiDataReader_();
+  
+  /** @brief Open an ASCII data file
+   * 
+   * @param filename Input file name
+   * @param unit Unit of the timestamps in the file, the provided timestamps are in seconds
+   * @param type Dataset format
+   * @param n_triads Number of data triads stored in each line (from 1 to 3, see 
+   *                 importAsciiData()). Only the files with a single triad store 
+   *                 the interval ids
+   * @param triad_index Index of the triad to be read (from 0 to n_triads - 1)
+   * 
+   * @return True on success, false otherwise
+   */
+  bool open( const char *filename, 
+             TimestampUnit unit = TIMESTAMP_UNIT_USEC,
+             DatasetType type = DATASET_COMMA_SEPARATED,
+             int n_triads = 1, int triad_index = 0 );
+  
+  /** @brief Close the file */
+  void close();
+  
+  bool isOpen() const { return file_ != NULL; };
+  
+  /** @brief Read the next chunk of samples (see TriadDataSource_::read()). As for 
+   *         importAsciiData(), invalid lines are reported and skipped */
+  virtual int read( TriadBuffer_<_T> &chunk, int max_samples );
+  
+private:
+  AsciiDataReader_( const AsciiDataReader_ & );
+  AsciiDataReader_ &operator=( const AsciiDataReader_ & );
+  
+  /* Remove the already parsed data from the buffer, and read 
+   * a new block from the file. Returns false at the end of the file */
+  bool fillBuffer();
+  
+  FILE *file_;
+  TimestampUnit unit_;
+  int n_triads_, triad_index_;
+  std::vector< char > buffer_;
+  size_t buffer_begin_, buffer_end_;
+  bool eof_;
+  int line_;
+};
+
+typedef AsciiDataReader_<double> AsciiDataReader;
+
+/** @brief Save a set of data triads sharing the same timestamps (e.g., the accelerometers 
+ *         and gyroscopes readings) in a binary data file
+ * 
+ * @param filename Output file name
+ * @param triads Input data triads, with the same number of samples. The timestamps 
+ *               (in seconds) are taken from the first triad
+ * @param sample_rate Nominal sample rate in Hz (0 if unknown)
+ * @param triad_types Type of each triad (if empty, all the triads are TRIAD_UNKNOWN)
+ * @param save_interval_ids If true, the interval ids are saved for each triad 
+ *                          (see staticIntervalsDetector())
+ * 
+ * The file starts with a fixed size header (format version, data type, number of samples 
+ * and triads, sample rate, timestamps unit and the triad types), followed by a columnar 
+ * payload: the timestamps, the x, y and z values of each triad and eventually the 
+ * interval ids of each triad, each one in a contiguous array aligned to 64 bytes. 
+ * The values are stored as doubles or floats, depending on _T, with the native 
+ * (little-endian) byte order.
+ * 
+ * @return True on success, false otherwise
+ */
+template <typename _T>
+  bool exportBinaryData( const char *filename, 
+                         const std::vector< TriadBuffer_<_T> > &triads,
+                         double sample_rate = 0,
+                         const std::vector< TriadType > &triad_types = std::vector< TriadType >(),
+                         bool save_interval_ids = true );
+
+/** @brief Save a single data triad in a binary data file, see exportBinaryData() */
+template <typename _T>
+  bool exportBinaryData( const char *filename, 
+                         const TriadBuffer_<_T> &samples,
+                         double sample_rate = 0, TriadType triad_type = TRIAD_UNKNOWN,
+                         bool save_interval_ids = true );
+
+/** @brief Read the header of a binary data file (see exportBinaryData())
+ * 
+ * @return True on success, false if the file can't be read or it is not a valid file
+ */
+bool readBinaryDataInfo( const char *filename, BinaryDataInfo &info );
+
+/** @brief Load all the data triads stored in a binary data file (see exportBinaryData())
+ * 
+ * @param filename Input file name
+ * @param[out] triads Loaded data triads
+ * @param[out] info If not NULL, the description of the file content
+ * 
+ * The file is memory mapped (if supported by the system): if the file data type 
+ * matches _T, the output buffers directly refer to the mapped data, without copying 
+ * or parsing it. The data is copied only if a buffer is modified 
+ * (see TriadBuffer_), and the file is unmapped when all the buffers have been released.
+ * If the interval ids are not stored for a triad, they are set to -1.
+ * 
+ * @return True on success, false otherwise
+ */
+template <typename _T>
+  bool importBinaryData( const char *filename, 
+                         std::vector< TriadBuffer_<_T> > &triads,
+                         BinaryDataInfo *info = NULL );
+
+/** @brief Load the first data triad stored in a binary data file, see importBinaryData() */
+template <typename _T>
+  bool importBinaryData( const char *filename, TriadBuffer_<_T> &samples );
+
+/** @brief Load the first two data triads stored in a binary data file, 
+ *         see importBinaryData() */
+template <typename _T>
+  bool importBinaryData( const char *filename, 
+                         TriadBuffer_<_T> &samples0, 
+                         TriadBuffer_<_T> &samples1 );
+
+/** @brief Load the first three data triads stored in a binary data file, 
+ *         see importBinaryData() */
+template <typename _T>
+  bool importBinaryData( const char *filename, 
+                         TriadBuffer_<_T> &samples0, 
+                         TriadBuffer_<_T> &samples1, 
+                         TriadBuffer_<_T> &samples2 );
 }
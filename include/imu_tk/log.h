@@ -0,0 +1,105 @@
+/* 
+ * imu_tk - Inertial Measurement Unit Toolkit
+ * 
+ *  Copyright (c) 2014, Alberto Pretto <pretto@diag.uniroma1.it>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ * 
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ * 
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <sstream>
+#include <string>
+
+/** @brief Maximum log level compiled in the code: the log messages with a greater level 
+ *         (by default only LOG_LEVEL_TRACE, used inside the per-sample loops) are removed 
+ *         at compile time */
+#ifndef IMU_TK_LOG_MAX_LEVEL
+#define IMU_TK_LOG_MAX_LEVEL 4
+#endif
+
+/** @brief Log a message (composed with the stream insertion operator, e.g. 
+ *         IMU_TK_LOG( imu_tk::LOG_LEVEL_INFO, "value : "<<value ) ) if level is enabled 
+ *         (see imu_tk::logLevel()). The message is composed only if it is actually logged */
+#define IMU_TK_LOG( level, msg )                                            \
+  do                                                                        \
+  {                                                                         \
+    if( (level) <= IMU_TK_LOG_MAX_LEVEL && imu_tk::logEnabled( level ) )    \
+    {                                                                       \
+      std::ostringstream imu_tk_log_stream;                                 \
+      imu_tk_log_stream << msg;                                             \
+      imu_tk::logMessage( level, imu_tk_log_stream.str() );                 \
+    }                                                                       \
+  } while( 0 )
+
+#define IMU_TK_LOG_ERROR( msg ) IMU_TK_LOG( imu_tk::LOG_LEVEL_ERROR, msg )
+#define IMU_TK_LOG_WARNING( msg ) IMU_TK_LOG( imu_tk::LOG_LEVEL_WARNING, msg )
+#define IMU_TK_LOG_INFO( msg ) IMU_TK_LOG( imu_tk::LOG_LEVEL_INFO, msg )
+#define IMU_TK_LOG_DEBUG( msg ) IMU_TK_LOG( imu_tk::LOG_LEVEL_DEBUG, msg )
+#define IMU_TK_LOG_TRACE( msg ) IMU_TK_LOG( imu_tk::LOG_LEVEL_TRACE, msg )
+
+namespace imu_tk
+{
+/** @brief Log messages levels, by increasing verbosity */
+enum LogLevel
+{
+  LOG_LEVEL_NONE    = 0,
+  LOG_LEVEL_ERROR   = 1,
+  LOG_LEVEL_WARNING = 2,
+  LOG_LEVEL_INFO    = 3,
+  LOG_LEVEL_DEBUG   = 4,
+  LOG_LEVEL_TRACE   = 5
+};
+
+/** @brief Set the global log level (LOG_LEVEL_INFO by default): only the messages with 
+ *         a level lower or equal to it are logged */
+void setLogLevel( LogLevel level );
+
+/** @brief Provide the current log level for the calling thread, i.e. the level set by 
+ *         the innermost ScopedLogLevel object, if any, or the global log level otherwise */
+LogLevel logLevel();
+
+/** @brief True if the messages with the given level are currently logged */
+inline bool logEnabled( LogLevel level ) { return level <= logLevel(); };
+
+/** @brief Write a log message (followed by a new line) to the standard output, 
+ *         without flushing it, or to the standard error for the errors and the warnings. 
+ *         Concurrent messages are not interleaved */
+void logMessage( LogLevel level, const std::string &msg );
+
+/** @brief Set the log level of the calling thread for the lifetime of the object, 
+ *         restoring the previous one on destruction (e.g., MultiPosCalibration_ sets it
+ *         during a calibration, depending on its verbose output flag) */
+class ScopedLogLevel
+{
+public:
+  explicit ScopedLogLevel( LogLevel level );
+  ~ScopedLogLevel();
+  
+private:
+  ScopedLogLevel( const ScopedLogLevel & );
+  ScopedLogLevel &operator=( const ScopedLogLevel & );
+  
+  int prev_level_;
+};
+}
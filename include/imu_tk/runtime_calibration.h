@@ -0,0 +1,433 @@
+/* 
+ * imu_tk - Inertial Measurement Unit Toolkit
+ * 
+ *  Copyright (c) 2014, Alberto Pretto <pretto@diag.uniroma1.it>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ * 
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ * 
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <Eigen/Core>
+
+#include "imu_tk/base.h"
+#include "imu_tk/calibrated_triad.h"
+
+namespace imu_tk
+{
+  
+/** @brief Block correction of the raw readings of a sensor triad, to be used at runtime 
+ *         (e.g., inside a sensor driver) to apply a calibration estimated off-line.
+ * 
+ * The correction applies the equation X' = T*K*(X - B) (see CalibratedTriad_) rewritten as 
+ * 
+ * X' = M*R - O
+ * 
+ * with R the raw counts, X = s*R the readings used to estimate the calibration (s is the 
+ * raw counts scale, 1 if the calibration has been estimated directly from the raw counts),
+ * M = s*T*K the precomputed misalignment * scale matrix and O = T*K*B the normalized biases.
+ * The samples are corrected in blocks of BLOCK_SIZE samples with fixed size Eigen 
+ * expressions (vectorized by Eigen with SSE/AVX/NEON where available), 
+ * without any memory allocation. 
+ * The corrected samples can be written over the raw ones (in place correction).
+ */
+template < typename _T > class TriadCorrection_
+{
+public:
+  enum { BLOCK_SIZE = 64 };
+  
+  /** @brief Identity correction */
+  TriadCorrection_() : 
+    ms_mat_( Eigen::Matrix< _T, 3 , 3>::Identity() ), 
+    offset_vec_( Eigen::Matrix< _T, 3 , 1>::Zero() ) {};
+  
+  /** @brief Build the correction from a misalignment * scale matrix T*K and a bias vector B
+   * 
+   * @param raw_scale The raw counts scale s (see TriadCorrection_)
+   */
+  TriadCorrection_( const Eigen::Matrix< _T, 3 , 3> &ms_mat, const Eigen::Matrix< _T, 3 , 1> &bias_vec,
+                    _T raw_scale = _T(1) ) :
+    ms_mat_( raw_scale*ms_mat ), offset_vec_( ms_mat*bias_vec ) {};
+  
+  /** @brief Build the correction from a calibration
+   * 
+   * @param raw_scale The raw counts scale s (see TriadCorrection_)
+   */
+  explicit TriadCorrection_( const CalibratedTriad_<_T> &calib, _T raw_scale = _T(1) ) :
+    ms_mat_( raw_scale*calib.getMisalignmentScaleMatrix() ), 
+    offset_vec_( calib.getMisalignmentScaleMatrix()*calib.getBiasVector() ) {};
+  
+  /** @brief Build the correction from the plain calibration parameters storage
+   * 
+   * @param raw_scale The raw counts scale s (see TriadCorrection_)
+   */
+  explicit TriadCorrection_( const TriadCalibrationParams_<_T> &params, _T raw_scale = _T(1) ) :
+    TriadCorrection_( CalibratedTriad_<_T>( params ), raw_scale ) {};
+    
+  /** @brief Provide the misalignment * scale matrix M applied to the raw counts */
+  inline const Eigen::Matrix< _T, 3 , 3>& getMatrix() const { return ms_mat_; };
+  /** @brief Provide the normalized biases O subtracted after the product with M */
+  inline const Eigen::Matrix< _T, 3 , 1>& getOffsetVector() const { return offset_vec_; };
+  
+  /** @brief Correct n_samples samples stored in separated (SoA) x, y, z arrays
+   * 
+   * @param raw_x, raw_y, raw_z Input raw counts (e.g., int16_t, int32_t, float or _T)
+   * @param x, y, z Output corrected samples: they can be the input arrays, 
+   *                if the raw counts are of type _T
+   */
+  template < typename _TRaw > 
+    void apply( const _TRaw *raw_x, const _TRaw *raw_y, const _TRaw *raw_z, 
+                _T *x, _T *y, _T *z, int n_samples ) const;
+  
+  /** @brief Correct in place n_samples samples stored in separated (SoA) x, y, z arrays */
+  inline void apply( _T *x, _T *y, _T *z, int n_samples ) const 
+  { 
+    apply( x, y, z, x, y, z, n_samples ); 
+  };
+  
+  /** @brief Correct in place the samples of a data samples buffer */
+  inline void apply( TriadBuffer_<_T> &samples ) const
+  { 
+    apply( samples.x(), samples.y(), samples.z(), samples.size() ); 
+  };
+  
+  /** @brief Correct n_samples interleaved samples (x0, y0, z0, x1, y1, z1, ...)
+   * 
+   * @param raw_xyz Input raw counts (e.g., int16_t, int32_t, float or _T), 3*n_samples elements
+   * @param xyz Output corrected samples, 3*n_samples elements: it can be the input array, 
+   *            if the raw counts are of type _T
+   */
+  template < typename _TRaw > 
+    void applyInterleaved( const _TRaw *raw_xyz, _T *xyz, int n_samples ) const;
+  
+  /** @brief Correct in place n_samples interleaved samples (x0, y0, z0, x1, y1, z1, ...) */
+  inline void applyInterleaved( _T *xyz, int n_samples ) const 
+  { 
+    applyInterleaved( xyz, xyz, n_samples ); 
+  };
+  
+private:
+  
+  Eigen::Matrix< _T, 3 , 3> ms_mat_;
+  Eigen::Matrix< _T, 3 , 1> offset_vec_;
+};
+
+typedef TriadCorrection_<double> TriadCorrection;
+
+/** @brief Read-only view of the calibrated samples of a data samples buffer, that
+ *         applies the calibration on access (one sample at time, or in blocks) 
+ *         instead of storing a calibrated copy of the samples.
+ * 
+ * The view keeps a (copy on write, see TriadBuffer_) copy of the raw samples buffer, 
+ * i.e. it shares its storage without copying the samples.
+ */
+template < typename _T > class CalibratedSamplesView_
+{
+public:
+  /** @brief Construct an empty view */
+  CalibratedSamplesView_() {};
+  
+  /** @brief Construct the view of the raw samples corrected by a calibration */
+  CalibratedSamplesView_( const TriadBuffer_<_T> &raw_samples, const CalibratedTriad_<_T> &calib ) :
+    raw_samples_( raw_samples ), calib_( calib ), correction_( calib ) {};
+  
+  inline int size() const { return raw_samples_.size(); };
+  inline bool empty() const { return raw_samples_.empty(); };
+  
+  /** @brief Provide the (not calibrated) samples buffer */
+  inline const TriadBuffer_<_T>& rawSamples() const { return raw_samples_; };
+  /** @brief Provide the calibration applied to the samples */
+  inline const CalibratedTriad_<_T>& calibration() const { return calib_; };
+  
+  inline const _T& timestamp( int i ) const { return raw_samples_.timestamp(i); };
+  /** @brief Provide the i-th calibrated sample values, see CalibratedTriad_::unbiasNormalize() */
+  inline Eigen::Matrix< _T, 3, 1> data( int i ) const 
+  { 
+    return calib_.unbiasNormalize( raw_samples_.data(i) ); 
+  };
+  /** @brief Provide the i-th calibrated sample, with its timestamp and its interval id */
+  inline TriadData_<_T> operator[] ( int i ) const 
+  { 
+    return TriadData_<_T>( timestamp(i), data(i), raw_samples_.interval_id(i) ); 
+  };
+  
+  /** @brief Calibrate the samples [start, start + n_samples) into the x, y, z arrays 
+   *         (see TriadCorrection_::apply()) */
+  inline void block( int start, int n_samples, _T *x, _T *y, _T *z ) const
+  {
+    correction_.apply( raw_samples_.x() + start, raw_samples_.y() + start, raw_samples_.z() + start,
+                       x, y, z, n_samples );
+  };
+  
+  /** @brief Provide a buffer with all the calibrated samples */
+  TriadBuffer_<_T> materialize() const;
+  
+  /** @brief Store all the calibrated samples in a sequence of TriadData_ objects */
+  void materialize( std::vector< TriadData_<_T> > &samples ) const;
+  
+private:
+  
+  TriadBuffer_<_T> raw_samples_;
+  CalibratedTriad_<_T> calib_;
+  TriadCorrection_<_T> correction_;
+};
+
+/** @brief Fixed-point version of TriadCorrection_, that corrects integer raw counts 
+ *         with integer arithmetic only (e.g., for processors without FPU)
+ * 
+ * The corrected readings are provided as int32_t values in units of 1/output_scale 
+ * (e.g., output_scale = 1000 provides the accelerations in mm/s^2 for a calibration 
+ * estimated in m/s^2), rounded to the nearest integer and saturated. 
+ * The elements of the matrix M are stored with frac_bits fractional bits, and the products
+ * are accumulated in 64 bits: the rounding error (in 1/output_scale units) is 
+ * about 0.5 + (|R_x| + |R_y| + |R_z|)/2^(frac_bits+1).
+ * 
+ * The raw counts can be of any integer type with at most 31 value bits (e.g., int16_t, 
+ * uint16_t or int32_t, not uint32_t or int64_t). The constructors require the sum of the 
+ * absolute values of each row of the fixed point matrix to be less than 2^31 and the fixed 
+ * point offsets to be less than 2^61 in absolute value, so that the 64 bits accumulation
+ * can't overflow for any raw count of 32 bits.
+ */
+class FixedPointTriadCorrection
+{
+public:
+  /** @brief Identity correction */
+  FixedPointTriadCorrection() 
+  { 
+    init( Eigen::Matrix3d::Identity(), Eigen::Vector3d::Zero(), 1.0, 1.0, 16 ); 
+  };
+  
+  /** @brief Build the correction from a misalignment * scale matrix T*K and a bias vector B
+   * 
+   * @param raw_scale The raw counts scale s (see TriadCorrection_)
+   * @param output_scale Scale of the integer corrected readings
+   * @param frac_bits Number of fractional bits of the fixed point matrix elements, in [1, 30]
+   * 
+   * \throws std::invalid_argument if frac_bits is out of range, or the fixed point matrix or
+   *         offsets, with frac_bits fractional bits, exceed the range given in the class 
+   *         description
+   */
+  template < typename _T > 
+    FixedPointTriadCorrection( const Eigen::Matrix< _T, 3 , 3> &ms_mat, 
+                               const Eigen::Matrix< _T, 3 , 1> &bias_vec,
+                               double raw_scale = 1.0, double output_scale = 1.0, int frac_bits = 16 )
+  {
+    init( ms_mat.template cast<double>(), bias_vec.template cast<double>(), 
+          raw_scale, output_scale, frac_bits );
+  };
+  
+  /** @brief Build the correction from a calibration, see the above constructor */
+  template < typename _T > 
+    explicit FixedPointTriadCorrection( const CalibratedTriad_<_T> &calib, double raw_scale = 1.0, 
+                                        double output_scale = 1.0, int frac_bits = 16 )
+  {
+    init( calib.getMisalignmentScaleMatrix().template cast<double>(), 
+          calib.getBiasVector().template cast<double>(), raw_scale, output_scale, frac_bits );
+  };
+  
+  /** @brief Build the correction from the plain calibration parameters storage, 
+   *         see the above constructors */
+  template < typename _T > 
+    explicit FixedPointTriadCorrection( const TriadCalibrationParams_<_T> &params, double raw_scale = 1.0, 
+                                        double output_scale = 1.0, int frac_bits = 16 )
+  {
+    CalibratedTriad_<_T> calib( params );
+    init( calib.getMisalignmentScaleMatrix().template cast<double>(), 
+          calib.getBiasVector().template cast<double>(), raw_scale, output_scale, frac_bits );
+  };
+  
+  inline int fracBits() const { return frac_bits_; };
+  
+  /** @brief Correct n_samples integer samples (e.g., int16_t or int32_t) stored in separated 
+   *         (SoA) x, y, z arrays: the output arrays can be the input ones, if the raw counts 
+   *         are of type int32_t */
+  template < typename _TRaw > 
+    void apply( const _TRaw *raw_x, const _TRaw *raw_y, const _TRaw *raw_z, 
+                int32_t *x, int32_t *y, int32_t *z, int n_samples ) const;
+  
+  /** @brief Correct n_samples interleaved integer samples (x0, y0, z0, x1, y1, z1, ...): 
+   *         the output array can be the input one, if the raw counts are of type int32_t */
+  template < typename _TRaw > 
+    void applyInterleaved( const _TRaw *raw_xyz, int32_t *xyz, int n_samples ) const;
+  
+private:
+  
+  inline void init( const Eigen::Matrix3d &ms_mat, const Eigen::Vector3d &bias_vec, 
+                    double raw_scale, double output_scale, int frac_bits );
+  
+  static inline int32_t saturate( int64_t v )
+  {
+    if( v > int64_t( std::numeric_limits<int32_t>::max() ) ) 
+      return std::numeric_limits<int32_t>::max();
+    if( v < int64_t( std::numeric_limits<int32_t>::min() ) ) 
+      return std::numeric_limits<int32_t>::min();
+    return int32_t(v);
+  };
+  
+  int frac_bits_;
+  /* Fixed point matrix (row major) and offsets, the latter including the rounding term */
+  int64_t m_[9], offset_[3];
+};
+
+/* Implementations */
+
+template < typename _T > template < typename _TRaw >
+  void TriadCorrection_<_T>::apply( const _TRaw *raw_x, const _TRaw *raw_y, const _TRaw *raw_z, 
+                                    _T *x, _T *y, _T *z, int n_samples ) const
+{
+  typedef Eigen::Array< _T, Eigen::Dynamic, 1, 0, BLOCK_SIZE, 1 > Block;
+  typedef Eigen::Map< const Eigen::Array< _TRaw, Eigen::Dynamic, 1 > > RawMap;
+  typedef Eigen::Map< Eigen::Array< _T, Eigen::Dynamic, 1 > > Map;
+  
+  const _T m00 = ms_mat_(0,0), m01 = ms_mat_(0,1), m02 = ms_mat_(0,2),
+           m10 = ms_mat_(1,0), m11 = ms_mat_(1,1), m12 = ms_mat_(1,2),
+           m20 = ms_mat_(2,0), m21 = ms_mat_(2,1), m22 = ms_mat_(2,2),
+           o0 = offset_vec_(0), o1 = offset_vec_(1), o2 = offset_vec_(2);
+  
+  Block bx, by, bz;
+  for( int start = 0; start < n_samples; start += BLOCK_SIZE )
+  {
+    const int n = std::min( int(BLOCK_SIZE), n_samples - start );
+    bx = RawMap( raw_x + start, n ).template cast<_T>();
+    by = RawMap( raw_y + start, n ).template cast<_T>();
+    bz = RawMap( raw_z + start, n ).template cast<_T>();
+    
+    // All the raw counts of the block are read before writing: the outputs can alias the inputs
+    Map( x + start, n ) = m00*bx + m01*by + m02*bz - o0;
+    Map( y + start, n ) = m10*bx + m11*by + m12*bz - o1;
+    Map( z + start, n ) = m20*bx + m21*by + m22*bz - o2;
+  }
+}
+
+template < typename _T > template < typename _TRaw >
+  void TriadCorrection_<_T>::applyInterleaved( const _TRaw *raw_xyz, _T *xyz, int n_samples ) const
+{
+  typedef Eigen::Matrix< _T, 3, Eigen::Dynamic, 0, 3, BLOCK_SIZE > Block;
+  typedef Eigen::Map< const Eigen::Matrix< _TRaw, 3, Eigen::Dynamic > > RawMap;
+  typedef Eigen::Map< Eigen::Matrix< _T, 3, Eigen::Dynamic > > Map;
+  
+  Block b;
+  for( int start = 0; start < n_samples; start += BLOCK_SIZE )
+  {
+    const int n = std::min( int(BLOCK_SIZE), n_samples - start );
+    b.noalias() = ms_mat_*RawMap( raw_xyz + 3*start, 3, n ).template cast<_T>();
+    Map( xyz + 3*start, 3, n ) = b.colwise() - offset_vec_;
+  }
+}
+
+template < typename _T >
+  TriadBuffer_<_T> CalibratedSamplesView_<_T>::materialize() const
+{
+  // Shares the timestamps and the interval ids until modified
+  TriadBuffer_<_T> samples( raw_samples_ );
+  correction_.apply( samples );
+  return samples;
+}
+
+template < typename _T >
+  void CalibratedSamplesView_<_T>::materialize( std::vector< TriadData_<_T> > &samples ) const
+{
+  const int block_size = TriadCorrection_<_T>::BLOCK_SIZE;
+  _T x[block_size], y[block_size], z[block_size];
+  
+  samples.clear();
+  samples.reserve( size() );
+  for( int start = 0; start < size(); start += block_size )
+  {
+    const int n = std::min( block_size, size() - start );
+    block( start, n, x, y, z );
+    for( int i = 0; i < n; i++ )
+      samples.push_back( TriadData_<_T>( timestamp( start + i ), x[i], y[i], z[i], 
+                                         raw_samples_.interval_id( start + i ) ) );
+  }
+}
+
+inline void FixedPointTriadCorrection::init( const Eigen::Matrix3d &ms_mat, const Eigen::Vector3d &bias_vec, 
+                                             double raw_scale, double output_scale, int frac_bits )
+{
+  if( frac_bits < 1 || frac_bits > 30 )
+    throw std::invalid_argument("FixedPointTriadCorrection: frac_bits should be in [1, 30]");
+  
+  frac_bits_ = frac_bits;
+  const double one = double( int64_t(1) << frac_bits );
+  Eigen::Matrix3d m = ( output_scale*raw_scale*one )*ms_mat;
+  Eigen::Vector3d o = ( output_scale*one )*( ms_mat*bias_vec );
+  // |m_row|_1*2^31 + |offset| < 2^63 for any raw count of 32 bits (with margin for the rounding)
+  const double max_row_norm = double( int64_t(1) << 31 ) - 2.0, 
+               max_offset = double( int64_t(1) << 61 );
+  for( int r = 0; r < 3; r++ )
+  {
+    if( !( m.row(r).cwiseAbs().sum() <= max_row_norm ) )
+      throw std::invalid_argument("FixedPointTriadCorrection: matrix elements out of range, "
+                                  "reduce frac_bits or output_scale");
+    if( !( std::fabs( o(r) ) <= max_offset ) )
+      throw std::invalid_argument("FixedPointTriadCorrection: offset out of range, "
+                                  "reduce frac_bits or output_scale");
+    for( int c = 0; c < 3; c++ )
+      m_[3*r + c] = int64_t( std::llround( m(r,c) ) );
+    // Round to the nearest integer with the final arithmetic shift
+    offset_[r] = int64_t( std::llround( o(r) ) ) - ( int64_t(1) << ( frac_bits - 1 ) );
+  }
+}
+
+template < typename _TRaw >
+  void FixedPointTriadCorrection::apply( const _TRaw *raw_x, const _TRaw *raw_y, const _TRaw *raw_z, 
+                                         int32_t *x, int32_t *y, int32_t *z, int n_samples ) const
+{
+  static_assert( std::numeric_limits<_TRaw>::is_integer && std::numeric_limits<_TRaw>::digits <= 31,
+                 "FixedPointTriadCorrection: the raw counts should be integers of at most 31 value bits" );
+  const int64_t m00 = m_[0], m01 = m_[1], m02 = m_[2], m10 = m_[3], m11 = m_[4], m12 = m_[5], 
+                m20 = m_[6], m21 = m_[7], m22 = m_[8], o0 = offset_[0], o1 = offset_[1], o2 = offset_[2];
+  const int shift = frac_bits_;
+  for( int i = 0; i < n_samples; i++ )
+  {
+    const int64_t rx = raw_x[i], ry = raw_y[i], rz = raw_z[i];
+    x[i] = saturate( ( m00*rx + m01*ry + m02*rz - o0 ) >> shift );
+    y[i] = saturate( ( m10*rx + m11*ry + m12*rz - o1 ) >> shift );
+    z[i] = saturate( ( m20*rx + m21*ry + m22*rz - o2 ) >> shift );
+  }
+}
+
+template < typename _TRaw >
+  void FixedPointTriadCorrection::applyInterleaved( const _TRaw *raw_xyz, int32_t *xyz, int n_samples ) const
+{
+  static_assert( std::numeric_limits<_TRaw>::is_integer && std::numeric_limits<_TRaw>::digits <= 31,
+                 "FixedPointTriadCorrection: the raw counts should be integers of at most 31 value bits" );
+  const int64_t m00 = m_[0], m01 = m_[1], m02 = m_[2], m10 = m_[3], m11 = m_[4], m12 = m_[5], 
+                m20 = m_[6], m21 = m_[7], m22 = m_[8], o0 = offset_[0], o1 = offset_[1], o2 = offset_[2];
+  const int shift = frac_bits_;
+  for( int i = 0; i < 3*n_samples; i += 3 )
+  {
+    const int64_t rx = raw_xyz[i], ry = raw_xyz[i + 1], rz = raw_xyz[i + 2];
+    xyz[i] = saturate( ( m00*rx + m01*ry + m02*rz - o0 ) >> shift );
+    xyz[i + 1] = saturate( ( m10*rx + m11*ry + m12*rz - o1 ) >> shift );
+    xyz[i + 2] = saturate( ( m20*rx + m21*ry + m22*rz - o2 ) >> shift );
+  }
+}
+
+}
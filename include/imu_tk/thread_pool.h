@@ -0,0 +1,100 @@
+/* 
+ * imu_tk - Inertial Measurement Unit Toolkit
+ * 
+ *  Copyright (c) 2014, Alberto Pretto <pretto@diag.uniroma1.it>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ * 
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ * 
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <boost/shared_ptr.hpp>
+
+namespace imu_tk
+{
+/** @brief Fixed size pool of worker threads executing the submitted tasks.
+ * 
+ * Each worker has its own tasks queue: the tasks are distributed among the queues
+ * in a round-robin way, each worker executes the tasks of its queue (most recently 
+ * submitted first) and, when its queue is empty, it steals the oldest tasks 
+ * from the queues of the other workers (work stealing). The exceptions thrown by 
+ * a task are caught, so a failing task never stops a worker: the first one is 
+ * rethrown by wait(). */
+class ThreadPool
+{
+public:
+  /** @brief Start n_threads worker threads (if n_threads is less than 1, 
+   *         the number of hardware threads). With a single thread, no worker is started:
+   *         the tasks are executed by the thread that calls wait() (or the destructor) */
+  explicit ThreadPool( int n_threads = 0 );
+  
+  /** @brief Wait for the completion of all the submitted tasks, and stop the workers. 
+   *         The exceptions not yet rethrown by wait() are discarded */
+  ~ThreadPool();
+  
+  /** @brief Provides the number of worker threads */
+  int numThreads() const { return int(queues_.size()); };
+  
+  /** @brief Submit a task, to be executed as soon as a worker is available */
+  void submit( const std::function< void() > &task );
+  
+  /** @brief Wait for the completion of all the tasks submitted so far. If some of these 
+   *         tasks threw an exception, rethrow the first one (once all the tasks are completed) */
+  void wait();
+  
+private:
+  ThreadPool( const ThreadPool & );
+  ThreadPool &operator=( const ThreadPool & );
+  
+  struct TasksQueue
+  {
+    std::mutex mutex;
+    std::deque< std::function< void() > > tasks;
+  };
+  
+  void waitTasks();
+  void runTask( std::function< void() > &task );
+  bool popTask( int worker_idx, std::function< void() > &task );
+  void run( int worker_idx );
+  
+  std::vector< boost::shared_ptr< TasksQueue > > queues_;
+  std::vector< std::thread > threads_;
+  
+  std::mutex mutex_;
+  std::condition_variable work_cond_, done_cond_;
+  /* Number of queued tasks and of submitted, not yet completed tasks (guarded by mutex_) */
+  int n_queued_, n_pending_;
+  /* First exception thrown by a task, not yet rethrown by wait() (guarded by mutex_) */
+  std::exception_ptr task_exception_;
+  int next_queue_;
+  bool stop_;
+};
+
+}
@@ -0,0 +1,91 @@
+/* 
+ * imu_tk - Inertial Measurement Unit Toolkit
+ * 
+ *  Copyright (c) 2014, Alberto Pretto <pretto@diag.uniroma1.it>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ * 
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ * 
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <vector>
+#include "imu_tk/base.h"
+
+namespace imu_tk
+{
+
+/**
+  * @brief Resample a data triad onto the timestamps of a reference data triad, 
+  *        with linear interpolation
+  * 
+  * @param samples Input signal, ordered by increasing timestamps
+  * @param ref_samples Reference signal: the resampled signal has its timestamps 
+  *                    and interval ids
+  * @param[out] resampled_samples Output signal
+  * @param time_offset Offset added to the timestamps of samples to express them in the time base
+  *                    of ref_samples (e.g., the one estimated by estimateTimeOffset() )
+  * 
+  * The interpolation indices are found in a single forward pass over both timestamps sequences,
+  * in blocks of samples, and each block is then interpolated axis by axis. Outside the time 
+  * interval of samples, the first or the last sample is held.
+  */
+template <typename _T> 
+  void resampleTriad( const TriadBuffer_<_T> &samples, const TriadBuffer_<_T> &ref_samples,
+                      TriadBuffer_<_T> &resampled_samples, _T time_offset = _T(0) );
+
+/**
+  * @brief Estimate the time offset between an accelerometers triad and a gyroscopes triad of 
+  *        the same IMU, timestamped independently
+  * 
+  * @param acc_samples Accelerometers signal, ordered by increasing timestamps
+  * @param gyro_samples Gyroscopes signal, ordered by increasing timestamps
+  * @param max_offset Maximum absolute value of the time offset, in seconds
+  * @param data_dt Period of the common time grid used in the estimation. If less than 0,
+  *                the smallest of the mean periods of the two signals is used
+  * 
+  * @returns The offset to be added to the gyroscopes timestamps to express them in
+  *          the time base of the accelerometers
+  * 
+  * Both signals are resampled onto uniform grids, the magnitude of the accelerometers 
+  * derivative is cross-correlated (via FFT) with the magnitude of the (mean removed) 
+  * rotational velocities, that both peak during the motions, and the offset is given by the 
+  * correlation peak, refined with a parabolic interpolation. Raw (not calibrated) samples can
+  * be used, since only the positions of the peaks matter.
+  */
+template <typename _T> 
+  _T estimateTimeOffset( const TriadBuffer_<_T> &acc_samples, const TriadBuffer_<_T> &gyro_samples,
+                         _T max_offset = _T(1), _T data_dt = _T(-1) );
+  
+/**
+  * @brief Align a gyroscopes triad to an accelerometers triad: estimate their time offset 
+  *        (see estimateTimeOffset() ) and resample the gyroscopes onto the accelerometers 
+  *        timestamps (see resampleTriad() ), so that the two signals can be indexed 
+  *        in the same way
+  * 
+  * @returns The estimated time offset
+  */
+template <typename _T> 
+  _T alignGyroToAcc( const TriadBuffer_<_T> &acc_samples, const TriadBuffer_<_T> &gyro_samples,
+                     TriadBuffer_<_T> &aligned_gyro_samples, _T max_offset = _T(1) );
+
+}
@@ -33,6 +33,7 @@
 #include <map>
 
 #include <QGLWidget>
+#include <QGLBuffer>
 #include <QVector>
 #include <QMutex>
 #include <Eigen/Geometry>
@@ -151,11 +152,29 @@ class OpenGL3DScene: public QGLWidget
     //! First person view flag
     bool fp_view_ ;
     
+    /*! 
+    @brief Append-only vertex buffer object, with a copy of the vertices in the client memory.
+    
+    The (client and server) capacity is doubled when exceeded, so each vertex is uploaded 
+    an amortized constant number of times: without reallocation, only the new vertices are 
+    uploaded (glBufferSubData).
+    */
+    struct VertexBuffer
+    {
+      VertexBuffer() : buffer( QGLBuffer::VertexBuffer ), capacity(0) {};
+      QGLBuffer buffer;
+      std::vector< GLfloat > vertices;
+      //! Number of vertices allocated in the buffer object
+      int capacity;
+      
+      int size() const { return int(vertices.size()/3); };
+    };
+    
     struct PathItem
     {
       PathItem(){ removed = false; };
       std::vector< Eigen::Vector3d > unprocessed_poses;
-      std::vector< GLuint > lists;
+      VertexBuffer vertices;
       QColor color;
       bool removed; 
     };
@@ -184,11 +203,20 @@ class OpenGL3DScene: public QGLWidget
     {
       CloudItem(){ removed = false; };
       std::vector< Eigen::Vector3d > unprcessed_cloud;
-      std::vector< GLuint > lists;
+      VertexBuffer vertices;
       QColor color;
       bool removed;
     };
     
+    /*! 
+    @brief Append the points to a vertex buffer (the GL context should be current).
+    */
+    void appendVertices( VertexBuffer &vb, const std::vector< Eigen::Vector3d > &pts );
+    /*! 
+    @brief Draw all the vertices of a vertex buffer with the given primitive and color.
+    */
+    void drawVertices( VertexBuffer &vb, GLenum mode, const QColor &color );
+    
     std::map <std::string, PathItem> path_items_;
     std::map <std::string, LineItem> line_items_;
     std::map <std::string, CloudItem> cloud_items_;
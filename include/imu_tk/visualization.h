@@ -44,18 +44,33 @@ public:
   Plot();
   ~Plot(){};
   
+  /** @brief Set the maximum number of points plotted for each axis (default 4096): 
+   *         longer sequences are decimated keeping the minimum and the maximum sample 
+   *         of each group of consecutive samples, so that peaks are always visible. 
+   *         If less than 2, all the samples are plotted */
+  void setMaxPoints( int max_points ) { max_points_ = max_points; };
+  int maxPoints() const { return max_points_; };
+  
   template <typename _T> 
     void plotSamples( const std::vector< TriadData_<_T> > &samples,
                       DataInterval range = DataInterval() );
+  template <typename _T> 
+    void plotSamples( const TriadBuffer_<_T> &samples,
+                      DataInterval range = DataInterval() );
   template <typename _T> 
     void plotIntervals( const std::vector< TriadData_<_T> > &samples,
                         const std::vector< DataInterval > &intervals,
                         DataInterval range = DataInterval() );
+  template <typename _T> 
+    void plotIntervals( const TriadBuffer_<_T> &samples,
+                        const std::vector< DataInterval > &intervals,
+                        DataInterval range = DataInterval() );
 private:
 
   /* Pimpl idiom */
   class PlotImpl; 
   boost::shared_ptr< PlotImpl > plot_impl_ptr_;
+  int max_points_;
 };
 
 void waitForKey();
@@ -65,9 +80,22 @@ class Vis3D
 {
 public:
   
-  Vis3D( const std::string win_name = "imu_tk" );
+  /** @brief Constructor
+   * 
+   * @param win_name Window title
+   * @param async If true, the scene is owned by a dedicated render thread that refreshes it 
+   *              at display rate: registerFrame(), setFramePos(), registerLine(), ... just 
+   *              push the update into a lock-free queue and return immediately, and the 
+   *              render thread applies only the latest state of each item at each refresh. 
+   *              Requires that neither a QApplication nor another asynchronous Vis3D 
+   *              exist in the calling process, otherwise the synchronous mode is used.
+   */
+  Vis3D( const std::string win_name = "imu_tk", bool async = false );
   ~Vis3D(){};
   
+  /** @brief True if the scene is refreshed by its own render thread */
+  bool isAsync() const { return async_ptr_.get() != NULL; };
+  
   void registerFrame( std::string name, uint8_t r = 255, uint8_t g = 255, uint8_t b = 255 );
   void unregisterFrame( std::string name );    
   template <typename _T> 
@@ -78,13 +106,19 @@ public:
   template <typename _T> 
     void setLinePos( std::string name, const _T p0[3], const _T p1[3] );
     
+  /** @brief Update the scene and wait for delay_ms milliseconds, or until the Esc key is 
+   *         pressed if delay_ms is 0. In asynchronous mode the scene is refreshed by the 
+   *         render thread anyway: the call returns immediately if delay_ms > 0, otherwise 
+   *         it waits for the Esc key */
   void updateAndWait( int delay_ms = 0 );
     
 private:
   
   /* Pimpl idiom */
   class VisualizerImpl;
+  class AsyncRenderer;
   boost::shared_ptr< VisualizerImpl > vis_impl_ptr_;
+  boost::shared_ptr< AsyncRenderer > async_ptr_;
 };
 
 
@@ -0,0 +1,198 @@
+/* 
+ * imu_tk - Inertial Measurement Unit Toolkit
+ * 
+ *  Copyright (c) 2014, Alberto Pretto <pretto@diag.uniroma1.it>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ * 
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ * 
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "imu_tk/base.h"
+#include "imu_tk/thread_pool.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+using namespace imu_tk;
+
+/* Cumulative sums theta_k (k = 0, ..., n) of the samples of an axis, with the mean removed:
+ * the mean does not change the second differences of theta, and removing it limits
+ * their magnitude (and the cancellation errors) in long sequences. The sums are in sample
+ * units, the sample period cancels out in the variances */
+template <typename _T> static void cumulativeSums( const _T *v, int n, std::vector< double > &theta )
+{
+  double mean = 0;
+  for( int i = 0; i < n; i++ )
+    mean += v[i];
+  mean /= n;
+  
+  theta.resize( n + 1 );
+  theta[0] = 0;
+  double sum = 0;
+  for( int i = 0; i < n; i++ )
+  {
+    sum += double( v[i] ) - mean;
+    theta[i + 1] = sum;
+  }
+}
+
+/* Overlapping Allan variance for the cluster size m, in O(n). The squares are accumulated 
+ * in four independent sums, to break the dependency chain of a single accumulator */
+static double clusterVariance( const std::vector< double > &theta, int m )
+{
+  const int n = int( theta.size() ) - 1, n_terms = n - 2*m + 1, n_unrolled = n_terms & ~3;
+  const double *t0 = &theta[0], *t1 = t0 + m, *t2 = t0 + 2*m;
+  double sums[4] = { 0, 0, 0, 0 };
+  for( int k = 0; k < n_unrolled; k += 4 )
+  {
+    for( int l = 0; l < 4; l++ )
+    {
+      double d = t2[k + l] - 2.0*t1[k + l] + t0[k + l];
+      sums[l] += d*d;
+    }
+  }
+  for( int k = n_unrolled; k < n_terms; k++ )
+  {
+    double d = t2[k] - 2.0*t1[k] + t0[k];
+    sums[0] += d*d;
+  }
+  return ( ( sums[0] + sums[1] ) + ( sums[2] + sums[3] ) )/( 2.0*double(m)*double(m)*n_terms );
+}
+
+template <typename _T> 
+  void imu_tk::allanVariance( const TriadBuffer_<_T> &samples, AllanVariance_<_T> &avar, 
+                              _T data_dt, const DataInterval &interval, int n_threads )
+{
+  avar = AllanVariance_<_T>();
+  DataInterval rev_interval = checkInterval( samples, interval );
+  const int start_idx = rev_interval.start_idx, n = rev_interval.end_idx - rev_interval.start_idx + 1;
+  if( n < 3 )
+  {
+    IMU_TK_LOG_WARNING( "allanVariance() : at least 3 samples are required" );
+    return;
+  }
+  
+  if( data_dt < 0 )
+    data_dt = ( samples.timestamp( rev_interval.end_idx ) - samples.timestamp( start_idx ) )/_T( n - 1 );
+  avar.data_dt = data_dt;
+  
+  // Octave-spaced cluster sizes, at least two clusters per sum term
+  for( int m = 1; 2*m <= n - 1; m *= 2 )
+  {
+    avar.cluster_sizes.push_back( m );
+    avar.taus.push_back( _T(m)*data_dt );
+  }
+  const int n_clusters = avar.size();
+  
+  std::vector< double > theta[3], variances( 3*n_clusters );
+  {
+    ThreadPool pool( std::min( ( n_threads < 1 )?
+                               std::max( int( std::thread::hardware_concurrency() ), 1 ):n_threads, 
+                               3*n_clusters ) );
+    for( int j = 0; j < 3; j++ )
+      pool.submit( [&, j](){ cumulativeSums( samples.axis(j) + start_idx, n, theta[j] ); } );
+    pool.wait();
+    
+    // Each task writes only its own variance
+    for( int i = 0; i < n_clusters; i++ )
+      for( int j = 0; j < 3; j++ )
+        pool.submit( [&, i, j](){ variances[3*i + j] = clusterVariance( theta[j], avar.cluster_sizes[i] ); } );
+    pool.wait();
+  }
+  
+  avar.variances.resize( n_clusters );
+  for( int i = 0; i < n_clusters; i++ )
+    avar.variances[i] = Eigen::Matrix< _T, 3, 1>( _T( variances[3*i] ), _T( variances[3*i + 1] ), 
+                                                 _T( variances[3*i + 2] ) );
+}
+
+template <typename _T> 
+  void imu_tk::allanVariance( const std::vector< TriadData_<_T> > &samples, AllanVariance_<_T> &avar, 
+                              _T data_dt, const DataInterval &interval, int n_threads )
+{
+  allanVariance( TriadBuffer_<_T>( samples ), avar, data_dt, interval, n_threads );
+}
+
+template <typename _T> 
+  NoiseParameters_<_T> imu_tk::noiseParameters( const AllanVariance_<_T> &avar )
+{
+  // Ratio between the minimum of the Allan deviation and the bias instability, sqrt(2*ln(2)/pi)
+  const double bias_instability_factor = 0.664282;
+  
+  NoiseParameters_<_T> params;
+  params.random_walk.setZero();
+  params.bias_instability.setZero();
+  params.bias_instability_tau.setZero();
+  params.rate_random_walk.setZero();
+  
+  const int n_clusters = avar.size();
+  for( int j = 0; j < 3; j++ )
+  {
+    double min_adev = std::numeric_limits< double >::max(), min_rw_err = min_adev, min_rrw_err = min_adev;
+    for( int i = 0; i < n_clusters; i++ )
+    {
+      double tau = avar.taus[i], adev = std::sqrt( double( avar.variances[i](j) ) );
+      if( adev > 0 && adev < min_adev )
+      {
+        min_adev = adev;
+        params.bias_instability(j) = _T( adev/bias_instability_factor );
+        params.bias_instability_tau(j) = _T( tau );
+      }
+      
+      if( i == n_clusters - 1 )
+        break;
+      
+      double next_tau = avar.taus[i + 1], next_adev = std::sqrt( double( avar.variances[i + 1](j) ) );
+      if( adev <= 0 || next_adev <= 0 || next_tau <= tau )
+        continue;
+      
+      // Slope of the log-log deviation, at the geometric center of the segment
+      double slope = std::log( next_adev/adev )/std::log( next_tau/tau ),
+             c_tau = std::sqrt( tau*next_tau ), c_adev = std::sqrt( adev*next_adev );
+      if( std::abs( slope + 0.5 ) < min_rw_err )
+      {
+        min_rw_err = std::abs( slope + 0.5 );
+        params.random_walk(j) = _T( c_adev*std::sqrt( c_tau ) );
+      }
+      if( std::abs( slope - 0.5 ) < min_rrw_err )
+      {
+        min_rrw_err = std::abs( slope - 0.5 );
+        params.rate_random_walk(j) = _T( c_adev*std::sqrt( 3.0/c_tau ) );
+      }
+    }
+  }
+  return params;
+}
+
+template void imu_tk::allanVariance<double>( const TriadBuffer_<double> &samples, AllanVariance_<double> &avar, 
+                                             double data_dt, const DataInterval &interval, int n_threads );
+template void imu_tk::allanVariance<float>( const TriadBuffer_<float> &samples, AllanVariance_<float> &avar, 
+                                            float data_dt, const DataInterval &interval, int n_threads );
+template void imu_tk::allanVariance<double>( const std::vector< TriadData_<double> > &samples, 
+                                             AllanVariance_<double> &avar, double data_dt, 
+                                             const DataInterval &interval, int n_threads );
+template void imu_tk::allanVariance<float>( const std::vector< TriadData_<float> > &samples, 
+                                            AllanVariance_<float> &avar, float data_dt, 
+                                            const DataInterval &interval, int n_threads );
+template NoiseParameters_<double> imu_tk::noiseParameters<double>( const AllanVariance_<double> &avar );
+template NoiseParameters_<float> imu_tk::noiseParameters<float>( const AllanVariance_<float> &avar );
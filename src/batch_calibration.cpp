@@ -0,0 +1,316 @@
+/* 
+ * imu_tk - Inertial Measurement Unit Toolkit
+ * 
+ *  Copyright (c) 2014, Alberto Pretto <pretto@diag.uniroma1.it>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ * 
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ * 
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "imu_tk/batch_calibration.h"
+#include "imu_tk/thread_pool.h"
+#include "imu_tk/log.h"
+
+#include <cstdio>
+#include <sstream>
+#include <algorithm>
+#include <set>
+#include <exception>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dirent.h>
+#endif
+
+using namespace imu_tk;
+
+/* Directory of a file path, empty if the path does not contain a directory */
+static std::string directoryName( const std::string &path )
+{
+  size_t pos = path.find_last_of( '/' );
+  return ( pos == std::string::npos )?std::string():path.substr( 0, pos + 1 );
+}
+
+static std::string joinPath( const std::string &dir, const std::string &name )
+{
+  if( dir.empty() || dir[dir.size() - 1] == '/' )
+    return dir + name;
+  return dir + '/' + name;
+}
+
+static std::string jsonString( const std::string &str )
+{
+  std::string json("\"");
+  for( size_t i = 0; i < str.size(); i++ )
+  {
+    const char c = str[i];
+    if( c == '"' || c == '\\' )
+    {
+      json += '\\';
+      json += c;
+    }
+    else if( (unsigned char)c < 0x20 )
+    {
+      char code[8];
+      snprintf( code, sizeof(code), "\\u%04x", (unsigned char)c );
+      json += code;
+    }
+    else
+      json += c;
+  }
+  return json + '"';
+}
+
+template <typename _T> std::string BatchCalibrationReport_<_T>::toJson() const
+{
+  std::ostringstream os;
+  os.precision(10);
+  os<<"{\n"
+    <<"\"num_units\": "<<units.size()<<",\n"
+    <<"\"num_succeeded\": "<<num_succeeded<<",\n"
+    <<"\"num_failed\": "<<num_failed<<",\n"
+    <<"\"total\": { \"wall_time\": "<<total.wall_time<<", \"cpu_time\": "<<total.cpu_time<<" },\n"
+    <<"\"units\": [\n";
+  for( int i = 0; i < int(units.size()); i++ )
+  {
+    const BatchCalibrationResult_<_T> &unit = units[i];
+    os<<"{\n"
+      <<"\"name\": "<<jsonString( unit.name )<<",\n"
+      <<"\"success\": "<<( unit.success?"true":"false" )<<",\n"
+      <<"\"error\": "<<jsonString( unit.error )<<",\n"
+      <<"\"calib_filename\": "<<jsonString( unit.calib_filename )<<",\n"
+      <<"\"report\": "<<unit.report.toJson()
+      <<"}"<<( ( i < int(units.size()) - 1 )?",\n":"\n" );
+  }
+  os<<"]\n}\n";
+  return os.str();
+}
+
+template <typename _T> BatchCalibrator_<_T>::BatchCalibrator_() :
+  calibration_( new MultiPosCalibration_<_T>() ),
+  n_threads_(0),
+  unit_(TIMESTAMP_UNIT_SEC),
+  type_(DATASET_COMMA_SEPARATED){}
+
+template <typename _T> void BatchCalibrator_<_T>::addUnit( const std::string &name, 
+                                                           const std::string &acc_filename, 
+                                                           const std::string &gyro_filename )
+{
+  BatchCalibrationUnit_<_T> unit;
+  unit.name = name;
+  unit.acc_filename = acc_filename;
+  unit.gyro_filename = gyro_filename;
+  units_.push_back( unit );
+}
+
+template <typename _T> void BatchCalibrator_<_T>::addUnit( const std::string &name, 
+                                                           const TriadBuffer_<_T> &acc_samples, 
+                                                           const TriadBuffer_<_T> &gyro_samples )
+{
+  BatchCalibrationUnit_<_T> unit;
+  unit.name = name;
+  unit.acc_samples = acc_samples;
+  unit.gyro_samples = gyro_samples;
+  units_.push_back( unit );
+}
+
+template <typename _T> int BatchCalibrator_<_T>::addDirectory( const std::string &dir, 
+                                                               const std::string &acc_tag, 
+                                                               const std::string &gyro_tag )
+{
+  std::set< std::string > filenames;
+#if defined(__unix__) || defined(__APPLE__)
+  DIR *dir_stream = opendir( dir.c_str() );
+  if( dir_stream == NULL )
+  {
+    IMU_TK_LOG_ERROR( "BatchCalibrator::addDirectory(): can't open directory "<<dir<<", exit" );
+    return 0;
+  }
+  for( struct dirent *entry = readdir( dir_stream ); entry != NULL; entry = readdir( dir_stream ) )
+  {
+    if( entry->d_name[0] != '.' )
+      filenames.insert( entry->d_name );
+  }
+  closedir( dir_stream );
+#else
+  IMU_TK_LOG_ERROR( "BatchCalibrator::addDirectory(): not supported on this platform, exit" );
+  return 0;
+#endif
+  
+  if( acc_tag.empty() )
+    return 0;
+  
+  int n_units = 0;
+  // std::set is sorted, so are the units
+  for( std::set< std::string >::const_iterator it = filenames.begin(); it != filenames.end(); ++it )
+  {
+    const std::string &acc_name = *it;
+    size_t pos = acc_name.rfind( acc_tag );
+    if( pos == std::string::npos )
+      continue;
+    std::string gyro_name = acc_name;
+    gyro_name.replace( pos, acc_tag.size(), gyro_tag );
+    if( !filenames.count( gyro_name ) )
+      continue;
+    
+    std::string name = acc_name;
+    name.erase( pos, acc_tag.size() );
+    size_t ext_pos = name.find_last_of( '.' );
+    if( ext_pos != std::string::npos && ext_pos > 0 )
+      name.erase( ext_pos );
+    
+    addUnit( name, joinPath( dir, acc_name ), joinPath( dir, gyro_name ) );
+    n_units++;
+  }
+  return n_units;
+}
+
+template <typename _T> BatchCalibrationReport_<_T> BatchCalibrator_<_T>::calibrate() const
+{
+  BatchCalibrationReport_<_T> report;
+  StageTimer timer( report.total, false );
+  
+  const int n_units = units_.size();
+  report.units.resize( n_units );
+  {
+    ThreadPool pool( std::min( ( n_threads_ < 1 )?
+                               std::max( int( std::thread::hardware_concurrency() ), 1 ):n_threads_, 
+                               std::max( n_units, 1 ) ) );
+    // Each task writes only its own result
+    for( int i = 0; i < n_units; i++ )
+      pool.submit( std::bind( &BatchCalibrator_<_T>::calibrateUnit, this, 
+                              std::cref( units_[i] ), std::ref( report.units[i] ) ) );
+    pool.wait();
+  }
+  
+  for( int i = 0; i < n_units; i++ )
+  {
+    if( report.units[i].success )
+      report.num_succeeded++;
+    else
+      report.num_failed++;
+  }
+  
+  timer.stop();
+  return report;
+}
+
+template <typename _T> 
+  void BatchCalibrator_<_T>::calibrateUnit( const BatchCalibrationUnit_<_T> &unit, 
+                                            BatchCalibrationResult_<_T> &result ) const
+{
+  ScopedLogLevel log_level( std::min( logLevel(), LOG_LEVEL_WARNING ) );
+  // The units are calibrated concurrently: only the CPU time of this worker is measured
+  ScopedCpuTimeClock cpu_clock( CPU_TIME_THREAD );
+  result.name = unit.name;
+  try
+  {
+    TriadBuffer_<_T> acc_samples( unit.acc_samples ), gyro_samples( unit.gyro_samples );
+    if( !unit.acc_filename.empty() && !loadData( unit.acc_filename, acc_samples ) )
+    {
+      result.error = "can't load the accelerometers data file " + unit.acc_filename;
+      return;
+    }
+    if( !unit.gyro_filename.empty() && !loadData( unit.gyro_filename, gyro_samples ) )
+    {
+      result.error = "can't load the gyroscopes data file " + unit.gyro_filename;
+      return;
+    }
+    if( acc_samples.empty() || gyro_samples.empty() )
+    {
+      result.error = "no data samples";
+      return;
+    }
+    
+    MultiPosCalibration_<_T> calibration( *calibration_ );
+    calibration.enableVerboseOutput( false );
+    // The units already run in parallel: unless explicitly set, the parameters sweep and the
+    // uncertainty estimation of each unit use a single thread, instead of the hardware threads
+    if( calibration.sweepOptions().num_threads < 1 )
+    {
+      SweepOptions sweep_options = calibration.sweepOptions();
+      sweep_options.num_threads = 1;
+      calibration.setSweepOptions( sweep_options );
+    }
+    if( calibration.uncertaintyOptions().num_threads < 1 )
+    {
+      UncertaintyOptions uncertainty_options = calibration.uncertaintyOptions();
+      uncertainty_options.num_threads = 1;
+      calibration.setUncertaintyOptions( uncertainty_options );
+    }
+    bool success = calibration.calibrateAccGyro( acc_samples, gyro_samples );
+    
+    result.report = calibration.getReport();
+    if( !success )
+    {
+      result.error = "calibration failed";
+      return;
+    }
+    result.acc_calib = calibration.getAccCalib();
+    result.gyro_calib = calibration.getGyroCalib();
+    
+    std::string calib_dir = output_dir_.empty()?directoryName( unit.acc_filename ):output_dir_;
+    if( !output_dir_.empty() || !unit.acc_filename.empty() )
+    {
+      std::string calib_filename = joinPath( calib_dir, unit.name + ".yaml" );
+      if( !calibration.save( calib_filename ) )
+      {
+        result.error = "can't save the calibration file " + calib_filename;
+        return;
+      }
+      result.calib_filename = calib_filename;
+    }
+    result.success = true;
+  }
+  catch( const std::exception &e )
+  {
+    result.success = false;
+    result.error = std::string( "exception: " ) + e.what();
+  }
+  catch( ... )
+  {
+    result.success = false;
+    result.error = "unknown exception";
+  }
+}
+
+template <typename _T> 
+  bool BatchCalibrator_<_T>::loadData( const std::string &filename, TriadBuffer_<_T> &samples ) const
+{
+  FILE *file = fopen( filename.c_str(), "rb" );
+  if( file == NULL )
+    return false;
+  fclose( file );
+  
+  BinaryDataInfo info;
+  if( readBinaryDataInfo( filename.c_str(), info ) )
+    return importBinaryData( filename.c_str(), samples );
+  
+  std::vector< TriadData_<_T> > data;
+  importAsciiData( filename.c_str(), data, unit_, type_ );
+  samples = TriadBuffer_<_T>( data );
+  return true;
+}
+
+template struct BatchCalibrationReport_<double>;
+template struct BatchCalibrationReport_<float>;
+template class BatchCalibrator_<double>;
+template class BatchCalibrator_<float>;
@@ -30,111 +30,473 @@
 #include "imu_tk/integration.h"
 #include "imu_tk/visualization.h"
 #include "imu_tk/filters.h"
+#include "imu_tk/time_alignment.h"
+#include "imu_tk/thread_pool.h"
+#include "imu_tk/calibration_residuals.h"
 
 #include <limits>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <locale>
+#include <thread>
+#include <algorithm>
+#include <random>
+#include <cstdio>
+#include <functional>
 #include "ceres/ceres.h"
 
 using namespace imu_tk;
 using namespace Eigen;
 using namespace std;
 
-template <typename _T1> struct MultiPosAccResidual
+/* Log level used during a calibration: with the verbose output enabled, also the 
+ * debug messages are logged, otherwise the current log level is preserved */
+static LogLevel calibrationLogLevel( bool verbose_output )
 {
-  MultiPosAccResidual( const _T1 &g_mag, const Eigen::Matrix< _T1, 3 , 1> &sample ) :
-  g_mag_(g_mag),
-  sample_(sample){}
-  
-  template <typename _T2>
-    bool operator() ( const _T2* const params, _T2* residuals ) const
+  return ( verbose_output && logLevel() < LOG_LEVEL_DEBUG )?LOG_LEVEL_DEBUG:logLevel();
+}
+
+/* Log (as debug messages) a calibration with its inverse scale factors */
+template <typename _T> static void logCalibration( const char *sensor, const CalibratedTriad_<_T> &calib )
+{
+  IMU_TK_LOG_DEBUG( calib<<endl
+                    <<sensor<<" calibration: inverse scale factors:"<<endl
+                    <<1.0/calib.scaleX()<<endl
+                    <<1.0/calib.scaleY()<<endl
+                    <<1.0/calib.scaleZ() );
+}
+
+/* Create a gyroscopes cost function given the Jacobian mode and the number of 
+ * parameters (i.e., if the biases are optimized or not) */
+template <typename _T> static ceres::CostFunction* 
+  createGyroCostFunction( JacobianMode jacobian_mode, bool optimize_bias,
+                          const Eigen::Matrix< _T, 3 , 1> &g_versor_pos0, 
+                          const Eigen::Matrix< _T, 3 , 1> &g_versor_pos1,
+                          const TriadBuffer_<_T> &gyro_samples, 
+                          const DataInterval &gyro_interval_pos01, _T dt )
+{
+  if( jacobian_mode == JACOBIAN_ANALYTIC )
   {
-    Eigen::Matrix< _T2, 3 , 1> raw_samp( _T2(sample_(0)), _T2(sample_(1)), _T2(sample_(2)) );
-    /* Assume body frame same as accelerometer frame, 
-     * so bottom left params in the misalignment matris are set to zero */
-    CalibratedTriad_<_T2> calib_triad( params[0], params[1], params[2], 
-                                     _T2(0), _T2(0), _T2(0),
-                                     params[3], params[4], params[5], 
-                                     params[6], params[7], params[8] );
-    
-    Eigen::Matrix< _T2, 3 , 1> calib_samp = calib_triad.unbiasNormalize( raw_samp );
-    residuals[0] = _T2 ( g_mag_ ) - calib_samp.norm();
-    return true;
+    if( optimize_bias )
+      return MultiPosGyroAnalyticResidual<_T, 12>::Create ( g_versor_pos0, g_versor_pos1, gyro_samples,
+                                                            gyro_interval_pos01, dt );
+    else
+      return MultiPosGyroAnalyticResidual<_T, 9>::Create ( g_versor_pos0, g_versor_pos1, gyro_samples,
+                                                           gyro_interval_pos01, dt );
   }
-  
-  static ceres::CostFunction* Create ( const _T1 &g_mag, const Eigen::Matrix< _T1, 3 , 1> &sample )
+  else
+  {
+    if( optimize_bias )
+      return MultiPosGyroResidual<_T, 12>::Create ( g_versor_pos0, g_versor_pos1, gyro_samples,
+                                                    gyro_interval_pos01, dt );
+    else
+      return MultiPosGyroResidual<_T, 9>::Create ( g_versor_pos0, g_versor_pos1, gyro_samples,
+                                                   gyro_interval_pos01, dt );
+  }
+}
+
+/* Build a CalibratedTriad_ object from the row-major misalignment and scale 
+ * matrices and the bias vector */
+template <typename _T> static CalibratedTriad_<_T> 
+  calibratedTriad( const std::vector< double > &mis_mat, const std::vector< double > &scale_mat, 
+                   const std::vector< double > &bias_vec )
+{
+  return CalibratedTriad_<_T>( -mis_mat[1], mis_mat[2], -mis_mat[5], 
+                                mis_mat[3], -mis_mat[6], mis_mat[7],
+                                scale_mat[0], scale_mat[4], scale_mat[8],
+                                bias_vec[0], bias_vec[1], bias_vec[2] );
+}
+
+/* Read the accelerometers and gyroscopes calibrations stored by MultiPosCalibration_::save() */
+template <typename _T> static bool 
+  readCalibratedTriads( std::map< std::string, std::vector< double > > &values, 
+                        CalibratedTriad_<_T> calib[2] )
+{
+  const char *prefixes[2] = { "acc_", "gyro_" };
+  for( int i = 0; i < 2; i++ )
   {
-    return ( new ceres::AutoDiffCostFunction< MultiPosAccResidual, 1, 9 > (
-               new MultiPosAccResidual<_T1>( g_mag, sample ) ) );
+    const std::string prefix( prefixes[i] );
+    const std::vector< double > &mis_mat = values[prefix + "misalign_matrix"],
+                                &scale_mat = values[prefix + "scale_matrix"],
+                                &bias_vec = values[prefix + "bias_vector"];
+    if( mis_mat.size() != 9 || scale_mat.size() != 9 || bias_vec.size() != 3 )
+      return false;
+    calib[i] = calibratedTriad<_T>( mis_mat, scale_mat, bias_vec );
   }
+  return true;
+}
+
+/* Read the uncertainty of a triad stored by MultiPosCalibration_::save(), if any */
+template <typename _T> static void 
+  readTriadUncertainty( std::map< std::string, std::vector< double > > &values, 
+                        const std::string &prefix, TriadUncertainty_<_T> &uncertainty )
+{
+  uncertainty = TriadUncertainty_<_T>();
+  const std::vector< double > &mis_std = values[prefix + "misalign_matrix_std"],
+                              &scale_std = values[prefix + "scale_factors_std"],
+                              &bias_std = values[prefix + "bias_vector_std"],
+                              &n_replicas = values[prefix + "uncertainty_replicas"];
+  if( mis_std.size() != 9 || scale_std.size() != 3 || bias_std.size() != 3 || n_replicas.size() != 1 )
+    return;
   
-  const _T1 g_mag_;
-  const Eigen::Matrix< _T1, 3 , 1> sample_;
-};
+  uncertainty.num_replicas = int( n_replicas[0] );
+  uncertainty.mis_mat_std = 
+    Eigen::Map< const Eigen::Matrix< double, 3, 3, Eigen::RowMajor > >( mis_std.data() ).template cast<_T>();
+  uncertainty.scale_std = Eigen::Vector3d( scale_std[0], scale_std[1], scale_std[2] ).template cast<_T>();
+  uncertainty.bias_std = Eigen::Vector3d( bias_std[0], bias_std[1], bias_std[2] ).template cast<_T>();
+}
+
+/* Read the intervals statistics stored by MultiPosCalibration_::saveAccIntervalsCache() */
+template <typename _T> static bool 
+  readIntervalsStatistics( std::map< std::string, std::vector< double > > &values, 
+                           std::vector< IntervalStatistics_<_T> > &intervals )
+{
+  if( !values.count("acc_intervals") )
+    return false;
+  
+  const std::vector< double > &data = values["acc_intervals"];
+  const int n_values = 11;
+  if( data.size()%n_values )
+    return false;
+  
+  intervals.resize( data.size()/n_values );
+  for( int i = 0; i < int(intervals.size()); i++ )
+  {
+    const double *v = &data[i*n_values];
+    IntervalStatistics_<_T> &stats = intervals[i];
+    stats.interval = DataInterval( int(v[0]), int(v[1]) );
+    stats.interval_id = int(v[2]);
+    stats.start_timestamp = _T(v[3]);
+    stats.end_timestamp = _T(v[4]);
+    stats.mean = Eigen::Matrix< double, 3, 1>( v[5], v[6], v[7] ).template cast<_T>();
+    stats.variance = Eigen::Matrix< double, 3, 1>( v[8], v[9], v[10] ).template cast<_T>();
+  }
+  return true;
+}
+
+/* Add the parameters of a calibration to a hash */
+template <typename _T> static void hashCalibration( Hash64 &hash, const CalibratedTriad_<_T> &calib )
+{
+  const Eigen::Matrix< _T, 3, 3> mis_mat = calib.getMisalignmentMatrix(), 
+                                 scale_mat = calib.getScaleMatrix();
+  const Eigen::Matrix< _T, 3, 1> bias_vec = calib.getBiasVector();
+  hash.update( mis_mat.data(), sizeof(mis_mat) );
+  hash.update( scale_mat.data(), sizeof(scale_mat) );
+  hash.update( bias_vec.data(), sizeof(bias_vec) );
+}
+
+/* Fill the solver report with the statistics of the solved problem */
+static void fillSolverReport( const ceres::Problem &problem, const ceres::Solver::Summary &summary,
+                              SolverReport &report )
+{
+  report.num_residual_blocks = problem.NumResidualBlocks();
+  report.num_residuals = problem.NumResiduals();
+  report.num_successful_steps = summary.num_successful_steps;
+  report.num_unsuccessful_steps = summary.num_unsuccessful_steps;
+#if defined(CERES_VERSION_MAJOR) && CERES_VERSION_MAJOR >= 2
+  report.num_residual_evaluations = summary.num_residual_evaluations;
+  report.num_jacobian_evaluations = summary.num_jacobian_evaluations;
+#endif
+  report.initial_cost = summary.initial_cost;
+  report.final_cost = summary.final_cost;
+  report.converged = ( summary.termination_type == ceres::CONVERGENCE );
+}
+
+/* Number of threads actually used, given the number of threads in SolverOptions */
+static int solverNumThreads( int num_threads )
+{
+  if( num_threads < 1 )
+    num_threads = std::max( int( std::thread::hardware_concurrency() ), 1 );
+  return num_threads;
+}
+
+/* Set up the ceres solver options */
+static void setupSolverOptions( const SolverOptions &solver_options, bool verbose_output,
+                                ceres::Solver::Options &options )
+{
+  options.linear_solver_type = solver_options.linear_solver_type;
+  options.trust_region_strategy_type = solver_options.trust_region_strategy_type;
+  options.num_threads = solverNumThreads( solver_options.num_threads );
+  options.max_num_iterations = solver_options.max_num_iterations;
+  options.function_tolerance = solver_options.function_tolerance;
+  options.gradient_tolerance = solver_options.gradient_tolerance;
+  options.parameter_tolerance = solver_options.parameter_tolerance;
+  options.minimizer_progress_to_stdout = verbose_output;
+}
 
-template <typename _T1> struct MultiPosGyroResidual
+/* Solve the accelerometers calibration problem given the static samples, starting from 
+ * init_calib. Only the output arguments are modified, so several problems can be solved 
+ * concurrently */
+template <typename _T> static void 
+  solveAccProblem( _T g_mag, const TriadBuffer_<_T>& static_samples, 
+                   const CalibratedTriad_<_T> &init_calib, bool batched_residual, 
+                   JacobianMode jacobian_mode, const SolverOptions &solver_options, 
+                   bool verbose_output, CalibratedTriad_<_T> &calib, 
+                   TriadCalibrationReport &report )
 {
-  MultiPosGyroResidual( const Eigen::Matrix< _T1, 3 , 1> &g_versor_pos0, 
-                        const Eigen::Matrix< _T1, 3 , 1> &g_versor_pos1,
-                        const std::vector< TriadData_<_T1> > &gyro_samples, 
-                        const DataInterval &gyro_interval_pos01, 
-                        _T1 dt, bool optimize_bias) :
+  std::vector< double > acc_calib_params(9);
 
-  g_versor_pos0_(g_versor_pos0), 
-  g_versor_pos1_(g_versor_pos1),
-  gyro_samples_(gyro_samples),
-  interval_pos01_(gyro_interval_pos01),
-  dt_(dt), optimize_bias_(optimize_bias){}
+  acc_calib_params[0] = init_calib.misYZ();
+  acc_calib_params[1] = init_calib.misZY();
+  acc_calib_params[2] = init_calib.misZX();
+  
+  acc_calib_params[3] = init_calib.scaleX();
+  acc_calib_params[4] = init_calib.scaleY();
+  acc_calib_params[5] = init_calib.scaleZ();
+  
+  acc_calib_params[6] = init_calib.biasX();
+  acc_calib_params[7] = init_calib.biasY();
+  acc_calib_params[8] = init_calib.biasZ();
   
-  template <typename _T2>
-    bool operator() ( const _T2* const params, _T2* residuals ) const
+  report.num_used_samples = static_samples.size();
+  
+  StageTimer construction_timer( report.stages[STAGE_PROBLEM_CONSTRUCTION] );
+  ceres::Problem problem;
+  if( batched_residual )
+  {
+    // One block for each thread, so the blocks are evaluated in parallel
+    const int n_samps = static_samples.size(), 
+              n_blocks = std::max( std::min( solverNumThreads( solver_options.num_threads ), 
+                                             n_samps ), 1 );
+    for( int i = 0; i < n_blocks; i++ )
+    {
+      const int start_idx = int( ( long long )n_samps*i/n_blocks ), 
+                end_idx = int( ( long long )n_samps*( i + 1 )/n_blocks );
+      ceres::CostFunction* cost_function = 
+        MultiPosAccBatchResidual<_T>::Create ( g_mag, static_samples, start_idx, end_idx - start_idx );
+      
+      problem.AddResidualBlock ( cost_function, NULL /* squared loss */, acc_calib_params.data() );
+    }
+  }
+  else
   {
-    CalibratedTriad_<_T2> calib_triad( params[0], params[1], params[2], 
-                                      params[3], params[4], params[5], 
-                                      params[6], params[7], params[8],
-                                      optimize_bias_?params[9]:_T2(0), 
-                                      optimize_bias_?params[10]:_T2(0), 
-                                      optimize_bias_?params[11]:_T2(0) );
+    for( int i = 0; i < static_samples.size(); i++)
+    {
+      ceres::CostFunction* cost_function;
+      if( jacobian_mode == JACOBIAN_ANALYTIC )
+        cost_function = MultiPosAccAnalyticResidual<_T>::Create ( g_mag, static_samples.data(i) );
+      else
+        cost_function = MultiPosAccResidual<_T>::Create ( g_mag, static_samples.data(i) );
 
-    std::vector< TriadData_<_T2> > calib_gyro_samples;
-    calib_gyro_samples.reserve( interval_pos01_.end_idx - interval_pos01_.start_idx + 1 );
-    
-    for( int i = interval_pos01_.start_idx; i <= interval_pos01_.end_idx; i++ )
-      calib_gyro_samples.push_back( TriadData_<_T2>( calib_triad.unbiasNormalize( gyro_samples_[i] ) ) );
-    
-    Eigen::Matrix< _T2, 3 , 3> rot_mat;
-    integrateGyroInterval( calib_gyro_samples, rot_mat, _T2(dt_) );
-    
-    Eigen::Matrix< _T2, 3 , 1> diff = rot_mat.transpose()*g_versor_pos0_.template cast<_T2>() -
-                                      g_versor_pos1_.template cast<_T2>();
-    
-    residuals[0] = diff(0);
-    residuals[1] = diff(1);
-    residuals[2] = diff(2);
+      problem.AddResidualBlock ( cost_function, NULL /* squared loss */, acc_calib_params.data() );
+    }
+  }
+
+  ceres::Solver::Options options;
+  setupSolverOptions( solver_options, verbose_output, options );
+
+  ceres::Solver::Summary summary;
+  construction_timer.stop();
+  {
+    StageTimer timer( report.stages[STAGE_SOLVE] );
+    ceres::Solve ( options, &problem, &summary );
+  }
+  fillSolverReport( problem, summary, report.solver );
+  report.calibrated = true;
+
+  calib = CalibratedTriad_<_T>( acc_calib_params[0],
+                                acc_calib_params[1],
+                                acc_calib_params[2],
+                                0,0,0,
+                                acc_calib_params[3],
+                                acc_calib_params[4],
+                                acc_calib_params[5],
+                                acc_calib_params[6],
+                                acc_calib_params[7],
+                                acc_calib_params[8] );
+}
+
+/* Mean squared residual of the calibrated means of the static intervals, used to compare 
+ * solutions obtained with different numbers of residuals */
+template <typename _T> static double 
+  intervalsMeansCost( _T g_mag, const CalibratedTriad_<_T> &calib,
+                      const std::vector< DataInterval > &intervals,
+                      const TriadStatsIndex_<_T> &stats_index )
+{
+  double cost = 0;
+  for( int i = 0; i < int(intervals.size()); i++ )
+  {
+    double res = double( g_mag ) - 
+                 double( calib.unbiasNormalize( stats_index.mean( intervals[i] ) ).norm() );
+    cost += res*res;
+  }
+  return intervals.empty() ? std::numeric_limits< double >::max() : cost/intervals.size();
+}
+
+/* Random perturbation of an accelerometers calibration (see SweepOptions::init_perturbation) */
+template <typename _T> static CalibratedTriad_<_T> 
+  perturbedAccCalibration( const CalibratedTriad_<_T> &calib, _T g_mag, double perturbation,
+                           std::mt19937 &rng )
+{
+  std::uniform_real_distribution< double > u( -perturbation, perturbation );
+  const double s_x = calib.scaleX()*( 1.0 + u(rng) ), 
+               s_y = calib.scaleY()*( 1.0 + u(rng) ), 
+               s_z = calib.scaleZ()*( 1.0 + u(rng) );
+  // The biases are perturbed in the calibrated units
+  const double b_x = calib.biasX() + u(rng)*g_mag/s_x, 
+               b_y = calib.biasY() + u(rng)*g_mag/s_y, 
+               b_z = calib.biasZ() + u(rng)*g_mag/s_z;
+  return CalibratedTriad_<_T>( _T( calib.misYZ() + u(rng) ), _T( calib.misZY() + u(rng) ), 
+                               _T( calib.misZX() + u(rng) ), 0, 0, 0,
+                               _T(s_x), _T(s_y), _T(s_z), _T(b_x), _T(b_y), _T(b_z) );
+}
+
+/* True if a gyroscopes motion interval can be integrated, i.e. it is not empty and all 
+ * its samples are inside the samples buffer (the motion intervals that start or end 
+ * past the last sample are invalid) */
+static bool validMotionInterval( const DataInterval &interval, int n_samps )
+{
+  return interval.start_idx >= 0 && interval.end_idx >= interval.start_idx && 
+         interval.end_idx < n_samps;
+}
+
+/* Solve the gyroscopes calibration problem given the gravity versors of the static positions, 
+ * using the motion intervals between the pairs of consecutive positions (pair i is the motion 
+ * from position i to position i+1). The pairs with an invalid motion interval (see 
+ * validMotionInterval() ) are skipped. The parameters start from init_calib, with the biases
+ * relative to the biases gyro_bias removed from the samples. As for solveAccProblem(), 
+ * several problems can be solved concurrently. Returns false (and calib is not set) 
+ * if no pair can be used */
+template <typename _T> static bool 
+  solveGyroProblem( const std::vector< Eigen::Matrix< _T, 3, 1> > &g_versors,
+                    const TriadBuffer_<_T> &unbiased_gyro_samples,
+                    const std::vector< DataInterval > &gyro_intervals,
+                    const std::vector< int > &pairs,
+                    const CalibratedTriad_<_T> &init_calib,
+                    const Eigen::Matrix< _T, 3, 1> &gyro_bias,
+                    JacobianMode jacobian_mode, bool optimize_bias, _T dt,
+                    const SolverOptions &solver_options, bool verbose_output,
+                    CalibratedTriad_<_T> &calib, TriadCalibrationReport &report, 
+                    ceres::Solver::Summary &summary )
+{
+  std::vector< double > gyro_calib_params(12);
+
+  gyro_calib_params[0] = init_calib.misYZ();
+  gyro_calib_params[1] = init_calib.misZY();
+  gyro_calib_params[2] = init_calib.misZX();
+  gyro_calib_params[3] = init_calib.misXZ();
+  gyro_calib_params[4] = init_calib.misXY();
+  gyro_calib_params[5] = init_calib.misYX();
+  
+  gyro_calib_params[6] = init_calib.scaleX();
+  gyro_calib_params[7] = init_calib.scaleY();
+  gyro_calib_params[8] = init_calib.scaleZ();
+  
+  gyro_calib_params[9] = init_calib.biasX() - gyro_bias(0);
+  gyro_calib_params[10] = init_calib.biasY() - gyro_bias(1);
+  gyro_calib_params[11] = init_calib.biasZ() - gyro_bias(2);
+  
+  report.num_used_samples = 0;
+  
+  StageTimer construction_timer( report.stages[STAGE_PROBLEM_CONSTRUCTION] );
+  ceres::Problem problem;
+      
+  int n_used_pairs = 0;
+  for( int p = 0; p < int(pairs.size()); p++ )
+  {
+    const int i = pairs[p];
+    if( !validMotionInterval( gyro_intervals[i], unbiased_gyro_samples.size() ) )
+      continue;
+    report.num_used_samples += gyro_intervals[i].end_idx - gyro_intervals[i].start_idx + 1;
+    n_used_pairs++;
     
-    return true;
+    ceres::CostFunction* cost_function =
+      createGyroCostFunction<_T>( jacobian_mode, optimize_bias, 
+                                  g_versors[i], g_versors[i + 1], unbiased_gyro_samples,
+                                  gyro_intervals[i], dt );
+
+    problem.AddResidualBlock ( cost_function, NULL /* squared loss */, gyro_calib_params.data() ); 
   }
+  if( !n_used_pairs )
+    return false;
   
-  static ceres::CostFunction* Create ( const Eigen::Matrix< _T1, 3 , 1> &g_versor_pos0, 
-                                       const Eigen::Matrix< _T1, 3 , 1> &g_versor_pos1,
-                                       const std::vector< TriadData_<_T1> > &gyro_samples, 
-                                       const DataInterval &gyro_interval_pos01, 
-                                       _T1 dt, bool optimize_bias )
+  ceres::Solver::Options options;
+  setupSolverOptions( solver_options, verbose_output, options );
+
+  construction_timer.stop();
+
   {
-    if( optimize_bias )
-      return ( new ceres::AutoDiffCostFunction< MultiPosGyroResidual, 3, 12 > (
-                new MultiPosGyroResidual( g_versor_pos0, g_versor_pos1, gyro_samples, 
-                                          gyro_interval_pos01, dt, optimize_bias ) ) );
-    else
-      return ( new ceres::AutoDiffCostFunction< MultiPosGyroResidual, 3, 9 > (
-                new MultiPosGyroResidual( g_versor_pos0, g_versor_pos1, gyro_samples, 
-                                          gyro_interval_pos01, dt, optimize_bias ) ) );
+    StageTimer timer( report.stages[STAGE_SOLVE] );
+    ceres::Solve ( options, &problem, &summary );
+  }
+  fillSolverReport( problem, summary, report.solver );
+  report.calibrated = true;
+  
+  calib = CalibratedTriad_<_T>( gyro_calib_params[0],
+                                gyro_calib_params[1],
+                                gyro_calib_params[2],
+                                gyro_calib_params[3],
+                                gyro_calib_params[4],
+                                gyro_calib_params[5],
+                                gyro_calib_params[6],
+                                gyro_calib_params[7],
+                                gyro_calib_params[8],
+                                gyro_bias(0) + gyro_calib_params[9],
+                                gyro_bias(1) + gyro_calib_params[10],
+                                gyro_bias(2) + gyro_calib_params[11]);
+  return true;
+}
+
+/* Standard deviations of the calibration parameters over the replicas of a resampling method */
+template <typename _T> static void 
+  triadUncertainty( const std::vector< CalibratedTriad_<_T> > &replicas, ResamplingMethod method,
+                    TriadUncertainty_<_T> &uncertainty )
+{
+  uncertainty = TriadUncertainty_<_T>();
+  const int n_replicas = replicas.size();
+  if( n_replicas < 2 )
+    return;
+  
+  // For each replica (row): the misalignment matrix (column major), the scale factors and the biases
+  Eigen::Matrix< double, Eigen::Dynamic, 15 > params( n_replicas, 15 );
+  for( int r = 0; r < n_replicas; r++ )
+  {
+    const Eigen::Matrix< _T, 3, 3> mis_mat = replicas[r].getMisalignmentMatrix();
+    params.template block< 1, 9 >( r, 0 ) = 
+      Eigen::Map< const Eigen::Matrix< _T, 1, 9 > >( mis_mat.data() ).template cast<double>();
+    params.template block< 1, 3 >( r, 9 ) = 
+      replicas[r].getScaleMatrix().diagonal().transpose().template cast<double>();
+    params.template block< 1, 3 >( r, 12 ) = 
+      replicas[r].getBiasVector().transpose().template cast<double>();
   }
   
-  const Eigen::Matrix< _T1, 3 , 1> g_versor_pos0_, g_versor_pos1_;
-  const std::vector< TriadData_<_T1> > gyro_samples_;
-  const DataInterval interval_pos01_;
-  const _T1 dt_;
-  const bool optimize_bias_;
+  const Eigen::Matrix< double, 1, 15 > mean = params.colwise().mean();
+  Eigen::Matrix< double, 1, 15 > var = ( params.rowwise() - mean ).colwise().squaredNorm();
+  // The jackknife replicas differ by a single interval: their spread is scaled by (n - 1)/n
+  if( method == RESAMPLING_JACKKNIFE )
+    var *= double( n_replicas - 1 )/n_replicas;
+  else
+    var /= ( n_replicas - 1 );
+  const Eigen::Matrix< double, 1, 15 > std_dev = var.cwiseSqrt();
+  
+  uncertainty.num_replicas = n_replicas;
+  uncertainty.mis_mat_std = Eigen::Map< const Eigen::Matrix< double, 3, 3 > >( std_dev.data() ).template cast<_T>();
+  uncertainty.scale_std = std_dev.template segment<3>(9).transpose().template cast<_T>();
+  uncertainty.bias_std = std_dev.template segment<3>(12).transpose().template cast<_T>();
+}
+
+/* A setting of the accelerometers parameters sweep, with its extracted samples */
+template <typename _T> struct AccSweepSetting
+{
+  int th_idx;
+  int interval_n_samples;
+  bool use_means;
+  TriadBuffer_<_T> static_samples;
+  std::vector< DataInterval > extracted_intervals;
+};
+
+/* A run of the accelerometers parameters sweep, i.e. a setting and an initial guess */
+template <typename _T> struct AccSweepRun
+{
+  AccSweepRun() : setting_idx(-1), guess_idx(-1), 
+                  cost( std::numeric_limits< double >::max() ), solved(false){};
+  
+  int setting_idx, guess_idx;
+  CalibratedTriad_<_T> calib;
+  TriadCalibrationReport report;
+  double cost;
+  bool solved;
 };
 
 template <typename _T>
@@ -142,250 +504,1264 @@ template <typename _T>
   g_mag_(9.8),
   min_interval_n_samples_(100),
   min_num_intervals_(12),
+  init_interval_duration_(_T(30.0)),
   acc_use_means_(false),
+  acc_batched_residual_(false),
+  variance_intervals_detection_(false),
   gyro_dt_(-1.0),
   optimize_gyro_bias_(false),
+  time_alignment_(false),
+  max_time_offset_(_T(1.0)),
+  time_offset_(0),
+  parameter_sweep_(false),
+  min_cost_interval_n_samples_(100),
+  uncertainty_estimation_(false),
+  result_from_cache_(false),
+  max_cached_intervals_(0),
+  has_acc_calib_(false),
+  jacobian_mode_(JACOBIAN_AUTODIFF),
   verbose_output_(false){}
 
 template <typename _T>
   bool MultiPosCalibration_<_T>::calibrateAcc ( const std::vector< TriadData_<_T> >& acc_samples )
 {
-  cout<<"Accelerometers calibration: calibrating..."<<endl;
+  return calibrateAcc( TriadBuffer_<_T>( acc_samples ) );
+}
+
+template <typename _T>
+  bool MultiPosCalibration_<_T>::calibrateAcc ( const TriadBuffer_<_T>& acc_samples )
+{
+  if( parameter_sweep_ )
+    return calibrateAccSweep( acc_samples );
+  
+  ScopedLogLevel log_level( calibrationLogLevel( verbose_output_ ) );
+  StageTimer total_timer( report_.total, false );
+  IMU_TK_LOG_INFO( "Accelerometers calibration: calibrating..." );
   
   min_cost_static_intervals_.clear();
-  calib_acc_samples_.clear();
-  calib_gyro_samples_.clear();
+  min_cost_interval_n_samples_ = min_interval_n_samples_;
+  clearCalibSamples();
+  report_.clear();
   
   int n_samps = acc_samples.size();
-
-  std::vector< double > min_cost_calib_params;
+  report_.acc.num_samples = n_samps;
 
   std::vector< imu_tk::DataInterval > static_intervals;
-  std::vector< imu_tk::TriadData_<_T> > static_samples;
-  std::vector< double > acc_calib_params(9);
-
-  acc_calib_params[0] = init_acc_calib_.misYZ();
-  acc_calib_params[1] = init_acc_calib_.misZY();
-  acc_calib_params[2] = init_acc_calib_.misZX();
+  imu_tk::TriadBuffer_<_T> static_samples;
+  std::vector< DataInterval > extracted_intervals;
   
-  acc_calib_params[3] = init_acc_calib_.scaleX();
-  acc_calib_params[4] = init_acc_calib_.scaleY();
-  acc_calib_params[5] = init_acc_calib_.scaleZ();
+  // With the variance-based detection, the threshold is a multiple of the variance 
+  // magnitude in the initial static interval: the calibration is repeated for
+  // several multiples, keeping the one with the minimum residual
+  _T norm_th = 0;
+  int first_th_mult = 1, last_th_mult = 1;
   
-  acc_calib_params[6] = init_acc_calib_.biasX();
-  acc_calib_params[7] = init_acc_calib_.biasY();
-  acc_calib_params[8] = init_acc_calib_.biasZ();
-    
-  std::vector< DataInterval > extracted_intervals;
-
-  staticIntervalsDetector ( acc_samples, static_intervals );
-  extractIntervalsSamples ( acc_samples, static_intervals,
-                            static_samples, extracted_intervals,
-                            min_interval_n_samples_, acc_use_means_ );
-    
-  if(verbose_output_)
-    cout<<"Accelerometers calibration: extracted "<<extracted_intervals.size();
-
-  // TODO Perform here a quality test
-  if( extracted_intervals.size() < min_num_intervals_)
+  // The intervals statistics are queried for all the detected intervals (in each attempt)
+  TriadStatsIndex_<_T> stats_index;
   {
-    if( verbose_output_) cout<<"Not enough intervals, calibration is not possible"<<endl;
-    return(false);
+    StageTimer timer( report_.acc.stages[STAGE_SAMPLES_EXTRACTION] );
+    stats_index.build( acc_samples );
   }
   
-  if( verbose_output_) cout<<"Calibrating... "<<endl;
-
-  ceres::Problem problem;
-  for( int i = 0; i < static_samples.size(); i++)
+  if( variance_intervals_detection_ )
   {
-    ceres::CostFunction* cost_function =
-      MultiPosAccResidual<_T>::Create ( g_mag_, static_samples[i].data() );
-
-    problem.AddResidualBlock ( cost_function, NULL /* squared loss */, acc_calib_params.data() );
+    DataInterval init_static_interval = 
+      DataInterval::initialInterval( acc_samples, init_interval_duration_ );
+    norm_th = stats_index.variance( init_static_interval ).norm();
+    first_th_mult = 2;
+    last_th_mult = 10;
   }
-
-  ceres::Solver::Options options;
-  options.linear_solver_type = ceres::DENSE_QR;
-  options.minimizer_progress_to_stdout = verbose_output_;
-
-  ceres::Solver::Summary summary;
-  ceres::Solve ( options, &problem, &summary );
-
-  min_cost_static_intervals_ = static_intervals;
-  min_cost_calib_params = acc_calib_params;
-
-  cout<<"residual "<<summary.final_cost<<endl;
-
-  acc_calib_ = CalibratedTriad_<_T>( min_cost_calib_params[0],
-                                     min_cost_calib_params[1],
-                                     min_cost_calib_params[2],
-                                     0,0,0,
-                                     min_cost_calib_params[3],
-                                     min_cost_calib_params[4],
-                                     min_cost_calib_params[5],
-                                     min_cost_calib_params[6],
-                                     min_cost_calib_params[7],
-                                     min_cost_calib_params[8] );
-  
-  calib_acc_samples_.reserve(n_samps);
   
-  // Calibrate the input accelerometer data with the obtained calibration
-  for( int i = 0; i < n_samps; i++)
-    calib_acc_samples_.push_back( acc_calib_.unbiasNormalize( acc_samples[i]) );
+  double min_cost = std::numeric_limits< double >::max();
+  int min_cost_th_mult = -1;
+  CalibratedTriad_<_T> min_cost_calib;
+  TriadCalibrationReport min_cost_report;
+  std::vector< IntervalStatistics_<_T> > min_cost_intervals;
   
-  if(verbose_output_) 
+  for( int th_mult = first_th_mult; th_mult <= last_th_mult; th_mult++ )
   {
-    Plot plot;
-    plot.plotIntervals( calib_acc_samples_, min_cost_static_intervals_);
+    {
+      StageTimer timer( report_.acc.stages[STAGE_INTERVALS_DETECTION] );
+      if( variance_intervals_detection_ )
+        staticIntervalsDetector ( acc_samples, th_mult*norm_th, static_intervals );
+      else
+        staticIntervalsDetector ( acc_samples, static_intervals );
+    }
     
-    cout<<acc_calib_<<endl
-        <<"Accelerometers calibration: inverse scale factors:"<<endl
-        <<1.0/acc_calib_.scaleX()<<endl
-        <<1.0/acc_calib_.scaleY()<<endl
-        <<1.0/acc_calib_.scaleZ()<<endl;
-        
-    waitForKey();
+    std::vector< IntervalStatistics_<_T> > valid_intervals;
+    {
+      StageTimer timer( report_.acc.stages[STAGE_SAMPLES_EXTRACTION] );
+      extractIntervalsSamples ( acc_samples, static_intervals,
+                                static_samples, extracted_intervals,
+                                min_interval_n_samples_, acc_use_means_, &stats_index );
+      
+      // Store the intervals statistics, to be used in the next incremental calibrations
+      intervalsStatistics( acc_samples, extracted_intervals, stats_index, valid_intervals );
+    }
+    
+    if( variance_intervals_detection_ )
+      IMU_TK_LOG_DEBUG( "Accelerometers calibration: threshold "<<th_mult<<"*"<<norm_th );
+    
+    if( !solveAccCalibration( static_samples, extracted_intervals.size(), init_acc_calib_ ) )
+      continue;
+    
+    if( report_.acc.solver.final_cost < min_cost )
+    {
+      min_cost = report_.acc.solver.final_cost;
+      min_cost_th_mult = th_mult;
+      min_cost_calib = acc_calib_;
+      min_cost_report = report_.acc;
+      min_cost_static_intervals_ = static_intervals;
+      min_cost_intervals.swap( valid_intervals );
+    }
+  }
+  
+  if( min_cost_th_mult < 0 )
+  {
+    IMU_TK_LOG_ERROR( "Accelerometers calibration: not enough intervals, calibration is not possible" );
+    return false;
   }
+  
+  acc_calib_ = min_cost_calib;
+  // Keep the stages timings of all the attempts
+  std::copy( report_.acc.stages, report_.acc.stages + NUM_CALIBRATION_STAGES, 
+             min_cost_report.stages );
+  report_.acc = min_cost_report;
+  acc_intervals_cache_.clear();
+  cacheAccIntervals( min_cost_intervals );
+  if( uncertainty_estimation_ )
+    estimateAccUncertainty( acc_samples, min_cost_intervals, acc_use_means_ );
+  
+  if( variance_intervals_detection_ )
+    IMU_TK_LOG_DEBUG( "Accelerometers calibration: better calibration obtained using threshold multiplier "
+                      <<min_cost_th_mult<<" with residual "<<min_cost );
+  
+  setCalibAccSamples( acc_samples );
   return true;
 }
 
-template <typename _T> 
-  bool MultiPosCalibration_<_T>::calibrateAccGyro ( const vector< TriadData_<_T> >& acc_samples, 
-                                                   const vector< TriadData_<_T> >& gyro_samples )
+template <typename _T>
+  bool MultiPosCalibration_<_T>::calibrateAccSweep ( const TriadBuffer_<_T>& acc_samples )
 {
-  if( !calibrateAcc( acc_samples ) )
-    return false;
+  ScopedLogLevel log_level( calibrationLogLevel( verbose_output_ ) );
+  StageTimer total_timer( report_.total, false );
+  IMU_TK_LOG_INFO( "Accelerometers calibration: calibrating (parameters sweep)..." );
   
-  cout<<"Gyroscopes calibration: calibrating..."<<endl;
+  min_cost_static_intervals_.clear();
+  clearCalibSamples();
+  report_.clear();
+  report_.acc.num_samples = acc_samples.size();
   
-  std::vector< TriadData_<_T> > static_acc_means;
-  std::vector< DataInterval > extracted_intervals;
-  extractIntervalsSamples ( calib_acc_samples_, min_cost_static_intervals_, 
-                            static_acc_means, extracted_intervals,
-                            min_interval_n_samples_, true );
+  StageTiming phases[NUM_CALIBRATION_STAGES];
   
-  int n_static_pos = static_acc_means.size(), n_samps = gyro_samples.size();
+  // The intervals statistics are shared by all the runs
+  TriadStatsIndex_<_T> stats_index;
+  {
+    StageTimer timer( phases[STAGE_SAMPLES_EXTRACTION] );
+    stats_index.build( acc_samples );
+  }
   
-  // Compute the gyroscopes biases in the (static) initialization interval
-  DataInterval init_static_interval = DataInterval::initialInterval( gyro_samples );
-  std::cout << "Found initial interval starting in sample " << init_static_interval.start_idx <<
-      " and finishing in sample num " << init_static_interval.end_idx << std::endl;
-
-  Eigen::Matrix<_T, 3, 1> gyro_bias = dataMean( gyro_samples, init_static_interval );
+  _T norm_th = 0;
+  std::vector< double > th_mults( 1, 1.0 );
+  if( variance_intervals_detection_ )
+  {
+    DataInterval init_static_interval = 
+      DataInterval::initialInterval( acc_samples, init_interval_duration_ );
+    norm_th = stats_index.variance( init_static_interval ).norm();
+    th_mults = sweep_options_.threshold_multipliers;
+    if( th_mults.empty() )
+      for( int th_mult = 2; th_mult <= 10; th_mult++ )
+        th_mults.push_back( th_mult );
+  }
   
-  gyro_calib_ = CalibratedTriad_<_T>(0, 0, 0, 0, 0, 0, 
-                                    1.0, 1.0, 1.0, 
-                                    gyro_bias(0), gyro_bias(1), gyro_bias(2) );
+  const std::vector< int > n_samples_grid = sweep_options_.min_interval_n_samples.empty() ? 
+    std::vector< int >( 1, min_interval_n_samples_ ) : sweep_options_.min_interval_n_samples;
+  const std::vector< bool > use_means_grid = sweep_options_.acc_use_means.empty() ? 
+    std::vector< bool >( 1, acc_use_means_ ) : sweep_options_.acc_use_means;
   
-
-  // calib_gyro_samples_ already cleared in calibrateAcc()
-  calib_gyro_samples_.reserve(n_samps);
-  // Remove the bias
-  for( int i = 0; i < n_samps; i++ )
-    calib_gyro_samples_.push_back(gyro_calib_.unbias(gyro_samples[i]));
+  std::vector< AccSweepSetting<_T> > settings;
+  for( int t = 0; t < int(th_mults.size()); t++ )
+    for( int n = 0; n < int(n_samples_grid.size()); n++ )
+      for( int m = 0; m < int(use_means_grid.size()); m++ )
+      {
+        AccSweepSetting<_T> setting;
+        setting.th_idx = t;
+        setting.interval_n_samples = n_samples_grid[n];
+        setting.use_means = use_means_grid[m];
+        settings.push_back( setting );
+      }
   
-  std::vector< double > gyro_calib_params(12);
-
-  gyro_calib_params[0] = init_gyro_calib_.misYZ();
-  gyro_calib_params[1] = init_gyro_calib_.misZY();
-  gyro_calib_params[2] = init_gyro_calib_.misZX();
-  gyro_calib_params[3] = init_gyro_calib_.misXZ();
-  gyro_calib_params[4] = init_gyro_calib_.misXY();
-  gyro_calib_params[5] = init_gyro_calib_.misYX();
+  std::mt19937 rng( sweep_options_.seed );
+  if( sweep_options_.num_random_settings > 0 && 
+      sweep_options_.num_random_settings < int(settings.size()) )
+  {
+    std::shuffle( settings.begin(), settings.end(), rng );
+    settings.resize( sweep_options_.num_random_settings );
+  }
   
-  gyro_calib_params[6] = init_gyro_calib_.scaleX();
-  gyro_calib_params[7] = init_gyro_calib_.scaleY();
-  gyro_calib_params[8] = init_gyro_calib_.scaleZ();
+  // The first initial guess is the provided one
+  std::vector< CalibratedTriad_<_T> > init_guesses( 1, init_acc_calib_ );
+  for( int g = 1; g < sweep_options_.num_init_guesses; g++ )
+    init_guesses.push_back( perturbedAccCalibration( init_acc_calib_, g_mag_, 
+                                                     sweep_options_.init_perturbation, rng ) );
   
-  // Bias has been estimated and removed in the initialization period
-  gyro_calib_params[9] = 0.0;
-  gyro_calib_params[10] = 0.0;
-  gyro_calib_params[11] = 0.0;
+  const int n_runs = settings.size()*init_guesses.size();
+  ThreadPool pool( std::min( solverNumThreads( sweep_options_.num_threads ), std::max( n_runs, 1 ) ) );
   
-  ceres::Problem problem;
-      
-  for( int i = 0; i < n_static_pos - 1; i++ )
+  // Each task writes only its own detected intervals, setting or run
+  std::vector< std::vector< DataInterval > > static_intervals( th_mults.size() );
   {
-    Eigen::Matrix<_T, 3, 1> g_versor_pos0 = static_acc_means[i].data(),
-                            g_versor_pos1 = static_acc_means[i + 1].data();
-                               
-    g_versor_pos0 /= g_versor_pos0.norm();                           
-    g_versor_pos1 /= g_versor_pos1.norm();
-    
-    int gyro_idx0 = -1, gyro_idx1 = -1;
-    _T ts0 = calib_acc_samples_[extracted_intervals[i].end_idx].timestamp(), 
-       ts1 = calib_acc_samples_[extracted_intervals[i + 1].start_idx].timestamp();
-     
-    // Assume monotone signal time
-    for( int t_idx = 0; t_idx < n_samps; t_idx++ )
-    {
-      if( gyro_idx0 < 0 )
+    StageTimer timer( phases[STAGE_INTERVALS_DETECTION] );
+    for( int t = 0; t < int(th_mults.size()); t++ )
+      pool.submit( [&, t]()
       {
-        if( calib_gyro_samples_[t_idx].timestamp() >= ts0 )
-          gyro_idx0 = t_idx;
-      }
-      else
+        if( variance_intervals_detection_ )
+          staticIntervalsDetector ( acc_samples, _T( th_mults[t]*norm_th ), static_intervals[t] );
+        else
+          staticIntervalsDetector ( acc_samples, static_intervals[t] );
+      } );
+    pool.wait();
+  }
+  
+  {
+    StageTimer timer( phases[STAGE_SAMPLES_EXTRACTION] );
+    for( int s = 0; s < int(settings.size()); s++ )
+      pool.submit( [&, s]()
       {
-        if( calib_gyro_samples_[t_idx].timestamp() >= ts1 )
-        {
-          gyro_idx1 = t_idx - 1;
-          break;
-        }
-      }
-    }
-    
-//     cout<<"from "<<calib_gyro_samples_[gyro_idx0].timestamp()<<" to "
-//         <<calib_gyro_samples_[gyro_idx1].timestamp()
-//         <<" v0 : "<< g_versor_pos0(0)<<" "<< g_versor_pos0(1)<<" "<< g_versor_pos0(2)
-//         <<" v1 : "<< g_versor_pos1(0)<<" "<< g_versor_pos1(1)<<" "<< g_versor_pos1(2)<<endl;
-    
-    DataInterval gyro_interval(gyro_idx0, gyro_idx1);
-    
-    ceres::CostFunction* cost_function =
-      MultiPosGyroResidual<_T>::Create ( g_versor_pos0, g_versor_pos1, calib_gyro_samples_,
-                                         gyro_interval, gyro_dt_, optimize_gyro_bias_ );
-
-    problem.AddResidualBlock ( cost_function, NULL /* squared loss */, gyro_calib_params.data() ); 
+        AccSweepSetting<_T> &setting = settings[s];
+        extractIntervalsSamples ( acc_samples, static_intervals[setting.th_idx],
+                                  setting.static_samples, setting.extracted_intervals,
+                                  setting.interval_n_samples, setting.use_means, &stats_index );
+      } );
+    pool.wait();
+  }
+  
+  // Each problem is solved by a single thread, the runs are solved concurrently
+  SolverOptions run_solver_options = solver_options_;
+  run_solver_options.num_threads = 1;
+  std::vector< AccSweepRun<_T> > runs( n_runs );
+  {
+    StageTimer timer( phases[STAGE_SOLVE] );
+    for( int r = 0; r < n_runs; r++ )
+    {
+      runs[r].setting_idx = r/init_guesses.size();
+      runs[r].guess_idx = r%init_guesses.size();
+      if( int(settings[runs[r].setting_idx].extracted_intervals.size()) < min_num_intervals_ )
+        continue;
       
+      pool.submit( [&, r]()
+      {
+        AccSweepRun<_T> &run = runs[r];
+        const AccSweepSetting<_T> &setting = settings[run.setting_idx];
+        run.report.num_samples = acc_samples.size();
+        run.report.num_static_intervals = setting.extracted_intervals.size();
+        solveAccProblem( g_mag_, setting.static_samples, init_guesses[run.guess_idx], 
+                         acc_batched_residual_, jacobian_mode_, run_solver_options, false, 
+                         run.calib, run.report );
+        run.cost = intervalsMeansCost( g_mag_, run.calib, setting.extracted_intervals, stats_index );
+        run.solved = true;
+      } );
+    }
+    pool.wait();
   }
   
-  ceres::Solver::Options options;
-  options.linear_solver_type = ceres::DENSE_QR;
-  options.minimizer_progress_to_stdout = verbose_output_;
+  int min_cost_run = -1;
+  for( int r = 0; r < n_runs; r++ )
+  {
+    const AccSweepSetting<_T> &setting = settings[runs[r].setting_idx];
+    if( !runs[r].solved )
+    {
+      IMU_TK_LOG_DEBUG( "Accelerometers calibration: threshold multiplier "<<th_mults[setting.th_idx]
+                        <<", min interval samples "<<setting.interval_n_samples<<", use means "
+                        <<setting.use_means<<": extracted "<<setting.extracted_intervals.size()
+                        <<" intervals, calibration is not possible" );
+      continue;
+    }
+    IMU_TK_LOG_DEBUG( "Accelerometers calibration: threshold multiplier "<<th_mults[setting.th_idx]
+                      <<", min interval samples "<<setting.interval_n_samples<<", use means "
+                      <<setting.use_means<<", initial guess "<<runs[r].guess_idx
+                      <<": cost "<<runs[r].cost );
+    if( min_cost_run < 0 || runs[r].cost < runs[min_cost_run].cost )
+      min_cost_run = r;
+  }
+  
+  if( min_cost_run < 0 )
+  {
+    IMU_TK_LOG_ERROR( "Accelerometers calibration: not enough intervals in all the sweep settings, "
+                      "calibration is not possible" );
+    return false;
+  }
+  
+  const AccSweepRun<_T> &best_run = runs[min_cost_run];
+  const AccSweepSetting<_T> &best_setting = settings[best_run.setting_idx];
+  IMU_TK_LOG_DEBUG( "Accelerometers calibration: better calibration obtained using threshold multiplier "
+                    <<th_mults[best_setting.th_idx]<<", min interval samples "
+                    <<best_setting.interval_n_samples<<", use means "<<best_setting.use_means
+                    <<" and initial guess "<<best_run.guess_idx<<" with cost "<<best_run.cost );
+  
+  acc_calib_ = best_run.calib;
+  has_acc_calib_ = true;
+  report_.acc = best_run.report;
+  std::copy( phases, phases + NUM_CALIBRATION_STAGES, report_.acc.stages );
+  min_cost_static_intervals_ = static_intervals[best_setting.th_idx];
+  min_cost_interval_n_samples_ = best_setting.interval_n_samples;
+  
+  std::vector< IntervalStatistics_<_T> > valid_intervals;
+  intervalsStatistics( acc_samples, best_setting.extracted_intervals, stats_index, valid_intervals );
+  acc_intervals_cache_.clear();
+  cacheAccIntervals( valid_intervals );
+  if( uncertainty_estimation_ )
+    estimateAccUncertainty( acc_samples, valid_intervals, best_setting.use_means );
+  
+  setCalibAccSamples( acc_samples );
+  return true;
+}
 
-  ceres::Solver::Summary summary;
+template <typename _T>
+  void MultiPosCalibration_<_T>::intervalsStatistics ( const TriadBuffer_<_T>& acc_samples, 
+                                                      const std::vector< DataInterval > &extracted_intervals,
+                                                      const TriadStatsIndex_<_T> &stats_index,
+                                                      std::vector< IntervalStatistics_<_T> > &intervals ) const
+{
+  intervals.resize( extracted_intervals.size() );
+  for( int i = 0; i < int(extracted_intervals.size()); i++ )
+  {
+    IntervalStatistics_<_T> &stats = intervals[i];
+    stats.interval = extracted_intervals[i];
+    stats.interval_id = variance_intervals_detection_ ? i : 
+                                                        acc_samples.interval_id( stats.interval.start_idx );
+    stats.start_timestamp = acc_samples.timestamp( stats.interval.start_idx );
+    stats.end_timestamp = acc_samples.timestamp( stats.interval.end_idx );
+    stats_index.meanVariance( stats.interval, stats.mean, stats.variance );
+  }
+}
 
-  ceres::Solve ( options, &problem, &summary );
-  gyro_calib_ = CalibratedTriad_<_T>( gyro_calib_params[0],
-                                     gyro_calib_params[1],
-                                     gyro_calib_params[2],
-                                     gyro_calib_params[3],
-                                     gyro_calib_params[4],
-                                     gyro_calib_params[5],
-                                     gyro_calib_params[6],
-                                     gyro_calib_params[7],
-                                     gyro_calib_params[8],
-                                     gyro_bias(0) + gyro_calib_params[9],
-                                     gyro_bias(1) + gyro_calib_params[10],
-                                     gyro_bias(2) + gyro_calib_params[11]);                            
-
-  // Calibrate the input gyroscopes data with the obtained calibration
-  for( int i = 0; i < n_samps; i++)
-    calib_gyro_samples_.push_back( gyro_calib_.unbiasNormalize( gyro_samples[i]) );
+template <typename _T>
+  void MultiPosCalibration_<_T>::setCalibAccSamples ( const TriadBuffer_<_T>& acc_samples )
+{
+  {
+    StageTimer timer( report_.acc.stages[STAGE_SAMPLES_CALIBRATION] );
+    // The input accelerometer data are calibrated on access
+    calib_acc_view_ = CalibratedSamplesView_<_T>( acc_samples, acc_calib_ );
+  }
   
+  logCalibration( "Accelerometers", acc_calib_ );
   if(verbose_output_) 
   {
-    
-    cout<<summary.FullReport()<<endl;
-    cout<<"Gyroscopes calibration: residual "<<summary.final_cost<<endl
-        <<gyro_calib_<<endl
-        <<"Gyroscopes calibration: inverse scale factors:"<<endl
-        <<1.0/gyro_calib_.scaleX()<<endl
-        <<1.0/gyro_calib_.scaleY()<<endl
-        <<1.0/gyro_calib_.scaleZ()<<endl;
+    Plot plot;
+    plot.plotIntervals( calib_acc_view_.materialize(), min_cost_static_intervals_);
+    waitForKey();
   }
-  
-  return true;
+}
+
+template <typename _T>
+  bool MultiPosCalibration_<_T>::calibrateAcc ( TriadDataSource_<_T> &acc_source, int chunk_size )
+{
+  ScopedLogLevel log_level( calibrationLogLevel( verbose_output_ ) );
+  StageTimer total_timer( report_.total, false );
+  std::vector< IntervalStatistics_<_T> > valid_intervals;
+  return calibrateAccStream( acc_source, chunk_size, valid_intervals );
+}
+
+template <typename _T> 
+  bool MultiPosCalibration_<_T>::calibrateAccGyro ( const vector< TriadData_<_T> >& acc_samples, 
+                                                   const vector< TriadData_<_T> >& gyro_samples )
+{
+  return calibrateAccGyro( TriadBuffer_<_T>( acc_samples ), TriadBuffer_<_T>( gyro_samples ) );
+}
+
+template <typename _T> 
+  bool MultiPosCalibration_<_T>::calibrateAccGyro ( const TriadBuffer_<_T>& acc_samples, 
+                                                   const TriadBuffer_<_T>& gyro_samples )
+{
+  // The samples are hashed only if the results cache is used
+  if( result_cache_dir_.empty() )
+    return calibrateAccGyro( acc_samples, gyro_samples, 0, 0 );
+  return calibrateAccGyro( acc_samples, gyro_samples, 
+                           samplesHash( acc_samples ), samplesHash( gyro_samples ) );
+}
+
+template <typename _T> 
+  bool MultiPosCalibration_<_T>::calibrateAccGyro ( const TriadBuffer_<_T>& acc_samples, 
+                                                   const TriadBuffer_<_T>& gyro_samples,
+                                                   uint64_t acc_samples_hash, 
+                                                   uint64_t gyro_samples_hash )
+{
+  ScopedLogLevel log_level( calibrationLogLevel( verbose_output_ ) );
+  StageTimer total_timer( report_.total, false );
+  result_from_cache_ = false;
+  
+  std::string cache_file;
+  if( !result_cache_dir_.empty() )
+  {
+    cache_file = resultCacheFile( acc_samples_hash, gyro_samples_hash );
+    if( loadCachedResult( cache_file, acc_samples, gyro_samples ) )
+    {
+      IMU_TK_LOG_INFO( "Calibration: results loaded from the cache file "<<cache_file );
+      result_from_cache_ = true;
+      return true;
+    }
+  }
+  
+  time_offset_ = _T(0);
+  if( !calibrateAcc( acc_samples ) )
+    return false;
+  
+  IMU_TK_LOG_INFO( "Gyroscopes calibration: calibrating..." );
+  
+  bool calibrated;
+  if( !time_alignment_ )
+    calibrated = calibrateGyro( acc_samples, gyro_samples );
+  else
+  {
+    TriadBuffer_<_T> aligned_gyro_samples;
+    {
+      StageTimer alignment_timer( report_.gyro.stages[STAGE_SAMPLES_EXTRACTION] );
+      time_offset_ = alignGyroToAcc( acc_samples, gyro_samples, aligned_gyro_samples, max_time_offset_ );
+    }
+    IMU_TK_LOG_DEBUG( "Gyroscopes calibration: estimated time offset "<<time_offset_<<" s" );
+    calibrated = calibrateGyro( acc_samples, aligned_gyro_samples );
+  }
+  
+  if( calibrated && !cache_file.empty() && !saveCachedResult( cache_file ) )
+    IMU_TK_LOG_WARNING( "Calibration: can't write the cache file "<<cache_file );
+  return calibrated;
+}
+
+template <typename _T> 
+  std::string MultiPosCalibration_<_T>::resultCacheFile ( uint64_t acc_samples_hash, 
+                                                          uint64_t gyro_samples_hash ) const
+{
+  // Cache format version, to invalidate the files of older versions
+  const int32_t version = 2;
+  Hash64 hash;
+  hash.updateValue( version );
+  hash.updateValue( int32_t( sizeof(_T) ) );
+  hash.updateValue( acc_samples_hash );
+  hash.updateValue( gyro_samples_hash );
+  
+  // All the settings that affect the results
+  hash.updateValue( g_mag_ );
+  hash.updateValue( int32_t( min_num_intervals_ ) );
+  hash.updateValue( init_interval_duration_ );
+  hash.updateValue( int32_t( min_interval_n_samples_ ) );
+  hash.updateValue( uint8_t( acc_use_means_ ) );
+  hash.updateValue( uint8_t( acc_batched_residual_ ) );
+  hash.updateValue( uint8_t( variance_intervals_detection_ ) );
+  hash.updateValue( gyro_dt_ );
+  hash.updateValue( uint8_t( optimize_gyro_bias_ ) );
+  hash.updateValue( uint8_t( time_alignment_ ) );
+  if( time_alignment_ )
+    hash.updateValue( max_time_offset_ );
+  hashCalibration( hash, init_acc_calib_ );
+  hashCalibration( hash, init_gyro_calib_ );
+  hash.updateValue( int32_t( max_cached_intervals_ ) );
+  hash.updateValue( int32_t( jacobian_mode_ ) );
+  // The number of solver threads only changes the evaluation order of the residuals
+  hash.updateValue( int32_t( solver_options_.linear_solver_type ) );
+  hash.updateValue( int32_t( solver_options_.trust_region_strategy_type ) );
+  hash.updateValue( int32_t( solver_options_.max_num_iterations ) );
+  hash.updateValue( solver_options_.function_tolerance );
+  hash.updateValue( solver_options_.gradient_tolerance );
+  hash.updateValue( solver_options_.parameter_tolerance );
+  
+  hash.updateValue( uint8_t( parameter_sweep_ ) );
+  if( parameter_sweep_ )
+  {
+    for( int i = 0; i < int(sweep_options_.min_interval_n_samples.size()); i++ )
+      hash.updateValue( int32_t( sweep_options_.min_interval_n_samples[i] ) );
+    hash.updateValue( int32_t( -1 ) );
+    for( int i = 0; i < int(sweep_options_.acc_use_means.size()); i++ )
+      hash.updateValue( uint8_t( sweep_options_.acc_use_means[i] ) );
+    hash.updateValue( int32_t( -1 ) );
+    for( int i = 0; i < int(sweep_options_.threshold_multipliers.size()); i++ )
+      hash.updateValue( sweep_options_.threshold_multipliers[i] );
+    hash.updateValue( int32_t( -1 ) );
+    hash.updateValue( int32_t( sweep_options_.num_random_settings ) );
+    hash.updateValue( int32_t( sweep_options_.num_init_guesses ) );
+    hash.updateValue( sweep_options_.init_perturbation );
+    hash.updateValue( uint32_t( sweep_options_.seed ) );
+  }
+  
+  hash.updateValue( uint8_t( uncertainty_estimation_ ) );
+  if( uncertainty_estimation_ )
+  {
+    hash.updateValue( int32_t( uncertainty_options_.method ) );
+    hash.updateValue( int32_t( uncertainty_options_.num_replicas ) );
+    hash.updateValue( uint32_t( uncertainty_options_.seed ) );
+  }
+  
+  char name[64];
+  snprintf( name, sizeof(name), "imu_tk_result_%016llx.yaml", (unsigned long long)hash.digest() );
+  if( result_cache_dir_.empty() || result_cache_dir_[result_cache_dir_.size() - 1] == '/' )
+    return result_cache_dir_ + name;
+  return result_cache_dir_ + "/" + name;
+}
+
+template <typename _T> 
+  bool MultiPosCalibration_<_T>::loadCachedResult ( const std::string &filename, 
+                                                    const TriadBuffer_<_T>& acc_samples, 
+                                                    const TriadBuffer_<_T>& gyro_samples )
+{
+  std::map< std::string, std::vector< double > > values;
+  CalibratedTriad_<_T> calib[2];
+  std::vector< IntervalStatistics_<_T> > intervals;
+  if( !readCalibrationValues( filename, values ) || values["imu_tk_result_cache"].size() != 1 ||
+      values["time_offset"].size() != 1 || !readCalibratedTriads( values, calib ) || 
+      !readIntervalsStatistics( values, intervals ) || values["static_intervals"].size()%2 )
+    return false;
+  
+  const std::vector< double > &bounds = values["static_intervals"];
+  min_cost_static_intervals_.clear();
+  for( int i = 0; i < int(bounds.size()); i += 2 )
+    min_cost_static_intervals_.push_back( DataInterval( int(bounds[i]), int(bounds[i + 1]) ) );
+  clearCalibSamples();
+  report_.clear();
+  report_.acc.num_samples = acc_samples.size();
+  report_.gyro.num_samples = gyro_samples.size();
+  
+  acc_calib_ = calib[0];
+  gyro_calib_ = calib[1];
+  has_acc_calib_ = true;
+  time_offset_ = _T( values["time_offset"][0] );
+  acc_intervals_cache_.swap( intervals );
+  if( uncertainty_estimation_ )
+  {
+    readTriadUncertainty( values, "acc_", acc_uncertainty_ );
+    readTriadUncertainty( values, "gyro_", gyro_uncertainty_ );
+  }
+  
+  // The input data are calibrated on access (the gyroscopes data after the time alignment)
+  calib_acc_view_ = CalibratedSamplesView_<_T>( acc_samples, acc_calib_ );
+  if( time_alignment_ )
+  {
+    TriadBuffer_<_T> aligned_gyro_samples;
+    resampleTriad( gyro_samples, acc_samples, aligned_gyro_samples, time_offset_ );
+    calib_gyro_view_ = CalibratedSamplesView_<_T>( aligned_gyro_samples, gyro_calib_ );
+  }
+  else
+    calib_gyro_view_ = CalibratedSamplesView_<_T>( gyro_samples, gyro_calib_ );
+  return true;
+}
+
+template <typename _T> 
+  bool MultiPosCalibration_<_T>::saveCachedResult ( const std::string &filename ) const
+{
+  // Write a temporary file, then rename it: concurrent readers never see partial files
+  std::ostringstream tmp_suffix;
+  tmp_suffix<<".tmp"<<std::hash< std::thread::id >()( std::this_thread::get_id() )
+            <<"_"<<static_cast< const void * >( this );
+  const std::string tmp_filename = filename + tmp_suffix.str();
+  if( !save( tmp_filename ) )
+    return false;
+  
+  bool saved;
+  {
+    std::ofstream file( tmp_filename.data(), std::ios::app );
+    file.precision( std::numeric_limits<_T>::max_digits10 );
+    file<<"time_offset: ["<<time_offset_<<"]"<<std::endl<<std::endl;
+    writeAccIntervals( file );
+    file<<std::endl<<"static_intervals: [";
+    for( int i = 0; i < int(min_cost_static_intervals_.size()); i++ )
+      file<<( i?", ":"" )<<min_cost_static_intervals_[i].start_idx<<", "
+          <<min_cost_static_intervals_[i].end_idx;
+    file<<"]"<<std::endl;
+    file<<std::endl<<"imu_tk_result_cache: [1]"<<std::endl;
+    saved = file.good();
+  }
+  
+  if( !saved || std::rename( tmp_filename.c_str(), filename.c_str() ) != 0 )
+  {
+    std::remove( tmp_filename.c_str() );
+    return false;
+  }
+  return true;
+}
+
+template <typename _T> 
+  bool MultiPosCalibration_<_T>::calibrateGyro ( const TriadBuffer_<_T>& acc_samples, 
+                                                const TriadBuffer_<_T>& gyro_samples )
+{
+  StageTimer extraction_timer( report_.gyro.stages[STAGE_SAMPLES_EXTRACTION] );
+  // The calibration is affine: the means of the calibrated samples are the calibrated 
+  // means of the raw samples
+  TriadBuffer_<_T> static_acc_means;
+  std::vector< DataInterval > extracted_intervals;
+  extractIntervalsSamples ( acc_samples, min_cost_static_intervals_, 
+                            static_acc_means, extracted_intervals,
+                            min_cost_interval_n_samples_, true );
+  extraction_timer.stop();
+  
+  int n_static_pos = static_acc_means.size(), n_samps = gyro_samples.size();
+  report_.gyro.num_samples = n_samps;
+  
+  // Compute the gyroscopes biases in the (static) initialization interval
+  StageTimer detection_timer( report_.gyro.stages[STAGE_INTERVALS_DETECTION] );
+  DataInterval init_static_interval = variance_intervals_detection_ ?
+    DataInterval::initialInterval( gyro_samples, init_interval_duration_ ) :
+    DataInterval::initialInterval( gyro_samples );
+  IMU_TK_LOG_DEBUG( "Found initial interval starting in sample " << init_static_interval.start_idx <<
+                    " and finishing in sample num " << init_static_interval.end_idx );
+
+  Eigen::Matrix<_T, 3, 1> gyro_bias = dataMean( gyro_samples, init_static_interval );
+  detection_timer.stop();
+
+  StageTimer gyro_extraction_timer( report_.gyro.stages[STAGE_SAMPLES_EXTRACTION] );
+  // Remove the bias. The unbiased samples are stored only once, and shared by all 
+  // the gyroscopes residuals
+  TriadBuffer_<_T> unbiased_gyro_samples( gyro_samples );
+  for( int j = 0; j < 3; j++ )
+    Eigen::Map< Eigen::Matrix< _T, Eigen::Dynamic, 1 > >
+      ( unbiased_gyro_samples.axis(j), n_samps ).array() -= gyro_bias(j);
+  
+  std::vector< Eigen::Matrix<_T, 3, 1> > g_versors( n_static_pos );
+  for( int i = 0; i < n_static_pos; i++ )
+  {
+    Eigen::Matrix<_T, 3, 1> calib_acc_mean = acc_calib_.unbiasNormalize( static_acc_means.data(i) );
+    g_versors[i] = calib_acc_mean/calib_acc_mean.norm();
+  }
+  
+  // Map the boundaries of the accelerometers static intervals to gyroscopes indices. 
+  // If the two triads share the timestamps (e.g., after the time alignment) the indices
+  // are the same, otherwise they are found in a single pass over the (monotone) 
+  // gyroscopes timestamps
+  std::vector< int > boundary_idx;
+  if( n_samps == acc_samples.size() &&
+      std::equal( gyro_samples.timestamps(), gyro_samples.timestamps() + n_samps, 
+                  acc_samples.timestamps() ) )
+  {
+    boundary_idx.reserve( 2*std::max( n_static_pos - 1, 0 ) );
+    for( int i = 0; i < n_static_pos - 1; i++ )
+    {
+      boundary_idx.push_back( extracted_intervals[i].end_idx );
+      boundary_idx.push_back( extracted_intervals[i + 1].start_idx );
+    }
+  }
+  else
+  {
+    TimeIndex_<_T> gyro_time_index( unbiased_gyro_samples );
+    if( !gyro_time_index.monotone() )
+    {
+      IMU_TK_LOG_ERROR( "Gyroscopes calibration: the timestamps are not monotone" );
+      return false;
+    }
+    
+    std::vector< _T > boundary_ts;
+    boundary_ts.reserve( 2*std::max( n_static_pos - 1, 0 ) );
+    for( int i = 0; i < n_static_pos - 1; i++ )
+    {
+      boundary_ts.push_back( acc_samples.timestamp( extracted_intervals[i].end_idx ) );
+      boundary_ts.push_back( acc_samples.timestamp( extracted_intervals[i + 1].start_idx ) );
+    }
+    gyro_time_index.lowerBounds( boundary_ts, boundary_idx );
+  }
+  
+  std::vector< DataInterval > gyro_intervals;
+  for( int i = 0; i < n_static_pos - 1; i++ )
+  {
+    // The motion interval starts with the first gyroscopes sample not before the end 
+    // of the i-th static interval, and ends with the sample that precedes the start 
+    // of the next static interval 
+    int gyro_idx0 = boundary_idx[2*i], gyro_idx1 = -1;
+    if( gyro_idx0 < n_samps )
+    {
+      int next_idx = std::max( boundary_idx[2*i + 1], gyro_idx0 + 1 );
+      if( next_idx < n_samps )
+        gyro_idx1 = next_idx - 1;
+    }
+    else
+      gyro_idx0 = -1;
+    
+    gyro_intervals.push_back( DataInterval(gyro_idx0, gyro_idx1) );
+  }
+  gyro_extraction_timer.stop();
+  
+  if( !solveGyroCalibration( g_versors, unbiased_gyro_samples, gyro_intervals, gyro_bias ) )
+    return false;
+  if( uncertainty_estimation_ )
+    estimateGyroUncertainty( static_acc_means, unbiased_gyro_samples, gyro_intervals, gyro_bias );
+
+  StageTimer calibration_timer( report_.gyro.stages[STAGE_SAMPLES_CALIBRATION] );
+  // The input gyroscopes data are calibrated on access
+  calib_gyro_view_ = CalibratedSamplesView_<_T>( gyro_samples, gyro_calib_ );
+  
+  return true;
+}
+
+template <typename _T> 
+  bool MultiPosCalibration_<_T>::calibrateAccGyro ( TriadDataSource_<_T> &acc_source, 
+                                                   TriadDataSource_<_T> &gyro_source,
+                                                   int chunk_size )
+{
+  ScopedLogLevel log_level( calibrationLogLevel( verbose_output_ ) );
+  StageTimer total_timer( report_.total, false );
+  std::vector< IntervalStatistics_<_T> > acc_intervals;
+  if( !calibrateAccStream( acc_source, chunk_size, acc_intervals ) )
+    return false;
+  
+  IMU_TK_LOG_INFO( "Gyroscopes calibration: calibrating..." );
+  
+  // Reading the gyroscopes data, the extraction of the samples can't be timed
+  // separately from the detection of the initial interval
+  StageTimer extraction_timer( report_.gyro.stages[STAGE_SAMPLES_EXTRACTION] );
+  
+  // The means of the calibrated samples are the calibrated means
+  int n_static_pos = acc_intervals.size();
+  std::vector< Eigen::Matrix<_T, 3, 1> > g_versors( n_static_pos );
+  for( int i = 0; i < n_static_pos; i++ )
+  {
+    g_versors[i] = acc_calib_.unbiasNormalize( acc_intervals[i].mean );
+    g_versors[i] /= g_versors[i].norm();
+  }
+  
+  // Read the gyroscopes data, keeping only the samples between each pair of consecutive 
+  // static intervals, and computing the biases in the (static) initialization interval
+  // (see DataInterval::initialInterval())
+  TriadBuffer_<_T> gyro_samples, chunk;
+  std::vector< DataInterval > gyro_intervals;
+  Eigen::Matrix<_T, 3, 1> gyro_bias( 0, 0, 0 );
+  int n_init_samples = 0, init_interval_status = 0, n_samps = 0;
+  int pos = 0, interval_start = -1;
+  while( gyro_source.read( chunk, chunk_size ) > 0 )
+  {
+    for( int i = 0; i < chunk.size(); i++, n_samps++ )
+    {
+      if( init_interval_status == 0 && chunk.interval_id(i) == 0 )
+        init_interval_status = 1;
+      else if( init_interval_status == 1 && chunk.interval_id(i) != 0 )
+        init_interval_status = 2;
+      if( init_interval_status == 1 )
+      {
+        gyro_bias += chunk.data(i);
+        n_init_samples++;
+      }
+      
+      // Assume monotone signal time
+      const _T ts = chunk.timestamp(i);
+      while( pos < n_static_pos - 1 )
+      {
+        if( interval_start < 0 )
+        {
+          if( ts >= acc_intervals[pos].end_timestamp )
+          {
+            interval_start = gyro_samples.size();
+            gyro_samples.push_back( ts, chunk.x(i), chunk.y(i), chunk.z(i), chunk.interval_id(i) );
+          }
+          break;
+        }
+        else if( ts >= acc_intervals[pos + 1].start_timestamp )
+        {
+          gyro_intervals.push_back( DataInterval( interval_start, gyro_samples.size() - 1 ) );
+          interval_start = -1;
+          pos++;
+        }
+        else
+        {
+          gyro_samples.push_back( ts, chunk.x(i), chunk.y(i), chunk.z(i), chunk.interval_id(i) );
+          break;
+        }
+      }
+    }
+  }
+  if( interval_start >= 0 )
+    gyro_intervals.push_back( DataInterval( interval_start, gyro_samples.size() - 1 ) );
+  
+  if( !n_init_samples )
+  {
+    IMU_TK_LOG_ERROR( "Gyroscopes calibration: no initial static interval, calibration is not possible" );
+    return false;
+  }
+  gyro_bias /= _T(n_init_samples);
+  
+  IMU_TK_LOG_DEBUG( "Gyroscopes calibration: read "<<n_samps<<" samples, stored "
+                    <<gyro_samples.size()<<" samples" );
+  
+  for( int j = 0; j < 3; j++ )
+    Eigen::Map< Eigen::Matrix< _T, Eigen::Dynamic, 1 > >
+      ( gyro_samples.axis(j), gyro_samples.size() ).array() -= gyro_bias(j);
+  
+  // Only the motion intervals actually found are used: if the gyroscopes data end before
+  // the last static positions, these positions are discarded
+  if( int(gyro_intervals.size()) < n_static_pos - 1 )
+  {
+    IMU_TK_LOG_WARNING( "Gyroscopes calibration: the data cover only "<<gyro_intervals.size() + 1
+                        <<" of "<<n_static_pos<<" static intervals, the remaining ones are not used" );
+    g_versors.resize( gyro_intervals.size() + 1 );
+  }
+  if( gyro_intervals.empty() )
+  {
+    IMU_TK_LOG_ERROR( "Gyroscopes calibration: no motion interval found, calibration is not possible" );
+    return false;
+  }
+  report_.gyro.num_samples = n_samps;
+  extraction_timer.stop();
+  
+  return solveGyroCalibration( g_versors, gyro_samples, gyro_intervals, gyro_bias );
+}
+
+template <typename _T> 
+  bool MultiPosCalibration_<_T>::calibrateAccStream ( TriadDataSource_<_T> &acc_source, int chunk_size,
+                                                     std::vector< IntervalStatistics_<_T> > &valid_intervals )
+{
+  IMU_TK_LOG_INFO( "Accelerometers calibration: calibrating..." );
+  
+  min_cost_static_intervals_.clear();
+  clearCalibSamples();
+  valid_intervals.clear();
+  report_.clear();
+  
+  // Includes the time spent reading the data
+  StageTimer detection_timer( report_.acc.stages[STAGE_INTERVALS_DETECTION] );
+  StaticIntervalsStreamDetector_<_T> detector( min_interval_n_samples_, !acc_use_means_ );
+  TriadBuffer_<_T> chunk;
+  while( acc_source.read( chunk, chunk_size ) > 0 )
+    detector.process( chunk );
+  detector.finish();
+  detection_timer.stop();
+  report_.acc.num_samples = detector.numSamples();
+  
+  StageTimer extraction_timer( report_.acc.stages[STAGE_SAMPLES_EXTRACTION] );
+  const std::vector< IntervalStatistics_<_T> > &intervals = detector.intervals();
+  std::vector< imu_tk::DataInterval > static_intervals;
+  imu_tk::TriadBuffer_<_T> static_samples = detector.samples();
+  for( int i = 0; i < int(intervals.size()); i++ )
+  {
+    static_intervals.push_back( intervals[i].interval );
+    if( intervals[i].numSamples() >= min_interval_n_samples_ )
+    {
+      valid_intervals.push_back( intervals[i] );
+      if( acc_use_means_ )
+      {
+        // Take the timestamp centered in the interval where the mean is computed
+        const Eigen::Matrix< _T, 3, 1> &mean_val = intervals[i].mean;
+        static_samples.push_back( ( intervals[i].start_timestamp + intervals[i].end_timestamp )/_T(2), 
+                                  mean_val(0), mean_val(1), mean_val(2), i );
+      }
+    }
+  }
+  
+  extraction_timer.stop();
+  
+  IMU_TK_LOG_DEBUG( "Accelerometers calibration: read "<<detector.numSamples()<<" samples, stored "
+                    <<static_samples.size()<<" samples" );
+  
+  acc_intervals_cache_.clear();
+  cacheAccIntervals( valid_intervals );
+  
+  if( !solveAccCalibration( static_samples, valid_intervals.size(), init_acc_calib_ ) )
+  {
+    IMU_TK_LOG_ERROR( "Accelerometers calibration: not enough intervals, calibration is not possible" );
+    return false;
+  }
+
+  min_cost_static_intervals_ = static_intervals;
+  
+  logCalibration( "Accelerometers", acc_calib_ );
+  return true;
+}
+
+template <typename _T>
+  bool MultiPosCalibration_<_T>::calibrateAccIncremental ( const TriadBuffer_<_T>& acc_samples )
+{
+  ScopedLogLevel log_level( calibrationLogLevel( verbose_output_ ) );
+  StageTimer total_timer( report_.total, false );
+  IMU_TK_LOG_INFO( "Accelerometers calibration: incremental calibration..." );
+  
+  report_.clear();
+  report_.acc.num_samples = acc_samples.size();
+  
+  StageTimer detection_timer( report_.acc.stages[STAGE_INTERVALS_DETECTION] );
+  StaticIntervalsStreamDetector_<_T> detector;
+  detector.process( acc_samples );
+  detector.finish();
+  detection_timer.stop();
+  
+  return updateAccCalibration( detector.intervals() );
+}
+
+template <typename _T>
+  bool MultiPosCalibration_<_T>::calibrateAccIncremental ( TriadDataSource_<_T> &acc_source, 
+                                                          int chunk_size )
+{
+  ScopedLogLevel log_level( calibrationLogLevel( verbose_output_ ) );
+  StageTimer total_timer( report_.total, false );
+  IMU_TK_LOG_INFO( "Accelerometers calibration: incremental calibration..." );
+  
+  report_.clear();
+  
+  // Includes the time spent reading the data
+  StageTimer detection_timer( report_.acc.stages[STAGE_INTERVALS_DETECTION] );
+  StaticIntervalsStreamDetector_<_T> detector;
+  TriadBuffer_<_T> chunk;
+  while( acc_source.read( chunk, chunk_size ) > 0 )
+    detector.process( chunk );
+  detector.finish();
+  detection_timer.stop();
+  report_.acc.num_samples = detector.numSamples();
+  
+  return updateAccCalibration( detector.intervals() );
+}
+
+template <typename _T>
+  bool MultiPosCalibration_<_T>::updateAccCalibration ( const std::vector< IntervalStatistics_<_T> > &new_intervals )
+{
+  // Warm start from the current calibration, if any
+  const CalibratedTriad_<_T> init_calib = has_acc_calib_?acc_calib_:init_acc_calib_;
+  
+  min_cost_static_intervals_.clear();
+  clearCalibSamples();
+  
+  StageTimer extraction_timer( report_.acc.stages[STAGE_SAMPLES_EXTRACTION] );
+  std::vector< IntervalStatistics_<_T> > valid_intervals;
+  for( int i = 0; i < int(new_intervals.size()); i++ )
+  {
+    min_cost_static_intervals_.push_back( new_intervals[i].interval );
+    if( new_intervals[i].numSamples() >= min_interval_n_samples_ )
+      valid_intervals.push_back( new_intervals[i] );
+  }
+  const int n_new_intervals = cacheAccIntervals( valid_intervals );
+  
+  TriadBuffer_<_T> static_means;
+  static_means.reserve( acc_intervals_cache_.size() );
+  for( int i = 0; i < int(acc_intervals_cache_.size()); i++ )
+  {
+    const IntervalStatistics_<_T> &stats = acc_intervals_cache_[i];
+    static_means.push_back( ( stats.start_timestamp + stats.end_timestamp )/_T(2), 
+                            stats.mean(0), stats.mean(1), stats.mean(2), i );
+  }
+  extraction_timer.stop();
+  
+  IMU_TK_LOG_DEBUG( "Accelerometers calibration: "<<n_new_intervals<<" new static intervals ("
+                    <<int(valid_intervals.size()) - n_new_intervals<<" already cached), "
+                    <<acc_intervals_cache_.size()<<" cached intervals" );
+  
+  if( !solveAccCalibration( static_means, static_means.size(), init_calib ) )
+  {
+    IMU_TK_LOG_ERROR( "Accelerometers calibration: not enough intervals, calibration is not possible" );
+    return false;
+  }
+  
+  logCalibration( "Accelerometers", acc_calib_ );
+  return true;
+}
+
+template <typename _T>
+  void MultiPosCalibration_<_T>::clearCalibSamples()
+{
+  calib_acc_view_ = CalibratedSamplesView_<_T>();
+  calib_gyro_view_ = CalibratedSamplesView_<_T>();
+  std::vector< TriadData_<_T> >().swap( calib_acc_samples_ );
+  std::vector< TriadData_<_T> >().swap( calib_gyro_samples_ );
+  // The uncertainties refer to the previous calibration
+  replica_intervals_.clear();
+  replica_pairs_.clear();
+  acc_replicas_.clear();
+  acc_uncertainty_ = gyro_uncertainty_ = TriadUncertainty_<_T>();
+}
+
+template <typename _T>
+  int MultiPosCalibration_<_T>::cacheAccIntervals ( const std::vector< IntervalStatistics_<_T> > &intervals )
+{
+  // Skip the intervals already cached, e.g. if the same data are provided twice: 
+  // the intervals of different data sets are distinguished by their statistics
+  const int n_cached = acc_intervals_cache_.size();
+  for( int i = 0; i < int(intervals.size()); i++ )
+  {
+    const IntervalStatistics_<_T> &stats = intervals[i];
+    bool cached = false;
+    for( int j = 0; j < n_cached && !cached; j++ )
+    {
+      const IntervalStatistics_<_T> &cached_stats = acc_intervals_cache_[j];
+      cached = cached_stats.start_timestamp == stats.start_timestamp &&
+               cached_stats.end_timestamp == stats.end_timestamp &&
+               cached_stats.numSamples() == stats.numSamples() &&
+               cached_stats.mean == stats.mean;
+    }
+    if( !cached )
+      acc_intervals_cache_.push_back( stats );
+  }
+  const int n_added = int(acc_intervals_cache_.size()) - n_cached;
+  // Remove the oldest ones
+  if( max_cached_intervals_ > 0 && int(acc_intervals_cache_.size()) > max_cached_intervals_ )
+    acc_intervals_cache_.erase( acc_intervals_cache_.begin(), 
+                                acc_intervals_cache_.end() - max_cached_intervals_ );
+  return n_added;
+}
+
+template <typename _T>
+  bool MultiPosCalibration_<_T>::load ( std::string filename )
+{
+  std::map< std::string, std::vector< double > > values;
+  if( !readCalibrationValues( filename, values ) )
+    return false;
+  
+  CalibratedTriad_<_T> calib[2];
+  if( !readCalibratedTriads( values, calib ) )
+    return false;
+  
+  init_acc_calib_ = acc_calib_ = calib[0];
+  has_acc_calib_ = true;
+  init_gyro_calib_ = gyro_calib_ = calib[1];
+  return true;
+}
+
+template <typename _T>
+  bool MultiPosCalibration_<_T>::saveAccIntervalsCache ( std::string filename ) const
+{
+  std::ofstream file( filename.data() );
+  if( !file.is_open() )
+    return false;
+  
+  file.precision( std::numeric_limits<_T>::max_digits10 );
+  writeAccIntervals( file );
+  return file.good();
+}
+
+template <typename _T>
+  void MultiPosCalibration_<_T>::writeAccIntervals ( std::ostream &os ) const
+{
+  // For each interval: start index, end index, interval id, start timestamp, end timestamp, 
+  // mean, variance
+  os<<"acc_intervals: [";
+  for( int i = 0; i < int(acc_intervals_cache_.size()); i++ )
+  {
+    const IntervalStatistics_<_T> &stats = acc_intervals_cache_[i];
+    os<<( i?",":"" )<<std::endl<<"  "
+      <<stats.interval.start_idx<<", "<<stats.interval.end_idx<<", "<<stats.interval_id<<", "
+      <<stats.start_timestamp<<", "<<stats.end_timestamp<<", "
+      <<stats.mean(0)<<", "<<stats.mean(1)<<", "<<stats.mean(2)<<", "
+      <<stats.variance(0)<<", "<<stats.variance(1)<<", "<<stats.variance(2);
+  }
+  os<<"]"<<std::endl;
+}
+
+template <typename _T>
+  bool MultiPosCalibration_<_T>::loadAccIntervalsCache ( std::string filename )
+{
+  std::map< std::string, std::vector< double > > values;
+  std::vector< IntervalStatistics_<_T> > intervals;
+  if( !readCalibrationValues( filename, values ) || !readIntervalsStatistics( values, intervals ) )
+    return false;
+  
+  acc_intervals_cache_.swap( intervals );
+  return true;
+}
+
+template <typename _T>
+  bool MultiPosCalibration_<_T>::solveAccCalibration ( const TriadBuffer_<_T>& static_samples,
+                                                      int n_static_intervals,
+                                                      const CalibratedTriad_<_T> &init_calib )
+{
+  IMU_TK_LOG_DEBUG( "Accelerometers calibration: extracted "<<n_static_intervals<<" intervals (at least "
+                    <<min_num_intervals_<<" required)" );
+
+  // TODO Perform here a quality test
+  if( n_static_intervals < min_num_intervals_)
+    return(false);
+
+  report_.acc.num_static_intervals = n_static_intervals;
+  solveAccProblem( g_mag_, static_samples, init_calib, acc_batched_residual_, jacobian_mode_, 
+                   solver_options_, verbose_output_, acc_calib_, report_.acc );
+
+  IMU_TK_LOG_DEBUG( "residual "<<report_.acc.solver.final_cost );
+  
+  has_acc_calib_ = true;
+  return true;
+}
+
+template <typename _T>
+  bool MultiPosCalibration_<_T>::solveGyroCalibration ( const std::vector< Eigen::Matrix< _T, 3, 1> > &g_versors,
+                                                       const TriadBuffer_<_T> &unbiased_gyro_samples,
+                                                       const std::vector< DataInterval > &gyro_intervals,
+                                                       const Eigen::Matrix< _T, 3, 1> &gyro_bias )
+{
+  report_.gyro.num_static_intervals = g_versors.size();
+  
+  // Bias has been estimated and removed in the initialization period
+  CalibratedTriad_<_T> init_calib = init_gyro_calib_;
+  init_calib.setBias( gyro_bias );
+  
+  std::vector< int > pairs;
+  for( int i = 0; i < int(g_versors.size()) - 1; i++ )
+    pairs.push_back( i );
+  
+  int n_invalid = 0;
+  for( int i = 0; i < int(pairs.size()); i++ )
+    if( !validMotionInterval( gyro_intervals[pairs[i]], unbiased_gyro_samples.size() ) )
+      n_invalid++;
+  if( n_invalid )
+    IMU_TK_LOG_WARNING( "Gyroscopes calibration: "<<n_invalid<<" motion intervals out of the "
+                        "gyroscopes data, not used" );
+  
+  ceres::Solver::Summary summary;
+  if( !solveGyroProblem( g_versors, unbiased_gyro_samples, gyro_intervals, pairs, init_calib, 
+                         gyro_bias, jacobian_mode_, optimize_gyro_bias_, gyro_dt_, solver_options_, 
+                         verbose_output_, gyro_calib_, report_.gyro, summary ) )
+  {
+    IMU_TK_LOG_ERROR( "Gyroscopes calibration: no valid motion interval, calibration is not possible" );
+    return false;
+  }
+  
+  IMU_TK_LOG_DEBUG( summary.FullReport() );
+  IMU_TK_LOG_DEBUG( "Gyroscopes calibration: residual "<<summary.final_cost );
+  logCalibration( "Gyroscopes", gyro_calib_ );
+  return true;
+}
+
+template <typename _T>
+  void MultiPosCalibration_<_T>::estimateAccUncertainty ( const TriadBuffer_<_T>& acc_samples,
+                                                          const std::vector< IntervalStatistics_<_T> > &intervals,
+                                                          bool use_means )
+{
+  replica_intervals_.clear();
+  replica_pairs_.clear();
+  acc_replicas_.clear();
+  
+  const int n_intervals = intervals.size();
+  if( n_intervals < 2 )
+    return;
+  
+  // Static intervals of each replica, and the motion intervals that follow them
+  if( uncertainty_options_.method == RESAMPLING_JACKKNIFE )
+  {
+    replica_intervals_.resize( n_intervals );
+    replica_pairs_.resize( n_intervals );
+    for( int r = 0; r < n_intervals; r++ )
+    {
+      for( int i = 0; i < n_intervals; i++ )
+      {
+        if( i != r )
+          replica_intervals_[r].push_back( i );
+        // Leave out the motions to and from the left out interval
+        if( i < n_intervals - 1 && i != r - 1 && i != r )
+          replica_pairs_[r].push_back( i );
+      }
+    }
+  }
+  else
+  {
+    const int n_replicas = std::max( uncertainty_options_.num_replicas, 0 );
+    std::mt19937 rng( uncertainty_options_.seed );
+    std::uniform_int_distribution< int > draw( 0, n_intervals - 1 );
+    replica_intervals_.resize( n_replicas );
+    replica_pairs_.resize( n_replicas );
+    for( int r = 0; r < n_replicas; r++ )
+    {
+      for( int i = 0; i < n_intervals; i++ )
+      {
+        const int interval_idx = draw( rng );
+        replica_intervals_[r].push_back( interval_idx );
+        if( interval_idx < n_intervals - 1 )
+          replica_pairs_[r].push_back( interval_idx );
+      }
+    }
+  }
+  
+  const int n_replicas = replica_intervals_.size();
+  acc_replicas_.resize( n_replicas );
+  // Each replica is solved by a single thread, starting from the estimated parameters
+  SolverOptions replica_solver_options = solver_options_;
+  replica_solver_options.num_threads = 1;
+  {
+    ThreadPool pool( std::min( solverNumThreads( uncertainty_options_.num_threads ), 
+                               std::max( n_replicas, 1 ) ) );
+    // Each task writes only its own replica
+    for( int r = 0; r < n_replicas; r++ )
+      pool.submit( [&, r]()
+      {
+        // The replica problem is built as the calibration one: from the means of the 
+        // resampled intervals, or from all their samples
+        const std::vector< int > &replica = replica_intervals_[r];
+        TriadBuffer_<_T> static_samples;
+        if( use_means )
+        {
+          static_samples.reserve( replica.size() );
+          for( int i = 0; i < int(replica.size()); i++ )
+          {
+            const IntervalStatistics_<_T> &stats = intervals[replica[i]];
+            static_samples.push_back( stats.start_timestamp, stats.mean(0), stats.mean(1), stats.mean(2) );
+          }
+        }
+        else
+        {
+          int n_samples = 0;
+          for( int i = 0; i < int(replica.size()); i++ )
+            n_samples += intervals[replica[i]].interval.end_idx - intervals[replica[i]].interval.start_idx + 1;
+          static_samples.reserve( n_samples );
+          for( int i = 0; i < int(replica.size()); i++ )
+          {
+            const DataInterval &interval = intervals[replica[i]].interval;
+            for( int j = interval.start_idx; j <= interval.end_idx; j++ )
+              static_samples.push_back( acc_samples.timestamp(j), acc_samples.x(j), 
+                                        acc_samples.y(j), acc_samples.z(j) );
+          }
+        }
+        TriadCalibrationReport report;
+        solveAccProblem( g_mag_, static_samples, acc_calib_, acc_batched_residual_, jacobian_mode_, 
+                         replica_solver_options, false, acc_replicas_[r], report );
+      } );
+    pool.wait();
+  }
+  
+  triadUncertainty( acc_replicas_, uncertainty_options_.method, acc_uncertainty_ );
+  IMU_TK_LOG_DEBUG( "Accelerometers calibration: uncertainty estimated from "<<n_replicas<<" replicas" );
+}
+
+template <typename _T>
+  void MultiPosCalibration_<_T>::estimateGyroUncertainty ( const TriadBuffer_<_T> &static_acc_means,
+                                                          const TriadBuffer_<_T> &unbiased_gyro_samples,
+                                                          const std::vector< DataInterval > &gyro_intervals,
+                                                          const Eigen::Matrix< _T, 3, 1> &gyro_bias )
+{
+  const int n_replicas = acc_replicas_.size(), n_static_pos = static_acc_means.size();
+  for( int r = 0; r < n_replicas; r++ )
+  {
+    if( !replica_pairs_[r].empty() && 
+        *std::max_element( replica_pairs_[r].begin(), replica_pairs_[r].end() ) >= n_static_pos - 1 )
+    {
+      IMU_TK_LOG_WARNING( "Gyroscopes calibration: the static intervals do not match the "
+                          "accelerometers ones, the uncertainty is not estimated" );
+      return;
+    }
+  }
+  
+  std::vector< CalibratedTriad_<_T> > gyro_replicas( n_replicas );
+  // The replicas without any valid motion interval are not used
+  std::vector< char > replica_solved( n_replicas, 0 );
+  SolverOptions replica_solver_options = solver_options_;
+  replica_solver_options.num_threads = 1;
+  {
+    ThreadPool pool( std::min( solverNumThreads( uncertainty_options_.num_threads ), 
+                               std::max( n_replicas, 1 ) ) );
+    // The replicas share the unbiased gyroscopes samples, each task writes only its own replica
+    for( int r = 0; r < n_replicas; r++ )
+      pool.submit( [&, r]()
+      {
+        // Gravity versors given by the replica accelerometers calibration
+        std::vector< Eigen::Matrix<_T, 3, 1> > g_versors( n_static_pos );
+        for( int i = 0; i < n_static_pos; i++ )
+        {
+          Eigen::Matrix<_T, 3, 1> calib_acc_mean = acc_replicas_[r].unbiasNormalize( static_acc_means.data(i) );
+          g_versors[i] = calib_acc_mean/calib_acc_mean.norm();
+        }
+        TriadCalibrationReport report;
+        ceres::Solver::Summary summary;
+        replica_solved[r] = 
+          solveGyroProblem( g_versors, unbiased_gyro_samples, gyro_intervals, replica_pairs_[r], 
+                            gyro_calib_, gyro_bias, jacobian_mode_, optimize_gyro_bias_, gyro_dt_, 
+                            replica_solver_options, false, gyro_replicas[r], report, summary );
+      } );
+    pool.wait();
+  }
+  
+  std::vector< CalibratedTriad_<_T> > solved_replicas;
+  for( int r = 0; r < n_replicas; r++ )
+    if( replica_solved[r] )
+      solved_replicas.push_back( gyro_replicas[r] );
+  
+  triadUncertainty( solved_replicas, uncertainty_options_.method, gyro_uncertainty_ );
+  IMU_TK_LOG_DEBUG( "Gyroscopes calibration: uncertainty estimated from "<<solved_replicas.size()
+                    <<" replicas" );
 }
 
 template class MultiPosCalibration_<double>;
@@ -0,0 +1,170 @@
+/* 
+ * imu_tk - Inertial Measurement Unit Toolkit
+ * 
+ *  Copyright (c) 2014, Alberto Pretto <pretto@diag.uniroma1.it>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ * 
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ * 
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "imu_tk/calibration_report.h"
+
+#include <sstream>
+#include <fstream>
+#include <ctime>
+#include <cmath>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <time.h>
+#endif
+
+using namespace imu_tk;
+
+namespace
+{
+// Clock set by a ScopedCpuTimeClock object in the current thread
+thread_local CpuTimeClock thread_cpu_clock = CPU_TIME_PROCESS;
+}
+
+double imu_tk::cpuTime( CpuTimeClock clock )
+{
+#if defined(__unix__) || defined(__APPLE__)
+  timespec ts;
+  if( clock_gettime( ( clock == CPU_TIME_THREAD )?CLOCK_THREAD_CPUTIME_ID:CLOCK_PROCESS_CPUTIME_ID, 
+                     &ts ) == 0 )
+    return double( ts.tv_sec ) + 1e-9*double( ts.tv_nsec );
+#else
+  (void)clock;
+#endif
+  return double( std::clock() )/CLOCKS_PER_SEC;
+}
+
+CpuTimeClock imu_tk::cpuTimeClock()
+{
+  return thread_cpu_clock;
+}
+
+ScopedCpuTimeClock::ScopedCpuTimeClock( CpuTimeClock clock ) :
+  prev_clock_(thread_cpu_clock)
+{
+  thread_cpu_clock = clock;
+}
+
+ScopedCpuTimeClock::~ScopedCpuTimeClock()
+{
+  thread_cpu_clock = prev_clock_;
+}
+
+/* JSON does not represent the non-finite values (e.g., the costs of a failed solve) */
+static void writeNumber( std::ostream &os, double value )
+{
+  if( std::isfinite( value ) )
+    os<<value;
+  else
+    os<<"null";
+}
+
+static void writeTiming( std::ostream &os, const StageTiming &timing )
+{
+  os<<"{ \"wall_time\": ";
+  writeNumber( os, timing.wall_time );
+  os<<", \"cpu_time\": ";
+  writeNumber( os, timing.cpu_time );
+  os<<" }";
+}
+
+static void writeTriadReport( std::ostream &os, const TriadCalibrationReport &report, 
+                              const std::string &indent )
+{
+  const SolverReport &solver = report.solver;
+  os<<"{\n"
+    <<indent<<"  \"calibrated\": "<<( report.calibrated?"true":"false" )<<",\n"
+    <<indent<<"  \"num_samples\": "<<report.num_samples<<",\n"
+    <<indent<<"  \"num_static_intervals\": "<<report.num_static_intervals<<",\n"
+    <<indent<<"  \"num_used_samples\": "<<report.num_used_samples<<",\n"
+    <<indent<<"  \"stages\": {\n";
+  for( int i = 0; i < NUM_CALIBRATION_STAGES; i++ )
+  {
+    os<<indent<<"    \""<<calibrationStageName( CalibrationStage(i) )<<"\": ";
+    writeTiming( os, report.stages[i] );
+    os<<( ( i < NUM_CALIBRATION_STAGES - 1 )?",\n":"\n" );
+  }
+  os<<indent<<"  },\n"
+    <<indent<<"  \"solver\": {\n"
+    <<indent<<"    \"num_residual_blocks\": "<<solver.num_residual_blocks<<",\n"
+    <<indent<<"    \"num_residuals\": "<<solver.num_residuals<<",\n"
+    <<indent<<"    \"num_successful_steps\": "<<solver.num_successful_steps<<",\n"
+    <<indent<<"    \"num_unsuccessful_steps\": "<<solver.num_unsuccessful_steps<<",\n"
+    <<indent<<"    \"num_residual_evaluations\": "<<solver.num_residual_evaluations<<",\n"
+    <<indent<<"    \"num_jacobian_evaluations\": "<<solver.num_jacobian_evaluations<<",\n"
+    <<indent<<"    \"initial_cost\": ";
+  writeNumber( os, solver.initial_cost );
+  os<<",\n"
+    <<indent<<"    \"final_cost\": ";
+  writeNumber( os, solver.final_cost );
+  os<<",\n"
+    <<indent<<"    \"converged\": "<<( solver.converged?"true":"false" )<<"\n"
+    <<indent<<"  }\n"
+    <<indent<<"}";
+}
+
+const char *imu_tk::calibrationStageName( CalibrationStage stage )
+{
+  switch( stage )
+  {
+    case STAGE_INTERVALS_DETECTION:
+      return "intervals_detection";
+    case STAGE_SAMPLES_EXTRACTION:
+      return "samples_extraction";
+    case STAGE_PROBLEM_CONSTRUCTION:
+      return "problem_construction";
+    case STAGE_SOLVE:
+      return "solve";
+    case STAGE_SAMPLES_CALIBRATION:
+      return "samples_calibration";
+    default:
+      return "unknown";
+  }
+}
+
+std::string CalibrationReport::toJson() const
+{
+  std::ostringstream os;
+  os.precision(10);
+  os<<"{\n  \"accelerometers\": ";
+  writeTriadReport( os, acc, "  " );
+  os<<",\n  \"gyroscopes\": ";
+  writeTriadReport( os, gyro, "  " );
+  os<<",\n  \"total\": ";
+  writeTiming( os, total );
+  os<<"\n}\n";
+  return os.str();
+}
+
+bool CalibrationReport::saveJson( const std::string &filename ) const
+{
+  std::ofstream file( filename.c_str() );
+  if( !file.is_open() )
+    return false;
+  file<<toJson();
+  return file.good();
+}
@@ -28,6 +28,8 @@
 
 #include "imu_tk/filters.h"
 
+#include <algorithm>
+
 using namespace Eigen;
 
 template <typename _T> 
@@ -39,24 +41,24 @@ template <typename _T>
   imu_tk::DataInterval current_interval(-1, -1);
   int previous_id = -1;
 
-  std::cout << "Starting staticIntervalsDetector!" << std::endl;
-  std::cout << "number of samples loaded from dataset = " << samples.size() << std::endl;
+  IMU_TK_LOG_DEBUG( "Starting staticIntervalsDetector!" );
+  IMU_TK_LOG_DEBUG( "number of samples loaded from dataset = " << samples.size() );
 
   for( int i = 0; i < samples.size(); i++ )
   {
     if( samples[i].interval_id() != -1)
     {
-      std::cout << "id of sample num " << i << " = " << samples[i].interval_id() << std::endl;
-      std::cout << "previous id = " << previous_id << std::endl;
+      IMU_TK_LOG_TRACE( "id of sample num " << i << " = " << samples[i].interval_id() );
+      IMU_TK_LOG_TRACE( "previous id = " << previous_id );
 
       if ( samples[i].interval_id() != previous_id )
       {
         if( current_interval.start_idx != -1)
         {
-          std::cout << "Saving interval that started in sample num " << current_interval.start_idx <<
-              " and finished in sample num " << current_interval.end_idx << std::endl;
+          IMU_TK_LOG_DEBUG( "Saving interval that started in sample num " << current_interval.start_idx <<
+                            " and finished in sample num " << current_interval.end_idx );
           intervals.push_back(current_interval);
-          std::cout << "Total number of interval stored: " << intervals.size() << std::endl;
+          IMU_TK_LOG_DEBUG( "Total number of interval stored: " << intervals.size() );
         }
         current_interval.start_idx = i;
         previous_id = samples[i].interval_id();
@@ -68,14 +70,279 @@ template <typename _T>
       }
     }
   }
-  std::cout << "Saving interval that started in sample num " << current_interval.start_idx <<
-      " and finished in sample num " << current_interval.end_idx << std::endl;
+  IMU_TK_LOG_DEBUG( "Saving interval that started in sample num " << current_interval.start_idx <<
+                    " and finished in sample num " << current_interval.end_idx );
   intervals.push_back(current_interval);
-  std::cout << "Total number of interval stored: " << intervals.size() << std::endl;
+  IMU_TK_LOG_DEBUG( "Total number of interval stored: " << intervals.size() );
 }
 
+template <typename _T> 
+  void imu_tk::staticIntervalsDetector ( const imu_tk::TriadBuffer_<_T>& samples, 
+                                         std::vector< imu_tk::DataInterval >& intervals )
+{
+  intervals.clear();
+
+  imu_tk::DataInterval current_interval(-1, -1);
+  int previous_id = -1;
+  const int *interval_ids = samples.intervalIds();
+
+  for( int i = 0; i < samples.size(); i++ )
+  {
+    if( interval_ids[i] != -1)
+    {
+      if ( interval_ids[i] != previous_id )
+      {
+        if( current_interval.start_idx != -1)
+          intervals.push_back(current_interval);
+        current_interval.start_idx = i;
+        previous_id = interval_ids[i];
+      }
+      current_interval.end_idx = i;
+    }
+  }
+  intervals.push_back(current_interval);
+}
+
+template <typename _T>
+  imu_tk::StaticIntervalsStreamDetector_<_T>::StaticIntervalsStreamDetector_( int min_interval_n_samples,  
+                                                                            bool store_samples ) :
+  min_interval_n_samples_(min_interval_n_samples),
+  store_samples_(store_samples)
+{
+  reset();
+}
+
+template <typename _T>
+  void imu_tk::StaticIntervalsStreamDetector_<_T>::reset()
+{
+  n_samples_ = 0;
+  intervals_.clear();
+  samples_.clear();
+  in_interval_ = false;
+}
+
+template <typename _T>
+  void imu_tk::StaticIntervalsStreamDetector_<_T>::process( const TriadBuffer_<_T> &chunk )
+{
+  const int *interval_ids = chunk.intervalIds();
+  for( int i = 0; i < chunk.size(); i++, n_samples_++ )
+  {
+    if( interval_ids[i] == -1 )
+      continue;
+    
+    if( in_interval_ && interval_ids[i] != cur_interval_.interval_id )
+      closeInterval();
+    
+    if( !in_interval_ )
+    {
+      in_interval_ = true;
+      cur_interval_.interval = DataInterval( n_samples_, n_samples_ );
+      cur_interval_.interval_id = interval_ids[i];
+      cur_interval_.start_timestamp = chunk.timestamp(i);
+      cur_welford_mean_.setZero();
+      cur_welford_m2_.setZero();
+      cur_n_samples_ = 0;
+      cur_samples_start_ = samples_.size();
+    }
+    
+    cur_interval_.interval.end_idx = n_samples_;
+    cur_interval_.end_timestamp = chunk.timestamp(i);
+    
+    const Eigen::Matrix< _T, 3, 1> sample = chunk.data(i);
+    // Welford's online algorithm for the mean and the variance, in double precision
+    cur_n_samples_++;
+    const Eigen::Matrix< double, 3, 1> delta = sample.template cast<double>() - cur_welford_mean_;
+    cur_welford_mean_ += delta/double(cur_n_samples_);
+    cur_welford_m2_ += ( delta.array()*
+                         ( sample.template cast<double>() - cur_welford_mean_ ).array() ).matrix();
+    
+    if( store_samples_ )
+      samples_.push_back( chunk.timestamp(i), chunk.x(i), chunk.y(i), chunk.z(i), interval_ids[i] );
+  }
+}
+
+template <typename _T>
+  void imu_tk::StaticIntervalsStreamDetector_<_T>::finish()
+{
+  if( in_interval_ )
+    closeInterval();
+}
+
+template <typename _T>
+  void imu_tk::StaticIntervalsStreamDetector_<_T>::closeInterval()
+{
+  in_interval_ = false;
+  
+  cur_interval_.mean = cur_welford_mean_.template cast<_T>();
+  if( cur_n_samples_ > 1 )
+    cur_interval_.variance = ( cur_welford_m2_/double(cur_n_samples_ - 1) ).template cast<_T>();
+  else
+    cur_interval_.variance.setZero();
+  intervals_.push_back( cur_interval_ );
+  
+  // Keep only the samples of the intervals long enough
+  if( store_samples_ && cur_interval_.numSamples() < min_interval_n_samples_ )
+    samples_.resize( cur_samples_start_ );
+}
+
+template <typename _T> 
+  void imu_tk::staticIntervalsDetector ( const std::vector< imu_tk::TriadData_<_T> >& samples, _T threshold,
+                                         std::vector< imu_tk::DataInterval >& intervals, int win_size )
+{
+  staticIntervalsDetector( imu_tk::TriadBuffer_<_T>( samples ), threshold, intervals, win_size );
+}
+
+template <typename _T> 
+  void imu_tk::staticIntervalsDetector ( const imu_tk::TriadBuffer_<_T>& samples, _T threshold,
+                                         std::vector< imu_tk::DataInterval >& intervals, int win_size )
+{
+  StaticIntervalsVarianceDetector_<_T> detector( threshold, win_size );
+  detector.process( samples );
+  detector.finish();
+  intervals = detector.intervals();
+}
+
+template <typename _T> 
+  void imu_tk::labelStaticIntervals ( imu_tk::TriadBuffer_<_T> &samples, 
+                                      const std::vector< imu_tk::DataInterval > &intervals )
+{
+  int *interval_ids = samples.intervalIds();
+  std::fill( interval_ids, interval_ids + samples.size(), -1 );
+  for( int i = 0; i < int(intervals.size()); i++ )
+  {
+    DataInterval interval = checkInterval( samples, intervals[i] );
+    std::fill( interval_ids + interval.start_idx, interval_ids + interval.end_idx + 1, i );
+  }
+}
+
+template <typename _T>
+  imu_tk::StaticIntervalsVarianceDetector_<_T>::StaticIntervalsVarianceDetector_( _T threshold,  
+                                                                                int win_size ) :
+  threshold_(threshold),
+  win_size_(win_size)
+{
+  if ( win_size_ < 11 ) win_size_ = 11;
+  if( !(win_size_ % 2) ) win_size_++;
+  reset();
+}
+
+template <typename _T>
+  void imu_tk::StaticIntervalsVarianceDetector_<_T>::reset()
+{
+  n_samples_ = n_updates_ = 0;
+  window_.assign( win_size_, Eigen::Matrix< double, 3, 1>::Zero() );
+  offset_.setZero();
+  sum_.setZero();
+  sum_sq_.setZero();
+  in_interval_ = false;
+  intervals_.clear();
+}
+
+template <typename _T>
+  void imu_tk::StaticIntervalsVarianceDetector_<_T>::process( const TriadBuffer_<_T> &chunk )
+{
+  const int h = win_size_/2;
+  const _T *x = chunk.x(), *y = chunk.y(), *z = chunk.z();
+  for( int i = 0; i < chunk.size(); i++, n_samples_++ )
+  {
+    Eigen::Matrix< double, 3, 1> sample( x[i], y[i], z[i] );
+    if( !n_samples_ )
+      offset_ = sample;
+    sample -= offset_;
+    
+    Eigen::Matrix< double, 3, 1> &slot = window_[n_samples_%win_size_];
+    if( n_samples_ >= win_size_ )
+    {
+      sum_ -= slot;
+      sum_sq_ -= slot.cwiseProduct( slot );
+    }
+    slot = sample;
+    sum_ += sample;
+    sum_sq_ += sample.cwiseProduct( sample );
+    
+    if( n_samples_ < win_size_ - 1 )
+      continue;
+    
+    // Bound the rounding errors accumulated subtracting the old samples
+    if( ++n_updates_ >= 1024 )
+      recomputeSums();
+    
+    // Window centered in n_samples_ - h
+    Eigen::Matrix< double, 3, 1> variance = 
+      ( sum_sq_ - sum_.cwiseProduct( sum_ )/double(win_size_) )/double(win_size_ - 1);
+    variance = variance.cwiseMax( 0.0 );
+    const double norm = variance.norm();
+    const int center_idx = n_samples_ - h;
+    
+    if( !in_interval_ )
+    {
+      if( norm < threshold_ )
+      {
+        cur_interval_.start_idx = center_idx;
+        in_interval_ = true;
+      }
+    }
+    else if( norm >= threshold_ )
+    {
+      cur_interval_.end_idx = center_idx - 1;
+      intervals_.push_back( cur_interval_ );
+      in_interval_ = false;
+    }
+  }
+}
+
+template <typename _T>
+  void imu_tk::StaticIntervalsVarianceDetector_<_T>::finish()
+{
+  // If the last interval has not been included in the intervals vector
+  if( in_interval_ )
+  {
+    cur_interval_.end_idx = n_samples_ - win_size_/2 - 1;
+    intervals_.push_back( cur_interval_ );
+    in_interval_ = false;
+  }
+}
+
+template <typename _T>
+  void imu_tk::StaticIntervalsVarianceDetector_<_T>::recomputeSums()
+{
+  n_updates_ = 0;
+  sum_.setZero();
+  sum_sq_.setZero();
+  for( int i = 0; i < win_size_; i++ )
+  {
+    sum_ += window_[i];
+    sum_sq_ += window_[i].cwiseProduct( window_[i] );
+  }
+}
 
 template void imu_tk::staticIntervalsDetector<double> ( const std::vector< TriadData_<double> > &samples,
                                                         std::vector< DataInterval > &intervals);
 template void imu_tk::staticIntervalsDetector<float> ( const std::vector< TriadData_<float> > &samples,
                                                         std::vector< DataInterval > &intervals);
+template void imu_tk::staticIntervalsDetector<double> ( const TriadBuffer_<double> &samples,
+                                                        std::vector< DataInterval > &intervals);
+template void imu_tk::staticIntervalsDetector<float> ( const TriadBuffer_<float> &samples,
+                                                        std::vector< DataInterval > &intervals);
+
+template void imu_tk::staticIntervalsDetector<double> ( const std::vector< TriadData_<double> > &samples,
+                                                        double threshold, std::vector< DataInterval > &intervals,
+                                                        int win_size );
+template void imu_tk::staticIntervalsDetector<float> ( const std::vector< TriadData_<float> > &samples,
+                                                       float threshold, std::vector< DataInterval > &intervals,
+                                                       int win_size );
+template void imu_tk::staticIntervalsDetector<double> ( const TriadBuffer_<double> &samples,
+                                                        double threshold, std::vector< DataInterval > &intervals,
+                                                        int win_size );
+template void imu_tk::staticIntervalsDetector<float> ( const TriadBuffer_<float> &samples,
+                                                       float threshold, std::vector< DataInterval > &intervals,
+                                                       int win_size );
+template void imu_tk::labelStaticIntervals<double> ( TriadBuffer_<double> &samples, 
+                                                     const std::vector< DataInterval > &intervals );
+template void imu_tk::labelStaticIntervals<float> ( TriadBuffer_<float> &samples, 
+                                                    const std::vector< DataInterval > &intervals );
+
+template class imu_tk::StaticIntervalsStreamDetector_<double>;
+template class imu_tk::StaticIntervalsStreamDetector_<float>;
+template class imu_tk::StaticIntervalsVarianceDetector_<double>;
+template class imu_tk::StaticIntervalsVarianceDetector_<float>;
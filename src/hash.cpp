@@ -0,0 +1,232 @@
+/* 
+ * imu_tk - Inertial Measurement Unit Toolkit
+ * 
+ *  Copyright (c) 2014, Alberto Pretto <pretto@diag.uniroma1.it>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ * 
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ * 
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "imu_tk/hash.h"
+
+#include <cstring>
+#include <algorithm>
+
+using namespace imu_tk;
+
+static const uint64_t PRIME_1 = 11400714785074694791ULL, 
+                      PRIME_2 = 14029467366897019727ULL,
+                      PRIME_3 = 1609587929392839161ULL, 
+                      PRIME_4 = 9650029242287828579ULL,
+                      PRIME_5 = 2870177450012600261ULL;
+
+static inline uint64_t rotl( uint64_t x, int r ) { return ( x << r ) | ( x >> ( 64 - r ) ); }
+
+/* Reads of the little-endian words of the XXH64 specification (the native byte order, 
+ * as for the binary data files, see io_utils.h) */
+static inline uint64_t read64( const unsigned char *p )
+{
+  uint64_t v;
+  memcpy( &v, p, sizeof(v) );
+  return v;
+}
+
+static inline uint32_t read32( const unsigned char *p )
+{
+  uint32_t v;
+  memcpy( &v, p, sizeof(v) );
+  return v;
+}
+
+static inline uint64_t round64( uint64_t acc, uint64_t input )
+{
+  acc += input*PRIME_2;
+  return rotl( acc, 31 )*PRIME_1;
+}
+
+static inline uint64_t mergeRound( uint64_t acc, uint64_t val )
+{
+  acc ^= round64( 0, val );
+  return acc*PRIME_1 + PRIME_4;
+}
+
+void Hash64::reset( uint64_t seed )
+{
+  seed_ = seed;
+  acc_[0] = seed + PRIME_1 + PRIME_2;
+  acc_[1] = seed + PRIME_2;
+  acc_[2] = seed;
+  acc_[3] = seed - PRIME_1;
+  n_pending_ = 0;
+  total_size_ = 0;
+}
+
+void Hash64::update( const void *data, size_t size )
+{
+  const unsigned char *p = static_cast< const unsigned char * >( data ), *end = p + size;
+  total_size_ += size;
+  
+  // Complete the pending stripe, if any
+  if( n_pending_ )
+  {
+    size_t n = std::min( size, 32 - n_pending_ );
+    memcpy( pending_ + n_pending_, p, n );
+    n_pending_ += n;
+    p += n;
+    if( n_pending_ < 32 )
+      return;
+    for( int i = 0; i < 4; i++ )
+      acc_[i] = round64( acc_[i], read64( pending_ + 8*i ) );
+    n_pending_ = 0;
+  }
+  
+  // Whole 32 bytes stripes
+  uint64_t v0 = acc_[0], v1 = acc_[1], v2 = acc_[2], v3 = acc_[3];
+  for( ; end - p >= 32; p += 32 )
+  {
+    v0 = round64( v0, read64( p ) );
+    v1 = round64( v1, read64( p + 8 ) );
+    v2 = round64( v2, read64( p + 16 ) );
+    v3 = round64( v3, read64( p + 24 ) );
+  }
+  acc_[0] = v0; acc_[1] = v1; acc_[2] = v2; acc_[3] = v3;
+  
+  if( p < end )
+  {
+    memcpy( pending_, p, end - p );
+    n_pending_ = end - p;
+  }
+}
+
+uint64_t Hash64::digest() const
+{
+  uint64_t h;
+  if( total_size_ >= 32 )
+  {
+    h = rotl( acc_[0], 1 ) + rotl( acc_[1], 7 ) + rotl( acc_[2], 12 ) + rotl( acc_[3], 18 );
+    for( int i = 0; i < 4; i++ )
+      h = mergeRound( h, acc_[i] );
+  }
+  else
+    h = seed_ + PRIME_5;
+  
+  h += total_size_;
+  
+  const unsigned char *p = pending_, *end = pending_ + n_pending_;
+  for( ; end - p >= 8; p += 8 )
+  {
+    h ^= round64( 0, read64( p ) );
+    h = rotl( h, 27 )*PRIME_1 + PRIME_4;
+  }
+  if( end - p >= 4 )
+  {
+    h ^= uint64_t( read32( p ) )*PRIME_1;
+    h = rotl( h, 23 )*PRIME_2 + PRIME_3;
+    p += 4;
+  }
+  for( ; p < end; p++ )
+  {
+    h ^= ( *p )*PRIME_5;
+    h = rotl( h, 11 )*PRIME_1;
+  }
+  
+  h ^= h >> 33;
+  h *= PRIME_2;
+  h ^= h >> 29;
+  h *= PRIME_3;
+  h ^= h >> 32;
+  return h;
+}
+
+/* Serialization of a sample, see hashSamples() */
+template <typename _T> static inline unsigned char *
+  packSample( unsigned char *p, _T ts, _T x, _T y, _T z, int interval_id )
+{
+  const _T values[4] = { ts, x, y, z };
+  const int32_t id = interval_id;
+  memcpy( p, values, sizeof(values) );
+  memcpy( p + sizeof(values), &id, sizeof(id) );
+  return p + sizeof(values) + sizeof(id);
+}
+
+template <typename _T> void imu_tk::hashSamples( Hash64 &hash, const TriadBuffer_<_T> &samples )
+{
+  // The samples are serialized in blocks, to update the hash with large buffers
+  const int block_size = 256, sample_size = 4*sizeof(_T) + sizeof(int32_t);
+  unsigned char block[block_size*sample_size];
+  const _T *ts = samples.timestamps(), *x = samples.x(), *y = samples.y(), *z = samples.z();
+  const int *ids = samples.intervalIds();
+  for( int start = 0; start < samples.size(); start += block_size )
+  {
+    const int end = std::min( start + block_size, samples.size() );
+    unsigned char *p = block;
+    for( int i = start; i < end; i++ )
+      p = packSample( p, ts[i], x[i], y[i], z[i], ids[i] );
+    hash.update( block, p - block );
+  }
+}
+
+template <typename _T> void imu_tk::hashSamples( Hash64 &hash, const std::vector< TriadData_<_T> > &samples )
+{
+  if( !samples.empty() )
+    hashSamples( hash, samples.data(), int(samples.size()) );
+}
+
+template <typename _T> void imu_tk::hashSamples( Hash64 &hash, const TriadData_<_T> *samples, int n_samples )
+{
+  const int block_size = 256, sample_size = 4*sizeof(_T) + sizeof(int32_t);
+  unsigned char block[block_size*sample_size];
+  for( int start = 0; start < n_samples; start += block_size )
+  {
+    const int end = std::min( start + block_size, n_samples );
+    unsigned char *p = block;
+    for( int i = start; i < end; i++ )
+      p = packSample( p, samples[i].timestamp(), samples[i].x(), samples[i].y(), samples[i].z(), 
+                      samples[i].interval_id() );
+    hash.update( block, p - block );
+  }
+}
+
+template <typename _T> uint64_t imu_tk::samplesHash( const TriadBuffer_<_T> &samples )
+{
+  Hash64 hash;
+  hashSamples( hash, samples );
+  return hash.digest();
+}
+
+template <typename _T> uint64_t imu_tk::samplesHash( const std::vector< TriadData_<_T> > &samples )
+{
+  Hash64 hash;
+  hashSamples( hash, samples );
+  return hash.digest();
+}
+
+template void imu_tk::hashSamples<double>( Hash64 &hash, const TriadBuffer_<double> &samples );
+template void imu_tk::hashSamples<float>( Hash64 &hash, const TriadBuffer_<float> &samples );
+template void imu_tk::hashSamples<double>( Hash64 &hash, const std::vector< TriadData_<double> > &samples );
+template void imu_tk::hashSamples<float>( Hash64 &hash, const std::vector< TriadData_<float> > &samples );
+template void imu_tk::hashSamples<double>( Hash64 &hash, const TriadData_<double> *samples, int n_samples );
+template void imu_tk::hashSamples<float>( Hash64 &hash, const TriadData_<float> *samples, int n_samples );
+template uint64_t imu_tk::samplesHash<double>( const TriadBuffer_<double> &samples );
+template uint64_t imu_tk::samplesHash<float>( const TriadBuffer_<float> &samples );
+template uint64_t imu_tk::samplesHash<double>( const std::vector< TriadData_<double> > &samples );
+template uint64_t imu_tk::samplesHash<float>( const std::vector< TriadData_<float> > &samples );
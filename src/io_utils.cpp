@@ -29,88 +29,431 @@
 #include "imu_tk/io_utils.h"
 
 #include <iostream>
-#include <fstream>
+#include <sstream>
+#include <locale>
 #include <string>
 #include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdint.h>
+#include <thread>
 
-// TODO Add setlocale()
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
-template <typename _T>
-void imu_tk::importAsciiData ( const char *filename,
-                               vector< TriadData_<_T> > &samples,
-                               TimestampUnit unit, DatasetType type )
+namespace
+{
+/* Read-only view of a whole file content: the file is memory mapped if possible, 
+ * otherwise it is loaded with a single block read */
+class FileBuffer
+{
+public:
+  FileBuffer() : data_(NULL), size_(0), mapped_(false) {};
+  ~FileBuffer() { close(); };
+  
+  bool open( const char *filename )
+  {
+    close();
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = ::open( filename, O_RDONLY );
+    if( fd < 0 )
+      return false;
+    struct stat st;
+    if( fstat( fd, &st ) == 0 && st.st_size > 0 )
+    {
+      void *addr = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+      if( addr != MAP_FAILED )
+      {
+        madvise( addr, st.st_size, MADV_SEQUENTIAL );
+        data_ = static_cast<const char *>(addr);
+        size_ = st.st_size;
+        mapped_ = true;
+      }
+    }
+    ::close( fd );
+    if( mapped_ )
+      return true;
+#endif
+    FILE *file = fopen( filename, "rb" );
+    if( file == NULL )
+      return false;
+    
+    const size_t block_size = 1 << 22;
+    size_t n_read;
+    do
+    {
+      buffer_.resize( buffer_.size() + block_size );
+      n_read = fread( &buffer_[buffer_.size() - block_size], 1, block_size, file );
+      buffer_.resize( buffer_.size() - block_size + n_read );
+    }
+    while( n_read == block_size );
+    fclose( file );
+    
+    data_ = buffer_.empty()?NULL:&buffer_[0];
+    size_ = buffer_.size();
+    return true;
+  }
+  
+  void close()
+  {
+#if defined(__unix__) || defined(__APPLE__)
+    if( mapped_ )
+      munmap( const_cast<char *>(data_), size_ );
+#endif
+    vector<char>().swap( buffer_ );
+    data_ = NULL;
+    size_ = 0;
+    mapped_ = false;
+  }
+  
+  const char *begin() const { return data_; };
+  const char *end() const { return data_ + size_; };
+  size_t size() const { return size_; };
+  
+private:
+  FileBuffer( const FileBuffer & );
+  FileBuffer &operator=( const FileBuffer & );
+  
+  const char *data_;
+  size_t size_;
+  bool mapped_;
+  vector<char> buffer_;
+};
+
+inline bool isSpace( char c )
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+inline bool isDigit( char c )
+{
+  return c >= '0' && c <= '9';
+}
+
+inline const char *skipSpaces( const char *p, const char *end )
 {
-  samples.clear();
+  while( p < end && isSpace(*p) ) p++;
+  return p;
+}
 
-  string line;
-  ifstream infile;
-  double ts, d[3];
-  int interval_id;
+/* Locale independent floating point parser. Numbers with at most 19 significant 
+ * digits whose mantissa and power of ten are both exactly representable are converted 
+ * with a single (correctly rounded) product or division (Clinger's fast path), 
+ * all the others are delegated to a "C" locale stream, the "nan" and "inf" tokens to strtod(). 
+ * Returns a pointer past the parsed number, or NULL on failure */
+/* Parse the "nan" and "inf" ("infinity") tokens, as strtod() and sscanf() do */
+const char *parseNonFinite( const char *p, const char *end, double &val )
+{
+  const char *token_end = p;
+  if( token_end < end && ( *token_end == '-' || *token_end == '+' ) )
+    token_end++;
+  while( token_end < end && isalpha( static_cast<unsigned char>(*token_end) ) )
+    token_end++;
+  
+  const string token( p, token_end );
+  char *parsed_end;
+  val = strtod( token.c_str(), &parsed_end );
+  if( token.empty() || parsed_end != token.c_str() + token.size() || isfinite( val ) )
+    return NULL;
+  return token_end;
+}
 
-  infile.open ( filename );
-  if ( infile.is_open() )
+const char *parseDouble( const char *p, const char *end, double &val )
+{
+  static const double pow10[] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                  1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                  1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+  const char *start = p;
+  bool negative = false;
+  if( p < end && ( *p == '-' || *p == '+' ) )
+    negative = ( *p++ == '-' );
+  
+  unsigned long long mantissa = 0;
+  int n_digits = 0, n_sig_digits = 0, exponent = 0;
+  for( ; p < end && isDigit(*p); p++, n_digits++ )
+  {
+    if( n_sig_digits || *p != '0' )
+    {
+      if( n_sig_digits < 19 ) mantissa = 10*mantissa + (*p - '0');
+      else exponent++;
+      n_sig_digits++;
+    }
+  }
+  if( p < end && *p == '.' )
   {
-    int l = 0;
-    while ( getline ( infile,line ) )
+    for( p++; p < end && isDigit(*p); p++, n_digits++ )
     {
-      int res = sscanf ( line.data(), "%lf,%lf,%lf,%lf,%d", &ts, &d[0], &d[1], &d[2], &interval_id );
-      if ( res != 5 )
+      if( n_sig_digits || *p != '0' )
       {
-        cout<<"importAsciiData(): error importing data in line "<<l<<", exit"<<endl;
+        if( n_sig_digits < 19 ) 
+        {
+          mantissa = 10*mantissa + (*p - '0');
+          exponent--;
+        }
+        n_sig_digits++;
       }
       else
-      {
-        ts /= unit;
-        samples.push_back ( TriadData_<_T> ( _T ( ts ), _T ( d[0] ), _T ( d[1] ), _T ( d[2] ), interval_id ) );
-      }
-      l++;
+        exponent--;
+    }
+  }
+  if( !n_digits )
+    return parseNonFinite( start, end, val );
+  
+  if( p < end && ( *p == 'e' || *p == 'E' ) )
+  {
+    const char *exp_p = p + 1;
+    bool exp_negative = false;
+    if( exp_p < end && ( *exp_p == '-' || *exp_p == '+' ) )
+      exp_negative = ( *exp_p++ == '-' );
+    if( exp_p < end && isDigit(*exp_p) )
+    {
+      int exp_val = 0;
+      for( ; exp_p < end && isDigit(*exp_p); exp_p++ )
+        if( exp_val < 100000 ) exp_val = 10*exp_val + (*exp_p - '0');
+      exponent += exp_negative?-exp_val:exp_val;
+      p = exp_p;
     }
-    infile.close();
   }
+  
+  if( n_sig_digits <= 19 && mantissa <= ( 1ULL << 53 ) && 
+      exponent >= -22 && exponent <= 22 )
+  {
+    val = double(mantissa);
+    if( exponent < 0 ) val /= pow10[-exponent];
+    else val *= pow10[exponent];
+    if( negative ) val = -val;
+  }
+  else
+  {
+    istringstream iss( string( start, p ) );
+    iss.imbue( locale::classic() );
+    if( !( iss >> val ) )
+      return NULL;
+  }
+  return p;
 }
 
-template <typename _T>
-void imu_tk::importAsciiData ( const char *filename,
-                               vector< TriadData_<_T> > &samples0,
-                               vector< TriadData_<_T> > &samples1,
-                               TimestampUnit unit, DatasetType type )
+inline const char *parseInt( const char *p, const char *end, int &val )
+{
+  bool negative = false;
+  if( p < end && ( *p == '-' || *p == '+' ) )
+    negative = ( *p++ == '-' );
+  if( p >= end || !isDigit(*p) )
+    return NULL;
+  
+  val = 0;
+  for( ; p < end && isDigit(*p); p++ )
+    val = 10*val + (*p - '0');
+  if( negative ) val = -val;
+  return p;
+}
+
+/* Parse a line with a timestamp followed by _N_TRIADS data triads, all comma separated, 
+ * and, if has_id is true, by the interval id */
+template <int _N_TRIADS> 
+  bool parseLine( const char *p, const char *end, bool has_id, 
+                  double &ts, double d[3*_N_TRIADS], int &interval_id )
+{
+  p = parseDouble( skipSpaces( p, end ), end, ts );
+  for( int i = 0; p != NULL && i < 3*_N_TRIADS; i++ )
+  {
+    p = skipSpaces( p, end );
+    if( p >= end || *p != ',' )
+      return false;
+    p = parseDouble( skipSpaces( p + 1, end ), end, d[i] );
+  }
+  if( p != NULL && has_id )
+  {
+    p = skipSpaces( p, end );
+    if( p >= end || *p != ',' )
+      return false;
+    p = parseInt( skipSpaces( p + 1, end ), end, interval_id );
+  }
+  return p != NULL;
+}
+
+/* Parse all the lines in [begin, end), appending the samples to the output vectors 
+ * and the indices of the invalid lines (starting from first_line) to error_lines. 
+ * If hash is not NULL, the samples of the first triad are added to it while parsing */
+template <typename _T, int _N_TRIADS> 
+  void parseChunk( const char *begin, const char *end, int first_line, bool has_id, 
+                   imu_tk::TimestampUnit unit, 
+                   vector< imu_tk::TriadData_<_T> > *samples[_N_TRIADS],
+                   vector< int > &error_lines, imu_tk::Hash64 *hash = NULL )
 {
-  samples0.clear();
-  samples1.clear();
-  string line;
-  ifstream infile;
-  double ts, d[6];
-  infile.open ( filename );
-  if ( infile.is_open() )
+  double ts, d[3*_N_TRIADS];
+  int interval_id = -1;
+  int l = first_line;
+  // Samples are hashed in blocks, while they are still in cache
+  const int hash_block_size = 4096;
+  int n_hashed = samples[0]->size();
+  for( const char *line = begin; line < end; l++ )
   {
-    char format[266];
-    switch ( type )
+    const char *line_end = static_cast<const char *>( memchr( line, '\n', end - line ) );
+    if( line_end == NULL ) line_end = end;
+    
+    if( parseLine<_N_TRIADS>( line, line_end, has_id, ts, d, interval_id ) )
     {
-    case DATASET_COMMA_SEPARATED:
-      sprintf ( format,"%%lf, %%lf, %%lf, %%lf, %%lf, %%lf, %%lf" );
-      break;
+      ts /= unit;
+      for( int i = 0; i < _N_TRIADS; i++ )
+        samples[i]->push_back ( imu_tk::TriadData_<_T> ( _T ( ts ), _T ( d[3*i] ), _T ( d[3*i + 1] ), 
+                                                         _T ( d[3*i + 2] ), interval_id ) );
     }
-    int l = 0;
-    while ( getline ( infile,line ) )
+    else
+      error_lines.push_back(l);
+    
+    if( hash != NULL && int(samples[0]->size()) - n_hashed >= hash_block_size )
     {
-      int res = sscanf ( line.data(), format, &ts, &d[0], &d[1], &d[2],
-                         &d[3], &d[4], &d[5] );
-      if ( res != 7 )
+      imu_tk::hashSamples( *hash, samples[0]->data() + n_hashed, hash_block_size );
+      n_hashed += hash_block_size;
+    }
+    
+    line = line_end + 1;
+  }
+  if( hash != NULL && int(samples[0]->size()) > n_hashed )
+    imu_tk::hashSamples( *hash, samples[0]->data() + n_hashed, int(samples[0]->size()) - n_hashed );
+}
+
+/* Only the comma separated ASCII datasets are supported */
+bool checkDatasetType( imu_tk::DatasetType type, const char *func_name )
+{
+  switch( type )
+  {
+    case imu_tk::DATASET_COMMA_SEPARATED:
+      return true;
+  }
+  IMU_TK_LOG_ERROR( func_name<<": unsupported dataset type, exit" );
+  return false;
+}
+
+template <typename _T, int _N_TRIADS> 
+  void importAsciiTriads( const char *filename, vector< imu_tk::TriadData_<_T> > *samples[_N_TRIADS],
+                          bool has_id, imu_tk::TimestampUnit unit, imu_tk::DatasetType type, 
+                          int n_threads, uint64_t *samples_hash = NULL )
+{
+  for( int i = 0; i < _N_TRIADS; i++ )
+    samples[i]->clear();
+  
+  if( !checkDatasetType( type, "importAsciiData()" ) )
+    return;
+  
+  imu_tk::Hash64 hash;
+  if( samples_hash != NULL )
+    *samples_hash = hash.digest();
+  
+  FileBuffer file;
+  if( !file.open( filename ) || !file.size() )
+    return;
+  
+  if( n_threads < 1 ) n_threads = 1;
+  if( size_t(n_threads) > file.size()/( 1 << 20 ) + 1 ) 
+    n_threads = int( file.size()/( 1 << 20 ) ) + 1;
+  
+  // Split the file in n_threads chunks of whole lines, counting the lines of each chunk
+  vector< const char * > chunks_begin( n_threads + 1, file.end() );
+  vector< int > chunks_n_lines( n_threads, 0 );
+  chunks_begin[0] = file.begin();
+  for( int c = 0; c < n_threads; c++ )
+  {
+    const char *chunk_end = file.begin() + ( file.size()*( c + 1 ) )/n_threads;
+    if( chunk_end < chunks_begin[c] ) chunk_end = chunks_begin[c];
+    const char *p = chunks_begin[c];
+    while( p < file.end() )
+    {
+      const char *line_end = static_cast<const char *>( memchr( p, '\n', file.end() - p ) );
+      chunks_n_lines[c]++;
+      p = ( line_end == NULL )?file.end():line_end + 1;
+      if( p >= chunk_end ) break;
+    }
+    chunks_begin[c + 1] = p;
+  }
+  
+  int n_lines = 0;
+  for( int c = 0; c < n_threads; c++ )
+    n_lines += chunks_n_lines[c];
+  for( int i = 0; i < _N_TRIADS; i++ )
+    samples[i]->reserve( n_lines );
+  
+  vector< vector< int > > error_lines( n_threads );
+  if( n_threads == 1 )
+  {
+    parseChunk<_T, _N_TRIADS>( chunks_begin[0], chunks_begin[1], 0, has_id, unit, 
+                               samples, error_lines[0], samples_hash ? &hash : NULL );
+  }
+  else
+  {
+    vector< vector< vector< imu_tk::TriadData_<_T> > > > chunks_samples( n_threads );
+    vector< thread > threads;
+    int first_line = 0;
+    for( int c = 0; c < n_threads; c++ )
+    {
+      chunks_samples[c].resize( _N_TRIADS );
+      threads.push_back( thread( [&, c, first_line]()
       {
-        cout<<"importAsciiData(): error importing data in line "<<l<<", exit"<<endl;
-      }
-      else
+        vector< imu_tk::TriadData_<_T> > *chunk_samples[_N_TRIADS];
+        for( int i = 0; i < _N_TRIADS; i++ )
+        {
+          chunks_samples[c][i].reserve( chunks_n_lines[c] );
+          chunk_samples[i] = &chunks_samples[c][i];
+        }
+        parseChunk<_T, _N_TRIADS>( chunks_begin[c], chunks_begin[c + 1], first_line, has_id, 
+                                   unit, chunk_samples, error_lines[c] );
+      } ) );
+      first_line += chunks_n_lines[c];
+    }
+    for( int c = 0; c < n_threads; c++ )
+    {
+      threads[c].join();
+      // The chunks are hashed in order, while the next ones are still being parsed
+      if( samples_hash != NULL )
+        imu_tk::hashSamples( hash, chunks_samples[c][0] );
+      for( int i = 0; i < _N_TRIADS; i++ )
       {
-        ts /= unit;
-        samples0.push_back ( TriadData_<_T> ( _T ( ts ), _T ( d[0] ), _T ( d[1] ), _T ( d[2] ) ) );
-        samples1.push_back ( TriadData_<_T> ( _T ( ts ), _T ( d[3] ), _T ( d[4] ), _T ( d[5] ) ) );
+        samples[i]->insert( samples[i]->end(), chunks_samples[c][i].begin(), 
+                            chunks_samples[c][i].end() );
+        vector< imu_tk::TriadData_<_T> >().swap( chunks_samples[c][i] );
       }
-      l++;
     }
-    infile.close();
   }
+  
+  for( int c = 0; c < n_threads; c++ )
+    for( int i = 0; i < int(error_lines[c].size()); i++ )
+      IMU_TK_LOG_ERROR( "importAsciiData(): error importing data in line "<<error_lines[c][i]<<", exit" );
+  
+  if( samples_hash != NULL )
+    *samples_hash = hash.digest();
+}
+}
+
+template <typename _T>
+void imu_tk::importAsciiData ( const char *filename,
+                               vector< TriadData_<_T> > &samples,
+                               TimestampUnit unit, DatasetType type,
+                               int n_threads, uint64_t *samples_hash )
+{
+  vector< TriadData_<_T> > *samples_ptrs[1] = { &samples };
+  importAsciiTriads<_T, 1>( filename, samples_ptrs, true, unit, type, n_threads, samples_hash );
+}
+
+template <typename _T>
+void imu_tk::importAsciiData ( const char *filename,
+                               vector< TriadData_<_T> > &samples0,
+                               vector< TriadData_<_T> > &samples1,
+                               TimestampUnit unit, DatasetType type,
+                               int n_threads )
+{
+  vector< TriadData_<_T> > *samples_ptrs[2] = { &samples0, &samples1 };
+  importAsciiTriads<_T, 2>( filename, samples_ptrs, false, unit, type, n_threads );
 }
 
 template <typename _T>
@@ -118,68 +461,561 @@ void imu_tk::importAsciiData ( const char *filename,
                                vector< TriadData_<_T> > &samples0,
                                vector< TriadData_<_T> > &samples1,
                                vector< TriadData_<_T> > &samples2,
-                               TimestampUnit unit, DatasetType type )
+                               TimestampUnit unit, DatasetType type,
+                               int n_threads )
+{
+  vector< TriadData_<_T> > *samples_ptrs[3] = { &samples0, &samples1, &samples2 };
+  importAsciiTriads<_T, 3>( filename, samples_ptrs, false, unit, type, n_threads );
+}
+
+template <typename _T>
+  imu_tk::AsciiDataReader_<_T>::AsciiDataReader_() :
+  file_(NULL),
+  unit_(TIMESTAMP_UNIT_USEC),
+  n_triads_(1),
+  triad_index_(0),
+  buffer_begin_(0),
+  buffer_end_(0),
+  eof_(false),
+  line_(0) {}
+
+template <typename _T>
+  imu_tk::AsciiDataReader_<_T>::~AsciiDataReader_()
 {
-  samples0.clear();
-  samples1.clear();
-  samples2.clear();
-  string line;
-  ifstream infile;
+  close();
+}
+
+template <typename _T>
+  bool imu_tk::AsciiDataReader_<_T>::open( const char *filename, TimestampUnit unit, 
+                                           DatasetType type, int n_triads, int triad_index )
+{
+  close();
+  
+  if( n_triads < 1 || n_triads > 3 || triad_index < 0 || triad_index >= n_triads )
+  {
+    IMU_TK_LOG_ERROR( "AsciiDataReader::open(): invalid triads configuration, exit" );
+    return false;
+  }
+  if( !checkDatasetType( type, "AsciiDataReader::open()" ) )
+    return false;
+  
+  file_ = fopen( filename, "rb" );
+  if( file_ == NULL )
+    return false;
+  
+  unit_ = unit;
+  n_triads_ = n_triads;
+  triad_index_ = triad_index;
+  buffer_.resize( 1 << 20 );
+  buffer_begin_ = buffer_end_ = 0;
+  eof_ = false;
+  line_ = 0;
+  return true;
+}
+
+template <typename _T>
+  void imu_tk::AsciiDataReader_<_T>::close()
+{
+  if( file_ != NULL )
+    fclose( file_ );
+  file_ = NULL;
+  vector<char>().swap( buffer_ );
+  buffer_begin_ = buffer_end_ = 0;
+}
+
+template <typename _T>
+  bool imu_tk::AsciiDataReader_<_T>::fillBuffer()
+{
+  if( eof_ )
+    return false;
+
+  // Move the incomplete line at the beginning of the buffer, enlarging it if needed
+  size_t n_pending = buffer_end_ - buffer_begin_;
+  if( n_pending )
+    memmove( &buffer_[0], &buffer_[buffer_begin_], n_pending );
+  buffer_begin_ = 0;
+  buffer_end_ = n_pending;
+  if( buffer_.size() - buffer_end_ < buffer_.size()/2 )
+    buffer_.resize( 2*buffer_.size() );
+  
+  size_t n_read = fread( &buffer_[buffer_end_], 1, buffer_.size() - buffer_end_, file_ );
+  buffer_end_ += n_read;
+  if( n_read == 0 )
+    eof_ = true;
+  return n_read > 0;
+}
+
+template <typename _T>
+  int imu_tk::AsciiDataReader_<_T>::read( TriadBuffer_<_T> &chunk, int max_samples )
+{
+  chunk.clear();
+  if( file_ == NULL || max_samples <= 0 )
+    return 0;
+  
+  chunk.reserve( max_samples );
   double ts, d[9];
-  infile.open ( filename );
-  if ( infile.is_open() )
+  int interval_id = -1;
+  while( chunk.size() < max_samples )
   {
-    char format[266];
-    switch ( type )
+    const char *begin = buffer_.empty()?NULL:&buffer_[buffer_begin_], 
+               *end = buffer_.empty()?NULL:&buffer_[0] + buffer_end_;
+    const char *line_end = static_cast<const char *>( memchr( begin, '\n', end - begin ) );
+    if( line_end == NULL )
     {
-    case DATASET_COMMA_SEPARATED:
-      sprintf ( format,"%%lf, %%lf, %%lf, %%lf, %%lf, %%lf, %%lf, %%lf, %%lf, %%lf" );
-      break;
+      if( fillBuffer() )
+        continue;
+      // Last line, without a line terminator
+      if( begin == end )
+        break;
+      line_end = end;
     }
-    int l = 0;
-    while ( getline ( infile,line ) )
+    
+    bool valid;
+    switch( n_triads_ )
     {
-      int res = sscanf ( line.data(), format, &ts, &d[0], &d[1], &d[2],
-                         &d[3], &d[4], &d[5], &d[6], &d[7], &d[8] );
-      if ( res != 10 )
-      {
-        cout<<"importAsciiData(): error importing data in line "<<l<<", exit"<<endl;
-      }
-      else
+      case 1:
+        valid = parseLine<1>( begin, line_end, true, ts, d, interval_id );
+        break;
+      case 2:
+        valid = parseLine<2>( begin, line_end, false, ts, d, interval_id );
+        break;
+      default:
+        valid = parseLine<3>( begin, line_end, false, ts, d, interval_id );
+        break;
+    }
+    if( valid )
+    {
+      ts /= unit_;
+      chunk.push_back( _T ( ts ), _T ( d[3*triad_index_] ), _T ( d[3*triad_index_ + 1] ), 
+                       _T ( d[3*triad_index_ + 2] ), interval_id );
+    }
+    else
+      IMU_TK_LOG_ERROR( "importAsciiData(): error importing data in line "<<line_<<", exit" );
+    
+    line_++;
+    buffer_begin_ = std::min( size_t( line_end - &buffer_[0] ) + 1, buffer_end_ );
+  }
+  
+  return chunk.size();
+}
+
+namespace
+{
+const int BINARY_DATA_VERSION = 1;
+const int BINARY_DATA_MAX_TRIADS = 16;
+const uint64_t BINARY_DATA_ALIGNMENT = 64;
+
+/* Fixed size (128 bytes) header of the binary data files */
+struct BinaryDataHeader
+{
+  char magic[8];
+  uint32_t byte_order;
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t value_size;
+  uint32_t n_triads;
+  uint32_t interval_ids_flags;
+  uint64_t n_samples;
+  double sample_rate;
+  uint32_t timestamp_unit;
+  uint32_t alignment;
+  uint32_t triad_types[BINARY_DATA_MAX_TRIADS];
+  uint32_t reserved[2];
+};
+
+const char BINARY_DATA_MAGIC[8] = { 'I', 'M', 'U', 'T', 'K', 'B', 'I', 'N' };
+const uint32_t BINARY_DATA_BYTE_ORDER = 0x01020304;
+
+inline uint64_t alignOffset( uint64_t offset )
+{
+  return ( offset + BINARY_DATA_ALIGNMENT - 1 )/BINARY_DATA_ALIGNMENT*BINARY_DATA_ALIGNMENT;
+}
+
+/* Compute the offsets of the timestamps, of the x, y, z values of each triad and 
+ * of each interval ids array (-1 if not stored), returning the end of the payload */
+uint64_t payloadOffsets( const BinaryDataHeader &header, uint64_t &timestamps_offset,
+                         vector< uint64_t > &values_offsets, vector< int64_t > &ids_offsets )
+{
+  const uint64_t column_size = header.n_samples*header.value_size,
+                 ids_column_size = header.n_samples*sizeof(int32_t);
+  timestamps_offset = alignOffset( header.header_size );
+  uint64_t end = timestamps_offset + column_size;
+  values_offsets.resize( 3*header.n_triads );
+  for( uint32_t i = 0; i < 3*header.n_triads; i++ )
+  {
+    values_offsets[i] = alignOffset( end );
+    end = values_offsets[i] + column_size;
+  }
+  ids_offsets.resize( header.n_triads );
+  for( uint32_t i = 0; i < header.n_triads; i++ )
+  {
+    if( header.interval_ids_flags & ( 1u << i ) )
+    {
+      ids_offsets[i] = alignOffset( end );
+      end = ids_offsets[i] + ids_column_size;
+    }
+    else
+      ids_offsets[i] = -1;
+  }
+  return end;
+}
+
+bool checkHeader( const BinaryDataHeader &header )
+{
+  return memcmp( header.magic, BINARY_DATA_MAGIC, sizeof(BINARY_DATA_MAGIC) ) == 0 &&
+         header.byte_order == BINARY_DATA_BYTE_ORDER &&
+         header.version >= 1 && header.version <= uint32_t(BINARY_DATA_VERSION) &&
+         header.header_size >= sizeof(BinaryDataHeader) &&
+         ( header.value_size == sizeof(float) || header.value_size == sizeof(double) ) &&
+         header.n_triads >= 1 && header.n_triads <= uint32_t(BINARY_DATA_MAX_TRIADS) &&
+         header.n_samples <= uint64_t(numeric_limits<int>::max()) &&
+         header.timestamp_unit > 0;
+}
+
+void headerToInfo( const BinaryDataHeader &header, imu_tk::BinaryDataInfo &info )
+{
+  info.version = header.version;
+  info.n_samples = int(header.n_samples);
+  info.sample_rate = header.sample_rate;
+  info.double_precision = ( header.value_size == sizeof(double) );
+  info.triad_types.resize( header.n_triads );
+  info.has_interval_ids.resize( header.n_triads );
+  for( uint32_t i = 0; i < header.n_triads; i++ )
+  {
+    info.triad_types[i] = imu_tk::TriadType( header.triad_types[i] );
+    info.has_interval_ids[i] = ( header.interval_ids_flags & ( 1u << i ) ) != 0;
+  }
+}
+
+bool writePadding( FILE *file, uint64_t &offset, uint64_t new_offset )
+{
+  static const char zeros[BINARY_DATA_ALIGNMENT] = { 0 };
+  bool ok = true;
+  if( new_offset > offset )
+    ok = fwrite( zeros, 1, new_offset - offset, file ) == new_offset - offset;
+  offset = new_offset;
+  return ok;
+}
+
+template < typename _T > bool writeColumn( FILE *file, uint64_t &offset, uint64_t column_offset, 
+                                           const _T *data, int n )
+{
+  if( !writePadding( file, offset, column_offset ) )
+    return false;
+  offset += uint64_t(n)*sizeof(_T);
+  return n == 0 || fwrite( data, sizeof(_T), n, file ) == size_t(n);
+}
+
+/* Copy a stored column of values into a _T array, scaling them */
+template < typename _T > void readColumn( const char *src, uint32_t value_size, int n, 
+                                          double scale, _T *dst )
+{
+  if( value_size == sizeof(double) )
+  {
+    const double *src_values = reinterpret_cast< const double * >( src );
+    for( int i = 0; i < n; i++ ) dst[i] = _T( src_values[i]*scale );
+  }
+  else
+  {
+    const float *src_values = reinterpret_cast< const float * >( src );
+    for( int i = 0; i < n; i++ ) dst[i] = _T( src_values[i]*scale );
+  }
+}
+
+/* Mapped binary data file: it keeps valid the arrays referred by the imported buffers */
+struct MappedBinaryData
+{
+  FileBuffer file;
+  vector< int > no_interval_ids;
+};
+}
+
+template <typename _T>
+  bool imu_tk::exportBinaryData( const char *filename, 
+                                 const vector< TriadBuffer_<_T> > &triads,
+                                 double sample_rate,
+                                 const vector< TriadType > &triad_types,
+                                 bool save_interval_ids )
+{
+  if( triads.empty() || triads.size() > size_t(BINARY_DATA_MAX_TRIADS) )
+  {
+    IMU_TK_LOG_ERROR( "exportBinaryData(): invalid number of triads, exit" );
+    return false;
+  }
+  int n_samples = triads[0].size();
+  for( int i = 1; i < int(triads.size()); i++ )
+  {
+    if( triads[i].size() != n_samples )
+    {
+      IMU_TK_LOG_ERROR( "exportBinaryData(): all the triads should have the same number of samples, exit" );
+      return false;
+    }
+  }
+  
+  BinaryDataHeader header;
+  memset( &header, 0, sizeof(header) );
+  memcpy( header.magic, BINARY_DATA_MAGIC, sizeof(BINARY_DATA_MAGIC) );
+  header.byte_order = BINARY_DATA_BYTE_ORDER;
+  header.version = BINARY_DATA_VERSION;
+  header.header_size = sizeof(BinaryDataHeader);
+  header.value_size = sizeof(_T);
+  header.n_triads = triads.size();
+  header.interval_ids_flags = save_interval_ids?( ( 1u << triads.size() ) - 1 ):0;
+  header.n_samples = n_samples;
+  header.sample_rate = sample_rate;
+  header.timestamp_unit = TIMESTAMP_UNIT_SEC;
+  header.alignment = BINARY_DATA_ALIGNMENT;
+  for( int i = 0; i < int(triads.size()); i++ )
+    header.triad_types[i] = ( i < int(triad_types.size()) )?triad_types[i]:TRIAD_UNKNOWN;
+  
+  uint64_t timestamps_offset;
+  vector< uint64_t > values_offsets;
+  vector< int64_t > ids_offsets;
+  payloadOffsets( header, timestamps_offset, values_offsets, ids_offsets );
+  
+  FILE *file = fopen( filename, "wb" );
+  if( file == NULL )
+  {
+    IMU_TK_LOG_ERROR( "exportBinaryData(): can't open file "<<filename<<", exit" );
+    return false;
+  }
+  
+  uint64_t offset = sizeof(header);
+  bool ok = fwrite( &header, sizeof(header), 1, file ) == 1;
+  ok = ok && writeColumn( file, offset, timestamps_offset, triads[0].timestamps(), n_samples );
+  for( int i = 0; i < int(triads.size()); i++ )
+    for( int j = 0; j < 3; j++ )
+      ok = ok && writeColumn( file, offset, values_offsets[3*i + j], triads[i].axis(j), n_samples );
+  for( int i = 0; i < int(triads.size()); i++ )
+  {
+    if( ids_offsets[i] >= 0 )
+    {
+      // Interval ids are stored as 32 bits integers
+      const int *ids = triads[i].intervalIds();
+      vector< int32_t > ids32( ids, ids + n_samples );
+      ok = ok && writeColumn( file, offset, ids_offsets[i], ids32.empty()?NULL:&ids32[0], n_samples );
+    }
+  }
+  ok = ( fclose( file ) == 0 ) && ok;
+  
+  if( !ok )
+    IMU_TK_LOG_ERROR( "exportBinaryData(): error writing file "<<filename<<", exit" );
+  return ok;
+}
+
+template <typename _T>
+  bool imu_tk::exportBinaryData( const char *filename, 
+                                 const TriadBuffer_<_T> &samples,
+                                 double sample_rate, TriadType triad_type,
+                                 bool save_interval_ids )
+{
+  return exportBinaryData( filename, vector< TriadBuffer_<_T> >( 1, samples ), sample_rate, 
+                           vector< TriadType >( 1, triad_type ), save_interval_ids );
+}
+
+bool imu_tk::readBinaryDataInfo( const char *filename, BinaryDataInfo &info )
+{
+  FILE *file = fopen( filename, "rb" );
+  if( file == NULL )
+    return false;
+  
+  BinaryDataHeader header;
+  bool ok = fread( &header, sizeof(header), 1, file ) == 1 && checkHeader( header );
+  fclose( file );
+  
+  if( ok )
+    headerToInfo( header, info );
+  return ok;
+}
+
+template <typename _T>
+  bool imu_tk::importBinaryData( const char *filename, 
+                                 vector< TriadBuffer_<_T> > &triads,
+                                 BinaryDataInfo *info )
+{
+  triads.clear();
+  
+  boost::shared_ptr< MappedBinaryData > data( new MappedBinaryData() );
+  BinaryDataHeader header;
+  if( !data->file.open( filename ) )
+  {
+    IMU_TK_LOG_ERROR( "importBinaryData(): can't open file "<<filename<<", exit" );
+    return false;
+  }
+  if( data->file.size() >= sizeof(header) )
+    memcpy( &header, data->file.begin(), sizeof(header) );
+  if( data->file.size() < sizeof(header) || !checkHeader( header ) )
+  {
+    IMU_TK_LOG_ERROR( "importBinaryData(): "<<filename<<" is not a valid binary data file, exit" );
+    return false;
+  }
+  
+  uint64_t timestamps_offset;
+  vector< uint64_t > values_offsets;
+  vector< int64_t > ids_offsets;
+  if( payloadOffsets( header, timestamps_offset, values_offsets, ids_offsets ) > data->file.size() )
+  {
+    IMU_TK_LOG_ERROR( "importBinaryData(): truncated file "<<filename<<", exit" );
+    return false;
+  }
+  
+  if( info != NULL )
+    headerToInfo( header, *info );
+  
+  const int n_samples = int(header.n_samples);
+  const char *payload = data->file.begin();
+  const double timestamps_scale = 1.0/header.timestamp_unit;
+  
+  if( header.value_size == sizeof(_T) && header.timestamp_unit == TIMESTAMP_UNIT_SEC && 
+      sizeof(int) == sizeof(int32_t) )
+  {
+    // Share the mapped data
+    data->no_interval_ids.assign( n_samples, -1 );
+    boost::shared_ptr< const void > owner( data );
+    const _T *timestamps = reinterpret_cast< const _T * >( payload + timestamps_offset );
+    for( uint32_t i = 0; i < header.n_triads; i++ )
+    {
+      const _T *values[3];
+      for( int j = 0; j < 3; j++ )
+        values[j] = reinterpret_cast< const _T * >( payload + values_offsets[3*i + j] );
+      const int *ids = ( ids_offsets[i] >= 0 )?
+                       reinterpret_cast< const int * >( payload + ids_offsets[i] ):
+                       ( n_samples?&data->no_interval_ids[0]:NULL );
+      triads.push_back( TriadBuffer_<_T>( n_samples, timestamps, values[0], values[1], values[2],
+                                          ids, owner ) );
+    }
+  }
+  else
+  {
+    // Convert the data type and/or the timestamps unit
+    for( uint32_t i = 0; i < header.n_triads; i++ )
+    {
+      TriadBuffer_<_T> samples( n_samples );
+      readColumn( payload + timestamps_offset, header.value_size, n_samples, 
+                  timestamps_scale, samples.timestamps() );
+      for( int j = 0; j < 3; j++ )
+        readColumn( payload + values_offsets[3*i + j], header.value_size, n_samples, 
+                    1.0, samples.axis(j) );
+      if( ids_offsets[i] >= 0 )
       {
-        ts /= unit;
-        samples0.push_back ( TriadData_<_T> ( _T ( ts ), _T ( d[0] ), _T ( d[1] ), _T ( d[2] ) ) );
-        samples1.push_back ( TriadData_<_T> ( _T ( ts ), _T ( d[3] ), _T ( d[4] ), _T ( d[5] ) ) );
-        samples2.push_back ( TriadData_<_T> ( _T ( ts ), _T ( d[6] ), _T ( d[7] ), _T ( d[8] ) ) );
+        const int32_t *ids = reinterpret_cast< const int32_t * >( payload + ids_offsets[i] );
+        std::copy( ids, ids + n_samples, samples.intervalIds() );
       }
-      l++;
+      triads.push_back( samples );
     }
-    infile.close();
   }
+  
+  return true;
+}
+
+template <typename _T>
+  bool imu_tk::importBinaryData( const char *filename, TriadBuffer_<_T> &samples )
+{
+  vector< TriadBuffer_<_T> > triads;
+  if( !importBinaryData( filename, triads ) )
+    return false;
+  
+  samples = triads[0];
+  return true;
+}
+
+template <typename _T>
+  bool imu_tk::importBinaryData( const char *filename, 
+                                 TriadBuffer_<_T> &samples0, 
+                                 TriadBuffer_<_T> &samples1 )
+{
+  vector< TriadBuffer_<_T> > triads;
+  if( !importBinaryData( filename, triads ) )
+    return false;
+  if( triads.size() < 2 )
+  {
+    IMU_TK_LOG_ERROR( "importBinaryData(): not enough triads in file "<<filename<<", exit" );
+    return false;
+  }
+  
+  samples0 = triads[0];
+  samples1 = triads[1];
+  return true;
+}
+
+template <typename _T>
+  bool imu_tk::importBinaryData( const char *filename, 
+                                 TriadBuffer_<_T> &samples0, 
+                                 TriadBuffer_<_T> &samples1, 
+                                 TriadBuffer_<_T> &samples2 )
+{
+  vector< TriadBuffer_<_T> > triads;
+  if( !importBinaryData( filename, triads ) )
+    return false;
+  if( triads.size() < 3 )
+  {
+    IMU_TK_LOG_ERROR( "importBinaryData(): not enough triads in file "<<filename<<", exit" );
+    return false;
+  }
+  
+  samples0 = triads[0];
+  samples1 = triads[1];
+  samples2 = triads[2];
+  return true;
 }
 
 template void imu_tk::importAsciiData<double> ( const char *filename,
     vector< TriadData_<double> > &samples,
-    TimestampUnit unit, DatasetType type );
+    TimestampUnit unit, DatasetType type, int n_threads, uint64_t *samples_hash );
 template void imu_tk::importAsciiData<float> ( const char *filename,
     vector< TriadData_<float> > &samples,
-    TimestampUnit unit, DatasetType type );
+    TimestampUnit unit, DatasetType type, int n_threads, uint64_t *samples_hash );
 
 template void imu_tk::importAsciiData<double> ( const char *filename,
     vector< TriadData_<double> > &samples0,
     vector< TriadData_<double> > &samples1,
-    TimestampUnit unit, DatasetType type );
+    TimestampUnit unit, DatasetType type, int n_threads );
 template void imu_tk::importAsciiData<float> ( const char *filename,
     vector< TriadData_<float> > &samples0,
     vector< TriadData_<float> > &samples1,
-    TimestampUnit unit, DatasetType type );
+    TimestampUnit unit, DatasetType type, int n_threads );
 template void imu_tk::importAsciiData<double> ( const char *filename,
     vector< TriadData_<double> > &samples0,
     vector< TriadData_<double> > &samples1,
     vector< TriadData_<double> > &samples2,
-    TimestampUnit unit, DatasetType type );
+    TimestampUnit unit, DatasetType type, int n_threads );
 template void imu_tk::importAsciiData<float> ( const char *filename,
     vector< TriadData_<float> > &samples0,
     vector< TriadData_<float> > &samples1,
     vector< TriadData_<float> > &samples2,
-    TimestampUnit unit, DatasetType type );
+    TimestampUnit unit, DatasetType type, int n_threads );
+
+template bool imu_tk::exportBinaryData<double> ( const char *filename, 
+    const vector< TriadBuffer_<double> > &triads, double sample_rate,
+    const vector< TriadType > &triad_types, bool save_interval_ids );
+template bool imu_tk::exportBinaryData<float> ( const char *filename, 
+    const vector< TriadBuffer_<float> > &triads, double sample_rate,
+    const vector< TriadType > &triad_types, bool save_interval_ids );
+template bool imu_tk::exportBinaryData<double> ( const char *filename, 
+    const TriadBuffer_<double> &samples, double sample_rate, 
+    TriadType triad_type, bool save_interval_ids );
+template bool imu_tk::exportBinaryData<float> ( const char *filename, 
+    const TriadBuffer_<float> &samples, double sample_rate, 
+    TriadType triad_type, bool save_interval_ids );
+
+template bool imu_tk::importBinaryData<double> ( const char *filename, 
+    vector< TriadBuffer_<double> > &triads, BinaryDataInfo *info );
+template bool imu_tk::importBinaryData<float> ( const char *filename, 
+    vector< TriadBuffer_<float> > &triads, BinaryDataInfo *info );
+template bool imu_tk::importBinaryData<double> ( const char *filename, 
+    TriadBuffer_<double> &samples );
+template bool imu_tk::importBinaryData<float> ( const char *filename, 
+    TriadBuffer_<float> &samples );
+template bool imu_tk::importBinaryData<double> ( const char *filename, 
+    TriadBuffer_<double> &samples0, TriadBuffer_<double> &samples1 );
+template bool imu_tk::importBinaryData<float> ( const char *filename, 
+    TriadBuffer_<float> &samples0, TriadBuffer_<float> &samples1 );
+template bool imu_tk::importBinaryData<double> ( const char *filename, 
+    TriadBuffer_<double> &samples0, TriadBuffer_<double> &samples1, 
+    TriadBuffer_<double> &samples2 );
+template bool imu_tk::importBinaryData<float> ( const char *filename, 
+    TriadBuffer_<float> &samples0, TriadBuffer_<float> &samples1, 
+    TriadBuffer_<float> &samples2 );
+
+template class imu_tk::AsciiDataReader_<double>;
+template class imu_tk::AsciiDataReader_<float>;
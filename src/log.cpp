@@ -0,0 +1,72 @@
+/* 
+ * imu_tk - Inertial Measurement Unit Toolkit
+ * 
+ *  Copyright (c) 2014, Alberto Pretto <pretto@diag.uniroma1.it>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ * 
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ * 
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "imu_tk/log.h"
+
+#include <iostream>
+#include <mutex>
+#include <atomic>
+
+namespace
+{
+std::atomic<int> global_log_level( imu_tk::LOG_LEVEL_INFO );
+// Level set by a ScopedLogLevel object in the current thread, -1 if not set
+thread_local int thread_log_level = -1;
+std::mutex log_mutex;
+}
+
+void imu_tk::setLogLevel( LogLevel level )
+{
+  global_log_level = level;
+}
+
+imu_tk::LogLevel imu_tk::logLevel()
+{
+  return LogLevel( ( thread_log_level >= 0 )?thread_log_level:int(global_log_level) );
+}
+
+void imu_tk::logMessage( LogLevel level, const std::string &msg )
+{
+  std::lock_guard<std::mutex> lock( log_mutex );
+  // Errors and warnings are written (unbuffered) to the standard error
+  if( level <= LOG_LEVEL_WARNING )
+    std::cerr<<msg<<std::endl;
+  else
+    std::cout<<msg<<'\n';
+}
+
+imu_tk::ScopedLogLevel::ScopedLogLevel( LogLevel level ) :
+  prev_level_(thread_log_level)
+{
+  thread_log_level = level;
+}
+
+imu_tk::ScopedLogLevel::~ScopedLogLevel()
+{
+  thread_log_level = prev_level_;
+}
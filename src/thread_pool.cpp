@@ -0,0 +1,187 @@
+/* 
+ * imu_tk - Inertial Measurement Unit Toolkit
+ * 
+ *  Copyright (c) 2014, Alberto Pretto <pretto@diag.uniroma1.it>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ * 
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ * 
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "imu_tk/thread_pool.h"
+
+#include <algorithm>
+
+using namespace imu_tk;
+
+ThreadPool::ThreadPool( int n_threads ) :
+  n_queued_(0),
+  n_pending_(0),
+  next_queue_(0),
+  stop_(false)
+{
+  if( n_threads < 1 )
+    n_threads = std::max( int( std::thread::hardware_concurrency() ), 1 );
+  
+  for( int i = 0; i < n_threads; i++ )
+    queues_.push_back( boost::shared_ptr< TasksQueue >( new TasksQueue() ) );
+  // With a single thread, the tasks are executed by the thread that waits for them
+  for( int i = 0; n_threads > 1 && i < n_threads; i++ )
+    threads_.push_back( std::thread( &ThreadPool::run, this, i ) );
+}
+
+ThreadPool::~ThreadPool()
+{
+  waitTasks();
+  {
+    std::lock_guard< std::mutex > lock( mutex_ );
+    stop_ = true;
+  }
+  work_cond_.notify_all();
+  for( int i = 0; i < int(threads_.size()); i++ )
+    threads_[i].join();
+}
+
+void ThreadPool::submit( const std::function< void() > &task )
+{
+  int queue_idx;
+  {
+    std::lock_guard< std::mutex > lock( mutex_ );
+    queue_idx = next_queue_;
+    next_queue_ = ( next_queue_ + 1 )%int(queues_.size());
+    n_pending_++;
+  }
+  {
+    std::lock_guard< std::mutex > lock( queues_[queue_idx]->mutex );
+    queues_[queue_idx]->tasks.push_back( task );
+  }
+  {
+    std::lock_guard< std::mutex > lock( mutex_ );
+    n_queued_++;
+  }
+  work_cond_.notify_one();
+}
+
+void ThreadPool::wait()
+{
+  waitTasks();
+  std::exception_ptr task_exception;
+  {
+    std::lock_guard< std::mutex > lock( mutex_ );
+    std::swap( task_exception, task_exception_ );
+  }
+  if( task_exception )
+    std::rethrow_exception( task_exception );
+}
+
+void ThreadPool::waitTasks()
+{
+  if( threads_.empty() )
+  {
+    std::function< void() > task;
+    while( popTask( 0, task ) )
+    {
+      {
+        std::lock_guard< std::mutex > lock( mutex_ );
+        n_queued_--;
+      }
+      runTask( task );
+    }
+  }
+  
+  std::unique_lock< std::mutex > lock( mutex_ );
+  while( n_pending_ > 0 )
+    done_cond_.wait( lock );
+}
+
+bool ThreadPool::popTask( int worker_idx, std::function< void() > &task )
+{
+  // Own queue first, from the back ...
+  {
+    TasksQueue &queue = *queues_[worker_idx];
+    std::lock_guard< std::mutex > lock( queue.mutex );
+    if( !queue.tasks.empty() )
+    {
+      task = queue.tasks.back();
+      queue.tasks.pop_back();
+      return true;
+    }
+  }
+  // ... then steal from the front of the other queues
+  const int n_queues = queues_.size();
+  for( int i = 1; i < n_queues; i++ )
+  {
+    TasksQueue &queue = *queues_[( worker_idx + i )%n_queues];
+    std::lock_guard< std::mutex > lock( queue.mutex );
+    if( !queue.tasks.empty() )
+    {
+      task = queue.tasks.front();
+      queue.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::runTask( std::function< void() > &task )
+{
+  std::exception_ptr task_exception;
+  try
+  {
+    task();
+  }
+  catch( ... ) 
+  {
+    task_exception = std::current_exception();
+  }
+  task = std::function< void() >();
+  
+  std::lock_guard< std::mutex > lock( mutex_ );
+  if( task_exception && !task_exception_ )
+    task_exception_ = task_exception;
+  if( --n_pending_ == 0 )
+    done_cond_.notify_all();
+}
+
+void ThreadPool::run( int worker_idx )
+{
+  std::function< void() > task;
+  while( true )
+  {
+    if( popTask( worker_idx, task ) )
+    {
+      {
+        std::lock_guard< std::mutex > lock( mutex_ );
+        n_queued_--;
+      }
+      runTask( task );
+    }
+    else
+    {
+      std::unique_lock< std::mutex > lock( mutex_ );
+      // n_queued_ can be temporarily negative, if a task is popped before being counted
+      while( n_queued_ <= 0 && !stop_ )
+        work_cond_.wait( lock );
+      if( stop_ && n_queued_ <= 0 )
+        return;
+    }
+  }
+}
@@ -0,0 +1,269 @@
+/* 
+ * imu_tk - Inertial Measurement Unit Toolkit
+ * 
+ *  Copyright (c) 2014, Alberto Pretto <pretto@diag.uniroma1.it>
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ * 
+ *  1. Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ * 
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "imu_tk/time_alignment.h"
+
+#include <algorithm>
+#include <complex>
+#include <cmath>
+#include <unsupported/Eigen/FFT>
+
+using namespace imu_tk;
+
+/* Number of samples interpolated in each block by interpolateAxes() */
+static const int INTERPOLATION_BLOCK_SIZE = 1024;
+/* Maximum number of points of the uniform time grids used in the offset estimation */
+static const int MAX_GRID_SIZE = 1 << 20;
+
+/* Interpolate the axes of a signal with timestamps ts (n >= 1 samples) at the (increasing) 
+ * query times minus time_offset. For each block of queries, the indices and the weights are 
+ * found advancing over ts, then each axis is interpolated in a separate, branch-free loop */
+template <typename _T> 
+  static void interpolateAxes( const _T *ts, const _T *const axes[3], int n, 
+                               const _T *query_ts, int n_queries, _T time_offset, _T *const out[3] )
+{
+  int idx[INTERPOLATION_BLOCK_SIZE];
+  _T w[INTERPOLATION_BLOCK_SIZE];
+  // With a single sample, idx[i] + 1 would be out of bounds: use the same sample twice
+  const int next_step = ( n > 1 )?1:0;
+  int j = 0;
+  for( int start = 0; start < n_queries; start += INTERPOLATION_BLOCK_SIZE )
+  {
+    const int n_block = std::min( INTERPOLATION_BLOCK_SIZE, n_queries - start );
+    for( int i = 0; i < n_block; i++ )
+    {
+      _T t = query_ts[start + i] - time_offset;
+      while( j < n - 2 && ts[j + 1] <= t )
+        j++;
+      idx[i] = j;
+      // Hold the first and the last samples outside the interval of the signal
+      if( !next_step || t <= ts[j] )
+        w[i] = _T(0);
+      else if( t >= ts[j + 1] )
+        w[i] = _T(1);
+      else
+        w[i] = ( t - ts[j] )/( ts[j + 1] - ts[j] );
+    }
+    
+    for( int a = 0; a < 3; a++ )
+    {
+      const _T *v = axes[a];
+      _T *o = out[a] + start;
+      for( int i = 0; i < n_block; i++ )
+      {
+        const _T v0 = v[idx[i]], v1 = v[idx[i] + next_step];
+        o[i] = v0 + w[i]*( v1 - v0 );
+      }
+    }
+  }
+}
+
+/* Resample a signal onto the uniform grid t0 + k*dt, k = 0, ..., n_grid - 1 */
+template <typename _T> 
+  static void uniformResample( const TriadBuffer_<_T> &samples, double t0, double dt, int n_grid,
+                               std::vector< _T > grid_axes[3] )
+{
+  std::vector< _T > grid_ts( n_grid );
+  for( int k = 0; k < n_grid; k++ )
+    grid_ts[k] = _T( t0 + k*dt );
+  _T *out[3];
+  for( int a = 0; a < 3; a++ )
+  {
+    grid_axes[a].resize( n_grid );
+    out[a] = grid_axes[a].data();
+  }
+  const _T *axes[3] = { samples.x(), samples.y(), samples.z() };
+  interpolateAxes( samples.timestamps(), axes, samples.size(), grid_ts.data(), n_grid, _T(0), out );
+}
+
+static void removeMean( std::vector< double > &v )
+{
+  double mean = 0;
+  for( int i = 0; i < int(v.size()); i++ )
+    mean += v[i];
+  mean /= v.size();
+  for( int i = 0; i < int(v.size()); i++ )
+    v[i] -= mean;
+}
+
+template <typename _T> 
+  void imu_tk::resampleTriad( const TriadBuffer_<_T> &samples, const TriadBuffer_<_T> &ref_samples,
+                              TriadBuffer_<_T> &resampled_samples, _T time_offset )
+{
+  const int n_ref = ref_samples.size();
+  if( samples.empty() )
+  {
+    IMU_TK_LOG_WARNING( "resampleTriad() : empty input signal" );
+    resampled_samples.clear();
+    return;
+  }
+  
+  // The output could be one of the inputs
+  TriadBuffer_<_T> res( n_ref );
+  std::copy( ref_samples.timestamps(), ref_samples.timestamps() + n_ref, res.timestamps() );
+  std::copy( ref_samples.intervalIds(), ref_samples.intervalIds() + n_ref, res.intervalIds() );
+  
+  const _T *axes[3] = { samples.x(), samples.y(), samples.z() };
+  _T *const out[3] = { res.x(), res.y(), res.z() };
+  interpolateAxes( samples.timestamps(), axes, samples.size(), ref_samples.timestamps(), 
+                   n_ref, time_offset, out );
+  resampled_samples = res;
+}
+
+template <typename _T> 
+  _T imu_tk::estimateTimeOffset( const TriadBuffer_<_T> &acc_samples, const TriadBuffer_<_T> &gyro_samples,
+                                 _T max_offset, _T data_dt )
+{
+  const int n_acc = acc_samples.size(), n_gyro = gyro_samples.size();
+  if( n_acc < 3 || n_gyro < 3 )
+  {
+    IMU_TK_LOG_WARNING( "estimateTimeOffset() : at least 3 samples are required" );
+    return _T(0);
+  }
+  
+  const double acc_t0 = acc_samples.timestamp(0), acc_t1 = acc_samples.timestamp( n_acc - 1 ),
+               gyro_t0 = gyro_samples.timestamp(0), gyro_t1 = gyro_samples.timestamp( n_gyro - 1 );
+  double dt = data_dt;
+  if( dt <= 0 )
+    dt = std::min( ( acc_t1 - acc_t0 )/( n_acc - 1 ), ( gyro_t1 - gyro_t0 )/( n_gyro - 1 ) );
+  // Limit the size of the grids (and of the FFTs) for very long sequences
+  dt = std::max( dt, std::max( acc_t1 - acc_t0, gyro_t1 - gyro_t0 )/( MAX_GRID_SIZE - 1 ) );
+  if( !( dt > 0 ) )
+  {
+    IMU_TK_LOG_WARNING( "estimateTimeOffset() : invalid timestamps" );
+    return _T(0);
+  }
+  
+  const int n_acc_grid = int( ( acc_t1 - acc_t0 )/dt ) + 1, n_gyro_grid = int( ( gyro_t1 - gyro_t0 )/dt ) + 1;
+  std::vector< _T > acc_grid[3], gyro_grid[3];
+  uniformResample( acc_samples, acc_t0, dt, n_acc_grid, acc_grid );
+  uniformResample( gyro_samples, gyro_t0, dt, n_gyro_grid, gyro_grid );
+  
+  // Magnitude of the accelerometers derivative (central differences)
+  std::vector< double > acc_sig( n_acc_grid, 0.0 ), gyro_sig( n_gyro_grid, 0.0 );
+  for( int k = 1; k < n_acc_grid - 1; k++ )
+  {
+    double sq_norm = 0;
+    for( int a = 0; a < 3; a++ )
+    {
+      double d = double( acc_grid[a][k + 1] ) - double( acc_grid[a][k - 1] );
+      sq_norm += d*d;
+    }
+    acc_sig[k] = std::sqrt( sq_norm )/( 2.0*dt );
+  }
+  
+  // Magnitude of the rotational velocities, with the mean of each axis removed 
+  // (i.e., approximately unbiased also for raw samples)
+  std::vector< double > gyro_axis[3];
+  for( int a = 0; a < 3; a++ )
+  {
+    gyro_axis[a].assign( gyro_grid[a].begin(), gyro_grid[a].end() );
+    removeMean( gyro_axis[a] );
+  }
+  for( int k = 0; k < n_gyro_grid; k++ )
+    gyro_sig[k] = std::sqrt( gyro_axis[0][k]*gyro_axis[0][k] + gyro_axis[1][k]*gyro_axis[1][k] + 
+                             gyro_axis[2][k]*gyro_axis[2][k] );
+  removeMean( acc_sig );
+  removeMean( gyro_sig );
+  
+  // Cross-correlation c[l] = sum_k acc_sig[k + l]*gyro_sig[k], zero padded to avoid 
+  // the circular wrap-around: the negative lags are stored at the end
+  int n_fft = 1;
+  while( n_fft < n_acc_grid + n_gyro_grid )
+    n_fft *= 2;
+  acc_sig.resize( n_fft, 0.0 );
+  gyro_sig.resize( n_fft, 0.0 );
+  
+  Eigen::FFT< double > fft;
+  std::vector< std::complex< double > > acc_spec, gyro_spec;
+  fft.fwd( acc_spec, acc_sig );
+  fft.fwd( gyro_spec, gyro_sig );
+  for( int i = 0; i < n_fft; i++ )
+    acc_spec[i] *= std::conj( gyro_spec[i] );
+  std::vector< double > corr;
+  fft.inv( corr, acc_spec );
+  
+  // Lags allowed by the maximum offset, with offset = acc_t0 - gyro_t0 + l*dt. The 
+  // correlation of each lag is normalized by the number of overlapping samples
+  const double base_offset = acc_t0 - gyro_t0;
+  int min_lag = std::max( int( std::ceil( ( -double( max_offset ) - base_offset )/dt ) ), -( n_gyro_grid - 1 ) ),
+      max_lag = std::min( int( std::floor( ( double( max_offset ) - base_offset )/dt ) ), n_acc_grid - 1 );
+  if( min_lag > max_lag )
+  {
+    IMU_TK_LOG_WARNING( "estimateTimeOffset() : the signals do not overlap within the maximum offset" );
+    return _T(0);
+  }
+  
+  std::vector< double > norm_corr( max_lag - min_lag + 1 );
+  for( int l = min_lag; l <= max_lag; l++ )
+  {
+    int n_overlap = std::min( n_acc_grid, n_gyro_grid + l ) - std::max( 0, l );
+    norm_corr[l - min_lag] = corr[( l >= 0 )?l:( n_fft + l )]/std::max( n_overlap, 1 );
+  }
+  int peak_idx = std::max_element( norm_corr.begin(), norm_corr.end() ) - norm_corr.begin();
+  
+  // Parabolic interpolation of the peak
+  double delta = 0;
+  if( peak_idx > 0 && peak_idx < int( norm_corr.size() ) - 1 )
+  {
+    double c0 = norm_corr[peak_idx - 1], c1 = norm_corr[peak_idx], c2 = norm_corr[peak_idx + 1],
+           den = c0 - 2.0*c1 + c2;
+    if( den < 0 )
+      delta = 0.5*( c0 - c2 )/den;
+  }
+  
+  return _T( base_offset + ( min_lag + peak_idx + delta )*dt );
+}
+
+template <typename _T> 
+  _T imu_tk::alignGyroToAcc( const TriadBuffer_<_T> &acc_samples, const TriadBuffer_<_T> &gyro_samples,
+                             TriadBuffer_<_T> &aligned_gyro_samples, _T max_offset )
+{
+  _T time_offset = estimateTimeOffset( acc_samples, gyro_samples, max_offset );
+  resampleTriad( gyro_samples, acc_samples, aligned_gyro_samples, time_offset );
+  return time_offset;
+}
+
+template void imu_tk::resampleTriad<double>( const TriadBuffer_<double> &samples, 
+                                             const TriadBuffer_<double> &ref_samples,
+                                             TriadBuffer_<double> &resampled_samples, double time_offset );
+template void imu_tk::resampleTriad<float>( const TriadBuffer_<float> &samples, 
+                                            const TriadBuffer_<float> &ref_samples,
+                                            TriadBuffer_<float> &resampled_samples, float time_offset );
+template double imu_tk::estimateTimeOffset<double>( const TriadBuffer_<double> &acc_samples, 
+                                                    const TriadBuffer_<double> &gyro_samples,
+                                                    double max_offset, double data_dt );
+template float imu_tk::estimateTimeOffset<float>( const TriadBuffer_<float> &acc_samples, 
+                                                  const TriadBuffer_<float> &gyro_samples,
+                                                  float max_offset, float data_dt );
+template double imu_tk::alignGyroToAcc<double>( const TriadBuffer_<double> &acc_samples, 
+                                                const TriadBuffer_<double> &gyro_samples,
+                                                TriadBuffer_<double> &aligned_gyro_samples, double max_offset );
+template float imu_tk::alignGyroToAcc<float>( const TriadBuffer_<float> &acc_samples, 
+                                              const TriadBuffer_<float> &gyro_samples,
+                                              TriadBuffer_<float> &aligned_gyro_samples, float max_offset );
@@ -180,26 +180,13 @@ void OpenGL3DScene::paintGL()
     glCallList ( axis_list_ );
 
 
-  std::vector< GLuint > lists;
-  
   std::map <std::string, PathItem>::iterator path_iter;
   for ( path_iter = path_items_.begin(); path_iter != path_items_.end(); path_iter++ )
-  {
-    lists.insert(lists.end(), path_iter->second.lists.begin(), path_iter->second.lists.end());
-  }
+    drawVertices ( path_iter->second.vertices, GL_LINE_STRIP, path_iter->second.color );
 
   std::map <std::string, CloudItem>::iterator cloud_iter;
   for ( cloud_iter = cloud_items_.begin(); cloud_iter != cloud_items_.end(); cloud_iter++ )
-  {
-    lists.insert(lists.end(), cloud_iter->second.lists.begin(), cloud_iter->second.lists.end());
-  }
-
-  
-  if( lists.size() )
-  {
-    // Execute the list of display lists
-    glCallLists ( lists.size(), GL_UNSIGNED_INT, ( const GLvoid * ) lists.data() );
-  }
+    drawVertices ( cloud_iter->second.vertices, GL_POINTS, cloud_iter->second.color );
   
   
   std::map <std::string, AxesItem>::iterator axes_iter;
@@ -228,6 +215,62 @@ void OpenGL3DScene::updateNow()
   sceneUpdated();
 }
 
+void OpenGL3DScene::appendVertices( VertexBuffer &vb, const std::vector< Eigen::Vector3d > &pts )
+{
+  if( pts.empty() )
+    return;
+  
+  int start = vb.size(), n_vertices = start + int(pts.size()), capacity = vb.capacity;
+  if( n_vertices > capacity )
+  {
+    // Double the capacity: the client-side and the GPU buffers grow together
+    capacity = qMax( qMax( 2*capacity, n_vertices ), 1024 );
+    vb.vertices.reserve( 3*capacity );
+  }
+  for( int i = 0; i < int(pts.size()); i++ )
+  {
+    vb.vertices.push_back( GLfloat(pts[i](0)) );
+    vb.vertices.push_back( GLfloat(pts[i](1)) );
+    vb.vertices.push_back( GLfloat(pts[i](2)) );
+  }
+  
+  if( !vb.buffer.isCreated() )
+  {
+    vb.buffer.setUsagePattern( QGLBuffer::DynamicDraw );
+    if( !vb.buffer.create() )
+      return;
+  }
+  
+  vb.buffer.bind();
+  if( capacity > vb.capacity )
+  {
+    // Reallocate the GPU buffer, uploading all the vertices
+    vb.capacity = capacity;
+    vb.buffer.allocate( 3*vb.capacity*int(sizeof(GLfloat)) );
+    vb.buffer.write( 0, vb.vertices.data(), 3*n_vertices*int(sizeof(GLfloat)) );
+  }
+  else
+  {
+    vb.buffer.write( 3*start*int(sizeof(GLfloat)), vb.vertices.data() + 3*start, 
+                     3*int(pts.size())*int(sizeof(GLfloat)) );
+  }
+  vb.buffer.release();
+}
+
+void OpenGL3DScene::drawVertices( VertexBuffer &vb, GLenum mode, const QColor &color )
+{
+  if( !vb.size() || !vb.buffer.isCreated() )
+    return;
+  
+  qglColor ( color );
+  vb.buffer.bind();
+  glEnableClientState( GL_VERTEX_ARRAY );
+  glVertexPointer( 3, GL_FLOAT, 0, 0 );
+  glDrawArrays( mode, 0, vb.size() );
+  glDisableClientState( GL_VERTEX_ARRAY );
+  vb.buffer.release();
+}
+
 void OpenGL3DScene::updateStructure( std::string name, bool update_gl )
 {
   makeCurrent();
@@ -238,47 +281,24 @@ void OpenGL3DScene::updateStructure( std::string name, bool update_gl )
     PathItem &p_item = path_iter->second;
     if( p_item.removed ) 
     {
-      for( int i = 0; i < path_iter->second.lists.size(); i++)
-        glDeleteLists ( path_iter->second.lists[i], 1 );
       path_items_.erase(path_iter);
-      
     }
-    else
+    else if( p_item.unprocessed_poses.size() )
     {
-      // Create a display list
-      GLuint new_list = glGenLists ( 1 );
-      p_item.lists.push_back(new_list);
-      glNewList ( new_list, GL_COMPILE );
-      qglColor ( p_item.color );
-
-      for( int i = 0; i < int(p_item.unprocessed_poses.size()) - 1; i++ )      
+      for( int i = 0; i < int(p_item.unprocessed_poses.size()); i++ )      
       {
-        Eigen::Vector3d &p0 = p_item.unprocessed_poses[i], &p1 = p_item.unprocessed_poses[i+1];
+        Eigen::Vector3d &p = p_item.unprocessed_poses[i];
         
         // Update 2D boundaries (X,Y) of the current drawn scene
-        if ( p0(0) > max_x_ ) max_x_ = p0(0);
-        if ( p0(0) < min_x_ ) min_x_ = p0(0);
-        if ( p0(1) > max_y_ ) max_y_ = p0(1);
-        if ( p0(1) < min_y_ ) min_y_ = p0(1);
-
-        if ( p1(0) > max_x_ ) max_x_ = p1(0);
-        if ( p1(0) < min_x_ ) min_x_ = p1(0);
-        if ( p1(1) > max_y_ ) max_y_ = p1(1);
-        if ( p1(1) < min_y_ ) min_y_ = p1(1);
-      
-        glBegin ( GL_LINES );
-
-        glVertex3d ( p0(0), p0(1), p0(2) );
-        glVertex3d ( p1(0), p1(1), p1(2) );
-
-        glEnd();
+        if ( p(0) > max_x_ ) max_x_ = p(0);
+        if ( p(0) < min_x_ ) min_x_ = p(0);
+        if ( p(1) > max_y_ ) max_y_ = p(1);
+        if ( p(1) < min_y_ ) min_y_ = p(1);
       }
-
-      glEndList();
-
-      Eigen::Vector3d last_pos = p_item.unprocessed_poses.back();
+      
+      // The path is drawn as a single line strip: only the new poses are uploaded
+      appendVertices( p_item.vertices, p_item.unprocessed_poses );
       p_item.unprocessed_poses.clear();
-      p_item.unprocessed_poses.push_back(last_pos);
     }
   }
   
@@ -295,6 +315,7 @@ void OpenGL3DScene::updateStructure( std::string name, bool update_gl )
     }  
     else if( l_item.updated )
     {
+      l_item.updated = false;
       if ( l_item.list != GL_INVALID_VALUE )
         glDeleteLists ( l_item.list, 1 );
       
@@ -323,27 +344,11 @@ void OpenGL3DScene::updateStructure( std::string name, bool update_gl )
 
     if( c_item.removed )
     {
-      for( int i = 0; i < cloud_iter->second.lists.size(); i++)
-        glDeleteLists ( cloud_iter->second.lists[i], 1 );
       cloud_items_.erase(cloud_iter);
     }
-    else
+    else if( c_item.unprcessed_cloud.size() )
     {
-      // Create a display list
-      GLuint new_list = glGenLists ( 1 );
-      c_item.lists.push_back(new_list);
-      glNewList ( new_list, GL_COMPILE );
-      qglColor ( c_item.color );
-
-      glBegin ( GL_POINTS );
-      for( int i = 0; i < int(c_item.unprcessed_cloud.size()); i++ )      
-      {
-        Eigen::Vector3d &p = c_item.unprcessed_cloud[i];
-        glVertex3d ( GLfloat(p(0)), GLfloat(p(1)), GLfloat(p(2)) );
-      }
-      glEnd();
-      glEndList();
-
+      appendVertices( c_item.vertices, c_item.unprcessed_cloud );
       c_item.unprcessed_cloud.clear();
     }
   }
@@ -363,6 +368,7 @@ void OpenGL3DScene::updateStructure( std::string name, bool update_gl )
     }  
     else if( a_item.updated )
     {
+      a_item.updated = false;
       if ( a_item.list != GL_INVALID_VALUE )
         glDeleteLists ( a_item.list, 1 );
       
@@ -659,13 +665,8 @@ void OpenGL3DScene::unregisterAllStructures()
 {
   // WARNING MAYBE BUG
   QMutexLocker locker ( &mutex_ );
-  
-  std::map <std::string, PathItem>::iterator path_iter;
-  for ( path_iter = path_items_.begin(); path_iter != path_items_.end(); path_iter++ )
-  {
-    for( int i = 0; i < path_iter->second.lists.size(); i++)
-      glDeleteLists ( path_iter->second.lists[i], 1 );
-  }
+  // The vertex buffers are released with the items
+  makeCurrent();
   
   path_items_.clear();
 
@@ -678,13 +679,6 @@ void OpenGL3DScene::unregisterAllStructures()
   
   line_items_.clear();
   
-  std::map <std::string, CloudItem>::iterator cloud_iter;
-  for ( cloud_iter = cloud_items_.begin(); cloud_iter != cloud_items_.end(); cloud_iter++ )
-  {
-    for( int i = 0; i < cloud_iter->second.lists.size(); i++)
-      glDeleteLists ( cloud_iter->second.lists[i], 1 );
-  }
-  
   cloud_items_.clear();
   
   std::map <std::string, AxesItem>::iterator axes_iter;
@@ -33,7 +33,12 @@
 #include "imu_tk/vis_extra/opengl_3d_scene.h"
 
 #include <cstdio>
+#include <algorithm>
 #include <sstream>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <memory>
 
 #include <QApplication>
 #include <QKeyEvent>
@@ -49,12 +54,14 @@ using namespace imu_tk;
 
 static int tmp_argc = 1;
 static char *tmp_argv[] = { (char *)"" };
+/* Refresh period of the asynchronous Vis3D render thread (60 Hz) */
+static const std::chrono::microseconds refresh_period( 16667 );
 
 class Plot::PlotImpl
 {
 public:
   
-  PlotImpl()
+  PlotImpl() : buffer_size_(0)
   { 
     gnuplot_pipe_ = popen("gnuplot", "w");
     if( gnuplot_pipe_ == NULL )
@@ -71,25 +78,112 @@ public:
   void write( const std::string &str )
   {
     if( gnuplot_pipe_ != NULL )
-    {
       fprintf( gnuplot_pipe_, "%s\n", str.c_str() );
+  };  
+  
+  /* Write the buffered binary data and flush the pipe */
+  void flush()
+  {
+    if( gnuplot_pipe_ != NULL )
+    {
+      if( buffer_size_ )
+        fwrite( buffer_, sizeof(float), buffer_size_, gnuplot_pipe_ );
       fflush( gnuplot_pipe_ );
     }
-  };  
+    buffer_size_ = 0;
+  };
+  
+  /* Number of groups of samples of the min/max envelope of a sequence of n_pts samples, 
+   * 0 if the sequence is not decimated */
+  static int numGroups( int n_pts, int max_points )
+  {
+    return ( max_points >= 2 && n_pts > max_points )?max_points/2:0;
+  };
+  
+  /* Number of points written by writeSeries() */
+  static int numSeriesPoints( int n_pts, int max_points )
+  {
+    int n_groups = numGroups( n_pts, max_points );
+    return n_groups?2*n_groups:n_pts;
+  };
+  
+  /* Inline binary data specification of a series of n_pts (time, value) pairs */
+  static std::string binarySeries( int n_pts, const char *title )
+  {
+    std::stringstream strs;
+    strs<<"'-' binary record="<<n_pts<<" format='%float32%float32' using 1:2 title '"
+        <<title<<"' with lines";
+    return strs.str();
+  };
+  
+  /* Write the samples [range.start_idx, range.end_idx] of a values array as binary 
+   * (time, value) pairs, or their min/max envelope, i.e. the minimum and the maximum 
+   * sample (in time order) of each of numGroups() groups of consecutive samples */
+  template <typename _T> 
+    void writeSeries( const _T *ts, const _T *v, const DataInterval &range, 
+                      int max_points, _T base_time )
+  {
+    const int n_pts = range.end_idx - range.start_idx + 1, 
+              n_groups = numGroups( n_pts, max_points );
+    
+    if( !n_groups )
+    {
+      for( int i = range.start_idx; i <= range.end_idx; i++ )
+        add( ts[i] - base_time, v[i] );
+      return;
+    }
+    
+    for( int g = 0; g < n_groups; g++ )
+    {
+      int start = range.start_idx + int( ( int64_t(g)*n_pts )/n_groups ), 
+          end = range.start_idx + int( ( int64_t(g + 1)*n_pts )/n_groups );
+      int min_i = start, max_i = start;
+      for( int i = start + 1; i < end; i++ )
+      {
+        if( v[i] < v[min_i] ) min_i = i;
+        else if( v[i] > v[max_i] ) max_i = i;
+      }
+      int i0 = std::min( min_i, max_i ), i1 = std::max( min_i, max_i );
+      add( ts[i0] - base_time, v[i0] );
+      add( ts[i1] - base_time, v[i1] );
+    }
+  };
+  
+  /* Write a binary (time, value) pair, buffered */
+  template <typename _T> void add( _T t, _T v )
+  {
+    buffer_[buffer_size_++] = float(t);
+    buffer_[buffer_size_++] = float(v);
+    if( buffer_size_ == BUFFER_SIZE )
+    {
+      if( gnuplot_pipe_ != NULL )
+        fwrite( buffer_, sizeof(float), buffer_size_, gnuplot_pipe_ );
+      buffer_size_ = 0;
+    }
+  };
   
 private:
   
+  enum { BUFFER_SIZE = 8192 };
   FILE *gnuplot_pipe_;
+  float buffer_[BUFFER_SIZE];
+  int buffer_size_;
 };
 
-Plot::Plot()
+Plot::Plot() : max_points_(4096)
 {
   plot_impl_ptr_ = boost::shared_ptr< PlotImpl > ( new PlotImpl() );
 }
 
 template <typename _T> 
   void Plot::plotSamples ( const std::vector< TriadData_<_T> >& samples, 
-                                   DataInterval range )
+                           DataInterval range )
+{
+  plotSamples( TriadBuffer_<_T>( samples ), range );
+}
+
+template <typename _T> 
+  void Plot::plotSamples ( const TriadBuffer_<_T>& samples, DataInterval range )
 {
   if( !plot_impl_ptr_->ready() )
   {
@@ -98,29 +192,32 @@ template <typename _T>
   }
   
   range = checkInterval( samples, range );
+  int n_series_pts = PlotImpl::numSeriesPoints( range.end_idx - range.start_idx + 1, max_points_ );
   
   std::stringstream strs;
-  strs<<"plot '-' title 'x' with lines, "
-      <<"'-' title 'y' with lines, "
-      <<"'-' title 'z' with lines"<<std::endl;
-   
-  _T base_time = samples[0].timestamp();
-  for( int i = range.start_idx; i <= range.end_idx; i++)
-    strs<<double(samples[i].timestamp() - base_time)<<" "<<double(samples[i].x())<<std::endl;
-  strs<<"EOF"<<std::endl;
-  for( int i = range.start_idx; i <= range.end_idx; i++)
-    strs<<double(samples[i].timestamp() - base_time)<<" "<<double(samples[i].y())<<std::endl;
-  strs<<"EOF"<<std::endl;
-  for( int i = range.start_idx; i <= range.end_idx; i++)
-    strs<<double(samples[i].timestamp() - base_time)<<" "<<double(samples[i].z())<<std::endl;
-  strs<<"EOF"<<std::endl;
+  strs<<"plot "<<PlotImpl::binarySeries( n_series_pts, "x" )<<", "
+      <<PlotImpl::binarySeries( n_series_pts, "y" )<<", "
+      <<PlotImpl::binarySeries( n_series_pts, "z" );
   plot_impl_ptr_->write( strs.str() );
+   
+  _T base_time = samples.timestamp(0);
+  for( int j = 0; j < 3; j++ )
+    plot_impl_ptr_->writeSeries( samples.timestamps(), samples.axis(j), range, max_points_, base_time );
+  plot_impl_ptr_->flush();
 }
 
 template <typename _T> 
   void Plot::plotIntervals ( const std::vector< TriadData_< _T > >& samples,
-                                     const std::vector< DataInterval >& intervals, 
-                                     DataInterval range )
+                             const std::vector< DataInterval >& intervals, 
+                             DataInterval range )
+{
+  plotIntervals( TriadBuffer_<_T>( samples ), intervals, range );
+}
+
+template <typename _T> 
+  void Plot::plotIntervals ( const TriadBuffer_<_T>& samples,
+                             const std::vector< DataInterval >& intervals, 
+                             DataInterval range )
 {
   if( !plot_impl_ptr_->ready() )
   {
@@ -135,57 +232,50 @@ template <typename _T>
   double max = 0, mean = 0;
   for( int i = range.start_idx; i <= range.end_idx; i++)
   {
-    if( double(samples[i].x()) > max ) max = double(samples[i].x());
-    if( double(samples[i].y()) > max ) max = double(samples[i].y());
-    if( double(samples[i].z()) > max ) max = double(samples[i].z());
+    if( double(samples.x(i)) > max ) max = double(samples.x(i));
+    if( double(samples.y(i)) > max ) max = double(samples.y(i));
+    if( double(samples.z(i)) > max ) max = double(samples.z(i));
     
-    mean += (double(samples[i].x()) + double(samples[i].y()) + double(samples[i].z()))/3;
+    mean += (double(samples.x(i)) + double(samples.y(i)) + double(samples.z(i)))/3;
   }
   
   mean /= n_pts;
   max -= mean;
-  double step_h = mean + max/2, val = 0;
-  int interval_idx = 0;
-  for( ; interval_idx < n_intervals; interval_idx++ )
-  {
-    if (intervals[interval_idx].start_idx >= range.start_idx )
-      break;
-  }
+  double step_h = mean + max/2;
   
-  std::stringstream strs;
-  strs<<"plot '-' title 'x' with lines, "
-      <<"'-' title 'y' with lines, "
-      <<"'-' title 'z' with lines, "
-      <<"'-' title 'intervals' with lines"<<std::endl;
-   
-  _T base_time = samples[0].timestamp();
-  for( int i = range.start_idx; i <= range.end_idx; i++)
-    strs<<double(samples[i].timestamp() - base_time)<<" "<<double(samples[i].x())<<std::endl;
-  strs<<"EOF"<<std::endl;
-  for( int i = range.start_idx; i <= range.end_idx; i++)
-    strs<<double(samples[i].timestamp() - base_time)<<" "<<double(samples[i].y())<<std::endl;
-  strs<<"EOF"<<std::endl;
-  for( int i = range.start_idx; i <= range.end_idx; i++)
-    strs<<double(samples[i].timestamp() - base_time)<<" "<<double(samples[i].z())<<std::endl;
-  strs<<"EOF"<<std::endl;
-  
-  for( int i = range.start_idx; i <= range.end_idx; i++)
+  // Square wave with height step_h inside the intervals: only its corners are plotted
+  _T base_time = samples.timestamp(0);
+  std::vector< double > interval_pts;
+  interval_pts.push_back( samples.timestamp(range.start_idx) - base_time );
+  interval_pts.push_back( 0 );
+  for( int interval_idx = 0; interval_idx < n_intervals; interval_idx++ )
   {
-    if( interval_idx < n_intervals)
-    {
-      if( i == intervals[interval_idx].start_idx )
-        val = step_h;
-      else if( i == intervals[interval_idx].end_idx)
-      {
-        val = 0;
-        interval_idx++;
-      }
-    }
-    strs<<double(samples[i].timestamp() - base_time)<<" "<<val<<std::endl;
+    const DataInterval &interval = intervals[interval_idx];
+    if( interval.start_idx < range.start_idx || interval.start_idx > range.end_idx )
+      continue;
+    
+    int end_idx = std::min( std::max( interval.end_idx, interval.start_idx ), range.end_idx );
+    double t0 = samples.timestamp(interval.start_idx) - base_time, 
+           t1 = samples.timestamp(end_idx) - base_time;
+    const double corners[8] = { t0, 0, t0, step_h, t1, step_h, t1, 0 };
+    interval_pts.insert( interval_pts.end(), corners, corners + 8 );
   }
-  strs<<"EOF"<<std::endl;
+  interval_pts.push_back( samples.timestamp(range.end_idx) - base_time );
+  interval_pts.push_back( 0 );
   
+  int n_series_pts = PlotImpl::numSeriesPoints( n_pts, max_points_ );
+  std::stringstream strs;
+  strs<<"plot "<<PlotImpl::binarySeries( n_series_pts, "x" )<<", "
+      <<PlotImpl::binarySeries( n_series_pts, "y" )<<", "
+      <<PlotImpl::binarySeries( n_series_pts, "z" )<<", "
+      <<PlotImpl::binarySeries( interval_pts.size()/2, "intervals" );
   plot_impl_ptr_->write( strs.str() );
+  
+  for( int j = 0; j < 3; j++ )
+    plot_impl_ptr_->writeSeries( samples.timestamps(), samples.axis(j), range, max_points_, base_time );
+  for( int i = 0; i < int(interval_pts.size()); i += 2 )
+    plot_impl_ptr_->add( interval_pts[i], interval_pts[i + 1] );
+  plot_impl_ptr_->flush();
 }
 
 void imu_tk::waitForKey()
@@ -233,22 +323,287 @@ protected:
 };
 
 
-Vis3D::Vis3D ( const std::string win_name )
+namespace
+{
+/* Bounded lock-free multi-producer multi-consumer queue (D. Vyukov's algorithm): 
+ * the sequence number of each cell tells producers and consumers whether the cell
+ * is free or filled, so that no locks are required */
+template < typename _T > class BoundedQueue : boost::noncopyable
+{
+public:
+  explicit BoundedQueue( int capacity_log2 ) :
+    mask_( ( size_t(1) << capacity_log2 ) - 1 ),
+    cells_( new Cell[mask_ + 1] ),
+    head_(0), tail_(0)
+  {
+    for( size_t i = 0; i <= mask_; i++ )
+      cells_[i].seq.store( i, std::memory_order_relaxed );
+  };
+  
+  size_t capacity() const { return mask_ + 1; };
+  
+  /* Returns false if the queue is full */
+  bool push( const _T &val )
+  {
+    Cell *cell;
+    size_t pos = tail_.load( std::memory_order_relaxed );
+    while( true )
+    {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->seq.load( std::memory_order_acquire );
+      intptr_t diff = intptr_t(seq) - intptr_t(pos);
+      if( diff == 0 )
+      {
+        if( tail_.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+          break;
+      }
+      else if( diff < 0 )
+        return false;
+      else
+        pos = tail_.load( std::memory_order_relaxed );
+    }
+    cell->data = val;
+    cell->seq.store( pos + 1, std::memory_order_release );
+    return true;
+  };
+  
+  /* Returns false if the queue is empty */
+  bool pop( _T &val )
+  {
+    Cell *cell;
+    size_t pos = head_.load( std::memory_order_relaxed );
+    while( true )
+    {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->seq.load( std::memory_order_acquire );
+      intptr_t diff = intptr_t(seq) - intptr_t(pos + 1);
+      if( diff == 0 )
+      {
+        if( head_.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+          break;
+      }
+      else if( diff < 0 )
+        return false;
+      else
+        pos = head_.load( std::memory_order_relaxed );
+    }
+    val = std::move( cell->data );
+    cell->seq.store( pos + mask_ + 1, std::memory_order_release );
+    return true;
+  };
+  
+private:
+  
+  struct Cell
+  {
+    std::atomic<size_t> seq;
+    _T data;
+  };
+  
+  const size_t mask_;
+  std::unique_ptr< Cell[] > cells_;
+  std::atomic<size_t> head_;
+  /* Keep the consumers and the producers indices in different cache lines */
+  char pad_[64];
+  std::atomic<size_t> tail_;
+};
+}
+
+class Vis3D::AsyncRenderer : boost::noncopyable
+{
+public:
+  
+  struct Command
+  {
+    enum Type
+    {
+      REGISTER_FRAME,
+      UNREGISTER_FRAME,
+      SET_FRAME_POS,
+      REGISTER_LINE,
+      UNREGISTER_LINE,
+      SET_LINE_POS,
+      WAIT_FOR_KEY
+    };
+    
+    Command( Type t = WAIT_FOR_KEY, const std::string &n = std::string() ) : 
+      type(t), name(n) {};
+    
+    Type type;
+    std::string name;
+    double v0[3], v1[3];
+    uint8_t rgb[3];
+  };
+  
+  AsyncRenderer( const QString &win_name ) :
+    queue_(QUEUE_SIZE_LOG2),
+    win_name_(win_name),
+    stop_(false),
+    key_pressed_(true)
+  {
+    thread_ = std::thread( &AsyncRenderer::run, this );
+  };
+  
+  ~AsyncRenderer()
+  {
+    stop_.store(true);
+    thread_.join();
+    running_.store(false);
+  };
+  
+  /* Only one render thread can own the QApplication of the process */
+  static bool acquire()
+  {
+    bool expected = false;
+    return running_.compare_exchange_strong( expected, true );
+  };
+  
+  /* The producer is blocked only if the queue is full, i.e. if more than the queue 
+   * capacity updates are pushed during a single refresh period */
+  void push( const Command &cmd )
+  {
+    while( !queue_.push( cmd ) )
+      std::this_thread::yield();
+  };
+  
+  void waitForKey()
+  {
+    key_pressed_.store(false);
+    push( Command( Command::WAIT_FOR_KEY ) );
+    while( !key_pressed_.load() )
+      std::this_thread::sleep_for( std::chrono::milliseconds(1) );
+  };
+  
+private:
+  
+  static const int QUEUE_SIZE_LOG2 = 13;
+  
+  void run()
+  {
+    bool own_app = ( QApplication::instance() == NULL );
+    if( own_app )
+      new QApplication( tmp_argc, tmp_argv );
+    
+    {
+      VisualizerImpl vis;
+      vis.setWindowTitle( win_name_ );
+      bool waiting = false;
+      Command cmd;
+      while( !stop_.load() )
+      {
+        std::chrono::steady_clock::time_point next_refresh = 
+          std::chrono::steady_clock::now() + refresh_period;
+        
+        /* Positions are just stored until the next updateNow(), so applying all the pending
+         * commands in order leaves only the latest state of each item to be rendered. 
+         * At most one queue worth of commands is applied per refresh, so that fast 
+         * producers can't starve the renderer */
+        for( size_t i = 0; i < queue_.capacity() && queue_.pop( cmd ); i++ )
+        {
+          if( cmd.type == Command::WAIT_FOR_KEY )
+          {
+            vis.waiting_for_key = true;
+            waiting = true;
+          }
+          else
+            apply( vis, cmd );
+        }
+        
+        vis.updateNow();
+        QApplication::instance()->processEvents();
+        
+        if( waiting && !vis.waiting_for_key )
+        {
+          waiting = false;
+          key_pressed_.store(true);
+        }
+        std::this_thread::sleep_until( next_refresh );
+      }
+    }
+    
+    /* Release also any caller still waiting for a key */
+    key_pressed_.store(true);
+    if( own_app )
+      delete QApplication::instance();
+  };
+  
+  static void apply( VisualizerImpl &vis, const Command &cmd )
+  {
+    switch( cmd.type )
+    {
+      case Command::REGISTER_FRAME :
+        vis.registerAxes( cmd.name, QColor( cmd.rgb[0], cmd.rgb[1], cmd.rgb[2] ) );
+        break;
+      case Command::UNREGISTER_FRAME :
+        vis.unregisterAxes( cmd.name );
+        break;
+      case Command::SET_FRAME_POS :
+        vis.setAxesPos( cmd.name, Eigen::Vector3d( cmd.v0[0], cmd.v0[1], cmd.v0[2] ), 
+                        Eigen::Vector3d( cmd.v1[0], cmd.v1[1], cmd.v1[2] ) );
+        break;
+      case Command::REGISTER_LINE :
+        vis.registerLine( cmd.name, QColor( cmd.rgb[0], cmd.rgb[1], cmd.rgb[2] ) );
+        break;
+      case Command::UNREGISTER_LINE :
+        vis.unregisterLine( cmd.name );
+        break;
+      case Command::SET_LINE_POS :
+        vis.setLine( cmd.name, Eigen::Vector3d( cmd.v0[0], cmd.v0[1], cmd.v0[2] ), 
+                     Eigen::Vector3d( cmd.v1[0], cmd.v1[1], cmd.v1[2] ) );
+        break;
+      default :
+        break;
+    }
+  };
+  
+  static std::atomic<bool> running_;
+  
+  BoundedQueue< Command > queue_;
+  QString win_name_;
+  std::atomic<bool> stop_, key_pressed_;
+  std::thread thread_;
+};
+
+std::atomic<bool> Vis3D::AsyncRenderer::running_(false);
+
+Vis3D::Vis3D ( const std::string win_name, bool async )
 {
-  vis_impl_ptr_ = boost::shared_ptr< VisualizerImpl > ( new VisualizerImpl() );
   QString w_name( win_name.c_str() );
   w_name += " - press h for help";
+  
+  if( async )
+  {
+    if( QApplication::instance() == NULL && AsyncRenderer::acquire() )
+    {
+      async_ptr_ = boost::shared_ptr< AsyncRenderer > ( new AsyncRenderer( w_name ) );
+      return;
+    }
+    IMU_TK_LOG_WARNING("Vis3D : a QApplication or another asynchronous Vis3D already exists, "
+                       "using the synchronous mode");
+  }
+  
+  vis_impl_ptr_ = boost::shared_ptr< VisualizerImpl > ( new VisualizerImpl() );
   vis_impl_ptr_->setWindowTitle(w_name);
 }
 
 void Vis3D::registerFrame( std::string name, uint8_t r, uint8_t g, uint8_t b )
 {
-  vis_impl_ptr_->registerAxes(name, QColor(r,g,b) );
+  if( async_ptr_ )
+  {
+    AsyncRenderer::Command cmd( AsyncRenderer::Command::REGISTER_FRAME, name );
+    cmd.rgb[0] = r; cmd.rgb[1] = g; cmd.rgb[2] = b;
+    async_ptr_->push( cmd );
+  }
+  else
+    vis_impl_ptr_->registerAxes(name, QColor(r,g,b) );
 }
 
 void Vis3D::unregisterFrame( std::string name )
 {
-  vis_impl_ptr_->unregisterAxes(name);
+  if( async_ptr_ )
+    async_ptr_->push( AsyncRenderer::Command( AsyncRenderer::Command::UNREGISTER_FRAME, name ) );
+  else
+    vis_impl_ptr_->unregisterAxes(name);
 }
     
 template <typename _T> 
@@ -259,18 +614,36 @@ template <typename _T>
   q_vec<<quat[0], quat[1], quat[2], quat[3];
   t_vec<<t[0], t[1], t[2];
   ceres::QuaternionToAngleAxis( q_vec.data(), r_vec.data() );
-  vis_impl_ptr_->setAxesPos(name, r_vec, t_vec );
+  if( async_ptr_ )
+  {
+    AsyncRenderer::Command cmd( AsyncRenderer::Command::SET_FRAME_POS, name );
+    Eigen::Map< Eigen::Vector3d >( cmd.v0 ) = r_vec;
+    Eigen::Map< Eigen::Vector3d >( cmd.v1 ) = t_vec;
+    async_ptr_->push( cmd );
+  }
+  else
+    vis_impl_ptr_->setAxesPos(name, r_vec, t_vec );
 }
 
 
 void Vis3D::registerLine( std::string name, uint8_t r, uint8_t g, uint8_t b )
 {
-  vis_impl_ptr_->registerLine(name, QColor(r,g,b));
+  if( async_ptr_ )
+  {
+    AsyncRenderer::Command cmd( AsyncRenderer::Command::REGISTER_LINE, name );
+    cmd.rgb[0] = r; cmd.rgb[1] = g; cmd.rgb[2] = b;
+    async_ptr_->push( cmd );
+  }
+  else
+    vis_impl_ptr_->registerLine(name, QColor(r,g,b));
 }
 
 void Vis3D::unregisterLine( std::string name )
 {
-  vis_impl_ptr_->unregisterLine(name);
+  if( async_ptr_ )
+    async_ptr_->push( AsyncRenderer::Command( AsyncRenderer::Command::UNREGISTER_LINE, name ) );
+  else
+    vis_impl_ptr_->unregisterLine(name);
 }
 
 template <typename _T> 
@@ -280,11 +653,26 @@ template <typename _T>
   p0_vec<<p0[0], p0[1], p0[2];
   p1_vec<<p1[0], p1[1], p1[2];
 
-  vis_impl_ptr_->setLine(name, p0_vec, p1_vec);
+  if( async_ptr_ )
+  {
+    AsyncRenderer::Command cmd( AsyncRenderer::Command::SET_LINE_POS, name );
+    Eigen::Map< Eigen::Vector3d >( cmd.v0 ) = p0_vec;
+    Eigen::Map< Eigen::Vector3d >( cmd.v1 ) = p1_vec;
+    async_ptr_->push( cmd );
+  }
+  else
+    vis_impl_ptr_->setLine(name, p0_vec, p1_vec);
 }
 
 void Vis3D::updateAndWait( int delay_ms )
 {
+  if( async_ptr_ )
+  {
+    if( delay_ms <= 0 )
+      async_ptr_->waitForKey();
+    return;
+  }
+  
   vis_impl_ptr_->waiting_for_key = true;
   QTime time;
   
@@ -312,12 +700,22 @@ template void Plot::plotSamples<double> ( const std::vector< TriadData_<double>
                                           DataInterval range );
 template void Plot::plotSamples<float> ( const std::vector< TriadData_<float> >& samples, 
                                          DataInterval range );
+template void Plot::plotSamples<double> ( const TriadBuffer_<double>& samples, 
+                                          DataInterval range );
+template void Plot::plotSamples<float> ( const TriadBuffer_<float>& samples, 
+                                         DataInterval range );
 template void Plot::plotIntervals<double> ( const std::vector< TriadData_<double> >& samples, 
                                             const std::vector< DataInterval >& intervals,
                                             DataInterval range );
 template void Plot::plotIntervals<float> ( const std::vector< TriadData_<float> >& samples, 
                                            const std::vector< DataInterval >& intervals,
                                            DataInterval range );
+template void Plot::plotIntervals<double> ( const TriadBuffer_<double>& samples, 
+                                            const std::vector< DataInterval >& intervals,
+                                            DataInterval range );
+template void Plot::plotIntervals<float> ( const TriadBuffer_<float>& samples,
+                                           const std::vector< DataInterval >& intervals,
+                                           DataInterval range );
 
 template void Vis3D::setFramePos<double>( std::string name, const double quat[4], const double t[3] );
 template void Vis3D::setFramePos<float>( std::string name, const float quat[4], const float t[3] );